@@ -670,7 +670,28 @@ public:
 	float fadeRate = 0.0f;
 };
 
+// Audio device that plays nothing. Used by dedicated servers.
+class NullAudioDevice : public AudioDevice
+{
+public:
+	void AddSound(USound* sound) override { }
+	void RemoveSound(USound* sound) override { }
+	bool IsPlaying(int channel) override { return false; }
+	int PlaySound(int channel, USound* sound, vec3& location, float volume, float radius, float pitch) override { return channel; }
+	void PlayMusic(std::unique_ptr<AudioSource> source) override { }
+	void UpdateSound(int channel, USound* sound, vec3& location, float volume, float radius, float pitch) override { }
+	void StopSound(int channel) override { }
+	void SetMusicVolume(float volume) override { }
+	void SetSoundVolume(float volume) override { }
+	void Update() override { }
+};
+
 std::unique_ptr<AudioDevice> AudioDevice::Create(int frequency, int numVoices, int musicBufferCount, int musicBufferSize)
 {
 	return std::make_unique<OpenALAudioDevice>(frequency, numVoices, musicBufferCount, musicBufferSize);
 }
+
+std::unique_ptr<AudioDevice> AudioDevice::CreateNull()
+{
+	return std::make_unique<NullAudioDevice>();
+}
@@ -15,6 +15,7 @@ class AudioDevice
 {
 public:
 	static std::unique_ptr<AudioDevice> Create(int frequency, int numVoices, int musicBufferCount, int musicBufferSize);
+	static std::unique_ptr<AudioDevice> CreateNull();
 
 	virtual ~AudioDevice() = default;
 	virtual void AddSound(USound* sound) = 0;
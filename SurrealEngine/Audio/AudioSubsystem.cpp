@@ -7,9 +7,16 @@
 #include "UObject/ULevel.h"
 #include "UObject/USound.h"
 #include "UObject/UMusic.h"
+#include "Utils/Profiler.h"
 
-AudioSubsystem::AudioSubsystem()
+AudioSubsystem::AudioSubsystem(bool nullDevice)
 {
+	if (nullDevice)
+	{
+		Device = AudioDevice::CreateNull();
+		return;
+	}
+
 	// TODO: Add configurable option for audio device
 	// TODO: Add configurable option for audio output frequency
 	// TODO: Add option for number of sound channels
@@ -48,6 +55,8 @@ UViewport* AudioSubsystem::GetViewport()
 
 void AudioSubsystem::Update(const mat4& listener)
 {
+	PROFILE_ZONE("AudioSubsystem::Update");
+
 	StartAmbience();
 	UpdateAmbience();
 	UpdateSounds(listener);
@@ -29,7 +29,7 @@ struct PlayingSound
 class AudioSubsystem
 {
 public:
-	AudioSubsystem();
+	AudioSubsystem(bool nullDevice = false);
 
 	void SetViewport(UViewport* Viewport);
 	UViewport* GetViewport();
@@ -0,0 +1,209 @@
+#include "Precomp.h"
+#include "BenchClipCommandlet.h"
+#include "DebuggerApp.h"
+#include "Engine.h"
+#include "Package/PackageManager.h"
+#include "Package/Package.h"
+#include "UObject/ULevel.h"
+#include "UObject/UActor.h"
+#include "UObject/UTexture.h"
+#include "Render/BspClipper.h"
+#include "Render/OcclusionBuffer.h"
+#include "Math/coords.h"
+#include <chrono>
+
+namespace
+{
+	// Front to back BSP traversal matching RenderSubsystem::ProcessNode, without the actors and zone masks.
+	// Records for each node if its surface was reported visible (1), hidden (0) or not reached (-1).
+	template<typename ClipperT>
+	class ClipTraversal
+	{
+	public:
+		ClipTraversal(ClipperT& clipper, UModel* model, UTexture* defaultTexture) : clipper(clipper), model(model), defaultTexture(defaultTexture) { }
+
+		void Run(const vec3& viewLocation, Array<int8_t>& nodeVisibility)
+		{
+			view = vec4(viewLocation, 1.0f);
+			visibility = &nodeVisibility;
+			visibility->assign(model->Nodes.size(), -1);
+			ProcessNode(0);
+		}
+
+	private:
+		void ProcessNode(int index)
+		{
+			BspNode* node = &model->Nodes[index];
+			if (node->RenderBound != -1 && !clipper.IsAABBVisible(model->Bounds[node->RenderBound]))
+				return;
+
+			vec4 plane = { node->PlaneX, node->PlaneY, node->PlaneZ, -node->PlaneW };
+			bool swapFrontAndBack = dot(view, plane) < 0.0f;
+			int back = node->Back;
+			int front = node->Front;
+			if (swapFrontAndBack)
+				std::swap(front, back);
+
+			if (front >= 0)
+				ProcessNode(front);
+
+			int polynode = index;
+			while (true)
+			{
+				ProcessNodeSurface(polynode);
+				if (model->Nodes[polynode].Plane < 0)
+					break;
+				polynode = model->Nodes[polynode].Plane;
+			}
+
+			if (back >= 0)
+				ProcessNode(back);
+		}
+
+		void ProcessNodeSurface(int index)
+		{
+			BspNode* node = &model->Nodes[index];
+			if (node->NumVertices <= 0 || node->Surf < 0)
+				return;
+
+			const BspSurface& surface = model->Surfaces[node->Surf];
+			vec3 points[256];
+			BspVert* v = &model->Vertices[node->VertPool];
+			for (int j = 0; j < node->NumVertices; j++)
+				points[j] = model->Points[v[j].Vertex];
+
+			UTexture* texture = surface.Material ? surface.Material : defaultTexture;
+			bool opaqueSurface = ((surface.PolyFlags & PF_NoOcclude) == 0) &&
+				(!texture || (!texture->bMasked() && !texture->bTransparent() && !texture->bModulate()));
+
+			(*visibility)[index] = clipper.CheckSurface(points, node->NumVertices, opaqueSurface) ? 1 : 0;
+		}
+
+		ClipperT& clipper;
+		UModel* model = nullptr;
+		UTexture* defaultTexture = nullptr;
+		vec4 view;
+		Array<int8_t>* visibility = nullptr;
+	};
+
+	struct CameraView
+	{
+		vec3 Location;
+		Rotator Rotation;
+	};
+
+	mat4 GetWorldToProjection(const CameraView& camera)
+	{
+		float aspect = 9.0f / 16.0f;
+		float rprojz = (float)std::tan(radians(90.0f) * 0.5f);
+		mat4 projection = mat4::frustum(-rprojz, rprojz, -aspect * rprojz, aspect * rprojz, 1.0f, 32768.0f, handedness::left, clipzrange::zero_positive_w);
+		mat4 worldToView = Coords::ViewToRenderDev().ToMatrix() * Coords::Rotation(camera.Rotation).Inverse().ToMatrix() * Coords::Location(camera.Location).ToMatrix();
+		return projection * worldToView;
+	}
+
+	template<typename ClipperT>
+	double RunPath(ClipperT& clipper, UModel* model, UTexture* defaultTexture, const Array<CameraView>& path, Array<Array<int8_t>>& results, int& surfaces)
+	{
+		ClipTraversal<ClipperT> traversal(clipper, model, defaultTexture);
+		results.resize(path.size());
+		surfaces = 0;
+
+		auto start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < path.size(); i++)
+		{
+			clipper.numSurfs = 0;
+			clipper.Setup(GetWorldToProjection(path[i]));
+			traversal.Run(path[i].Location, results[i]);
+			surfaces += clipper.numSurfs;
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+BenchClipCommandlet::BenchClipCommandlet()
+{
+	SetLongFormName("benchclip");
+	SetShortDescription("Compare the BSP occlusion clippers along the navigation points of a map");
+}
+
+void BenchClipCommandlet::OnCommand(DebuggerApp* console, const std::string& args)
+{
+	Array<std::string> params = SplitString(args);
+	if (params.size() != 1)
+	{
+		OnPrintHelp(console);
+		return;
+	}
+
+	Package* package = engine->packages->GetPackage(params[0]);
+	ULevel* level = UObject::Cast<ULevel>(package->GetUObject("Level", "MyLevel"));
+	if (!level)
+	{
+		console->WriteOutput(params[0] + " has no level object" + NewLine());
+		return;
+	}
+
+	level->LoadNow();
+	UModel* model = level->Model;
+	ULevelInfo* levelInfo = !level->Actors.empty() ? UObject::TryCast<ULevelInfo>(level->Actors[0]) : nullptr;
+	if (!model || model->Nodes.empty())
+	{
+		console->WriteOutput(params[0] + " has no BSP model" + NewLine());
+		return;
+	}
+
+	// The navigation network covers the places a player can go. Look in four directions from each point.
+	Array<CameraView> path;
+	for (UActor* actor : level->Actors)
+	{
+		if (UObject::TryCast<UNavigationPoint>(actor))
+		{
+			for (int yaw = 0; yaw < 65536; yaw += 16384)
+				path.push_back({ actor->Location(), Rotator(0, yaw, 0) });
+		}
+	}
+	if (path.empty())
+	{
+		console->WriteOutput(params[0] + " has no navigation points" + NewLine());
+		return;
+	}
+
+	UTexture* defaultTexture = levelInfo ? levelInfo->DefaultTexture() : nullptr;
+
+	BspClipper spanClipper;
+	OcclusionBuffer coverageClipper;
+	Array<Array<int8_t>> spanResults, coverageResults;
+	int spanSurfaces = 0, coverageSurfaces = 0;
+	double spanSeconds = RunPath(spanClipper, model, defaultTexture, path, spanResults, spanSurfaces);
+	double coverageSeconds = RunPath(coverageClipper, model, defaultTexture, path, coverageResults, coverageSurfaces);
+
+	// Surfaces the span clipper found visible should never be culled by the coverage mask
+	size_t spanVisible = 0, coverageVisible = 0, overculled = 0;
+	for (size_t i = 0; i < path.size(); i++)
+	{
+		for (size_t j = 0; j < model->Nodes.size(); j++)
+		{
+			bool spanSeen = spanResults[i][j] == 1;
+			bool coverageSeen = coverageResults[i][j] == 1;
+			if (spanSeen) spanVisible++;
+			if (coverageSeen) coverageVisible++;
+			if (spanSeen && !coverageSeen) overculled++;
+		}
+	}
+
+	auto report = [&](const std::string& name, int surfaces, double seconds, size_t visible)
+	{
+		console->WriteOutput(name + ": " + std::to_string(surfaces) + " surfaces checked, " + std::to_string(visible) + " visible in " + std::to_string((int)(seconds * 1000.0)) + " ms (" + std::to_string((int64_t)(surfaces / std::max(seconds, 0.000001))) + " surfaces/sec)" + NewLine());
+	};
+
+	console->WriteOutput(std::to_string(path.size()) + " camera views" + NewLine());
+	report("Span clipper", spanSurfaces, spanSeconds, spanVisible);
+	report("Coverage mask " + std::to_string(coverageClipper.GetWidth()) + "x" + std::to_string(coverageClipper.GetHeight()), coverageSurfaces, coverageSeconds, coverageVisible);
+	console->WriteOutput(std::to_string(overculled) + " surfaces visible to the span clipper were culled by the coverage mask" + NewLine() + NewLine());
+}
+
+void BenchClipCommandlet::OnPrintHelp(DebuggerApp* console)
+{
+	console->WriteOutput("Syntax: benchclip <map>" + NewLine());
+	console->WriteOutput("Traverses the BSP from every navigation point of the map with the span clipper and the coverage mask and prints the surfaces checked per second." + NewLine());
+}
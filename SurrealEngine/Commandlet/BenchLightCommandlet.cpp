@@ -0,0 +1,85 @@
+#include "Precomp.h"
+#include "BenchLightCommandlet.h"
+#include "DebuggerApp.h"
+#include "Engine.h"
+#include "Package/PackageManager.h"
+#include "Package/Package.h"
+#include "UObject/ULevel.h"
+#include "UObject/UActor.h"
+#include "Render/Lightmap/LightmapBuilder.h"
+#include "Math/coords.h"
+#include "Utils/CpuFeatures.h"
+#include <chrono>
+#include <set>
+
+BenchLightCommandlet::BenchLightCommandlet()
+{
+	SetLongFormName("benchlight");
+	SetShortDescription("Time baking every lightmap of a map");
+}
+
+void BenchLightCommandlet::OnCommand(DebuggerApp* console, const std::string& args)
+{
+	Array<std::string> params = SplitString(args);
+	if (params.size() != 1)
+	{
+		OnPrintHelp(console);
+		return;
+	}
+
+	Package* package = engine->packages->GetPackage(params[0]);
+	ULevel* level = UObject::Cast<ULevel>(package->GetUObject("Level", "MyLevel"));
+	if (!level)
+	{
+		console->WriteOutput(params[0] + " has no level object" + NewLine());
+		return;
+	}
+
+	level->LoadNow();
+	UModel* model = level->Model;
+	UZoneInfo* levelInfo = !level->Actors.empty() ? UObject::TryCast<UZoneInfo>(level->Actors[0]) : nullptr;
+	if (!model || !levelInfo)
+	{
+		console->WriteOutput(params[0] + " has no BSP model" + NewLine());
+		return;
+	}
+
+	LightmapBuilder builder;
+	SimdLevel maxLevel = GetMaxSimdLevel();
+	for (int i = (int)SimdLevel::Scalar; i <= (int)maxLevel; i++)
+	{
+		SetSimdLevel((SimdLevel)i);
+
+		std::set<int> baked;
+		uint64_t texels = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (const BspSurface& surface : model->Surfaces)
+		{
+			if (surface.LightMap < 0 || !baked.insert(surface.LightMap).second)
+				continue;
+
+			Coords mapCoords;
+			mapCoords.Origin = model->Points[surface.pBase];
+			mapCoords.XAxis = model->Vectors[surface.vTextureU];
+			mapCoords.YAxis = model->Vectors[surface.vTextureV];
+			mapCoords.ZAxis = model->Vectors[surface.vNormal];
+
+			LightmapLights lights = LightmapBuilder::GetLights(model, surface.LightMap, levelInfo);
+			builder.Setup(model, mapCoords, surface.LightMap, lights);
+			builder.AddStaticLights(model, surface.LightMap, lights);
+			texels += (uint64_t)builder.Width() * builder.Height();
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		console->WriteOutput(std::string(GetSimdLevelName((SimdLevel)i)) + ": " + std::to_string(baked.size()) + " lightmaps, " + std::to_string(texels) + " texels in " + std::to_string((int)(seconds * 1000.0)) + " ms (" + std::to_string((int64_t)(texels / std::max(seconds, 0.000001))) + " texels/sec)" + NewLine());
+	}
+	SetSimdLevel(maxLevel);
+
+	console->WriteOutput(NewLine());
+}
+
+void BenchLightCommandlet::OnPrintHelp(DebuggerApp* console)
+{
+	console->WriteOutput("Syntax: benchlight <map>" + NewLine());
+	console->WriteOutput("Bakes every lightmap of the map once for each supported SIMD level and prints the texels baked per second." + NewLine());
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "Commandlet/Commandlet.h"
+
+class BenchLightCommandlet : public Commandlet
+{
+public:
+	BenchLightCommandlet();
+
+	void OnCommand(DebuggerApp* console, const std::string& args) override;
+	void OnPrintHelp(DebuggerApp* console) override;
+};
@@ -0,0 +1,85 @@
+#include "Precomp.h"
+#include "BenchLoadCommandlet.h"
+#include "DebuggerApp.h"
+#include "Engine.h"
+#include "Package/PackageManager.h"
+#include "Package/Package.h"
+#include "UObject/ULevel.h"
+#include "UObject/UMesh.h"
+#include "UObject/UTexture.h"
+#include "UObject/UFont.h"
+#include <chrono>
+
+BenchLoadCommandlet::BenchLoadCommandlet()
+{
+	SetLongFormName("benchload");
+	SetShortDescription("Time loading the meshes, models and textures of all packages");
+}
+
+void BenchLoadCommandlet::OnCommand(DebuggerApp* console, const std::string& args)
+{
+	Array<NameString> names;
+	for (const std::string& name : SplitString(args))
+		names.push_back(name);
+	if (names.empty())
+		names = engine->packages->GetPackageNames();
+
+	LoadTiming timings[6];
+	timings[0].name = "Mesh";
+	timings[1].name = "Animation";
+	timings[2].name = "Model";
+	timings[3].name = "Texture";
+	timings[4].name = "Palette";
+	timings[5].name = "Font";
+
+	auto start = std::chrono::steady_clock::now();
+	int packageCount = 0;
+	for (const NameString& name : names)
+	{
+		try
+		{
+			Package* package = engine->packages->GetPackage(name);
+			bool inUse = package == engine->LevelPackage || (engine->EntryLevel && engine->EntryLevel->package == package);
+
+			LoadAll<UMesh>(package, timings[0]);
+			LoadAll<UAnimation>(package, timings[1]);
+			LoadAll<UModel>(package, timings[2]);
+			LoadAll<UTexture>(package, timings[3]);
+			LoadAll<UPalette>(package, timings[4]);
+			LoadAll<UFont>(package, timings[5]);
+			packageCount++;
+
+			if (!inUse)
+				engine->packages->UnloadPackage(name);
+		}
+		catch (const std::exception& e)
+		{
+			console->WriteOutput("Could not load " + name.ToString() + ": " + e.what() + NewLine());
+		}
+	}
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	for (const LoadTiming& timing : timings)
+	{
+		if (timing.count != 0)
+			console->WriteOutput(timing.name + ": " + std::to_string(timing.count) + " objects in " + std::to_string((int)timing.ms) + " ms" + NewLine());
+	}
+	console->WriteOutput(std::to_string(packageCount) + " packages in " + std::to_string((int)totalMs) + " ms" + NewLine() + NewLine());
+}
+
+template<typename T>
+void BenchLoadCommandlet::LoadAll(Package* package, LoadTiming& timing)
+{
+	Array<T*> objects = package->GetAllObjects<T>();
+	auto start = std::chrono::steady_clock::now();
+	for (T* obj : objects)
+		obj->LoadNow();
+	timing.ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	timing.count += (int)objects.size();
+}
+
+void BenchLoadCommandlet::OnPrintHelp(DebuggerApp* console)
+{
+	console->WriteOutput("Syntax: benchload (packages)" + NewLine());
+	console->WriteOutput("Loads every mesh, model and texture object and prints the time spent per object type. Loads all packages if none are specified." + NewLine());
+}
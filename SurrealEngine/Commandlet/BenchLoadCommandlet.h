@@ -0,0 +1,24 @@
+#pragma once
+
+#include "Commandlet/Commandlet.h"
+
+class Package;
+
+class BenchLoadCommandlet : public Commandlet
+{
+public:
+	BenchLoadCommandlet();
+
+	void OnCommand(DebuggerApp* console, const std::string& args) override;
+	void OnPrintHelp(DebuggerApp* console) override;
+
+private:
+	struct LoadTiming
+	{
+		std::string name;
+		int count = 0;
+		double ms = 0.0;
+	};
+
+	template<typename T> void LoadAll(Package* package, LoadTiming& timing);
+};
@@ -0,0 +1,110 @@
+#include "Precomp.h"
+#include "BenchUploadCommandlet.h"
+#include "DebuggerApp.h"
+#include "UObject/UTexture.h"
+#include "RenderDevice/Vulkan/TextureUploader.h"
+#include "Utils/CpuFeatures.h"
+#include <chrono>
+
+BenchUploadCommandlet::BenchUploadCommandlet()
+{
+	SetLongFormName("benchupload");
+	SetShortDescription("Time the texture format conversions done when uploading textures");
+}
+
+void BenchUploadCommandlet::OnCommand(DebuggerApp* console, const std::string& args)
+{
+	Array<std::string> params = SplitString(args);
+	if (params.size() > 1)
+	{
+		OnPrintHelp(console);
+		return;
+	}
+
+	int size = params.empty() ? 1024 : std::atoi(params[0].c_str());
+	if (size < 1 || size > 8192)
+	{
+		console->WriteOutput("Texture size must be between 1 and 8192" + NewLine());
+		return;
+	}
+
+	struct Converter
+	{
+		const char* Name;
+		TextureFormat Format;
+		int SrcBytesPerPixel;
+		bool Masked;
+	};
+
+	const Converter converters[] =
+	{
+		{ "P8", TextureFormat::P8, 1, false },
+		{ "P8 masked", TextureFormat::P8, 1, true },
+		{ "BGRA8_LM", TextureFormat::BGRA8_LM, 4, false },
+		{ "RGB10A2", TextureFormat::RGB10A2, 4, false },
+		{ "RGB10A2_UI", TextureFormat::RGB10A2_UI, 4, false },
+		{ "RGB10A2_LM", TextureFormat::RGB10A2_LM, 4, false }
+	};
+
+	// Synthetic source data. Every byte value shows up, so the converters are checked against the scalar version for all inputs.
+	uint32_t seed = 1;
+	auto random = [&]() { seed = seed * 1664525 + 1013904223; return (uint8_t)(seed >> 24); };
+
+	FColor palette[256];
+	for (FColor& color : palette)
+		color = FColor(random(), random(), random(), random());
+
+	UnrealMipmap mip;
+	mip.Width = size;
+	mip.Height = size;
+
+	// Convert a rect not starting at the origin and with an odd width, so the pitch and the scalar tail are covered too
+	int x = size > 2 ? 1 : 0;
+	int y = size > 2 ? 1 : 0;
+	int w = size - x;
+	int h = size - y;
+
+	SimdLevel maxLevel = GetMaxSimdLevel();
+	for (const Converter& converter : converters)
+	{
+		TextureUploader* uploader = TextureUploader::GetUploader(converter.Format);
+		mip.Data.resize((size_t)size * size * converter.SrcBytesPerPixel);
+		for (uint8_t& value : mip.Data)
+			value = random();
+
+		Array<uint8_t> expected(uploader->GetUploadSize(x, y, w, h));
+		Array<uint8_t> result(expected.size());
+
+		SetSimdLevel(SimdLevel::Scalar);
+		uploader->UploadRect(expected.data(), &mip, x, y, w, h, palette, converter.Masked);
+
+		for (int i = (int)SimdLevel::Scalar; i <= (int)maxLevel; i++)
+		{
+			SetSimdLevel((SimdLevel)i);
+
+			int iterations = 0;
+			auto start = std::chrono::steady_clock::now();
+			double seconds = 0.0;
+			do
+			{
+				uploader->UploadRect(result.data(), &mip, x, y, w, h, palette, converter.Masked);
+				iterations++;
+				seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			} while (seconds < 0.25);
+
+			bool matches = memcmp(expected.data(), result.data(), expected.size()) == 0;
+			double pixels = (double)w * h * iterations;
+			console->WriteOutput(std::string(converter.Name) + " " + GetSimdLevelName((SimdLevel)i) + ": " + std::to_string((int64_t)(pixels / seconds / 1'000'000.0)) + " Mpixels/sec" + (matches ? "" : " (OUTPUT DIFFERS FROM SCALAR)") + NewLine());
+		}
+	}
+	SetSimdLevel(maxLevel);
+
+	console->WriteOutput(NewLine());
+}
+
+void BenchUploadCommandlet::OnPrintHelp(DebuggerApp* console)
+{
+	console->WriteOutput("Syntax: benchupload [size]" + NewLine());
+	console->WriteOutput("Converts a synthetic size x size texture (default 1024) with each texture uploader for each supported SIMD level." + NewLine());
+	console->WriteOutput("Prints the pixels converted per second and checks that the output matches the scalar converter. No render device is needed." + NewLine());
+}
@@ -0,0 +1,76 @@
+
+#include "Precomp.h"
+#include "CookCommandlet.h"
+#include "DebuggerApp.h"
+#include "Engine.h"
+#include "Utils/File.h"
+#include "Package/PackageManager.h"
+#include "Package/Package.h"
+#include "Package/CookedMap.h"
+#include "Render/ZoneVisibility.h"
+#include "UObject/ULevel.h"
+
+CookCommandlet::CookCommandlet()
+{
+	SetLongFormName("cook");
+	SetShortDescription("Write cooked BSP snapshots and zone visibility for faster map loads");
+}
+
+void CookCommandlet::OnCommand(DebuggerApp* console, const std::string& args)
+{
+	Array<std::string> maps = SplitString(args);
+	if (maps.empty())
+	{
+		console->WriteOutput("Cooking all maps..." + NewLine());
+		for (const std::string& map : engine->packages->GetMaps())
+			maps.push_back(FilePath::remove_extension(map));
+	}
+
+	for (const std::string& map : maps)
+	{
+		try
+		{
+			CookMap(console, map);
+		}
+		catch (const std::exception& e)
+		{
+			console->WriteOutput("Could not cook " + map + ": " + e.what() + NewLine());
+		}
+	}
+
+	console->WriteOutput("Done." + NewLine() + NewLine());
+}
+
+void CookCommandlet::CookMap(DebuggerApp* console, const std::string& mapName)
+{
+	Package* package = engine->packages->GetPackage(mapName);
+	bool inUse = package == engine->LevelPackage || (engine->EntryLevel && engine->EntryLevel->package == package);
+
+	ULevel* level = UObject::Cast<ULevel>(package->GetUObject("Level", "MyLevel"));
+	if (!level)
+	{
+		console->WriteOutput(mapName + " has no level object" + NewLine());
+		return;
+	}
+
+	level->LoadNow();
+	if (level->Model)
+	{
+		CookedMap::Save(package, level->Model);
+		console->WriteOutput("Cooked " + CookedMap::GetFilename(package) + NewLine());
+
+		ZoneVisibility pvs;
+		pvs.Build(level->Model);
+		pvs.Save(package, level->Model);
+		console->WriteOutput("Cooked " + ZoneVisibility::GetFilename(package) + NewLine());
+	}
+
+	if (!inUse)
+		engine->packages->UnloadPackage(package->GetPackageName());
+}
+
+void CookCommandlet::OnPrintHelp(DebuggerApp* console)
+{
+	console->WriteOutput("Syntax: cook (maps)" + NewLine());
+	console->WriteOutput("Cooks all maps if none are specified. Cooked snapshots are ignored once the map file changes." + NewLine());
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Commandlet/Commandlet.h"
+
+class CookCommandlet : public Commandlet
+{
+public:
+	CookCommandlet();
+
+	void OnCommand(DebuggerApp* console, const std::string& args) override;
+	void OnPrintHelp(DebuggerApp* console) override;
+
+private:
+	void CookMap(DebuggerApp* console, const std::string& mapName);
+};
@@ -6,6 +6,11 @@
 #include "Engine.h"
 #include "Commandlet/Native/NativeCommandlet.h"
 #include "Commandlet/ExportCommandlet.h"
+#include "Commandlet/CookCommandlet.h"
+#include "Commandlet/BenchLoadCommandlet.h"
+#include "Commandlet/BenchLightCommandlet.h"
+#include "Commandlet/BenchClipCommandlet.h"
+#include "Commandlet/BenchUploadCommandlet.h"
 #include "Commandlet/QuitCommandlet.h"
 #include "Commandlet/RunCommandlet.h"
 #include "Commandlet/Debug/CollisionCommandlet.h"
@@ -73,6 +78,11 @@ void DebuggerApp::CreateCommandlets()
 	Commandlets.push_back(std::make_unique<RunCommandlet>());
 	Commandlets.push_back(std::make_unique<NativeCommandlet>());
 	Commandlets.push_back(std::make_unique<ExportCommandlet>());
+	Commandlets.push_back(std::make_unique<CookCommandlet>());
+	Commandlets.push_back(std::make_unique<BenchLoadCommandlet>());
+	Commandlets.push_back(std::make_unique<BenchLightCommandlet>());
+	Commandlets.push_back(std::make_unique<BenchClipCommandlet>());
+	Commandlets.push_back(std::make_unique<BenchUploadCommandlet>());
 	Commandlets.push_back(std::make_unique<ListBreakpointsCommandlet>());
 	Commandlets.push_back(std::make_unique<BreakpointCommandlet>());
 	Commandlets.push_back(std::make_unique<WatchpointCommandlet>());
@@ -666,6 +666,7 @@ MemoryStreamWriter Exporter::ExportBmpIndexed(UTexture* tex)
 
 	hdr.pixelOffset = (uint32_t)data.Tell();
 
+	tex->LoadMipData();
 	uint8_t *pixels = tex->Mipmaps[0].Data.data();
 	for (int y = vsize; y > 0; y--)
 	{
@@ -709,6 +710,7 @@ MemoryStreamWriter Exporter::GetImageP8(UTexture* tex)
 {
 	MemoryStreamWriter data;
 	UPalette* palette = tex->Palette();
+	tex->LoadMipData();
 	uint8_t* pixels = tex->Mipmaps[0].Data.data();
 
 	int usize = tex->USize();
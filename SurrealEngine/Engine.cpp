@@ -21,10 +21,15 @@
 #include "Math/FrustumPlanes.h"
 #include "GameWindow.h"
 #include "RenderDevice/RenderDevice.h"
+#include "RenderDevice/Capture/CaptureRenderDevice.h"
+#include "RenderDevice/Capture/RenderTraceReplayer.h"
 #include "Audio/AudioSubsystem.h"
+#include "TimeDemo.h"
+#include "Utils/Profiler.h"
 #include "VM/Frame.h"
 #include "VM/ScriptCall.h"
 #include <chrono>
+#include <thread>
 #include <set>
 
 Engine* engine = nullptr;
@@ -55,37 +60,75 @@ void Engine::Run()
 	canvas = UObject::Cast<UCanvas>(packages->NewObject("canvas", "Engine", "Canvas"));
 	DefaultTexture = UObject::Cast<UTexture>(packages->GetPackage("Engine")->GetUObject("Texture", "DefaultTexture"));
 
-	std::string consolestr = packages->GetIniValue("system", "Engine.Engine", "Console");
-	std::string consolepkg = consolestr.substr(0, consolestr.find('.'));
-	std::string consolecls = consolestr.substr(consolestr.find('.') + 1);
-	console = UObject::Cast<UConsole>(packages->NewObject("console", consolepkg, consolecls));
-
-	console->Viewport() = viewport;
 	canvas->Viewport() = viewport;
-	viewport->Console() = console;
+
+	if (!LaunchInfo.dedicatedServer)
+	{
+		std::string consolestr = packages->GetIniValue("system", "Engine.Engine", "Console");
+		std::string consolepkg = consolestr.substr(0, consolestr.find('.'));
+		std::string consolecls = consolestr.substr(consolestr.find('.') + 1);
+		console = UObject::Cast<UConsole>(packages->NewObject("console", consolepkg, consolecls));
+
+		console->Viewport() = viewport;
+		viewport->Console() = console;
+	}
 
 	LoadEngineSettings();
 	LoadKeybindings();
 
-	OpenWindow();
+	if (LaunchInfo.dedicatedServer)
+	{
+		nullRenderDevice = RenderDevice::CreateNull();
+		audio = std::make_unique<AudioSubsystem>(true);
+		render = std::make_unique<RenderSubsystem>(nullRenderDevice.get());
+	}
+	else if (LaunchInfo.benchRender)
+	{
+		captureRenderDevice = std::make_unique<CaptureRenderDevice>();
+		audio = std::make_unique<AudioSubsystem>(true);
+		render = std::make_unique<RenderSubsystem>(captureRenderDevice.get());
+	}
+	else
+	{
+		OpenWindow();
+
+		audio = std::make_unique<AudioSubsystem>();
+		render = std::make_unique<RenderSubsystem>(window->GetRenderDevice());
 
-	audio = std::make_unique<AudioSubsystem>();
-	render = std::make_unique<RenderSubsystem>(window->GetRenderDevice());
+		if (!client->StartupFullscreen)
+			viewport->bWindowsMouseAvailable() = true;
 
-	if (!client->StartupFullscreen)
-		viewport->bWindowsMouseAvailable() = true;
+		// The demo seeds std::rand before any map is loaded so that the playback runs the same game logic as the recording
+		if (!LaunchInfo.playDemo.empty())
+			timedemo = TimeDemo::Play(LaunchInfo.playDemo, LaunchInfo.demoStats);
+		else if (!LaunchInfo.recordDemo.empty())
+			timedemo = TimeDemo::Record(LaunchInfo.recordDemo, (uint32_t)std::rand());
+	}
 
 	if (!LaunchInfo.noEntryMap)
 		LoadEntryMap();
 
-	if (LaunchInfo.url.empty())
+	std::string url = LaunchInfo.url;
+	if (url.empty() && timedemo && timedemo->IsPlaying())
+		url = timedemo->GetURL();
+
+	if (url.empty())
 		LoadMap(GetDefaultURL(packages->GetIniValue("system", "URL", "LocalMap")));
 	else
-		LoadMap(UnrealURL(GetDefaultURL(packages->GetIniValue("system", "URL", "LocalMap")), LaunchInfo.url));
+		LoadMap(UnrealURL(GetDefaultURL(packages->GetIniValue("system", "URL", "LocalMap")), url));
 
 	LoginPlayer();
 
-	window->LockCursor();
+	if (timedemo && !timedemo->IsPlaying())
+		timedemo->SetURL(LevelInfo->URL.ToString());
+
+	if (LaunchInfo.benchRender)
+	{
+		RunRenderBenchmark();
+		return;
+	}
+
+	LockCursor();
 
 	UObjectProperty objprop({}, nullptr, ObjectFlags::NoFlags);
 	UStructProperty vecprop({}, nullptr, ObjectFlags::NoFlags);
@@ -94,7 +137,13 @@ void Engine::Run()
 	bool firstCall = true;
 	while (!quit)
 	{
-		float realTimeElapsed = CalcTimeElapsed();
+		float realTimeElapsed = LaunchInfo.dedicatedServer ? WaitForServerTick() : CalcTimeElapsed();
+		if (timedemo && !timedemo->BeginFrame(realTimeElapsed))
+			break;
+
+		Profiler::BeginFrame();
+		PROFILE_ZONE("Frame");
+
 		float entryLevelElapsed = EntryLevel ? clamp(realTimeElapsed * EntryLevelInfo->TimeDilation(), 1.0f / 400.0f, 1.0f / 2.5f) : 0.0f;
 		float levelElapsed = clamp(realTimeElapsed * LevelInfo->TimeDilation(), 1.0f / 400.0f, 1.0f / 2.5f);
 
@@ -103,9 +152,15 @@ void Engine::Run()
 		LevelInfo->TimeSeconds() += levelElapsed;
 		Logger::Get()->SetTimeSeconds(LevelInfo->TimeSeconds());
 
-		UpdateInput(realTimeElapsed);
+		TimeDemoPhases* phases = timedemo ? &timedemo->Phases : nullptr;
+
+		if (!LaunchInfo.dedicatedServer)
+		{
+			UpdateInput(realTimeElapsed);
 
-		CallEvent(console, EventName::Tick, { ExpressionValue::FloatValue(levelElapsed) });
+			ProfileTimer tickTimer(phases ? &phases->Tick : nullptr, "Console Tick");
+			CallEvent(console, EventName::Tick, { ExpressionValue::FloatValue(levelElapsed) });
+		}
 
 		// To do: set these to true if the frame rate is too low
 		if (LaunchInfo.engineVersion >= 436)
@@ -114,9 +169,12 @@ void Engine::Run()
 			LevelInfo->bAggressiveLOD() = false;
 		}
 
-		if (EntryLevel)
-			EntryLevel->Tick(entryLevelElapsed);
-		Level->Tick(levelElapsed);
+		{
+			ProfileTimer tickTimer(phases ? &phases->Tick : nullptr, nullptr);
+			if (EntryLevel)
+				EntryLevel->Tick(entryLevelElapsed);
+			Level->Tick(levelElapsed);
+		}
 
 		if (!LevelInfo->NextURL().empty())
 		{
@@ -187,10 +245,14 @@ void Engine::Run()
 			LoginPlayer();
 		}
 
+		if (LaunchInfo.dedicatedServer)
+			continue;
+
 		// To do: improve CallEvent so parameter passing isn't this painful
 		UFunction* funcPlayerCalcView = FindEventFunction(viewport->Actor(), "PlayerCalcView");
 		if (funcPlayerCalcView)
 		{
+			PROFILE_ZONE("PlayerCalcView");
 			vecprop.Struct = UObject::Cast<UStructProperty>(funcPlayerCalcView->Properties[1])->Struct;
 			rotprop.Struct = UObject::Cast<UStructProperty>(funcPlayerCalcView->Properties[2])->Struct;
 			CameraActor = viewport->Actor();
@@ -204,16 +266,32 @@ void Engine::Run()
 				});
 		}
 
-		UpdateAudio();
+		{
+			ProfileTimer audioTimer(phases ? &phases->Audio : nullptr, nullptr);
+			UpdateAudio();
+		}
 
 		ViewportX = 0;
 		ViewportY = 0;
 		ViewportWidth = engine->window->GetPixelWidth();
 		ViewportHeight = engine->window->GetPixelHeight();
-		render->DrawGame(levelElapsed);
+		{
+			ProfileTimer renderTimer(phases ? &phases->Render : nullptr, nullptr);
+			render->DrawGame(levelElapsed);
+		}
+
+		if (timedemo)
+			timedemo->EndFrame();
+		TimeDemo::CloseConsoleResults();
+	}
+
+	if (timedemo)
+	{
+		timedemo->Finish();
+		timedemo.reset();
 	}
 
-	window->UnlockCursor();
+	UnlockCursor();
 
 	if (packages->MissingSESystemIni())
 	{
@@ -293,6 +371,7 @@ void Engine::UnloadMap()
 	Level = nullptr;
 	LevelPackage = nullptr;
 
+	render->OnMapUnloaded();
 	packages->UnloadPackage(packageName);
 }
 
@@ -300,7 +379,7 @@ void Engine::LoadMap(const UnrealURL& url, const std::map<std::string, std::stri
 {
 	ClientTravelInfo.URL.Map.clear();
 
-	if (Level)
+	if (Level && console)
 		CallEvent(console, EventName::NotifyLevelChange);
 
 	if (url.HasOption("entry")) // Not sure what the purpose of this kind of travel is - do nothing for now.
@@ -332,7 +411,7 @@ void Engine::LoadMap(const UnrealURL& url, const std::map<std::string, std::stri
 	if (packages->GetEngineVersion() > 219)
 		LevelInfo->MinNetVersion() = "500";
 	LevelInfo->bHighDetailMode() = true;
-	LevelInfo->NetMode() = 0; // NM_StandAlone
+	LevelInfo->NetMode() = LaunchInfo.dedicatedServer ? 1 : 0; // NM_DedicatedServer or NM_StandAlone
 	LevelInfo->DefaultTexture() = engine->DefaultTexture;
 
 	LevelInfo->URL = url;
@@ -447,6 +526,10 @@ void Engine::LoadMap(const UnrealURL& url, const std::map<std::string, std::stri
 
 void Engine::LoginPlayer()
 {
+	// A dedicated server has no local player
+	if (LaunchInfo.dedicatedServer)
+		return;
+
 	UnrealURL url = LevelInfo->URL;
 	std::map<std::string, std::string> travelInfo = Level->TravelInfo;
 
@@ -562,6 +645,106 @@ void Engine::LoginPlayer()
 	render->OnMapLoaded();
 }
 
+void Engine::RunRenderBenchmark()
+{
+	struct CameraView
+	{
+		vec3 Location;
+		Rotator Rotation;
+	};
+
+	// Use the camera path file if there is one. Otherwise look in four directions from every navigation point.
+	Array<CameraView> path;
+	if (!LaunchInfo.benchRenderPath.empty())
+	{
+		for (const std::string& line : File::read_all_lines(LaunchInfo.benchRenderPath))
+		{
+			CameraView view;
+			int pitch = 0, yaw = 0, roll = 0;
+			if (std::sscanf(line.c_str(), "%f %f %f %d %d %d", &view.Location.x, &view.Location.y, &view.Location.z, &pitch, &yaw, &roll) == 6)
+			{
+				view.Rotation = Rotator(pitch, yaw, roll);
+				path.push_back(view);
+			}
+		}
+	}
+	else
+	{
+		for (UActor* actor : Level->Actors)
+		{
+			if (UObject::TryCast<UNavigationPoint>(actor))
+			{
+				for (int yaw = 0; yaw < 65536; yaw += 16384)
+					path.push_back({ actor->Location(), Rotator(0, yaw, 0) });
+			}
+		}
+	}
+
+	if (path.empty())
+	{
+		LogMessage("Render benchmark has no camera path");
+		return;
+	}
+
+	ViewportX = 0;
+	ViewportY = 0;
+	ViewportWidth = 1920;
+	ViewportHeight = 1080;
+
+	const float frameTime = 1.0f / 60.0f;
+	auto drawPath = [&]()
+	{
+		for (const CameraView& view : path)
+		{
+			CameraActor = viewport->Actor();
+			CameraLocation = view.Location;
+			CameraRotation = view.Rotation;
+			CameraFovAngle = viewport->Actor()->FovAngle();
+			render->DrawGame(frameTime);
+		}
+	};
+
+	// The first pass fills the texture and lightmap caches
+	drawPath();
+	render->FinishLightmapBakes();
+
+	captureRenderDevice->ClearTrace();
+	render->StageTimes = {};
+	auto start = std::chrono::steady_clock::now();
+	drawPath();
+	double totalMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	double frames = (double)path.size();
+	auto stageLine = [&](const std::string& name, double seconds)
+	{
+		LogMessage(name + ": " + std::to_string(seconds * 1000.0 / frames) + " ms/frame");
+	};
+
+	LogMessage("Render benchmark: " + std::to_string(path.size()) + " frames in " + std::to_string(totalMs) + " ms (" + std::to_string(totalMs / frames) + " ms/frame)");
+	stageLine("Lighting", render->StageTimes.Lighting);
+	stageLine("BSP traversal", render->StageTimes.Traversal);
+	stageLine("BSP surfaces", render->StageTimes.Surfaces);
+	stageLine("Actors", render->StageTimes.Actors);
+	stageLine("Translucent", render->StageTimes.Translucent);
+	stageLine("Canvas", render->StageTimes.Canvas);
+
+	const auto& stats = captureRenderDevice->Stats;
+	LogMessage(std::to_string(stats.ComplexSurfaces) + " complex surfaces, " + std::to_string(stats.GouraudPolygons) + " gouraud polygons, " + std::to_string(stats.GouraudTriangles) + " gouraud triangles, " + std::to_string(stats.Tiles) + " tiles");
+	LogMessage("Render trace: " + std::to_string(captureRenderDevice->GetTrace().size() / 1024) + " KB");
+
+	if (!LaunchInfo.benchRenderTrace.empty())
+		captureRenderDevice->SaveTrace(LaunchInfo.benchRenderTrace);
+
+	// Play the trace back to check that it is complete and to time the replay overhead
+	RenderTraceReplayer replayer;
+	replayer.Load(captureRenderDevice->GetTrace());
+	std::unique_ptr<RenderDevice> nullDevice = RenderDevice::CreateNull();
+	start = std::chrono::steady_clock::now();
+	int replayedFrames = replayer.Replay(nullDevice.get());
+	double replayMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	LogMessage("Render trace replay: " + std::to_string(replayedFrames) + " frames in " + std::to_string(replayMs) + " ms");
+}
+
 UObject* Engine::FindObject(NameString name, NameString className)
 {
 	for (auto actor : Level->Actors)
@@ -573,6 +756,27 @@ UObject* Engine::FindObject(NameString name, NameString className)
 	return nullptr;
 }
 
+float Engine::WaitForServerTick()
+{
+	using namespace std::chrono;
+
+	// Dedicated servers tick at a fixed rate and sleep in between
+	uint64_t tickInterval = 1'000'000 / std::max(ServerTickRate, 1);
+	uint64_t currentTime = duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	if (lastTime == 0 || currentTime > lastTime + tickInterval * 4)
+	{
+		// Don't try to catch up if we fell too far behind
+		lastTime = currentTime;
+	}
+	else
+	{
+		lastTime += tickInterval;
+		if (currentTime < lastTime)
+			std::this_thread::sleep_for(microseconds(lastTime - currentTime));
+	}
+	return tickInterval / 1'000'000.0f;
+}
+
 float Engine::CalcTimeElapsed()
 {
 	using namespace std::chrono;
@@ -652,10 +856,39 @@ std::string Engine::ConsoleCommand(UObject* context, const std::string& commandl
 	}
 	else if (command == "stat" && args.size() == 2)
 	{
+		if (args[1] == "packages")
+			return packages->GetStreamStats();
+
 		render->ShowRenderStats = 0;
+		render->ShowProfileStats = 0;
 
 		if (args[1] == "render")
 			render->ShowRenderStats = 1;
+
+		if (args[1] == "profile")
+		{
+			render->ShowProfileStats = 1;
+			Profiler::SetEnabled(true);
+		}
+	}
+	else if (command == "profile" && args.size() >= 2)
+	{
+#ifdef SURREAL_PROFILER
+		if (args[1] == "dump")
+		{
+			// profile dump [frames] [filename]
+			int frames = args.size() >= 3 ? std::atoi(args[2].c_str()) : 60;
+			std::string filename = args.size() >= 4 ? args[3] : "profile.json";
+			File::write_all_text(filename, Profiler::GetChromeTrace(frames));
+			return "Saved the last " + std::to_string(frames) + " frames to " + filename;
+		}
+		else
+		{
+			Profiler::SetEnabled(args[1] == "1");
+		}
+#else
+		return "The profiler zones were not compiled in (SURREAL_PROFILER)";
+#endif
 	}
 	else if (command == "collisiondebug" && args.size() == 2)
 	{
@@ -677,6 +910,8 @@ std::string Engine::ConsoleCommand(UObject* context, const std::string& commandl
 	}*/
 	else if (command == "getres")
 	{
+		if (!window)
+			return {};
 		return window->GetAvailableResolutions();
 	}
 	else if (command == "getcolordepths")
@@ -685,6 +920,9 @@ std::string Engine::ConsoleCommand(UObject* context, const std::string& commandl
 	}
 	else if (command == "getcurrentres")
 	{
+		if (!window)
+			return "0x0";
+
 		int width = window->GetPixelWidth();
 		int height = window->GetPixelHeight();
 
@@ -817,7 +1055,8 @@ std::string Engine::ConsoleCommand(UObject* context, const std::string& commandl
 	}
 	else if (command == "setres" && args.size() == 2)
 	{
-		window->SetResolution(args[1]);
+		if (window)
+			window->SetResolution(args[1]);
 	}
 	else
 	{
@@ -883,6 +1122,8 @@ void Engine::LoadEngineSettings()
 		renderdev->LoadProperties();
 	}
 
+	ServerTickRate = std::atoi(packages->GetIniValue("System", "IpDrv.TcpNetDriver", "NetServerMaxTickRate", "20").c_str());
+
 #ifdef WIN32
 	windowingSystemName = packages->GetIniValue("System", "Engine.SurrealWindowSystem", "WindowSystem", "Win32");
 #else
@@ -929,7 +1170,11 @@ void Engine::UpdateInput(float timeElapsed)
 	if (timeElapsed <= 0.0f)
 		return;
 
+	PROFILE_ZONE("Engine::UpdateInput");
+
 	TickWindow();
+	if (timedemo)
+		timedemo->DispatchInput();
 	if (tickDebugger)
 		tickDebugger();
 	for (auto& it : activeInputButtons)
@@ -1093,6 +1338,13 @@ void Engine::Key(std::string key)
 	if (Frame::RunState != FrameRunState::Running)
 		return;
 
+	if (timedemo)
+	{
+		if (!timedemo->AcceptInput())
+			return;
+		timedemo->RecordKey(key);
+	}
+
 	for (char c : key)
 	{
 		CallEvent(console, EventName::KeyType, { ExpressionValue::ByteValue(c) });
@@ -1104,6 +1356,13 @@ void Engine::InputEvent(EInputKey key, EInputType type, int delta)
 	if (Frame::RunState != FrameRunState::Running)
 		return;
 
+	if (timedemo)
+	{
+		if (!timedemo->AcceptInput())
+			return;
+		timedemo->RecordInputEvent(key, type, delta);
+	}
+
 	bool handled = CallEvent(console, EventName::KeyEvent, { ExpressionValue::ByteValue(key), ExpressionValue::ByteValue(type), ExpressionValue::FloatValue((float)delta) }).ToBool();
 	
 	if (!handled)
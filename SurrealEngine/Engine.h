@@ -13,6 +13,8 @@
 #include <list>
 
 class RenderSubsystem;
+class CaptureRenderDevice;
+class TimeDemo;
 class PackageManager;
 class UObject;
 class ULevel;
@@ -66,6 +68,7 @@ public:
 	void LoadMap(const UnrealURL& url, const std::map<std::string, std::string>& travelInfo = {});
 	void UnloadMap();
 	void LoginPlayer();
+	void RunRenderBenchmark();
 
 	UObject* FindObject(NameString name, NameString className);
 
@@ -140,11 +143,15 @@ public:
 	std::unique_ptr<GameWindow> window; // TODO: Move into UViewport
 	std::unique_ptr<RenderSubsystem> render;
 	std::unique_ptr<AudioSubsystem> audio;
+	std::unique_ptr<RenderDevice> nullRenderDevice; // Used by dedicated servers instead of the window's render device
+	std::unique_ptr<CaptureRenderDevice> captureRenderDevice; // Used by the render benchmark instead of the window's render device
+	std::unique_ptr<TimeDemo> timedemo; // Active when recording or playing back a time demo
 
 	int MouseMoveX = 0;
 	int MouseMoveY = 0;
 
 	float CalcTimeElapsed();
+	float WaitForServerTick();
 
 	int ViewportX = 0;
 	int ViewportY = 0;
@@ -165,6 +172,7 @@ public:
 	bool quit = false;
 
 	uint64_t lastTime = 0;
+	int ServerTickRate = 20;
 
 	void LoadEngineSettings();
 
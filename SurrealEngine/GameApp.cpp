@@ -10,23 +10,32 @@
 #include "UI/ErrorWindow/ErrorWindow.h"
 #include "Utils/File.h"
 #include <stdexcept>
+#include <iostream>
 #include <zwidget/core/theme.h>
 #include <zwidget/window/window.h>
 
 int GameApp::main(Array<std::string> args)
 {
-	//auto backend = DisplayBackend::TryCreateBackend();
-	auto backend = DisplayBackend::TryCreateWin32();
-	if (!backend) backend = DisplayBackend::TryCreateSDL2();
-	DisplayBackend::Set(std::move(backend));
+	CommandLine cmd(args);
+	commandline = &cmd;
+
+	bool dedicatedServer = cmd.HasArg("-server", "--server") || cmd.HasArg("-benchrender", "--benchrender");
+	if (dedicatedServer)
+	{
+		Logger::Get()->SetCallback([](const LogMessageLine& line) { std::cout << line.Text << std::endl; });
+	}
+	else
+	{
+		//auto backend = DisplayBackend::TryCreateBackend();
+		auto backend = DisplayBackend::TryCreateWin32();
+		if (!backend) backend = DisplayBackend::TryCreateSDL2();
+		DisplayBackend::Set(std::move(backend));
+	}
 	InitWidgetResources();
 	WidgetTheme::SetTheme(std::make_unique<DarkWidgetTheme>());
 
 	try
 	{
-		CommandLine cmd(args);
-		commandline = &cmd;
-
 		GameLaunchInfo info = GameFolderSelection::GetLaunchInfo();
 		if (!info.gameRootFolder.empty())
 		{
@@ -36,7 +45,10 @@ int GameApp::main(Array<std::string> args)
 	}
 	catch (const std::exception& e)
 	{
-		ErrorWindow::ExecModal(e.what(), Logger::Get()->GetLog());
+		if (dedicatedServer)
+			std::cout << e.what() << std::endl;
+		else
+			ErrorWindow::ExecModal(e.what(), Logger::Get()->GetLog());
 	}
 
 	DeinitWidgetResources();
@@ -47,7 +47,11 @@ GameLaunchInfo GameFolderSelection::GetLaunchInfo()
 		Exception::Throw("Unable to find a game folder");
 	}
 
-	int selectedGame = LauncherWindow::ExecModal(foundGames);
+	// A dedicated server or render benchmark has no display to show the launcher on. Use the first game found instead.
+	bool dedicatedServer = commandline->HasArg("-server", "--server");
+	bool benchRender = commandline->HasArg("-benchrender", "--benchrender");
+
+	int selectedGame = (dedicatedServer || benchRender) ? 0 : LauncherWindow::ExecModal(foundGames);
 	if (selectedGame < 0)
 		return {};
 
@@ -56,7 +60,14 @@ GameLaunchInfo GameFolderSelection::GetLaunchInfo()
 	info.engineVersion = commandline->GetArgInt("-e", "--engineversion", info.engineVersion);
 	info.gameName = commandline->GetArg("-g", "--game", info.gameName);
 	info.noEntryMap = commandline->HasArg("-n", "--noentrymap") || info.noEntryMap;
+	info.dedicatedServer = dedicatedServer;
 	info.url = commandline->GetArg("-u", "--url", info.url);
+	info.benchRender = benchRender && !dedicatedServer;
+	info.benchRenderTrace = commandline->GetArg("-benchtrace", "--benchtrace", info.benchRenderTrace);
+	info.benchRenderPath = commandline->GetArg("-benchpath", "--benchpath", info.benchRenderPath);
+	info.recordDemo = commandline->GetArg("-recorddemo", "--recorddemo", info.recordDemo);
+	info.playDemo = commandline->GetArg("-playdemo", "--playdemo", info.playDemo);
+	info.demoStats = commandline->GetArg("-demostats", "--demostats", info.demoStats);
 
 	return info;
 }
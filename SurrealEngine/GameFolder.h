@@ -5,11 +5,18 @@ struct GameLaunchInfo
 	int engineVersion = 0;					// Engine version (e.g. 226, 227, 436...)
 	int engineSubVersion = 0;				// Engine sub version displayed as a letter (Note: Isn't always consistent)
 	bool noEntryMap = false;
+	bool dedicatedServer = false;			// Run the game without a window, audio or rendering
 	std::string gameName = "";				// Name of the game (e.g. "Unreal Tournament")
 	std::string gameRootFolder = "";		// Path to the folder that contains all the subfolders and files
 	std::string gameExecutableName = "";	// Name of the game executable (e.g. "UnrealTournament")
 	std::string gameVersionString = "";		// Version (+ sub version) info as a string (e.g. "469d")
 	std::string url = "";					// The UnrealURL to launch upon startup
+	bool benchRender = false;				// Time the renderer along a camera path without a window or GPU, then quit
+	std::string benchRenderTrace = "";		// File the render trace of the benchmark is saved to
+	std::string benchRenderPath = "";		// Camera path of the benchmark. Each line is "x y z pitch yaw roll".
+	std::string recordDemo = "";			// File the input and frame times are recorded to as a time demo
+	std::string playDemo = "";				// Time demo to play back. The engine quits when it ends.
+	std::string demoStats = "";				// File the frame time stats of the time demo playback are written to as JSON
 };
 
 class GameFolderSelection
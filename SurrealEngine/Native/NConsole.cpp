@@ -3,6 +3,7 @@
 #include "NConsole.h"
 #include "VM/NativeFunc.h"
 #include "Engine.h"
+#include "TimeDemo.h"
 
 void NConsole::RegisterFunctions()
 {
@@ -17,5 +18,6 @@ void NConsole::ConsoleCommand(UObject* Self, const std::string& S, BitfieldBool&
 
 void NConsole::SaveTimeDemo(UObject* Self, const std::string& S)
 {
-	LogUnimplemented("Console.SaveTimeDemo(" + S + ")");
+	// The console calls this for every line of its timedemo results when bSaveTimeDemoToFile is set
+	TimeDemo::WriteConsoleResult(S);
 }
@@ -0,0 +1,434 @@
+
+#include "Precomp.h"
+#include "CookedMap.h"
+#include "Package.h"
+#include "PackageManager.h"
+#include "PackageStream.h"
+#include "ObjectStream.h"
+#include "UObject/ULevel.h"
+#include "UObject/UTexture.h"
+#include "UObject/UActor.h"
+#include "Utils/File.h"
+#include <type_traits>
+
+namespace
+{
+	const uint32_t CookedSignature = 0x4B4F4F43; // "COOK"
+	const uint32_t CookedFormatVersion = 4;
+
+	enum class CookedSection : uint32_t
+	{
+		Imports,
+		Vectors,
+		Points,
+		Nodes,
+		Surfaces,
+		Vertices,
+		Zones,
+		LightMap,
+		LightBits,
+		Bounds,
+		LeafHulls,
+		Leaves,
+		Lights,
+		Count
+	};
+
+	struct CookedHeader
+	{
+		uint32_t Signature;
+		uint32_t FormatVersion;
+		uint64_t SourceFileSize;
+		uint64_t ModelOffset;
+		uint64_t ModelSize;
+		uint64_t ModelHash;
+		int32_t NumSharedSides;
+		int32_t RootOutside;
+		int32_t Linked;
+		int32_t Polys;
+		uint32_t NumSections;
+		uint32_t Padding;
+	};
+
+	// FNV-1a. Catches edits to the map that keep the package and export sizes unchanged.
+	uint64_t HashBytes(const uint8_t* data, size_t size)
+	{
+		uint64_t hash = 0xcbf29ce484222325ULL;
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001b3ULL;
+		}
+		return hash;
+	}
+
+	struct CookedSectionEntry
+	{
+		uint32_t Count;
+		uint32_t RecordSize;
+		uint64_t Offset;
+	};
+
+	struct CookedImport
+	{
+		char PackageName[60];
+		int32_t ExportIndex;
+		char ObjectName[64]; // Checked when loading, so that a changed dependency invalidates the snapshot
+	};
+
+	struct CookedSurface
+	{
+		int32_t Material;
+		uint32_t PolyFlags;
+		int32_t pBase;
+		int32_t vNormal;
+		int32_t vTextureU;
+		int32_t vTextureV;
+		int32_t LightMap;
+		int32_t BrushPoly;
+		int16_t PanU;
+		int16_t PanV;
+		int32_t BrushActor;
+	};
+
+	struct CookedZone
+	{
+		int32_t ZoneActor;
+		int32_t Padding;
+		uint64_t Connectivity;
+		uint64_t Visibility;
+	};
+
+	class CookedMapWriter
+	{
+	public:
+		int32_t GetImportIndex(UObject* obj)
+		{
+			if (!obj || !obj->package)
+				return -1;
+
+			auto it = importIndexes.find(obj);
+			if (it != importIndexes.end())
+				return it->second;
+
+			std::string packageName = obj->package->GetPackageName().ToString();
+			if (packageName.size() >= sizeof(CookedImport::PackageName))
+				Exception::Throw("Package name too long for cooked map import: " + packageName);
+
+			std::string objectName = obj->Name.ToString();
+			if (objectName.size() >= sizeof(CookedImport::ObjectName))
+				Exception::Throw("Object name too long for cooked map import: " + objectName);
+
+			CookedImport import = {};
+			memcpy(import.PackageName, packageName.data(), packageName.size());
+			memcpy(import.ObjectName, objectName.data(), objectName.size());
+			import.ExportIndex = (int32_t)obj->exportIndex;
+
+			int32_t index = (int32_t)imports.size();
+			imports.push_back(import);
+			importIndexes[obj] = index;
+			return index;
+		}
+
+		template<typename T>
+		void AddSection(CookedSection id, const T* data, size_t count)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Cooked sections must be trivially copyable");
+
+			CookedSectionEntry& entry = sections[(int)id];
+			entry.Count = (uint32_t)count;
+			entry.RecordSize = (uint32_t)sizeof(T);
+			entry.Offset = blocks.size();
+
+			const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+			blocks.insert(blocks.end(), bytes, bytes + count * sizeof(T));
+			blocks.resize((blocks.size() + 15) / 16 * 16, 0);
+		}
+
+		void Finish(const CookedHeader& header, const std::string& filename)
+		{
+			AddSection(CookedSection::Imports, imports.data(), imports.size());
+
+			uint64_t dataStart = sizeof(CookedHeader) + sizeof(sections);
+			for (CookedSectionEntry& entry : sections)
+				entry.Offset += dataStart;
+
+			auto file = File::create_always(filename);
+			file->write(&header, sizeof(CookedHeader));
+			file->write(sections, sizeof(sections));
+			file->write(blocks.data(), blocks.size());
+		}
+
+	private:
+		Array<CookedImport> imports;
+		std::map<UObject*, int32_t> importIndexes;
+		CookedSectionEntry sections[(int)CookedSection::Count] = {};
+		Array<uint8_t> blocks;
+	};
+
+	class CookedMapReader
+	{
+	public:
+		static constexpr size_t HeaderSize = sizeof(CookedHeader) + sizeof(CookedSectionEntry) * (size_t)CookedSection::Count;
+
+		// Reads the header and the section table. Returns nullptr if the file is too small.
+		const CookedHeader* ReadHeader(File* file)
+		{
+			fileSize = (uint64_t)file->size();
+			if (fileSize < HeaderSize)
+				return nullptr;
+			data.resize(HeaderSize);
+			file->read(data.data(), HeaderSize);
+			return reinterpret_cast<const CookedHeader*>(data.data());
+		}
+
+		// Reads the rest of the file. Only done once the header has been validated.
+		void ReadSections(File* file)
+		{
+			data.resize(fileSize);
+			file->read(data.data() + HeaderSize, fileSize - HeaderSize);
+		}
+
+		template<typename T>
+		bool GetSection(CookedSection id, const T*& records, size_t& count) const
+		{
+			const CookedSectionEntry& entry = reinterpret_cast<const CookedSectionEntry*>(data.data() + sizeof(CookedHeader))[(int)id];
+			if (entry.RecordSize != sizeof(T) || entry.Offset + (uint64_t)entry.Count * entry.RecordSize > data.size())
+				return false;
+			records = reinterpret_cast<const T*>(data.data() + entry.Offset);
+			count = entry.Count;
+			return true;
+		}
+
+		template<typename T>
+		bool CopySection(CookedSection id, Array<T>& dest) const
+		{
+			const T* records = nullptr;
+			size_t count = 0;
+			if (!GetSection(id, records, count))
+				return false;
+			dest.resize(count);
+			if (count > 0)
+				memcpy(dest.data(), records, count * sizeof(T));
+			return true;
+		}
+
+	private:
+		Array<uint8_t> data;
+		uint64_t fileSize = 0;
+	};
+}
+
+std::string CookedMap::GetFilename(Package* package)
+{
+	return package->GetPackageFilename() + ".cooked";
+}
+
+void CookedMap::Save(Package* package, UModel* model)
+{
+	ExportTableEntry* entry = package->GetExportEntry(model->exportIndex + 1);
+
+	CookedMapWriter writer;
+
+	CookedHeader header = {};
+	header.Signature = CookedSignature;
+	header.FormatVersion = CookedFormatVersion;
+	header.SourceFileSize = package->GetFileSize();
+	header.ModelOffset = entry->ObjOffset;
+	header.ModelSize = entry->ObjSize;
+
+	Array<uint8_t> modelData(entry->ObjSize);
+	if (entry->ObjSize > 0)
+	{
+		auto packageStream = package->GetPackageManager()->GetStream(package);
+		packageStream->Seek(entry->ObjOffset);
+		packageStream->ReadBytes(modelData.data(), entry->ObjSize);
+	}
+	header.ModelHash = HashBytes(modelData.data(), modelData.size());
+
+	header.NumSharedSides = model->NumSharedSides;
+	header.RootOutside = model->RootOutside;
+	header.Linked = model->Linked;
+	header.Polys = writer.GetImportIndex(model->Polys);
+	header.NumSections = (uint32_t)CookedSection::Count;
+
+	Array<CookedSurface> surfaces;
+	surfaces.reserve(model->Surfaces.size());
+	for (const BspSurface& surface : model->Surfaces)
+	{
+		CookedSurface s;
+		s.Material = writer.GetImportIndex(surface.Material);
+		s.PolyFlags = surface.PolyFlags;
+		s.pBase = surface.pBase;
+		s.vNormal = surface.vNormal;
+		s.vTextureU = surface.vTextureU;
+		s.vTextureV = surface.vTextureV;
+		s.LightMap = surface.LightMap;
+		s.BrushPoly = surface.BrushPoly;
+		s.PanU = surface.PanU;
+		s.PanV = surface.PanV;
+		s.BrushActor = surface.BrushActor;
+		surfaces.push_back(s);
+	}
+
+	Array<CookedZone> zones;
+	zones.reserve(model->Zones.size());
+	for (const ZoneProperties& zone : model->Zones)
+	{
+		CookedZone z = {};
+		z.ZoneActor = writer.GetImportIndex(zone.ZoneActor);
+		z.Connectivity = zone.Connectivity;
+		z.Visibility = zone.Visibility;
+		zones.push_back(z);
+	}
+
+	Array<int32_t> lights;
+	lights.reserve(model->Lights.size());
+	for (UActor* light : model->Lights)
+		lights.push_back(writer.GetImportIndex(light));
+
+	writer.AddSection(CookedSection::Vectors, model->Vectors.data(), model->Vectors.size());
+	writer.AddSection(CookedSection::Points, model->Points.data(), model->Points.size());
+	writer.AddSection(CookedSection::Nodes, model->Nodes.data(), model->Nodes.size());
+	writer.AddSection(CookedSection::Surfaces, surfaces.data(), surfaces.size());
+	writer.AddSection(CookedSection::Vertices, model->Vertices.data(), model->Vertices.size());
+	writer.AddSection(CookedSection::Zones, zones.data(), zones.size());
+	writer.AddSection(CookedSection::LightMap, model->LightMap.data(), model->LightMap.size());
+	writer.AddSection(CookedSection::LightBits, model->LightBits.data(), model->LightBits.size());
+	writer.AddSection(CookedSection::Bounds, model->Bounds.data(), model->Bounds.size());
+	writer.AddSection(CookedSection::LeafHulls, model->LeafHulls.data(), model->LeafHulls.size());
+	writer.AddSection(CookedSection::Leaves, model->Leaves.data(), model->Leaves.size());
+	writer.AddSection(CookedSection::Lights, lights.data(), lights.size());
+
+	writer.Finish(header, GetFilename(package));
+}
+
+bool CookedMap::Load(ObjectStream* stream, UModel* model)
+{
+	Package* package = stream->GetPackage();
+
+	auto file = File::try_open_existing(GetFilename(package));
+	if (!file)
+		return false;
+
+	CookedMapReader reader;
+	const CookedHeader* headerData = reader.ReadHeader(file.get());
+	if (!headerData)
+		return false;
+
+	CookedHeader header = *headerData;
+	if (header.Signature != CookedSignature || header.FormatVersion != CookedFormatVersion || header.NumSections != (uint32_t)CookedSection::Count)
+		return false;
+
+	if (header.ModelOffset != stream->GetStartOffset() || header.ModelSize != stream->GetSize() || header.SourceFileSize != package->GetFileSize())
+		return false;
+
+	if (header.ModelHash != HashBytes(stream->GetData(), stream->GetSize()))
+		return false;
+
+	reader.ReadSections(file.get());
+	file.reset();
+
+	const CookedImport* importRecords = nullptr;
+	const CookedSurface* surfaceRecords = nullptr;
+	const CookedZone* zoneRecords = nullptr;
+	const int32_t* lightRecords = nullptr;
+	size_t importCount = 0, surfaceCount = 0, zoneCount = 0, lightCount = 0;
+	if (!reader.GetSection(CookedSection::Imports, importRecords, importCount) ||
+		!reader.GetSection(CookedSection::Surfaces, surfaceRecords, surfaceCount) ||
+		!reader.GetSection(CookedSection::Zones, zoneRecords, zoneCount) ||
+		!reader.GetSection(CookedSection::Lights, lightRecords, lightCount))
+		return false;
+
+	// Check that the imports still name the same objects before anything is loaded from the dependencies
+	PackageManager* packages = package->GetPackageManager();
+	Array<Package*> importPackages;
+	importPackages.reserve(importCount);
+	for (size_t i = 0; i < importCount; i++)
+	{
+		const CookedImport& import = importRecords[i];
+		std::string packageName(import.PackageName, strnlen(import.PackageName, sizeof(import.PackageName)));
+		std::string objectName(import.ObjectName, strnlen(import.ObjectName, sizeof(import.ObjectName)));
+		if (!packages->HasPackage(packageName))
+			return false;
+		Package* importPackage = packages->GetPackage(packageName);
+		if (import.ExportIndex < 0 || import.ExportIndex >= importPackage->GetExportCount())
+			return false;
+		if (importPackage->GetName(importPackage->GetExportEntry(import.ExportIndex + 1)->ObjName).ToString() != objectName)
+			return false;
+		importPackages.push_back(importPackage);
+	}
+
+	// Fix up the object references
+	Array<UObject*> imports;
+	imports.reserve(importCount);
+	for (size_t i = 0; i < importCount; i++)
+		imports.push_back(importPackages[i]->GetUObject(importRecords[i].ExportIndex + 1));
+
+	auto resolve = [&](int32_t index) -> UObject* { return (index >= 0 && (size_t)index < imports.size()) ? imports[index] : nullptr; };
+
+	if (!reader.CopySection(CookedSection::Vectors, model->Vectors) ||
+		!reader.CopySection(CookedSection::Points, model->Points) ||
+		!reader.CopySection(CookedSection::Nodes, model->Nodes) ||
+		!reader.CopySection(CookedSection::Vertices, model->Vertices) ||
+		!reader.CopySection(CookedSection::LightMap, model->LightMap) ||
+		!reader.CopySection(CookedSection::LightBits, model->LightBits) ||
+		!reader.CopySection(CookedSection::Bounds, model->Bounds) ||
+		!reader.CopySection(CookedSection::LeafHulls, model->LeafHulls) ||
+		!reader.CopySection(CookedSection::Leaves, model->Leaves))
+	{
+		// Leave the model empty so that the regular loader starts from scratch
+		model->Vectors.clear();
+		model->Points.clear();
+		model->Nodes.clear();
+		model->Vertices.clear();
+		model->LightMap.clear();
+		model->LightBits.clear();
+		model->Bounds.clear();
+		model->LeafHulls.clear();
+		model->Leaves.clear();
+		return false;
+	}
+
+	for (BspNode& node : model->Nodes)
+	{
+		node.ActorList = nullptr;
+		node.DecalList = nullptr;
+	}
+
+	model->Surfaces.resize(surfaceCount);
+	for (size_t i = 0; i < surfaceCount; i++)
+	{
+		const CookedSurface& s = surfaceRecords[i];
+		BspSurface& surface = model->Surfaces[i];
+		surface.Material = UObject::Cast<UTexture>(resolve(s.Material));
+		surface.PolyFlags = s.PolyFlags;
+		surface.pBase = s.pBase;
+		surface.vNormal = s.vNormal;
+		surface.vTextureU = s.vTextureU;
+		surface.vTextureV = s.vTextureV;
+		surface.LightMap = s.LightMap;
+		surface.BrushPoly = s.BrushPoly;
+		surface.PanU = s.PanU;
+		surface.PanV = s.PanV;
+		surface.BrushActor = s.BrushActor;
+	}
+
+	model->Zones.resize(zoneCount);
+	for (size_t i = 0; i < zoneCount; i++)
+	{
+		model->Zones[i].ZoneActor = UObject::Cast<UActor>(resolve(zoneRecords[i].ZoneActor));
+		model->Zones[i].Connectivity = zoneRecords[i].Connectivity;
+		model->Zones[i].Visibility = zoneRecords[i].Visibility;
+	}
+
+	model->Lights.resize(lightCount);
+	for (size_t i = 0; i < lightCount; i++)
+		model->Lights[i] = UObject::Cast<UActor>(resolve(lightRecords[i]));
+
+	model->Polys = UObject::Cast<UPolys>(resolve(header.Polys));
+	model->NumSharedSides = header.NumSharedSides;
+	model->RootOutside = header.RootOutside;
+	model->Linked = header.Linked;
+	return true;
+}
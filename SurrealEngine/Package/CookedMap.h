@@ -0,0 +1,27 @@
+#pragma once
+
+class Package;
+class ObjectStream;
+class UModel;
+
+// Cooked snapshot of the BSP model of a map.
+//
+// The file is a small header followed by a table of sections. Each section is a flat array
+// of fixed size records stored at an aligned offset, so loading it is a bulk copy of each array
+// followed by fixing up the object references. Object references are stored as indices into an
+// import table of (package name, export index) pairs.
+//
+// The snapshot is keyed on the size of the source package, the location of the model in it and a
+// hash of the model export, and each import records the name of the object it refers to. If the map or one of the packages
+// it refers to is changed the snapshot is ignored and the model is loaded from the package as usual.
+class CookedMap
+{
+public:
+	static std::string GetFilename(Package* package);
+
+	// Writes the snapshot for the model. The model must have been loaded from the package.
+	static void Save(Package* package, UModel* model);
+
+	// Called by UModel::Load after the UPrimitive header has been read. Returns false if no valid snapshot exists.
+	static bool Load(ObjectStream* stream, UModel* model);
+};
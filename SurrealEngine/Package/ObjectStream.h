@@ -2,6 +2,7 @@
 
 #include "Package.h"
 #include <string.h>
+#include <type_traits>
 #include "Utils/Exception.h"
 
 enum class ObjectFlags : uint32_t;
@@ -21,6 +22,27 @@ public:
 		pos += s;
 	}
 
+	// Reads count elements directly into the array with a single bounds check.
+	// The memory layout of T must match the layout in the package. Like the other reads, this assumes a little endian host.
+	template<typename T>
+	void ReadArray(Array<T>& array, size_t count)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "ReadArray requires a trivially copyable type");
+		const uint8_t* src = ReadBlock(count, sizeof(T));
+		array.resize(count);
+		memcpy(array.data(), src, count * sizeof(T));
+	}
+
+	// Returns a pointer to count packed records and moves past them. For records that must be unpacked one at a time.
+	const uint8_t* ReadBlock(size_t count, size_t recordSize)
+	{
+		if (count > (size - pos) / recordSize)
+			Exception::Throw("Unexpected end of file");
+		const uint8_t* block = data + pos;
+		pos += count * recordSize;
+		return block;
+	}
+
 	void ThrowIfNotEnd()
 	{
 		if (pos != size)
@@ -28,6 +50,9 @@ public:
 	}
 
 	bool IsEmptyStream() const { return size == 0; }
+	size_t GetStartOffset() const { return startoffset; }
+	size_t GetSize() const { return size; }
+	const uint8_t* GetData() const { return data; }
 
 	int8_t ReadInt8() { int8_t t; ReadBytes(&t, 1); return t; }
 	int16_t ReadInt16() { int16_t t; ReadBytes(&t, 2); return t; }
@@ -400,6 +400,7 @@ ImportTableEntry* Package::GetImportEntry(int objref)
 void Package::ReadTables()
 {
 	auto stream = Packages->GetStream(this);
+	FileSize = stream->Size();
 	stream->Seek(0);
 
 	uint32_t signature = stream->ReadInt32();
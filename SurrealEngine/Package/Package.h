@@ -54,10 +54,12 @@ public:
 	int GetVersion() const { return Version; }
 	NameString GetPackageName() const { return Name; }
 	std::string GetPackageFilename() const { return Filename; }
+	uint64_t GetFileSize() const { return FileSize; }
 
 	PackageManager* GetPackageManager() { return Packages; }
 
 	ExportTableEntry* GetExportEntry(int objref);
+	int GetExportCount() const { return (int)ExportTable.size(); }
 	ImportTableEntry* GetImportEntry(int objref);
 	int FindObjectReference(const NameString& className, const NameString& objectName, const NameString& groupName = {});
 
@@ -111,6 +113,7 @@ private:
 	PackageManager* Packages = nullptr;
 	NameString Name;
 	std::string Filename;
+	uint64_t FileSize = 0;
 
 	int Version = 0;
 	PackageFlags Flags = PackageFlags::NoFlags;
@@ -71,6 +71,11 @@ Package* PackageManager::GetPackage(const NameString& name)
 	return package.get();
 }
 
+bool PackageManager::HasPackage(const NameString& name) const
+{
+	return packageFilenames.find(name) != packageFilenames.end();
+}
+
 Package* PackageManager::GetPackageFromPath(const std::string& path)
 {
 	auto absolute_path = FilePath::relative_to_absolute_from_system(FilePath::combine(launchInfo.gameRootFolder, "System"), path);
@@ -98,14 +103,15 @@ void PackageManager::UnloadPackage(const NameString& name)
 	auto it = packages.find(name);
 	if (it != packages.end())
 	{
-		for (auto streamit = openStreams.begin(); streamit != openStreams.end(); ++streamit)
+		std::unique_lock lock(openFilesMutex);
+		auto slotit = openFileSlots.find(it->second.get());
+		if (slotit != openFileSlots.end())
 		{
-			if (streamit->Pkg == it->second.get())
-			{
-				openStreams.erase(streamit);
-				break;
-			}
+			openFiles[slotit->second] = {};
+			openFileSlots.erase(slotit);
 		}
+		lock.unlock();
+
 		packages.erase(it);
 	}
 }
@@ -171,31 +177,56 @@ Array<NameString> PackageManager::GetPackageNames() const
 
 std::shared_ptr<PackageStream> PackageManager::GetStream(Package* package)
 {
-	int numStreams = 0;
-	for (auto it = openStreams.begin(); it != openStreams.end(); ++it)
+	// Each stream has its own read position, so streams for the same package can be used from different threads
+	return std::make_shared<PackageStream>(package, GetFileHandle(package));
+}
+
+std::shared_ptr<File> PackageManager::GetFileHandle(Package* package)
+{
+	std::unique_lock lock(openFilesMutex);
+
+	openFilesClock++;
+
+	auto it = openFileSlots.find(package);
+	if (it != openFileSlots.end())
 	{
-		if ((*it).Pkg == package)
-		{
-			if (it != openStreams.begin())
-			{
-				OpenStream s = *it;
-				openStreams.erase(it);
-				openStreams.push_front(s);
-			}
-			return openStreams.front().Stream;
-		}
-		numStreams++;
+		OpenFile& entry = openFiles[it->second];
+		entry.LastUsed = openFilesClock;
+		openFileHits++;
+		return entry.Handle;
+	}
+
+	openFileMisses++;
+
+	std::shared_ptr<File> handle = File::open_existing(package->GetPackageFilename());
+
+	// Replace the least recently used handle. Streams still using it keep it open until they are done.
+	int slot = 0;
+	for (int i = 1; i < MaxOpenFiles; i++)
+	{
+		if (openFiles[i].LastUsed < openFiles[slot].LastUsed)
+			slot = i;
 	}
 
-	OpenStream s;
-	s.Pkg = package;
-	s.Stream = std::make_shared<PackageStream>(package, File::open_existing(package->GetPackageFilename()));
-	openStreams.push_front(s);
+	OpenFile& entry = openFiles[slot];
+	if (entry.Pkg)
+		openFileSlots.erase(entry.Pkg);
+	entry.Pkg = package;
+	entry.Handle = handle;
+	entry.LastUsed = openFilesClock;
+	openFileSlots[package] = slot;
 
-	if (numStreams == 10)
-		openStreams.pop_back();
+	return handle;
+}
+
+std::string PackageManager::GetStreamStats()
+{
+	std::unique_lock lock(openFilesMutex);
 
-	return openStreams.front().Stream;
+	uint64_t total = openFileHits + openFileMisses;
+	int hitRate = total > 0 ? (int)(openFileHits * 100 / total) : 0;
+	return "Package file handles: " + std::to_string(openFileSlots.size()) + "/" + std::to_string((int)MaxOpenFiles) + " open, " +
+		std::to_string(openFileHits) + " hits, " + std::to_string(openFileMisses) + " misses (" + std::to_string(hitRate) + "% hit rate)";
 }
 
 void PackageManager::DelayLoadNow()
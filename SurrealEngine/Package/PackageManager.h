@@ -3,9 +3,11 @@
 #include "Package.h"
 #include "IniFile.h"
 #include "GameFolder.h"
-#include <list>
+#include <unordered_map>
+#include <mutex>
 
 class PackageStream;
+class File;
 class UObject;
 class UClass;
 
@@ -30,16 +32,20 @@ public:
 	bool IsDeusEx() const { return launchInfo.gameExecutableName == "DeusEx"; }
 	bool IsCliveBarkersUndying() const { return launchInfo.gameExecutableName == "Undying"; }
 
+	bool IsDedicatedServer() const { return launchInfo.dedicatedServer; }
+
 	int GetEngineVersion() const { return launchInfo.engineVersion; }
 	int GetEngineSubVersion() const { return launchInfo.engineSubVersion; }
 
 	Package *GetPackage(const NameString& name);
+	bool HasPackage(const NameString& name) const;
 	Package *GetPackageFromPath(const std::string& path);
 	Array<NameString> GetPackageNames() const;
 
 	void UnloadPackage(const NameString& name);
 
 	std::shared_ptr<PackageStream> GetStream(Package* package);
+	std::string GetStreamStats();
 
 	UObject* NewObject(const NameString& name, const NameString& package, const NameString& className);
 	UObject* NewObject(const NameString& name, UClass* cls);
@@ -97,13 +103,22 @@ private:
 
 	bool missing_se_system_ini = false;
 
-	struct OpenStream
+	std::shared_ptr<File> GetFileHandle(Package* package);
+
+	struct OpenFile
 	{
 		Package* Pkg = nullptr;
-		std::shared_ptr<PackageStream> Stream;
+		std::shared_ptr<File> Handle;
+		uint64_t LastUsed = 0;
 	};
 
-	std::list<OpenStream> openStreams;
+	enum { MaxOpenFiles = 16 };
+	OpenFile openFiles[MaxOpenFiles];
+	std::unordered_map<Package*, int> openFileSlots;
+	std::mutex openFilesMutex;
+	uint64_t openFilesClock = 0;
+	uint64_t openFileHits = 0;
+	uint64_t openFileMisses = 0;
 
 	GameLaunchInfo launchInfo;
 
@@ -3,6 +3,7 @@
 #include "PackageStream.h"
 #include "Package.h"
 #include "Utils/File.h"
+#include <cstring>
 
 PackageStream::PackageStream(Package* package, std::shared_ptr<File> file) : package(package), file(file)
 {
@@ -10,7 +11,25 @@ PackageStream::PackageStream(Package* package, std::shared_ptr<File> file) : pac
 
 void PackageStream::ReadBytes(void* d, uint32_t s)
 {
-	file->read(d, s);
+	if (pos < bufferStart || pos + s > bufferStart + bufferSize)
+	{
+		if (s >= ReadAheadSize / 4 || pos + s > Size())
+		{
+			// Large reads (and reads past the end, so read_at reports the error) go straight to the file
+			file->read_at(d, s, pos);
+			pos += s;
+			return;
+		}
+
+		if (buffer.empty())
+			buffer.resize(ReadAheadSize);
+		bufferStart = pos;
+		bufferSize = std::min((uint64_t)ReadAheadSize, Size() - pos);
+		file->read_at(buffer.data(), bufferSize, bufferStart);
+	}
+
+	memcpy(d, buffer.data() + (pos - bufferStart), s);
+	pos += s;
 }
 
 int8_t PackageStream::ReadInt8()
@@ -70,17 +89,24 @@ uint64_t PackageStream::ReadUInt64()
 
 void PackageStream::Seek(uint32_t offset)
 {
-	file->seek(offset);
+	pos = offset;
 }
 
 void PackageStream::Skip(uint32_t bytes)
 {
-	file->seek(file->tell());
+	pos += bytes;
 }
 
 uint32_t PackageStream::Tell()
 {
-	return (uint32_t)file->tell();
+	return (uint32_t)pos;
+}
+
+uint64_t PackageStream::Size()
+{
+	if (fileSize == ~(uint64_t)0)
+		fileSize = file->size();
+	return fileSize;
 }
 
 int32_t PackageStream::ReadIndex()
@@ -3,6 +3,7 @@
 class File;
 class Package;
 
+// Read cursor into a package file. The file handle may be shared with other streams, possibly on other threads.
 class PackageStream
 {
 public:
@@ -25,6 +26,7 @@ public:
 	void Seek(uint32_t offset);
 	void Skip(uint32_t bytes);
 	uint32_t Tell();
+	uint64_t Size();
 
 	Package* GetPackage() const;
 	int GetVersion() const;
@@ -32,4 +34,12 @@ public:
 private:
 	Package* package;
 	std::shared_ptr<File> file;
+	uint64_t pos = 0;
+
+	// Read-ahead window so the many small reads of the name/import/export tables and property lists don't each become a syscall
+	enum { ReadAheadSize = 64 * 1024 };
+	Array<uint8_t> buffer;
+	uint64_t bufferStart = 0;
+	uint64_t bufferSize = 0;
+	uint64_t fileSize = ~(uint64_t)0;
 };
@@ -4,12 +4,117 @@
 #include "Shadowmap.h"
 #include "UObject/UActor.h"
 #include "Math/coords.h"
+#include "Utils/CpuFeatures.h"
 
-void LightEffect::Run(UActor* light, int width, int height, const vec3* locations, vec3 base, vec3 N, const float* shadowmap, float* result)
+#ifndef NOSSE
+#include <immintrin.h>
+#endif
+
+static void PointLightScalar(int start, int size, const vec3& lightpos, float invRadiusSquared, float angleAttenuation, const float* locationsX, const float* locationsY, const float* locationsZ, const float* shadowmap, float* result)
+{
+	for (int i = start; i < size; i++)
+	{
+		vec3 L = lightpos - vec3(locationsX[i], locationsY[i], locationsZ[i]);
+		float distsqr = dot(L, L) * invRadiusSquared;
+		if (distsqr < 1.0f)
+		{
+			float distanceAttenuation = LightEffect::LightDistanceFalloff(distsqr);
+			result[i] = shadowmap[i] * distanceAttenuation * angleAttenuation;
+		}
+		else
+		{
+			result[i] = 0.0f;
+		}
+	}
+}
+
+#ifndef NOSSE
+
+static void PointLightSSE2(int size, const vec3& lightpos, float invRadiusSquared, float angleAttenuation, const float* locationsX, const float* locationsY, const float* locationsZ, const float* shadowmap, float* result)
+{
+	__m128 lightX = _mm_set1_ps(lightpos.x);
+	__m128 lightY = _mm_set1_ps(lightpos.y);
+	__m128 lightZ = _mm_set1_ps(lightpos.z);
+	__m128 minvRadiusSquared = _mm_set1_ps(invRadiusSquared);
+	__m128 mangleAttenuation = _mm_set1_ps(angleAttenuation);
+	__m128 bias = _mm_set1_ps(1.0f / 4096.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 three = _mm_set1_ps(3.0f);
+
+	int sseend = size / 4 * 4;
+	for (int i = 0; i < sseend; i += 4)
+	{
+		__m128 dx = _mm_sub_ps(lightX, _mm_loadu_ps(locationsX + i));
+		__m128 dy = _mm_sub_ps(lightY, _mm_loadu_ps(locationsY + i));
+		__m128 dz = _mm_sub_ps(lightZ, _mm_loadu_ps(locationsZ + i));
+		__m128 distsqr = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), minvRadiusSquared);
+		__m128 inside = _mm_cmplt_ps(distsqr, one);
+
+		// LightDistanceFalloff
+		__m128 v = _mm_sqrt_ps(_mm_add_ps(distsqr, bias));
+		__m128 v2 = _mm_mul_ps(v, v);
+		__m128 v3 = _mm_mul_ps(v2, v);
+		__m128 distanceAttenuation = _mm_div_ps(_mm_sub_ps(_mm_add_ps(one, _mm_mul_ps(two, v3)), _mm_mul_ps(three, v2)), v);
+
+		__m128 attenuation = _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(shadowmap + i), distanceAttenuation), mangleAttenuation);
+		_mm_storeu_ps(result + i, _mm_and_ps(inside, attenuation));
+	}
+	PointLightScalar(sseend, size, lightpos, invRadiusSquared, angleAttenuation, locationsX, locationsY, locationsZ, shadowmap, result);
+}
+
+SIMD_TARGET_AVX2 static void PointLightAVX2(int size, const vec3& lightpos, float invRadiusSquared, float angleAttenuation, const float* locationsX, const float* locationsY, const float* locationsZ, const float* shadowmap, float* result)
+{
+	__m256 lightX = _mm256_set1_ps(lightpos.x);
+	__m256 lightY = _mm256_set1_ps(lightpos.y);
+	__m256 lightZ = _mm256_set1_ps(lightpos.z);
+	__m256 minvRadiusSquared = _mm256_set1_ps(invRadiusSquared);
+	__m256 mangleAttenuation = _mm256_set1_ps(angleAttenuation);
+	__m256 bias = _mm256_set1_ps(1.0f / 4096.0f);
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 two = _mm256_set1_ps(2.0f);
+	__m256 three = _mm256_set1_ps(3.0f);
+
+	int avxend = size / 8 * 8;
+	for (int i = 0; i < avxend; i += 8)
+	{
+		__m256 dx = _mm256_sub_ps(lightX, _mm256_loadu_ps(locationsX + i));
+		__m256 dy = _mm256_sub_ps(lightY, _mm256_loadu_ps(locationsY + i));
+		__m256 dz = _mm256_sub_ps(lightZ, _mm256_loadu_ps(locationsZ + i));
+		__m256 distsqr = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)), minvRadiusSquared);
+		__m256 inside = _mm256_cmp_ps(distsqr, one, _CMP_LT_OQ);
+
+		// LightDistanceFalloff
+		__m256 v = _mm256_sqrt_ps(_mm256_add_ps(distsqr, bias));
+		__m256 v2 = _mm256_mul_ps(v, v);
+		__m256 v3 = _mm256_mul_ps(v2, v);
+		__m256 distanceAttenuation = _mm256_div_ps(_mm256_sub_ps(_mm256_add_ps(one, _mm256_mul_ps(two, v3)), _mm256_mul_ps(three, v2)), v);
+
+		__m256 attenuation = _mm256_mul_ps(_mm256_mul_ps(_mm256_loadu_ps(shadowmap + i), distanceAttenuation), mangleAttenuation);
+		_mm256_storeu_ps(result + i, _mm256_and_ps(inside, attenuation));
+	}
+	PointLightScalar(avxend, size, lightpos, invRadiusSquared, angleAttenuation, locationsX, locationsY, locationsZ, shadowmap, result);
+}
+
+#endif
+
+LightEffectSource LightEffectSource::FromActor(UActor* light)
+{
+	LightEffectSource source;
+	source.Location = light->Location();
+	source.Rotation = light->Rotation();
+	source.Radius = light->WorldLightRadius();
+	source.Effect = light->LightEffect();
+	source.Cone = light->LightCone();
+	return source;
+}
+
+void LightEffect::Run(const LightEffectSource& light, int width, int height, const float* locationsX, const float* locationsY, const float* locationsZ, vec3 base, vec3 N, const float* shadowmap, float* result)
 {
 	int size = width * height;
+	vec3 lightpos = light.Location;
 
-	float radius = light->WorldLightRadius();
+	float radius = light.Radius;
 	float invRadius = 1.0f / radius;
 	float invRadiusSquared = invRadius * invRadius;
 
@@ -18,12 +123,12 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 //	__m128d base = _mm_
 //	float angleAttenuation = 
 //#else
-	float angleAttenuation = std::abs(dot(light->Location() - base, N) * invRadius);
+	float angleAttenuation = std::abs(dot(lightpos - base, N) * invRadius);
 //#endif
 
 	// To do: implement all the light effects
 
-	switch (light->LightEffect())
+	switch (light.Effect)
 	{
 	case LE_None:
 	case LE_TorchWaver:
@@ -39,26 +144,25 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 	case LE_Disco:
 	case LE_Rotor:
 	case LE_Unused:
-		for (int i = 0; i < size; i++)
+#ifndef NOSSE
+		if (GetSimdLevel() == SimdLevel::AVX2)
 		{
-			vec3 L = light->Location() - locations[i];
-			float distsqr = dot(L, L) * invRadiusSquared;
-			if (distsqr < 1.0f)
-			{
-				float distanceAttenuation = LightDistanceFalloff(distsqr);
-				result[i] = shadowmap[i] * distanceAttenuation * angleAttenuation;
-			}
-			else
-			{
-				result[i] = 0.0f;
-			}
+			PointLightAVX2(size, lightpos, invRadiusSquared, angleAttenuation, locationsX, locationsY, locationsZ, shadowmap, result);
+			break;
+		}
+		else if (GetSimdLevel() == SimdLevel::SSE2)
+		{
+			PointLightSSE2(size, lightpos, invRadiusSquared, angleAttenuation, locationsX, locationsY, locationsZ, shadowmap, result);
+			break;
 		}
+#endif
+		PointLightScalar(0, size, lightpos, invRadiusSquared, angleAttenuation, locationsX, locationsY, locationsZ, shadowmap, result);
 		break;
 
 	case LE_NonIncidence:
 		for (int i = 0; i < size; i++)
 		{
-			vec3 L = light->Location() - locations[i];
+			vec3 L = lightpos - vec3(locationsX[i], locationsY[i], locationsZ[i]);
 			float dist = std::sqrt(dot(L, L)) * invRadius;
 			result[i] = shadowmap[i] * std::max(1.0f - dist, 0.0f);
 		}
@@ -67,7 +171,7 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 	case LE_Cylinder:
 		for (int i = 0; i < size; i++)
 		{
-			vec3 L = light->Location() - locations[i];
+			vec3 L = lightpos - vec3(locationsX[i], locationsY[i], locationsZ[i]);
 			float distsqr = (L.x * L.x + L.y * L.y) * invRadiusSquared;
 			result[i] = shadowmap[i] * std::max(1.0f - distsqr, 0.0f);
 		}
@@ -76,7 +180,7 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 	case LE_Shell:
 		for (int i = 0; i < size; i++)
 		{
-			vec3 L = light->Location() - locations[i];
+			vec3 L = lightpos - vec3(locationsX[i], locationsY[i], locationsZ[i]);
 			float dist = std::sqrt(dot(L, L)) * invRadius;
 			float attenuation = (dist > 0.8f && dist < 1.0f) ? 1.0f - 10.0f * std::abs(dist - 0.9f) : 0.0f;
 			result[i] = shadowmap[i] * attenuation;
@@ -87,13 +191,13 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 	case LE_StaticSpot:
 	{
 		vec3 tmp0, tmp1, tmp2;
-		Coords::Rotation(light->Rotation()).GetAxes(tmp0, tmp1, tmp2);
+		Coords::Rotation(light.Rotation).GetAxes(tmp0, tmp1, tmp2);
 		vec3 spotDir = -tmp0;
-		float lightCosOuterAngle = 1.0f - light->LightCone() * (1.0f / 255.0f);
+		float lightCosOuterAngle = 1.0f - light.Cone * (1.0f / 255.0f);
 		float lightCosInnerAngle = 1.0f;
 		for (int i = 0; i < size; i++)
 		{
-			vec3 L = light->Location() - locations[i];
+			vec3 L = lightpos - vec3(locationsX[i], locationsY[i], locationsZ[i]);
 
 			float distsqr = dot(L, L) * invRadiusSquared;
 			if (distsqr < 1.0f && lightCosOuterAngle < 1.0f)
@@ -121,103 +225,3 @@ void LightEffect::Run(UActor* light, int width, int height, const vec3* location
 		break;
 	}
 }
-
-float LightEffect::VertexLight(UActor* light, const vec3& location, const vec3& N)
-{
-	float radius = light->WorldLightRadius();
-	float invRadius = 1.0f / radius;
-	float invRadiusSquared = invRadius * invRadius;
-
-	float angleAttenuation = std::abs(dot(light->Location() - location, N) * invRadius);
-
-	// To do: implement all the light effects
-
-	switch (light->LightEffect())
-	{
-	case LE_None:
-	case LE_TorchWaver:
-	case LE_FireWaver:
-	case LE_WateryShimmer:
-	case LE_Warp:
-	case LE_OmniBumpMap:
-	case LE_Interference:
-	case LE_SlowWave:
-	case LE_FastWave:
-	case LE_CloudCast:
-	case LE_Shock:
-	case LE_Disco:
-	case LE_Rotor:
-	case LE_Unused:
-		{
-			vec3 L = light->Location() - location;
-			float distsqr = dot(L, L) * invRadiusSquared;
-			if (distsqr < 1.0f)
-			{
-				float distanceAttenuation = LightDistanceFalloff(distsqr);
-				return distanceAttenuation * angleAttenuation;
-			}
-			else
-			{
-				return 0.0f;
-			}
-		}
-		break;
-
-	case LE_NonIncidence:
-		{
-			vec3 L = light->Location() - location;
-			float dist = std::sqrt(dot(L, L)) * invRadius;
-			return std::max(1.0f - dist, 0.0f);
-		}
-		break;
-
-	case LE_Cylinder:
-		{
-			vec3 L = light->Location() - location;
-			float distsqr = (L.x * L.x + L.y * L.y) * invRadiusSquared;
-			return std::max(1.0f - distsqr, 0.0f);
-		}
-		break;
-
-	case LE_Shell:
-		{
-			vec3 L = light->Location() - location;
-			float dist = std::sqrt(dot(L, L)) * invRadius;
-			float attenuation = (dist > 0.8f && dist < 1.0f) ? 1.0f - 10.0f * std::abs(dist - 0.9f) : 0.0f;
-			return attenuation;
-		}
-		break;
-
-	case LE_Spotlight:
-	case LE_StaticSpot:
-	{
-		vec3 tmp0, tmp1, tmp2;
-		Coords::Rotation(light->Rotation()).GetAxes(tmp0, tmp1, tmp2);
-		vec3 spotDir = -tmp0;
-		float lightCosOuterAngle = 1.0f - light->LightCone() * (1.0f / 255.0f);
-		float lightCosInnerAngle = 1.0f;
-		{
-			vec3 L = light->Location() - location;
-
-			float distsqr = dot(L, L) * invRadiusSquared;
-			if (distsqr < 1.0f && lightCosOuterAngle < 1.0f)
-			{
-				float distanceAttenuation = LightDistanceFalloff(distsqr);
-				float cosDir = dot(normalize(L), spotDir);
-				float spotAttenuation = 1.0f - std::min((1.0f - cosDir) / (1.0f - lightCosOuterAngle), 1.0f);
-				spotAttenuation = spotAttenuation * spotAttenuation;
-				return distanceAttenuation * angleAttenuation * spotAttenuation;
-			}
-			else
-			{
-				return 0.0f;
-			}
-		}
-		break;
-	}
-
-	case LE_Searchlight:
-	default:
-		return 0.0f;
-	}
-}
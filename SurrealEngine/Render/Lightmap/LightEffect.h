@@ -2,15 +2,27 @@
 
 #include <cmath>
 #include "Math/vec.h"
+#include "Math/rotator.h"
 
 class UActor;
 
+// The light actor properties used by the light effects. Copied on the game thread so that lightmaps can be built by worker threads.
+struct LightEffectSource
+{
+	vec3 Location = vec3(0.0f);
+	Rotator Rotation;
+	float Radius = 0.0f;
+	uint8_t Effect = 0;
+	uint8_t Cone = 0;
+
+	static LightEffectSource FromActor(UActor* light);
+};
+
 class LightEffect
 {
 public:
-	void Run(UActor* light, int width, int height, const vec3* locations, vec3 base, vec3 normal, const float* shadowmap, float* result);
-
-	static float VertexLight(UActor* light, const vec3& location, const vec3& normal);
+	// Calculates the attenuation of the light for each texel. The texel world locations are passed as separate x, y and z planes.
+	void Run(const LightEffectSource& light, int width, int height, const float* locationsX, const float* locationsY, const float* locationsZ, vec3 base, vec3 normal, const float* shadowmap, float* result);
 
 	static float LightDistanceFalloff(float distsqr)
 	{
@@ -0,0 +1,206 @@
+#include "Precomp.h"
+#include "LightmapAtlas.h"
+#include "UObject/ULevel.h"
+#include <cmath>
+
+LightmapAtlas::LightmapAtlas(TextureFormat format, int bytesPerTexel, int pageSize, uint64_t cacheIDTag) : Format(format), BytesPerTexel(bytesPerTexel), PageSize(pageSize), CacheIDTag(cacheIDTag)
+{
+}
+
+LightmapAtlas::Entry* LightmapAtlas::Find(uint64_t key)
+{
+	auto it = Entries.find(key);
+	return it != Entries.end() ? &it->second : nullptr;
+}
+
+LightmapAtlas::Entry* LightmapAtlas::Insert(uint64_t key, int width, int height)
+{
+	int x = 0, y = 0;
+	int pageIndex = -1;
+	for (int i = 0; i < (int)Pages.size(); i++)
+	{
+		if (Allocate(Pages[i], width + 2, height + 2, x, y))
+		{
+			pageIndex = i;
+			break;
+		}
+	}
+
+	if (pageIndex == -1)
+	{
+		int size = std::max(PageSize, std::max(width, height) + 2);
+		if (size == PageSize && (Pages.size() + 1) * (size_t)PageSize * PageSize * BytesPerTexel > MemoryBudget)
+			pageIndex = EvictPage();
+		if (pageIndex == -1)
+			pageIndex = AddPage(size);
+		Allocate(Pages[pageIndex], width + 2, height + 2, x, y);
+	}
+
+	Pages[pageIndex].Keys.push_back(key);
+
+	Entry& entry = Entries[key];
+	entry.Page = pageIndex;
+	entry.X = x + 1;
+	entry.Y = y + 1;
+	entry.Width = width;
+	entry.Height = height;
+	entry.UpdateFrame = -1;
+	return &entry;
+}
+
+bool LightmapAtlas::Allocate(Page& page, int width, int height, int& x, int& y)
+{
+	int pageWidth = page.Mip.Width;
+	int pageHeight = page.Mip.Height;
+
+	// Pick the row wasting the least height
+	Shelf* best = nullptr;
+	for (Shelf& shelf : page.Shelves)
+	{
+		if (shelf.Height >= height && shelf.X + width <= pageWidth && (!best || shelf.Height < best->Height))
+			best = &shelf;
+	}
+
+	if (!best || best->Height > height * 2)
+	{
+		if (page.NextShelfY + height <= pageHeight && width <= pageWidth)
+		{
+			Shelf shelf;
+			shelf.Y = page.NextShelfY;
+			shelf.Height = height;
+			page.NextShelfY += height;
+			page.Shelves.push_back(shelf);
+			best = &page.Shelves.back();
+		}
+		else if (!best)
+		{
+			return false;
+		}
+	}
+
+	x = best->X;
+	y = best->Y;
+	best->X += width;
+	return true;
+}
+
+int LightmapAtlas::AddPage(int size)
+{
+	Page page;
+	page.Mip.Width = size;
+	page.Mip.Height = size;
+	page.Mip.Data.resize((size_t)size * size * BytesPerTexel);
+	page.CacheID = (((uint64_t)Pages.size()) << 8) | CacheIDTag;
+	Pages.push_back(std::move(page));
+	return (int)Pages.size() - 1;
+}
+
+int LightmapAtlas::EvictPage()
+{
+	// Pages used by the current frame can't be reused since their draws have not been submitted yet
+	int pageIndex = -1;
+	for (int i = 0; i < (int)Pages.size(); i++)
+	{
+		const Page& page = Pages[i];
+		if (page.Mip.Width == PageSize && page.LastUsedFrame != CurrentFrame && (pageIndex == -1 || page.LastUsedFrame < Pages[pageIndex].LastUsedFrame))
+			pageIndex = i;
+	}
+
+	if (pageIndex != -1)
+	{
+		Page& page = Pages[pageIndex];
+		for (uint64_t key : page.Keys)
+			Entries.erase(key);
+		page.Keys.clear();
+		page.Shelves.clear();
+		page.NextShelfY = 0;
+		page.NeedsUpload = true;
+	}
+	return pageIndex;
+}
+
+void LightmapAtlas::Write(const Entry* entry, const void* texels)
+{
+	if (entry->Width <= 0 || entry->Height <= 0)
+		return;
+
+	Page& page = Pages[entry->Page];
+	size_t pitch = (size_t)page.Mip.Width * BytesPerTexel;
+	size_t rowSize = (size_t)entry->Width * BytesPerTexel;
+	uint8_t* dest = page.Mip.Data.data() + (entry->X - 1) * BytesPerTexel + (entry->Y - 1) * pitch;
+	const uint8_t* src = (const uint8_t*)texels;
+
+	for (int y = -1; y <= entry->Height; y++)
+	{
+		const uint8_t* line = src + clamp(y, 0, entry->Height - 1) * rowSize;
+		memcpy(dest, line, BytesPerTexel);
+		memcpy(dest + BytesPerTexel, line, rowSize);
+		memcpy(dest + BytesPerTexel + rowSize, line + rowSize - BytesPerTexel, BytesPerTexel);
+		dest += pitch;
+	}
+}
+
+FTextureInfo LightmapAtlas::GetTextureInfo(const Entry* entry, const LightMapIndex& lmindex)
+{
+	Page& page = Pages[entry->Page];
+	page.LastUsedFrame = CurrentFrame;
+
+	FTextureInfo texinfo = GetPageTextureInfo(entry);
+	page.NeedsUpload = false;
+	texinfo.UScale = lmindex.UScale;
+	texinfo.VScale = lmindex.VScale;
+	texinfo.Pan = { lmindex.PanX - entry->X * lmindex.UScale, lmindex.PanY - entry->Y * lmindex.VScale };
+	return texinfo;
+}
+
+FTextureInfo LightmapAtlas::GetPageTextureInfo(const Entry* entry) const
+{
+	const Page& page = Pages[entry->Page];
+
+	FTextureInfo texinfo;
+	texinfo.CacheID = page.CacheID;
+	texinfo.bRealtimeChanged = page.NeedsUpload;
+	texinfo.Format = Format;
+	texinfo.Mips = const_cast<UnrealMipmap*>(&page.Mip);
+	texinfo.NumMips = 1;
+	texinfo.USize = page.Mip.Width;
+	texinfo.VSize = page.Mip.Height;
+	return texinfo;
+}
+
+void LightmapAtlas::Clear()
+{
+	Pages.clear();
+	Entries.clear();
+}
+
+size_t LightmapAtlas::GetMemoryUsage() const
+{
+	size_t bytes = 0;
+	for (const Page& page : Pages)
+		bytes += page.Mip.Data.size();
+	return bytes;
+}
+
+uint32_t PackRGB9E5(float r, float g, float b)
+{
+	// See the EXT_texture_shared_exponent specification
+	const float maxValue = 65408.0f; // (2^9 - 1) / 2^9 * 2^(31 - 15)
+	r = clamp(r, 0.0f, maxValue);
+	g = clamp(g, 0.0f, maxValue);
+	b = clamp(b, 0.0f, maxValue);
+
+	float maxComponent = std::max(std::max(r, g), b);
+	int exponent = std::max(-16, (int)std::floor(std::log2(std::max(maxComponent, 1.0e-30f)))) + 1 + 15;
+	float scale = std::ldexp(1.0f, exponent - 15 - 9);
+	if ((int)std::floor(maxComponent / scale + 0.5f) == 512)
+	{
+		scale *= 2.0f;
+		exponent++;
+	}
+
+	uint32_t red = (uint32_t)std::floor(r / scale + 0.5f);
+	uint32_t green = (uint32_t)std::floor(g / scale + 0.5f);
+	uint32_t blue = (uint32_t)std::floor(b / scale + 0.5f);
+	return (((uint32_t)exponent) << 27) | (blue << 18) | (green << 9) | red;
+}
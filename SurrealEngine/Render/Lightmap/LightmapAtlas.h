@@ -0,0 +1,83 @@
+#pragma once
+
+#include "UObject/UTexture.h"
+#include "RenderDevice/RenderDevice.h"
+#include <unordered_map>
+
+class LightMapIndex;
+
+// Packs lightmaps (or fogmaps) into large texture pages so that surfaces share texture bindings.
+//
+// Each map gets a one texel border with its edges repeated so bilinear filtering does not bleed
+// into its neighbours. Pages are filled using rows of similar height. When the atlas reaches its
+// memory budget the least recently used page is emptied and reused.
+class LightmapAtlas
+{
+public:
+	struct Entry
+	{
+		int Page = -1;
+		int X = 0; // Location of the map inside the border
+		int Y = 0;
+		int Width = 0;
+		int Height = 0;
+		int UpdateFrame = -1; // For the caller to track when the content was last written
+	};
+
+	LightmapAtlas(TextureFormat format, int bytesPerTexel, int pageSize, uint64_t cacheIDTag);
+
+	Entry* Find(uint64_t key);
+	Entry* Insert(uint64_t key, int width, int height);
+
+	// Copies width * height tightly packed texels into the entry and its border
+	void Write(const Entry* entry, const void* texels);
+
+	// Texture info for drawing the map in the entry using the pan and scale of the lightmap index
+	FTextureInfo GetTextureInfo(const Entry* entry, const LightMapIndex& lmindex);
+
+	// Texture info of the page an entry lives on, for updating the area written by Write.
+	// bRealtimeChanged is set if the whole page will be uploaded the next time it is drawn anyway.
+	FTextureInfo GetPageTextureInfo(const Entry* entry) const;
+
+	void SetFrame(int frame) { CurrentFrame = frame; }
+	void SetMemoryBudget(size_t bytes) { MemoryBudget = bytes; }
+	void Clear();
+
+	size_t GetMemoryUsage() const;
+	int GetPageCount() const { return (int)Pages.size(); }
+
+private:
+	struct Shelf
+	{
+		int Y = 0;
+		int Height = 0;
+		int X = 0;
+	};
+
+	struct Page
+	{
+		UnrealMipmap Mip;
+		uint64_t CacheID = 0;
+		Array<Shelf> Shelves;
+		int NextShelfY = 0;
+		int LastUsedFrame = -1;
+		bool NeedsUpload = false;
+		Array<uint64_t> Keys;
+	};
+
+	bool Allocate(Page& page, int width, int height, int& x, int& y);
+	int AddPage(int size);
+	int EvictPage();
+
+	TextureFormat Format;
+	int BytesPerTexel = 0;
+	int PageSize = 0;
+	uint64_t CacheIDTag = 0;
+	size_t MemoryBudget = 64 * 1024 * 1024;
+	int CurrentFrame = 0;
+	Array<Page> Pages;
+	std::unordered_map<uint64_t, Entry> Entries;
+};
+
+// Packs a color into the RGB9E5 shared exponent format used for lightmap textures
+uint32_t PackRGB9E5(float r, float g, float b);
@@ -5,8 +5,35 @@
 #include "UObject/UActor.h"
 #include "RenderDevice/RenderDevice.h"
 #include "Math/hsb.h"
+#include "Utils/CpuFeatures.h"
 
-void LightmapBuilder::Setup(UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor)
+#ifndef NOSSE
+#include <immintrin.h>
+#endif
+
+LightmapLights LightmapBuilder::GetLights(UModel* model, int lightMap, UZoneInfo* zoneActor)
+{
+	LightmapLights lights;
+	lights.AmbientColor = hsbtorgb(zoneActor->AmbientHue(), zoneActor->AmbientSaturation(), zoneActor->AmbientBrightness()); // To do: is this the correct scale?
+	// To do: is there more ambient light than just from the zone?
+
+	const LightMapIndex& lmindex = model->LightMap[lightMap];
+	if (lmindex.LightActors >= 0)
+	{
+		for (UActor** lightlist = &model->Lights[lmindex.LightActors]; *lightlist != nullptr; lightlist++)
+		{
+			UActor* light = *lightlist;
+			LightmapLight entry;
+			entry.Source = LightEffectSource::FromActor(light);
+			entry.Color = hsbtorgb(light->LightHue(), light->LightSaturation(), light->LightBrightness());
+			entry.On = light->LightType() != LT_None && light->LightBrightness() > 0;
+			lights.Lights.push_back(entry);
+		}
+	}
+	return lights;
+}
+
+void LightmapBuilder::Setup(UModel* model, const Coords& mapCoords, int lightMap, const LightmapLights& lights)
 {
 	const LightMapIndex& lmindex = model->LightMap[lightMap];
 
@@ -18,10 +45,18 @@ void LightmapBuilder::Setup(UModel* model, const Coords& mapCoords, int lightMap
 	// Stop allocations over time by building up a reserve
 
 	size_t size = (size_t)width * height;
-	if (points.size() < size)
-		points.resize(size);
-	if (lightcolors.size() < size)
-		lightcolors.resize(size);
+	if (pointsX.size() < size)
+	{
+		pointsX.resize(size);
+		pointsY.resize(size);
+		pointsZ.resize(size);
+	}
+	if (red.size() < size)
+	{
+		red.resize(size);
+		green.resize(size);
+		blue.resize(size);
+	}
 	if (illuminationmap.size() < size)
 		illuminationmap.resize(size);
 
@@ -29,11 +64,10 @@ void LightmapBuilder::Setup(UModel* model, const Coords& mapCoords, int lightMap
 
 	// Initialize lightmap with the ambient color
 
-	vec3 ambientColor = hsbtorgb(zoneActor->AmbientHue(), zoneActor->AmbientSaturation(), zoneActor->AmbientBrightness()); // To do: is this the correct scale?
-	// To do: is there more ambient light than just from the zone?
-
-	for (vec3& c : lightcolors)
-		c = ambientColor;
+	vec3 ambientColor = lights.AmbientColor;
+	std::fill(red.begin(), red.begin() + size, ambientColor.r);
+	std::fill(green.begin(), green.begin() + size, ambientColor.g);
+	std::fill(blue.begin(), blue.begin() + size, ambientColor.b);
 
 	// To do: how does polyflags affect the lightmap (if at all)?
 
@@ -41,39 +75,89 @@ void LightmapBuilder::Setup(UModel* model, const Coords& mapCoords, int lightMap
 	//bool isTranslucent = (surface.PolyFlags & PF_Translucent) == PF_Translucent;
 }
 
-void LightmapBuilder::AddStaticLights(UModel* model, int lightMap)
+void LightmapBuilder::AddStaticLights(UModel* model, int lightMap, const LightmapLights& lights)
 {
-	size_t count = (size_t)width * height;
-
-	const LightMapIndex& lmindex = model->LightMap[lightMap];
-	if (lmindex.LightActors >= 0)
+	for (int lightindex = 0; lightindex < (int)lights.Lights.size(); lightindex++)
 	{
-		UActor** lightlist = &model->Lights[lmindex.LightActors];
-		for (int lightindex = 0; lightlist[lightindex] != nullptr; lightindex++)
+		const LightmapLight& light = lights.Lights[lightindex];
+		if (light.On)
 		{
-			UActor* light = lightlist[lightindex];
-			if (light->LightType() != LT_None && light->LightBrightness() > 0)
-			{
-				Shadow.Load(model, lightMap, lightindex);
-				Effect.Run(light, width, height, WorldLocations(), base, WorldNormal(), Shadow.Pixels(), illuminationmap.data());
-
-				vec3 lightcolor = hsbtorgb(light->LightHue(), light->LightSaturation(), light->LightBrightness());
-
-				const float* src = illuminationmap.data();
-				vec3* dest = lightcolors.data();
-				for (size_t i = 0; i < count; i++)
-				{
-					vec3 color = src[i] * lightcolor;
-					color.r = std::min(color.r, 1.0f);
-					color.g = std::min(color.g, 1.0f);
-					color.b = std::min(color.b, 1.0f);
-					dest[i] += color;
-				}
-			}
+			CalcLightIllumination(model, lightMap, lightindex, light.Source, illuminationmap.data());
+			AddLightIllumination(illuminationmap.data(), light.Color);
 		}
 	}
 }
 
+static void AddLightScalar(size_t start, size_t count, const float* src, const vec3& lightcolor, float* red, float* green, float* blue)
+{
+	for (size_t i = start; i < count; i++)
+	{
+		red[i] += std::min(src[i] * lightcolor.r, 1.0f);
+		green[i] += std::min(src[i] * lightcolor.g, 1.0f);
+		blue[i] += std::min(src[i] * lightcolor.b, 1.0f);
+	}
+}
+
+#ifndef NOSSE
+
+static void AddLightSSE2(size_t count, const float* src, const vec3& lightcolor, float* red, float* green, float* blue)
+{
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 lightR = _mm_set1_ps(lightcolor.r);
+	__m128 lightG = _mm_set1_ps(lightcolor.g);
+	__m128 lightB = _mm_set1_ps(lightcolor.b);
+	size_t sseend = count / 4 * 4;
+	for (size_t i = 0; i < sseend; i += 4)
+	{
+		__m128 illumination = _mm_loadu_ps(src + i);
+		_mm_storeu_ps(red + i, _mm_add_ps(_mm_loadu_ps(red + i), _mm_min_ps(_mm_mul_ps(illumination, lightR), one)));
+		_mm_storeu_ps(green + i, _mm_add_ps(_mm_loadu_ps(green + i), _mm_min_ps(_mm_mul_ps(illumination, lightG), one)));
+		_mm_storeu_ps(blue + i, _mm_add_ps(_mm_loadu_ps(blue + i), _mm_min_ps(_mm_mul_ps(illumination, lightB), one)));
+	}
+	AddLightScalar(sseend, count, src, lightcolor, red, green, blue);
+}
+
+SIMD_TARGET_AVX2 static void AddLightAVX2(size_t count, const float* src, const vec3& lightcolor, float* red, float* green, float* blue)
+{
+	__m256 one = _mm256_set1_ps(1.0f);
+	__m256 lightR = _mm256_set1_ps(lightcolor.r);
+	__m256 lightG = _mm256_set1_ps(lightcolor.g);
+	__m256 lightB = _mm256_set1_ps(lightcolor.b);
+	size_t avxend = count / 8 * 8;
+	for (size_t i = 0; i < avxend; i += 8)
+	{
+		__m256 illumination = _mm256_loadu_ps(src + i);
+		_mm256_storeu_ps(red + i, _mm256_add_ps(_mm256_loadu_ps(red + i), _mm256_min_ps(_mm256_mul_ps(illumination, lightR), one)));
+		_mm256_storeu_ps(green + i, _mm256_add_ps(_mm256_loadu_ps(green + i), _mm256_min_ps(_mm256_mul_ps(illumination, lightG), one)));
+		_mm256_storeu_ps(blue + i, _mm256_add_ps(_mm256_loadu_ps(blue + i), _mm256_min_ps(_mm256_mul_ps(illumination, lightB), one)));
+	}
+	AddLightScalar(avxend, count, src, lightcolor, red, green, blue);
+}
+
+#endif
+
+void LightmapBuilder::CalcLightIllumination(UModel* model, int lightMap, int lightindex, const LightEffectSource& light, float* result)
+{
+	Shadow.Load(model, lightMap, lightindex);
+	Effect.Run(light, width, height, pointsX.data(), pointsY.data(), pointsZ.data(), base, WorldNormal(), Shadow.Pixels(), result);
+}
+
+void LightmapBuilder::AddLightIllumination(const float* src, const vec3& lightcolor)
+{
+	size_t count = (size_t)width * height;
+
+#ifndef NOSSE
+	switch (GetSimdLevel())
+	{
+	case SimdLevel::AVX2: AddLightAVX2(count, src, lightcolor, red.data(), green.data(), blue.data()); return;
+	case SimdLevel::SSE2: AddLightSSE2(count, src, lightcolor, red.data(), green.data(), blue.data()); return;
+	default: break;
+	}
+#endif
+
+	AddLightScalar(0, count, src, lightcolor, red.data(), green.data(), blue.data());
+}
+
 void LightmapBuilder::CalcWorldLocations(Coords MapCoords, const LightMapIndex& lmindex)
 {
 	// Note: this could be simplified a lot for better performance
@@ -127,11 +211,16 @@ void LightmapBuilder::CalcWorldLocations(Coords MapCoords, const LightMapIndex&
 			std::swap(p0, p1);
 		}
 
-		vec3* dest = &points[y * width];
+		float* destX = &pointsX[y * width];
+		float* destY = &pointsY[y * width];
+		float* destZ = &pointsZ[y * width];
 		for (int i = 0; i < width; i++)
 		{
 			float t = (i + 0.5f - x0) / (x1 - x0);
-			dest[i] = mix(p0, p1, t);
+			vec3 p = mix(p0, p1, t);
+			destX[i] = p.x;
+			destY[i] = p.y;
+			destZ[i] = p.z;
 		}
 	}
 }
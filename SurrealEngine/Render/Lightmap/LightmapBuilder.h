@@ -9,29 +9,57 @@ class LightMapIndex;
 class UModel;
 class UZoneInfo;
 class Coords;
+class UActor;
 struct Poly;
 
+struct LightmapLight
+{
+	LightEffectSource Source;
+	vec3 Color = vec3(0.0f);
+	bool On = false;
+};
+
+// The zone and light properties a lightmap is built from
+struct LightmapLights
+{
+	vec3 AmbientColor = vec3(0.0f);
+	Array<LightmapLight> Lights; // In the order of the light list of the lightmap
+};
+
 class LightmapBuilder
 {
 public:
-	void Setup(UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor);
-	void AddStaticLights(UModel* model, int lightMap);
+	// Copies the properties of the lights touching the lightmap. Must be called on the game thread.
+	static LightmapLights GetLights(UModel* model, int lightMap, UZoneInfo* zoneActor);
+
+	void Setup(UModel* model, const Coords& mapCoords, int lightMap, const LightmapLights& lights);
+	void AddStaticLights(UModel* model, int lightMap, const LightmapLights& lights);
+
+	// Attenuation of one light in the light list of the lightmap, before its color is applied. Setup must have been called first.
+	void CalcLightIllumination(UModel* model, int lightMap, int lightindex, const LightEffectSource& light, float* result);
+
+	// Adds a light using an illumination buffer from CalcLightIllumination
+	void AddLightIllumination(const float* illumination, const vec3& lightcolor);
 
 	int Width() const { return width; }
 	int Height() const { return height; }
-	const vec3* Pixels() const { return lightcolors.data(); }
+
+	// Light colors stored as separate red, green and blue planes of Width() * Height() floats
+	const float* Red() const { return red.data(); }
+	const float* Green() const { return green.data(); }
+	const float* Blue() const { return blue.data(); }
 
 private:
-	const vec3* WorldLocations() const { return points.data(); }
 	const vec3& WorldNormal() const { return normal; }
 
 	void CalcWorldLocations(Coords MapCoords, const LightMapIndex& lmindex);
 
 	int width = 0;
 	int height = 0;
-	Array<vec3> lightcolors;
+	Array<float> red, green, blue;
 
-	Array<vec3> points;
+	// World locations of the texels, stored as separate x, y and z planes so the light effects can process several texels at once
+	Array<float> pointsX, pointsY, pointsZ;
 	vec3 normal;
 	vec3 base;
 
@@ -3,6 +3,135 @@
 #include "Shadowmap.h"
 #include "Math/vec.h"
 #include "UObject/ULevel.h"
+#include "Utils/CpuFeatures.h"
+
+#ifndef NOSSE
+#include <immintrin.h>
+#endif
+
+// The 3x3 gaussian blur is separable: 0.25, 0.5, 0.25 horizontally and 0.5, 1.0, 0.5 vertically
+
+static void UnpackRowScalar(int start, int width, const uint8_t* bits, float* line)
+{
+	for (int x = start; x < width; x++)
+	{
+		bool shadowtest = (bits[x >> 3] & (1 << (x & 7))) != 0;
+		line[x] = (float)shadowtest;
+	}
+}
+
+static void BlurRowScalar(int start, int end, int width, const float* src, float* dest)
+{
+	for (int x = start; x < end; x++)
+	{
+		float left = src[std::max(x - 1, 0)];
+		float right = src[std::min(x + 1, width - 1)];
+		dest[x] = left * 0.25f + src[x] * 0.5f + right * 0.25f;
+	}
+}
+
+static void BlurColumnScalar(int start, int width, const float* above, const float* center, const float* below, float* dest)
+{
+	for (int x = start; x < width; x++)
+	{
+		dest[x] = above[x] * 0.5f + center[x] + below[x] * 0.5f;
+	}
+}
+
+#ifndef NOSSE
+
+static void UnpackRowSSE2(int width, const uint8_t* bits, float* line)
+{
+	__m128i masklo = _mm_setr_epi32(1, 2, 4, 8);
+	__m128i maskhi = _mm_setr_epi32(16, 32, 64, 128);
+	__m128 one = _mm_set1_ps(1.0f);
+	int sseend = width / 8 * 8;
+	for (int x = 0; x < sseend; x += 8)
+	{
+		__m128i b = _mm_set1_epi32(bits[x >> 3]);
+		__m128 lo = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, masklo), masklo));
+		__m128 hi = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(b, maskhi), maskhi));
+		_mm_storeu_ps(line + x, _mm_and_ps(lo, one));
+		_mm_storeu_ps(line + x + 4, _mm_and_ps(hi, one));
+	}
+	UnpackRowScalar(sseend, width, bits, line);
+}
+
+static void BlurRowSSE2(int width, const float* src, float* dest)
+{
+	BlurRowScalar(0, 1, width, src, dest);
+	__m128 quarter = _mm_set1_ps(0.25f);
+	__m128 half = _mm_set1_ps(0.5f);
+	int sseend = 1 + std::max(width - 2, 0) / 4 * 4;
+	for (int x = 1; x < sseend; x += 4)
+	{
+		__m128 left = _mm_loadu_ps(src + x - 1);
+		__m128 center = _mm_loadu_ps(src + x);
+		__m128 right = _mm_loadu_ps(src + x + 1);
+		_mm_storeu_ps(dest + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(left, quarter), _mm_mul_ps(center, half)), _mm_mul_ps(right, quarter)));
+	}
+	BlurRowScalar(sseend, width, width, src, dest);
+}
+
+static void BlurColumnSSE2(int width, const float* above, const float* center, const float* below, float* dest)
+{
+	__m128 half = _mm_set1_ps(0.5f);
+	int sseend = width / 4 * 4;
+	for (int x = 0; x < sseend; x += 4)
+	{
+		__m128 a = _mm_loadu_ps(above + x);
+		__m128 c = _mm_loadu_ps(center + x);
+		__m128 b = _mm_loadu_ps(below + x);
+		_mm_storeu_ps(dest + x, _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, half), c), _mm_mul_ps(b, half)));
+	}
+	BlurColumnScalar(sseend, width, above, center, below, dest);
+}
+
+SIMD_TARGET_AVX2 static void UnpackRowAVX2(int width, const uint8_t* bits, float* line)
+{
+	__m256i mask = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+	__m256 one = _mm256_set1_ps(1.0f);
+	int avxend = width / 8 * 8;
+	for (int x = 0; x < avxend; x += 8)
+	{
+		__m256i b = _mm256_set1_epi32(bits[x >> 3]);
+		__m256 set = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(b, mask), mask));
+		_mm256_storeu_ps(line + x, _mm256_and_ps(set, one));
+	}
+	UnpackRowScalar(avxend, width, bits, line);
+}
+
+SIMD_TARGET_AVX2 static void BlurRowAVX2(int width, const float* src, float* dest)
+{
+	BlurRowScalar(0, 1, width, src, dest);
+	__m256 quarter = _mm256_set1_ps(0.25f);
+	__m256 half = _mm256_set1_ps(0.5f);
+	int avxend = 1 + std::max(width - 2, 0) / 8 * 8;
+	for (int x = 1; x < avxend; x += 8)
+	{
+		__m256 left = _mm256_loadu_ps(src + x - 1);
+		__m256 center = _mm256_loadu_ps(src + x);
+		__m256 right = _mm256_loadu_ps(src + x + 1);
+		_mm256_storeu_ps(dest + x, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(left, quarter), _mm256_mul_ps(center, half)), _mm256_mul_ps(right, quarter)));
+	}
+	BlurRowScalar(avxend, width, width, src, dest);
+}
+
+SIMD_TARGET_AVX2 static void BlurColumnAVX2(int width, const float* above, const float* center, const float* below, float* dest)
+{
+	__m256 half = _mm256_set1_ps(0.5f);
+	int avxend = width / 8 * 8;
+	for (int x = 0; x < avxend; x += 8)
+	{
+		__m256 a = _mm256_loadu_ps(above + x);
+		__m256 c = _mm256_loadu_ps(center + x);
+		__m256 b = _mm256_loadu_ps(below + x);
+		_mm256_storeu_ps(dest + x, _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(a, half), c), _mm256_mul_ps(b, half)));
+	}
+	BlurColumnScalar(avxend, width, above, center, below, dest);
+}
+
+#endif
 
 void Shadowmap::Load(UModel* model, int lightMap, int lightindex)
 {
@@ -20,41 +149,57 @@ void Shadowmap::Load(UModel* model, int lightMap, int lightindex)
 		tempbuf.resize(size);
 	this->width = width;
 	this->height = height;
+	if (size == 0)
+		return;
+
+	SimdLevel simd = GetSimdLevel();
 
 	// Convert bits to floats that are easier to work with
 
 	const uint8_t* bits = model->LightBits.data() + lmindex.DataOffset + lightindex * pitch * height;
 	for (int y = 0; y < height; y++)
 	{
-		float* line = &tempbuf[y * width];
-		for (int x = 0; x < width; x++)
-		{
-			bool shadowtest = (bits[x >> 3] & (1 << (x & 7))) != 0;
-			line[x] = (float)shadowtest;
-		}
+		float* line = &pixels[y * width];
+#ifndef NOSSE
+		if (simd == SimdLevel::AVX2)
+			UnpackRowAVX2(width, bits, line);
+		else if (simd == SimdLevel::SSE2)
+			UnpackRowSSE2(width, bits, line);
+		else
+#endif
+			UnpackRowScalar(0, width, bits, line);
 		bits += pitch;
 	}
 
-	// Apply 3x3 gaussian blur
-	static const float weights[9] = { 0.125f, 0.25f, 0.125f, 0.25f, 0.50f, 0.25f, 0.125f, 0.25f, 0.125f };
-	float* dest = pixels.data();
-	const float* src = tempbuf.data();
-	for (int y = 0; y < height; y++, dest += width, src += width)
-	{
-		for (int x = 0; x < width; x++)
-		{
-			float value = 0.0f;
-			for (int yy = -1; yy <= 1; yy++)
-			{
-				int yyy = clamp(y + yy, 0, height - 1) - y;
-				for (int xx = -1; xx <= 1; xx++)
-				{
-					int xxx = clamp(x + xx, 0, width - 1);
-					value += src[yyy * width + xxx] * weights[4 + xx + yy * 3];
-				}
-			}
-
-			dest[x] = value;
-		}
+	// Apply 3x3 gaussian blur, first horizontally into tempbuf and then vertically back into pixels
+
+	for (int y = 0; y < height; y++)
+	{
+		const float* src = &pixels[y * width];
+		float* dest = &tempbuf[y * width];
+#ifndef NOSSE
+		if (simd == SimdLevel::AVX2)
+			BlurRowAVX2(width, src, dest);
+		else if (simd == SimdLevel::SSE2)
+			BlurRowSSE2(width, src, dest);
+		else
+#endif
+			BlurRowScalar(0, width, width, src, dest);
+	}
+
+	for (int y = 0; y < height; y++)
+	{
+		const float* above = &tempbuf[std::max(y - 1, 0) * width];
+		const float* center = &tempbuf[y * width];
+		const float* below = &tempbuf[std::min(y + 1, height - 1) * width];
+		float* dest = &pixels[y * width];
+#ifndef NOSSE
+		if (simd == SimdLevel::AVX2)
+			BlurColumnAVX2(width, above, center, below, dest);
+		else if (simd == SimdLevel::SSE2)
+			BlurColumnSSE2(width, above, center, below, dest);
+		else
+#endif
+			BlurColumnScalar(0, width, above, center, below, dest);
 	}
 }
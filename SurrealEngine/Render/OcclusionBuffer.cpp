@@ -0,0 +1,380 @@
+#include "Precomp.h"
+#include "OcclusionBuffer.h"
+#include "Math/bbox.h"
+
+#ifndef NOSSE
+#include <immintrin.h>
+#endif
+
+namespace
+{
+	// Keeps rounding errors from turning a partially covered cell into a fully covered one
+	const float CellEpsilon = 0.001f;
+}
+
+OcclusionBuffer::OcclusionBuffer()
+{
+	SetResolution(640, 360);
+}
+
+void OcclusionBuffer::SetResolution(int width, int height)
+{
+	Width = clamp(width, 1, 4096);
+	Height = clamp(height, 1, 4096);
+	WordsPerRow = (Width + 63) / 64;
+	LastWordPadding = (Width % 64) ? ~0ULL << (Width % 64) : 0;
+	Mask.resize((size_t)WordsPerRow * Height);
+	FullWords.resize(Height);
+	BoundaryLeft.resize(Height + 1);
+	BoundaryRight.resize(Height + 1);
+}
+
+void OcclusionBuffer::Setup(const mat4& world_to_projection)
+{
+	WorldToProjection = world_to_projection;
+	FrustumClip = FrustumPlanes(world_to_projection);
+
+	std::fill(Mask.begin(), Mask.end(), 0);
+	std::fill(FullWords.begin(), FullWords.end(), 0);
+	if (LastWordPadding)
+	{
+		for (int y = 0; y < Height; y++)
+			Mask[(size_t)y * WordsPerRow + WordsPerRow - 1] = LastWordPadding;
+	}
+}
+
+bool OcclusionBuffer::CheckSurface(const vec3* vertices, uint32_t count, bool solid)
+{
+	if (count < 3)
+		return false;
+
+	numSurfs++;
+	numTris += count - 2;
+
+	if (ClipInput.size() < count + 8)
+	{
+		ClipInput.resize(count + 8);
+		ClipOutput.resize(count + 8);
+	}
+
+	for (uint32_t i = 0; i < count; i++)
+		ClipInput[i] = WorldToProjection * vec4(vertices[i], 1.0f);
+
+	int clipcount = ClipPolygon((int)count);
+	if (clipcount < 3)
+		return false;
+
+	// Map to the cells of the buffer
+	float halfwidth = Width * 0.5f;
+	float halfheight = Height * 0.5f;
+	for (int i = 0; i < clipcount; i++)
+	{
+		vec4& v = ClipInput[i];
+		float rcpw = 1.0f / v.w;
+		v.x = halfwidth * (1.0f + v.x * rcpw);
+		v.y = halfheight * (1.0f - v.y * rcpw);
+	}
+
+	return DrawPolygon(clipcount, solid);
+}
+
+int OcclusionBuffer::ClipPolygon(int count)
+{
+	// Clip so that the following is true for all vertices:
+	// -v.w <= v.x <= v.w
+	// -v.w <= v.y <= v.w
+	// -v.w <= v.z <= v.w
+
+	auto clipdistance = [](const vec4& v, int plane) -> float
+	{
+		switch (plane)
+		{
+		default:
+		case 0: return v.x + v.w;
+		case 1: return v.w - v.x;
+		case 2: return v.y + v.w;
+		case 3: return v.w - v.y;
+		case 4: return v.z + v.w;
+		case 5: return v.w - v.z;
+		}
+	};
+
+	for (int plane = 0; plane < 6; plane++)
+	{
+		bool allInside = true;
+		for (int i = 0; i < count; i++)
+		{
+			if (clipdistance(ClipInput[i], plane) < 0.0f)
+			{
+				allInside = false;
+				break;
+			}
+		}
+		if (allInside)
+			continue;
+
+		int outcount = 0;
+		for (int i = 0; i < count; i++)
+		{
+			const vec4& a = ClipInput[i];
+			const vec4& b = ClipInput[(i + 1) % count];
+			float da = clipdistance(a, plane);
+			float db = clipdistance(b, plane);
+
+			if (da >= 0.0f)
+				ClipOutput[outcount++] = a;
+
+			if ((da >= 0.0f) != (db >= 0.0f))
+			{
+				float t = da / (da - db);
+				ClipOutput[outcount++] = a + (b - a) * t;
+			}
+		}
+
+		std::swap(ClipInput, ClipOutput);
+		count = outcount;
+		if (count < 3)
+			return 0;
+
+		if (ClipOutput.size() < (size_t)count + 8)
+		{
+			ClipInput.resize(count + 8);
+			ClipOutput.resize(count + 8);
+		}
+	}
+	return count;
+}
+
+bool OcclusionBuffer::GetSpan(float y, int count, float& left, float& right) const
+{
+	left = std::numeric_limits<float>::max();
+	right = -std::numeric_limits<float>::max();
+	for (int i = 0; i < count; i++)
+	{
+		const vec4& a = ClipInput[i];
+		const vec4& b = ClipInput[(i + 1) % count];
+		if ((a.y <= y && b.y >= y) || (b.y <= y && a.y >= y))
+		{
+			if (a.y == b.y)
+			{
+				left = std::min(left, std::min(a.x, b.x));
+				right = std::max(right, std::max(a.x, b.x));
+			}
+			else
+			{
+				float x = a.x + (y - a.y) * (b.x - a.x) / (b.y - a.y);
+				left = std::min(left, x);
+				right = std::max(right, x);
+			}
+		}
+	}
+	return left <= right;
+}
+
+bool OcclusionBuffer::DrawPolygon(int count, bool solid)
+{
+	const vec4* points = ClipInput.data();
+
+	float ymin = points[0].y;
+	float ymax = points[0].y;
+	for (int i = 1; i < count; i++)
+	{
+		ymin = std::min(ymin, points[i].y);
+		ymax = std::max(ymax, points[i].y);
+	}
+
+	int row0 = std::max((int)std::floor(ymin), 0);
+	int row1 = std::min((int)std::floor(ymax) + 1, Height);
+	if (row0 >= row1)
+		return false;
+
+	// The polygon is convex. Its left edge is a convex function of y and its right edge is a concave one.
+	// Within a row the widest span is therefore found at the row boundaries or at a vertex inside the row,
+	// and the cells covered on every line of the row are the ones covered on both row boundaries.
+	for (int y = row0; y <= row1; y++)
+	{
+		if (!GetSpan((float)y, count, BoundaryLeft[y], BoundaryRight[y]))
+		{
+			BoundaryLeft[y] = std::numeric_limits<float>::max();
+			BoundaryRight[y] = -std::numeric_limits<float>::max();
+		}
+	}
+
+	bool visible = false;
+	for (int y = row0; y < row1; y++)
+	{
+		float y0 = (float)y;
+		float y1 = (float)(y + 1);
+
+		float outerLeft, outerRight;
+		float l, r;
+		GetSpan(std::max(y0, ymin), count, outerLeft, outerRight);
+		if (GetSpan(std::min(y1, ymax), count, l, r))
+		{
+			outerLeft = std::min(outerLeft, l);
+			outerRight = std::max(outerRight, r);
+		}
+		for (int i = 0; i < count; i++)
+		{
+			if (points[i].y >= y0 && points[i].y <= y1)
+			{
+				outerLeft = std::min(outerLeft, points[i].x);
+				outerRight = std::max(outerRight, points[i].x);
+			}
+		}
+		if (outerLeft > outerRight)
+			continue;
+
+		int x0 = std::max((int)std::floor(outerLeft - CellEpsilon), 0);
+		int x1 = std::min((int)std::floor(outerRight + CellEpsilon) + 1, Width);
+		if (x0 >= x1)
+			continue;
+
+		bool rowVisible = IsRowVisible(y, x0, x1);
+		if (!solid)
+		{
+			if (rowVisible)
+				return true;
+			continue;
+		}
+		visible = visible || rowVisible;
+
+		if (rowVisible && ymin <= y0 && ymax >= y1)
+		{
+			float innerLeft = std::max(BoundaryLeft[y], BoundaryLeft[y + 1]);
+			float innerRight = std::min(BoundaryRight[y], BoundaryRight[y + 1]);
+			int i0 = std::max((int)std::ceil(innerLeft + CellEpsilon), 0);
+			int i1 = std::min((int)std::floor(innerRight - CellEpsilon), Width);
+			if (i0 < i1)
+			{
+				FillRow(y, i0, i1);
+				numDrawSpans++;
+			}
+		}
+	}
+	return visible;
+}
+
+bool OcclusionBuffer::IsRowVisible(int y, int x0, int x1) const
+{
+	const uint64_t* row = Mask.data() + (size_t)y * WordsPerRow;
+	int w0 = x0 >> 6;
+	int w1 = (x1 - 1) >> 6;
+
+	// Skip the row if all the words are fully covered
+	int wordcount = w1 - w0 + 1;
+	uint64_t wordrange = (wordcount == 64 ? ~0ULL : ((1ULL << wordcount) - 1)) << w0;
+	if ((FullWords[y] & wordrange) == wordrange)
+		return false;
+
+	uint64_t firstmask = ~0ULL << (x0 & 63);
+	uint64_t lastmask = ~0ULL >> (63 - ((x1 - 1) & 63));
+	if (w0 == w1)
+		return (~row[w0] & firstmask & lastmask) != 0;
+
+	if ((~row[w0] & firstmask) != 0 || (~row[w1] & lastmask) != 0)
+		return true;
+
+	int w = w0 + 1;
+#ifndef NOSSE
+	__m128i ones = _mm_set1_epi32(-1);
+	for (; w + 2 <= w1; w += 2)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(row + w));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, ones)) != 0xffff)
+			return true;
+	}
+#endif
+	for (; w < w1; w++)
+	{
+		if (row[w] != ~0ULL)
+			return true;
+	}
+	return false;
+}
+
+void OcclusionBuffer::FillRow(int y, int x0, int x1)
+{
+	uint64_t* row = Mask.data() + (size_t)y * WordsPerRow;
+	uint64_t& fullwords = FullWords[y];
+	int w0 = x0 >> 6;
+	int w1 = (x1 - 1) >> 6;
+
+	uint64_t firstmask = ~0ULL << (x0 & 63);
+	uint64_t lastmask = ~0ULL >> (63 - ((x1 - 1) & 63));
+	if (w0 == w1)
+	{
+		row[w0] |= firstmask & lastmask;
+		if (row[w0] == ~0ULL)
+			fullwords |= 1ULL << w0;
+		return;
+	}
+
+	row[w0] |= firstmask;
+	if (row[w0] == ~0ULL)
+		fullwords |= 1ULL << w0;
+
+	row[w1] |= lastmask;
+	if (row[w1] == ~0ULL)
+		fullwords |= 1ULL << w1;
+
+	int w = w0 + 1;
+#ifndef NOSSE
+	__m128i ones = _mm_set1_epi32(-1);
+	for (; w + 2 <= w1; w += 2)
+		_mm_storeu_si128((__m128i*)(row + w), ones);
+#endif
+	for (; w < w1; w++)
+		row[w] = ~0ULL;
+
+	int middlecount = w1 - w0 - 1;
+	if (middlecount > 0)
+		fullwords |= (middlecount == 64 ? ~0ULL : ((1ULL << middlecount) - 1)) << (w0 + 1);
+}
+
+bool OcclusionBuffer::IsAABBVisible(const BBox& bbox)
+{
+	// First quickly check if we can rule it out using the frustum planes
+	int bits = FrustumClip.testIntersecting(bbox);
+	if (bits == -1) // outside
+		return false;
+
+	if (bits & (1 << 0)) // Near plane intersecting with bbox
+		return true;
+
+	// Find the 2D bounding box of the corners
+	vec2 min2d = vec2(std::numeric_limits<float>::max());
+	vec2 max2d = vec2(-std::numeric_limits<float>::max());
+	for (int i = 0; i < 8; i++)
+	{
+		vec4 v = WorldToProjection * vec4((i & 1) ? bbox.max.x : bbox.min.x, (i & 2) ? bbox.max.y : bbox.min.y, (i & 4) ? bbox.max.z : bbox.min.z, 1.0f);
+		float rcpw = 1.0f / v.w;
+		float x = Width * 0.5f * (1.0f + v.x * rcpw);
+		float y = Height * 0.5f * (1.0f - v.y * rcpw);
+		min2d.x = std::min(min2d.x, x);
+		min2d.y = std::min(min2d.y, y);
+		max2d.x = std::max(max2d.x, x);
+		max2d.y = std::max(max2d.y, y);
+	}
+
+	// if we are intersecting with any of the sides then include the entire edge
+	if (bits & (1 << 2)) min2d.x = 0;
+	if (bits & (1 << 3)) max2d.x = (float)Width;
+	if (bits & (1 << 4)) min2d.y = 0;
+	if (bits & (1 << 5)) max2d.y = (float)Height;
+
+	// Check if any of it can be seen
+	int y0 = std::max((int)std::floor(min2d.y), 0);
+	int y1 = std::min((int)std::floor(max2d.y) + 1, Height);
+	int x0 = std::max((int)std::floor(min2d.x), 0);
+	int x1 = std::min((int)std::floor(max2d.x) + 1, Width);
+	if (y0 >= y1 || x0 >= x1)
+		return false;
+
+	for (int y = y0; y < y1; y++)
+	{
+		if (IsRowVisible(y, x0, x1))
+			return true;
+	}
+	return false;
+}
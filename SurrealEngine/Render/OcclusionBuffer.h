@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Math/vec.h"
+#include "Math/mat.h"
+#include "Math/FrustumPlanes.h"
+
+class BBox;
+
+// Coverage mask used to reject BSP surfaces hidden behind the solid surfaces already seen by the front to back traversal.
+//
+// The mask has one bit per cell and is usually at a lower resolution than the screen. Each row is stored as 64 bit words,
+// plus a summary word with one bit for each fully covered word, so most tests of a hidden row are a single compare.
+// Rasterization is conservative in both directions: cells are only marked as covered when a solid polygon covers
+// all of the cell, and a polygon is visible if it touches any cell not yet covered. It never culls more than an exact test.
+class OcclusionBuffer
+{
+public:
+	OcclusionBuffer();
+
+	// The width can be at most 4096 cells
+	void SetResolution(int width, int height);
+	int GetWidth() const { return Width; }
+	int GetHeight() const { return Height; }
+
+	void Setup(const mat4& world_to_projection);
+
+	bool CheckSurface(const vec3* vertices, uint32_t count, bool solid);
+	bool IsAABBVisible(const BBox& bbox);
+
+	int numDrawSpans = 0;
+	int numSurfs = 0;
+	int numTris = 0;
+
+private:
+	int ClipPolygon(int count);
+	bool DrawPolygon(int count, bool solid);
+	bool GetSpan(float y, int count, float& left, float& right) const;
+
+	bool IsRowVisible(int y, int x0, int x1) const;
+	void FillRow(int y, int x0, int x1);
+
+	int Width = 0;
+	int Height = 0;
+	int WordsPerRow = 0;
+	Array<uint64_t> Mask; // Covered cells, WordsPerRow words for each row
+	Array<uint64_t> FullWords; // One bit for each fully covered word in a row
+	uint64_t LastWordPadding = 0; // Bits of the last word in a row that are outside the buffer
+
+	FrustumPlanes FrustumClip;
+	mat4 WorldToProjection;
+
+	Array<vec4> ClipInput;
+	Array<vec4> ClipOutput;
+	Array<float> BoundaryLeft;
+	Array<float> BoundaryRight;
+};
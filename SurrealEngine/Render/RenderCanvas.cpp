@@ -6,6 +6,7 @@
 #include "GameWindow.h"
 #include "VM/ScriptCall.h"
 #include "Engine.h"
+#include "TimeDemo.h"
 
 void RenderSubsystem::ResetCanvas()
 {
@@ -131,6 +132,8 @@ void RenderSubsystem::DrawTile(UTexture* Tex, float x, float y, float XL, float
 	if (Tex->Palette())
 		texinfo.Palette = (FColor*)Tex->Palette()->Colors.data();
 
+	UploadTextureChanges(texinfo, Tex);
+
 	if (Tex->bMasked())
 		flags |= PF_Masked;
 
@@ -154,6 +157,8 @@ void RenderSubsystem::DrawTileClipped(UTexture* Tex, float orgX, float orgY, flo
 	if (Tex->Palette())
 		texinfo.Palette = (FColor*)Tex->Palette()->Colors.data();
 
+	UploadTextureChanges(texinfo, Tex);
+
 	if (Tex->bMasked())
 		flags |= PF_Masked;
 
@@ -165,16 +170,18 @@ void RenderSubsystem::DrawTileClipped(UTexture* Tex, float orgX, float orgY, flo
 
 void RenderSubsystem::DrawText(UFont* font, vec4 color, float orgX, float orgY, float& curX, float& curY, float& curYL, bool newlineAtEnd, const std::string& text, uint32_t flags, bool center, float spaceX, float spaceY)
 {
+	const TextLayout& layout = GetTextLayout(font, text, false);
+
 	float centerX = 0;
 	if (center)
-		centerX = std::round((engine->canvas->SizeX() - GetTextSize(font, text).x) * 0.5f);
+		centerX = std::round((engine->canvas->SizeX() - layout.Size.x) * 0.5f);
 
-	for (char c : text)
+	for (const TextLayoutGlyph& glyph : layout.Glyphs)
 	{
 		// To do: word wrap
 		// To do: SpaceX and SpaceY also affects DrawText
 
-		if (c == '\n')
+		if (glyph.Newline)
 		{
 			curX = 0;
 			curY += curYL;
@@ -182,33 +189,17 @@ void RenderSubsystem::DrawText(UFont* font, vec4 color, float orgX, float orgY,
 		}
 		else
 		{
-			FontGlyph glyph = font->GetGlyph(c);
-
-			FTextureInfo texinfo;
-			texinfo.CacheID = (uint64_t)(ptrdiff_t)glyph.Texture;
-			texinfo.Texture = glyph.Texture;
-			texinfo.Format = texinfo.Texture->ActualFormat;
-			texinfo.Mips = glyph.Texture->Mipmaps.data();
-			texinfo.NumMips = (int)glyph.Texture->Mipmaps.size();
-			texinfo.USize = glyph.Texture->USize();
-			texinfo.VSize = glyph.Texture->VSize();
-			if (glyph.Texture->Palette())
-				texinfo.Palette = (FColor*)glyph.Texture->Palette()->Colors.data();
-
-			int width = glyph.USize;
-			int height = glyph.VSize;
-			float StartU = (float)glyph.StartU;
-			float StartV = (float)glyph.StartV;
-			float USize = (float)glyph.USize;
-			float VSize = (float)glyph.VSize;
-
-			Device->DrawTile(&Canvas.Frame, texinfo, (orgX + curX + centerX) * Canvas.uiscale, (float)(orgY + curY) * Canvas.uiscale, (float)width * Canvas.uiscale, (float)height * Canvas.uiscale, StartU, StartV, USize, VSize, 1.0f, color, vec4(0.0f), PF_Highlighted | PF_NoSmooth | PF_Masked);
-
-			curX += width + spaceX;
-			curYL = std::max(curYL, (float)glyph.VSize + spaceY);
+			Rectf dest = Rectf::xywh(orgX + curX + centerX, orgY + curY, glyph.USize, glyph.VSize);
+			Rectf src = Rectf::xywh(glyph.StartU, glyph.StartV, glyph.USize, glyph.VSize);
+			AddTextTile(glyph.Texture, dest, src);
+
+			curX += glyph.USize + spaceX;
+			curYL = std::max(curYL, glyph.VSize + spaceY);
 		}
 	}
 
+	DrawTextTiles(color, PF_Highlighted | PF_NoSmooth | PF_Masked);
+
 	curY += curYL;
 
 	if (newlineAtEnd)
@@ -219,159 +210,206 @@ void RenderSubsystem::DrawText(UFont* font, vec4 color, float orgX, float orgY,
 	}
 }
 
-void RenderSubsystem::DrawTextClipped(UFont* font, vec4 color, float orgX, float orgY, float curX, float curY, const std::string& text, uint32_t flags, bool checkHotKey, float clipX, float clipY, bool center)
+// Clips a tile to the box. Returns false if nothing is left of it.
+static bool ClipTile(Rectf& d, Rectf& s, const Rectf& clipBox)
 {
-	FontGlyph uglyph = font->GetGlyph('_');
-	int uwidth = uglyph.USize;
-	int uheight = uglyph.VSize;
-	float uStartU = (float)uglyph.StartU;
-	float uStartV = (float)uglyph.StartV;
-	float uUSize = (float)uglyph.USize;
-	float uVSize = (float)uglyph.VSize;
+	if (d.left > d.right || d.top > d.bottom)
+		return false;
 
-	Rectf clipBox = Rectf::xywh(orgX, orgY, clipX, clipY);
+	if (d.left >= clipBox.left && d.top >= clipBox.top && d.right <= clipBox.right && d.bottom <= clipBox.bottom)
+		return true;
+
+	float scaleX = (s.right - s.left) / (d.right - d.left);
+	float scaleY = (s.bottom - s.top) / (d.bottom - d.top);
+
+	if (d.left < clipBox.left)
+	{
+		s.left += scaleX * (clipBox.left - d.left);
+		d.left = clipBox.left;
+	}
+	if (d.right > clipBox.right)
+	{
+		s.right += scaleX * (clipBox.right - d.right);
+		d.right = clipBox.right;
+	}
+	if (d.top < clipBox.top)
+	{
+		s.top += scaleY * (clipBox.top - d.top);
+		d.top = clipBox.top;
+	}
+	if (d.bottom > clipBox.bottom)
+	{
+		s.bottom += scaleY * (clipBox.bottom - d.bottom);
+		d.bottom = clipBox.bottom;
+	}
+
+	return d.left < d.right && d.top < d.bottom;
+}
 
+void RenderSubsystem::DrawTextClipped(UFont* font, vec4 color, float orgX, float orgY, float curX, float curY, const std::string& text, uint32_t flags, bool checkHotKey, float clipX, float clipY, bool center)
+{
 	float centerX = 0;
 	if (center)
 		centerX = std::round((clipX - GetTextSize(font, text).x) * 0.5f);
 
+	const TextLayout& layout = GetTextLayout(font, text, checkHotKey);
+	FontGlyph uglyph = font->GetGlyph('_');
+
+	Rectf clipBox = Rectf::xywh(orgX, orgY, clipX, clipY);
+
+	for (const TextLayoutGlyph& glyph : layout.Glyphs)
+	{
+		if (curX + glyph.USize > (int)clipX)
+			break;
+
+		Rectf dest = Rectf::xywh(orgX + curX + centerX, orgY + curY, glyph.USize, glyph.VSize);
+		Rectf src = Rectf::xywh(glyph.StartU, glyph.StartV, glyph.USize, glyph.VSize);
+		if (ClipTile(dest, src, clipBox))
+			AddTextTile(glyph.Texture, dest, src);
+
+		if (glyph.HotKey)
+		{
+			dest = Rectf::xywh(orgX + curX + ((int)glyph.USize - uglyph.USize) / 2, orgY + curY, (float)uglyph.USize, (float)uglyph.VSize);
+			src = Rectf::xywh((float)uglyph.StartU, (float)uglyph.StartV, (float)uglyph.USize, (float)uglyph.VSize);
+			if (ClipTile(dest, src, clipBox))
+				AddTextTile(uglyph.Texture, dest, src);
+		}
+
+		curX += glyph.USize;
+	}
+
+	DrawTextTiles(color, PF_Highlighted | PF_NoSmooth | PF_Masked);
+}
+
+void RenderSubsystem::DrawTile(FTextureInfo& texinfo, const Rectf& dest, const Rectf& src, const Rectf& clipBox, float Z, vec4 color, vec4 fog, uint32_t flags)
+{
+	Rectf d = dest;
+	Rectf s = src;
+	if (ClipTile(d, s, clipBox))
+		Device->DrawTile(&Canvas.Frame, texinfo, d.left * Canvas.uiscale, d.top * Canvas.uiscale, (d.right - d.left) * Canvas.uiscale, (d.bottom - d.top) * Canvas.uiscale, s.left, s.top, s.right - s.left, s.bottom - s.top, Z, color, fog, flags);
+}
+
+const TextLayout& RenderSubsystem::GetTextLayout(UFont* font, const std::string& text, bool checkHotKey)
+{
+	uint64_t key = std::hash<std::string>()(text);
+	key = key * 31 + (uint64_t)(ptrdiff_t)font;
+	key = key * 31 + (checkHotKey ? 1 : 0);
+
+	// A different string with the same key simply replaces the layout
+	TextLayout& layout = Canvas.TextLayouts[key];
+	layout.FrameCounter = FrameCounter;
+	if (layout.Font == font && layout.CheckHotKey == checkHotKey && layout.Text == text)
+		return layout;
+
+	layout.Font = font;
+	layout.Text = text;
+	layout.CheckHotKey = checkHotKey;
+	layout.Glyphs.clear();
+	layout.Size = { 0, 0 };
+
 	bool foundAmpersand = false;
-	int maxY = 0;
 	for (char c : text)
 	{
 		if (checkHotKey && c == '&' && !foundAmpersand)
 		{
 			foundAmpersand = true;
+			continue;
 		}
-		else if (foundAmpersand && c != '&')
-		{
-			foundAmpersand = false;
-
-			FontGlyph glyph = font->GetGlyph(c);
-			if (curX + glyph.USize > (int)clipX)
-				break;
-
-			FTextureInfo texinfo;
-			texinfo.CacheID = (uint64_t)(ptrdiff_t)glyph.Texture;
-			texinfo.Texture = glyph.Texture;
-			texinfo.Format = texinfo.Texture->ActualFormat;
-			texinfo.Mips = glyph.Texture->Mipmaps.data();
-			texinfo.NumMips = (int)glyph.Texture->Mipmaps.size();
-			texinfo.USize = glyph.Texture->USize();
-			texinfo.VSize = glyph.Texture->VSize();
-			if (glyph.Texture->Palette())
-				texinfo.Palette = (FColor*)glyph.Texture->Palette()->Colors.data();
-
-			Rectf dest = Rectf::xywh(orgX + curX + centerX, orgY + curY, (float)glyph.USize, (float)glyph.VSize);
-			Rectf src = Rectf::xywh((float)glyph.StartU, (float)glyph.StartV, (float)glyph.USize, (float)glyph.VSize);
-			DrawTile(texinfo, dest, src, clipBox, 1.0f, color, vec4(0.0f), PF_Highlighted | PF_NoSmooth | PF_Masked);
-
-			texinfo.CacheID = (uint64_t)(ptrdiff_t)uglyph.Texture;
-			texinfo.Texture = uglyph.Texture;
-
-			dest = Rectf::xywh(orgX + curX + (glyph.USize - uwidth) / 2, orgY + curY, (float)uwidth, (float)uheight);
-			src = Rectf::xywh(uStartU, uStartV, uUSize, uVSize);
-			DrawTile(texinfo, dest, src, clipBox, 1.0f, color, vec4(0.0f), PF_Highlighted | PF_NoSmooth | PF_Masked);
-
-			curX += glyph.USize;
-			maxY = std::max(maxY, glyph.VSize);
-		}
-		else
-		{
-			foundAmpersand = false;
-
-			FontGlyph glyph = font->GetGlyph(c);
-			if (curX + glyph.USize > (int)clipX)
-				break;
-
-			FTextureInfo texinfo;
-			texinfo.CacheID = (uint64_t)(ptrdiff_t)glyph.Texture;
-			texinfo.Texture = glyph.Texture;
-			texinfo.Format = texinfo.Texture->ActualFormat;
-			texinfo.Mips = glyph.Texture->Mipmaps.data();
-			texinfo.NumMips = (int)glyph.Texture->Mipmaps.size();
-			texinfo.USize = glyph.Texture->USize();
-			texinfo.VSize = glyph.Texture->VSize();
-			if (glyph.Texture->Palette())
-				texinfo.Palette = (FColor*)glyph.Texture->Palette()->Colors.data();
-
-			Rectf dest = Rectf::xywh(orgX + curX + centerX, orgY + curY, (float)glyph.USize, (float)glyph.VSize);
-			Rectf src = Rectf::xywh((float)glyph.StartU, (float)glyph.StartV, (float)glyph.USize, (float)glyph.VSize);
-			DrawTile(texinfo, dest, src, clipBox, 1.0f, color, vec4(0.0f), PF_Highlighted | PF_NoSmooth | PF_Masked);
-
-			curX += glyph.USize;
-			maxY = std::max(maxY, glyph.VSize);
-		}
+
+		FontGlyph fontGlyph = font->GetGlyph(c);
+
+		TextLayoutGlyph glyph;
+		glyph.Texture = fontGlyph.Texture;
+		glyph.StartU = (float)fontGlyph.StartU;
+		glyph.StartV = (float)fontGlyph.StartV;
+		glyph.USize = (float)fontGlyph.USize;
+		glyph.VSize = (float)fontGlyph.VSize;
+		glyph.Newline = c == '\n';
+		glyph.HotKey = foundAmpersand && c != '&';
+		layout.Glyphs.push_back(glyph);
+
+		layout.Size.x += fontGlyph.USize;
+		layout.Size.y = std::max(layout.Size.y, fontGlyph.VSize);
+		foundAmpersand = false;
 	}
+
+	return layout;
 }
 
-void RenderSubsystem::DrawTile(FTextureInfo& texinfo, const Rectf& dest, const Rectf& src, const Rectf& clipBox, float Z, vec4 color, vec4 fog, uint32_t flags)
+void RenderSubsystem::PruneTextLayouts()
 {
-	if (dest.left > dest.right || dest.top > dest.bottom)
-		return;
-
-	if (dest.left >= clipBox.left && dest.top >= clipBox.top && dest.right <= clipBox.right && dest.bottom <= clipBox.bottom)
+	// Forget strings that have not been drawn or measured for a while
+	for (auto it = Canvas.TextLayouts.begin(); it != Canvas.TextLayouts.end();)
 	{
-		Device->DrawTile(&Canvas.Frame, texinfo, dest.left * Canvas.uiscale, dest.top * Canvas.uiscale, (dest.right - dest.left) * Canvas.uiscale, (dest.bottom - dest.top) * Canvas.uiscale, src.left, src.top, src.right - src.left, src.bottom - src.top, Z, color, fog, flags);
+		if (FrameCounter - it->second.FrameCounter > 64)
+			it = Canvas.TextLayouts.erase(it);
+		else
+			++it;
 	}
-	else
-	{
-		Rectf d = dest;
-		Rectf s = src;
+}
 
-		float scaleX = (s.right - s.left) / (d.right - d.left);
-		float scaleY = (s.bottom - s.top) / (d.bottom - d.top);
+void RenderSubsystem::AddTextTile(UTexture* texture, const Rectf& dest, const Rectf& src)
+{
+	auto it = std::find_if(Canvas.TextBatches.begin(), Canvas.TextBatches.end(), [&](const auto& batch) { return batch.Texture == texture; });
+	if (it == Canvas.TextBatches.end())
+	{
+		Canvas.TextBatches.push_back({});
+		it = Canvas.TextBatches.end() - 1;
+		it->Texture = texture;
+	}
 
-		if (d.left < clipBox.left)
-		{
-			s.left += scaleX * (clipBox.left - d.left);
-			d.left = clipBox.left;
-		}
-		if (d.right > clipBox.right)
-		{
-			s.right += scaleX * (clipBox.right - d.right);
-			d.right = clipBox.right;
-		}
-		if (d.top < clipBox.top)
-		{
-			s.top += scaleY * (clipBox.top - d.top);
-			d.top = clipBox.top;
-		}
-		if (d.bottom > clipBox.bottom)
-		{
-			s.bottom += scaleY * (clipBox.bottom - d.bottom);
-			d.bottom = clipBox.bottom;
-		}
+	TileRect tile;
+	tile.X = dest.left * Canvas.uiscale;
+	tile.Y = dest.top * Canvas.uiscale;
+	tile.XL = (dest.right - dest.left) * Canvas.uiscale;
+	tile.YL = (dest.bottom - dest.top) * Canvas.uiscale;
+	tile.U = src.left;
+	tile.V = src.top;
+	tile.UL = src.right - src.left;
+	tile.VL = src.bottom - src.top;
+	it->Tiles.push_back(tile);
+}
 
-		if (d.left < d.right && d.top < d.bottom)
-			Device->DrawTile(&Canvas.Frame, texinfo, d.left * Canvas.uiscale, d.top * Canvas.uiscale, (d.right - d.left) * Canvas.uiscale, (d.bottom - d.top) * Canvas.uiscale, s.left, s.top, s.right - s.left, s.bottom - s.top, Z, color, fog, flags);
+void RenderSubsystem::DrawTextTiles(vec4 color, uint32_t flags)
+{
+	// One device call for each font page texture used by the text
+	for (auto& batch : Canvas.TextBatches)
+	{
+		if (batch.Tiles.empty())
+			continue;
+
+		UTexture* texture = batch.Texture;
+		FTextureInfo texinfo;
+		texinfo.CacheID = (uint64_t)(ptrdiff_t)texture;
+		texinfo.Texture = texture;
+		texinfo.Format = texture->ActualFormat;
+		texinfo.Mips = texture->Mipmaps.data();
+		texinfo.NumMips = (int)texture->Mipmaps.size();
+		texinfo.USize = texture->USize();
+		texinfo.VSize = texture->VSize();
+		if (texture->Palette())
+			texinfo.Palette = (FColor*)texture->Palette()->Colors.data();
+
+		Device->DrawTiles(&Canvas.Frame, texinfo, batch.Tiles.data(), (int)batch.Tiles.size(), 1.0f, color, vec4(0.0f), flags);
+		batch.Tiles.clear();
 	}
 }
 
 ivec2 RenderSubsystem::GetTextSize(UFont* font, const std::string& text)
 {
-	int x = 0;
-	int y = 0;
-	for (char c : text)
-	{
-		FontGlyph glyph = font->GetGlyph(c);
-		x += glyph.USize;
-		y = std::max(y, glyph.VSize);
-	}
-	return { x, y };
+	return GetTextLayout(font, text, false).Size;
 }
 
 ivec2 RenderSubsystem::GetTextClippedSize(UFont* font, const std::string& text, float clipX)
 {
 	int x = 0;
 	int y = 0;
-	for (char c : text)
+	for (const TextLayoutGlyph& glyph : GetTextLayout(font, text, false).Glyphs)
 	{
-		FontGlyph glyph = font->GetGlyph(c);
-		if (x + glyph.USize > (int)clipX)
+		if (x + (int)glyph.USize > (int)clipX)
 			break;
-		x += glyph.USize;
-		y = std::max(y, glyph.VSize);
+		x += (int)glyph.USize;
+		y = std::max(y, (int)glyph.VSize);
 	}
 	return { x, y };
 }
@@ -390,6 +428,8 @@ void RenderSubsystem::DrawTimedemoStats()
 	{
 		Array<std::string> lines;
 		lines.push_back(std::to_string(Canvas.fps) + " FPS");
+		if (engine->timedemo && engine->timedemo->IsPlaying())
+			lines.push_back("Demo frame " + std::to_string(engine->timedemo->GetFrameIndex() + 1) + " of " + std::to_string(engine->timedemo->GetFrameCount()));
 		lines.push_back(std::to_string(engine->Level->Actors.size()) + " actors");
 
 		/*size_t numCollisionActors = 0;
@@ -398,6 +438,7 @@ void RenderSubsystem::DrawTimedemoStats()
 		lines.push_back(std::to_string(numCollisionActors) + " collision actors");*/
 
 		lines.push_back(std::to_string(Scene.OpaqueNodes.size() + Scene.TranslucentNodes.size()) + " visible surfaces");
+		lines.push_back(std::to_string(Scene.SurfaceBatches) + " opaque surface batches");
 		lines.push_back(std::to_string(Scene.Actors.size()) + " visible actors");
 		lines.push_back(std::to_string(Scene.Coronas.size()) + " visible coronas");
 
@@ -441,11 +482,18 @@ void RenderSubsystem::DrawTimedemoStats()
 
 		lines.push_back(std::to_string(Scene.OpaqueNodes.size() + Scene.TranslucentNodes.size()) + " visible surfaces");
 		lines.push_back(std::to_string(Scene.Actors.size()) + " visible actors");
-		lines.push_back(std::to_string(Scene.Coronas.size()) + " visible coronas");
+		lines.push_back(std::to_string(Scene.Coronas.size()) + " visible coronas (" + std::to_string(Corona.Drawn) + " drawn, " + std::to_string(Corona.TracesDone) + " traces)");
+		lines.push_back(std::to_string(Scene.Decals.size()) + " of " + std::to_string(engine->Level->Decals.size()) + " decals visible");
 
-		lines.push_back(std::to_string(Scene.Clipper.numDrawSpans) + " spans");
+		lines.push_back(std::to_string(Scene.Clipper.numDrawSpans) + " occlusion rows filled");
 		lines.push_back(std::to_string(Scene.Clipper.numSurfs) + " checked surfaces");
 		lines.push_back(std::to_string(Scene.Clipper.numTris) + " checked triangles");
+		lines.push_back(std::to_string(UTexture::GetResidentMipBytes() / (1024 * 1024)) + " MB texture data");
+		lines.push_back(std::to_string(Light.Lightmaps.GetPageCount()) + " lightmap pages (" + std::to_string(Light.Lightmaps.GetMemoryUsage() / (1024 * 1024)) + " MB)");
+		lines.push_back(std::to_string(Light.Fogmaps.GetPageCount()) + " fogmap pages (" + std::to_string(Light.Fogmaps.GetMemoryUsage() / (1024 * 1024)) + " MB)");
+		lines.push_back(std::to_string(Light.FogTexelsUpdated) + " fog texels updated");
+		lines.push_back(std::to_string(Light.TracesDone) + " light traces (" + std::to_string(Light.TracesSaved) + " saved)");
+		Device->AddStats(lines);
 
 		UFont* font = engine->canvas->MedFont();
 		if (font)
@@ -460,6 +508,34 @@ void RenderSubsystem::DrawTimedemoStats()
 			}
 		}
 	}
+
+	if (ShowProfileStats)
+	{
+		// Inclusive time of each profiler zone during the last frame
+		Array<std::string> lines;
+		for (const ProfileZoneStats& zone : Profiler::GetLastFrameZones())
+		{
+			char ms[32];
+			std::snprintf(ms, sizeof(ms), "%.2f ms", zone.Milliseconds);
+			std::string text = std::string(zone.Name) + ": " + ms;
+			if (zone.Count > 1)
+				text += " (" + std::to_string(zone.Count) + " calls)";
+			lines.push_back(text);
+		}
+
+		UFont* font = engine->canvas->SmallFont();
+		if (font)
+		{
+			float curY = 64;
+			for (const std::string& text : lines)
+			{
+				float curX = 16.0f;
+				float curYL = 0.0f;
+				DrawText(font, vec4(1.0f), 0.0f, 0.0f, curX, curY, curYL, false, text, PF_NoSmooth | PF_Masked, false);
+				curY += curYL;
+			}
+		}
+	}
 }
 
 void RenderSubsystem::DrawCollisionDebug()
@@ -7,47 +7,104 @@
 
 void RenderSubsystem::DrawCoronas(FSceneNode* frame)
 {
+	UpdateCoronaOcclusion(frame);
+
 	FSceneNode frame2d = *frame;
 	frame2d.ObjectToWorld = mat4::identity();
 	frame2d.WorldToView = mat4::identity();
 	Device->SetSceneNode(&frame2d);
 
-	for (UActor* light : Scene.Coronas)
+	Corona.Drawn = 0;
+	float fadeStep = Corona.FadeRate * LevelTimeElapsed;
+	for (auto it = Corona.States.begin(); it != Corona.States.end();)
 	{
-		if (light && light->bCorona() && light->Skin() && !engine->Level->TraceRayAnyHit(light->Location(), engine->CameraLocation, nullptr, false, true, true))
+		UActor* light = it->first;
+		CoronaState& state = it->second;
+
+		bool seen = state.SeenFrame == Scene.FrameCounter;
+		if (seen && state.Visible)
+			state.Brightness = std::min(state.Brightness + fadeStep, 1.0f);
+		else
+			state.Brightness = std::max(state.Brightness - fadeStep, 0.0f);
+
+		if (!seen && state.Brightness == 0.0f)
 		{
-			vec4 pos = frame->WorldToView * frame->ObjectToWorld * vec4(light->Location(), 1.0f);
-			if (pos.z >= 1.0f)
-			{
-				vec4 clip = frame->Projection * pos;
-
-				float x = frame->FX2 + clip.x / clip.w * frame->FX2;
-				float y = frame->FY2 + clip.y / clip.w * frame->FY2;
-				float z = 2.0f;
-
-				float width = (float)light->Skin()->Mipmaps.front().Width;
-				float height = (float)light->Skin()->Mipmaps.front().Height;
-				float size = light->DrawScale() * frame->FX * 0.8f;
-
-				vec3 lightcolor = hsbtorgb(light->LightHue(), light->LightSaturation(), 255/*light->LightBrightness()*/);
-
-				UpdateTexture(light->Skin());
-
-				FTextureInfo texinfo;
-				texinfo.CacheID = (uint64_t)(ptrdiff_t)light->Skin();
-				texinfo.Texture = light->Skin()->GetAnimTexture();
-				texinfo.Format = texinfo.Texture->ActualFormat;
-				texinfo.Mips = texinfo.Texture->Mipmaps.data();
-				texinfo.NumMips = (int)texinfo.Texture->Mipmaps.size();
-				texinfo.USize = texinfo.Texture->USize();
-				texinfo.VSize = texinfo.Texture->VSize();
-				if (texinfo.Texture->Palette())
-					texinfo.Palette = (FColor*)texinfo.Texture->Palette()->Colors.data();
-
-				UpdateTexture(texinfo.Texture);
-
-				Device->DrawTile(frame, texinfo, x - size * 0.5f, y - size * 0.5f, size, size, 0.0f, 0.0f, width, height, z, vec4(lightcolor, 1.0f), vec4(0.0f), PF_Translucent);
-			}
+			it = Corona.States.erase(it);
+			continue;
 		}
+
+		if (state.Brightness > 0.0f && !light->bDeleteMe() && light->bCorona() && light->Skin())
+		{
+			DrawCorona(frame, light, state.Brightness);
+			Corona.Drawn++;
+		}
+		++it;
+	}
+}
+
+void RenderSubsystem::UpdateCoronaOcclusion(FSceneNode* frame)
+{
+	Corona.TraceOrder.clear();
+	for (UActor* light : Scene.Coronas)
+	{
+		if (!light || !light->bCorona() || !light->Skin())
+			continue;
+
+		vec4 pos = frame->WorldToView * frame->ObjectToWorld * vec4(light->Location(), 1.0f);
+		if (pos.z < 1.0f)
+			continue;
+
+		CoronaState& state = Corona.States[light];
+		state.SeenFrame = Scene.FrameCounter;
+		Corona.TraceOrder.push_back({ light, &state });
 	}
+
+	// Lights never traced come first as their TraceFrame is -1
+	std::sort(Corona.TraceOrder.begin(), Corona.TraceOrder.end(), [](const auto& a, const auto& b) { return a.second->TraceFrame < b.second->TraceFrame; });
+
+	Corona.TracesDone = std::min((int)Corona.TraceOrder.size(), Corona.TraceBudget);
+	for (int i = 0; i < Corona.TracesDone; i++)
+	{
+		UActor* light = Corona.TraceOrder[i].first;
+		CoronaState* state = Corona.TraceOrder[i].second;
+		state->Visible = !engine->Level->TraceRayAnyHit(light->Location(), engine->CameraLocation, nullptr, false, true, true);
+		state->TraceFrame = Scene.FrameCounter;
+	}
+}
+
+void RenderSubsystem::DrawCorona(FSceneNode* frame, UActor* light, float brightness)
+{
+	vec4 pos = frame->WorldToView * frame->ObjectToWorld * vec4(light->Location(), 1.0f);
+	if (pos.z < 1.0f)
+		return;
+
+	vec4 clip = frame->Projection * pos;
+
+	float x = frame->FX2 + clip.x / clip.w * frame->FX2;
+	float y = frame->FY2 + clip.y / clip.w * frame->FY2;
+	float z = 2.0f;
+
+	float width = (float)light->Skin()->Mipmaps.front().Width;
+	float height = (float)light->Skin()->Mipmaps.front().Height;
+	float size = light->DrawScale() * frame->FX * 0.8f;
+
+	vec3 lightcolor = hsbtorgb(light->LightHue(), light->LightSaturation(), 255/*light->LightBrightness()*/);
+
+	UpdateTexture(light->Skin());
+
+	FTextureInfo texinfo;
+	texinfo.CacheID = (uint64_t)(ptrdiff_t)light->Skin();
+	texinfo.Texture = light->Skin()->GetAnimTexture();
+	texinfo.Format = texinfo.Texture->ActualFormat;
+	texinfo.Mips = texinfo.Texture->Mipmaps.data();
+	texinfo.NumMips = (int)texinfo.Texture->Mipmaps.size();
+	texinfo.USize = texinfo.Texture->USize();
+	texinfo.VSize = texinfo.Texture->VSize();
+	if (texinfo.Texture->Palette())
+		texinfo.Palette = (FColor*)texinfo.Texture->Palette()->Colors.data();
+
+	UpdateTexture(texinfo.Texture);
+
+	// Coronas are drawn additively, so fading scales the color
+	Device->DrawTile(frame, texinfo, x - size * 0.5f, y - size * 0.5f, size, size, 0.0f, 0.0f, width, height, z, vec4(lightcolor * brightness, 1.0f), vec4(0.0f), PF_Translucent);
 }
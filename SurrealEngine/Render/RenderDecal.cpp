@@ -6,7 +6,8 @@
 
 void RenderSubsystem::DrawDecals(FSceneNode* frame)
 {
-	for (auto& leveldecal : engine->Level->Decals)
+	// Only the decals in the visible BSP nodes were collected by ProcessNode
+	for (LevelDecal* leveldecal : Scene.Decals)
 	{
 		if (leveldecal->Decal->Texture())
 		{
@@ -26,6 +27,8 @@ void RenderSubsystem::DrawDecals(FSceneNode* frame)
 			if (texinfo.Texture->Palette())
 				texinfo.Palette = (FColor*)texinfo.Texture->Palette()->Colors.data();
 
+			UploadTextureChanges(texinfo, texture);
+
 			GouraudVertex points[4];
 			for (int i = 0; i < 4; i++)
 			{
@@ -5,6 +5,7 @@
 #include "Lightmap/FogmapBuilder.h"
 #include "Engine.h"
 #include "Math/hsb.h"
+#include "Math/halffloat.h"
 
 // Don't render the fog in debug builds as we'd rather have a higher frame rate
 #if defined(DEBUG) || defined(_DEBUG)
@@ -23,88 +24,98 @@ FTextureInfo RenderSubsystem::GetSurfaceFogmap(BspSurface& surface, const FSurfa
 
 	uint64_t cacheID = (((uint64_t)surface.LightMap) << 32) | (((uint64_t)ambientID) << 8) | 2;
 
-	auto level = engine->Level;
-	const LightMapIndex& lmindex = level->Model->LightMap[surface.LightMap];
-	auto& fogtex = Light.fogtextures[cacheID];
-	std::unique_ptr<LightmapTexture>& fogtexture = fogtex.second;
-	if (!fogtexture)
-	{
-#if 1 // Float high quality lightmaps
-		UnrealMipmap fogmip;
-		fogmip.Width = lmindex.UClamp;
-		fogmip.Height = lmindex.VClamp;
-		fogmip.Data.resize((size_t)fogmip.Width * fogmip.Height * sizeof(vec4));
-
-		fogtexture = std::make_unique<LightmapTexture>();
-		fogtexture->Format = TextureFormat::RGBA32_F;
-		fogtexture->Mip = std::move(fogmip);
-#else // Low quality lightmaps like UE1 got them
-		UnrealMipmap fogmip;
-		fogmip.Width = lmindex.UClamp;
-		fogmip.Height = lmindex.VClamp;
-		fogmip.Data.resize((size_t)fogmip.Width * fogmip.Height * 4);
-
-		fogtexture = std::make_unique<LightmapTexture>();
-		fogtexture->Format = TextureFormat::BGRA8_LM;
-		fogtexture->Mip = std::move(fogmip);
-#endif
-	}
+	const LightMapIndex& lmindex = model->LightMap[surface.LightMap];
+	LightmapAtlas::Entry* entry = Light.Fogmaps.Find(cacheID);
+	if (!entry)
+		entry = Light.Fogmaps.Insert(cacheID, lmindex.UClamp, lmindex.VClamp);
 
-	bool firstDrawThisScene = false;
-	if (fogtex.first != Light.FogFrameCounter)
+	// New fogmaps are always built. Outdated ones are rebuilt while the frame budget lasts, unless they fall too far behind.
+	const int maxFogLag = 8;
+	bool outdated = entry->UpdateFrame != Light.FogGeneration;
+	if (entry->UpdateFrame < 0 || (outdated && (Light.FogTexelsLeft > 0 || Light.FogGeneration - entry->UpdateFrame >= maxFogLag)))
 	{
-		firstDrawThisScene = true;
-		fogtex.first = Light.FogFrameCounter;
+		int texels = entry->Width * entry->Height;
+		Light.FogTexelsLeft -= texels;
+		Light.FogTexelsUpdated += texels;
+		entry->UpdateFrame = Light.FogGeneration;
+		UpdateFogmapTexture(entry, surface, zoneActor, model);
 	}
 
-	if (firstDrawThisScene)
-		UpdateFogmapTexture(lmindex, (uint32_t*)fogtexture->Mip.Data.data(), surface, zoneActor, model);
-
-	FTextureInfo texinfo;
-	texinfo.CacheID = cacheID;
-	texinfo.bRealtimeChanged = firstDrawThisScene;
-	texinfo.Format = fogtexture->Format;
-	texinfo.Mips = &fogtexture->Mip;
-	texinfo.NumMips = 1;
-	texinfo.USize = texinfo.Mips[0].Width;
-	texinfo.VSize = texinfo.Mips[0].Height;
-	texinfo.Pan = { lmindex.PanX, lmindex.PanY };
-	texinfo.UScale = lmindex.UScale;
-	texinfo.VScale = lmindex.VScale;
-	return texinfo;
+	return Light.Fogmaps.GetTextureInfo(entry, lmindex);
 #endif
 }
 
-void RenderSubsystem::UpdateFogmapTexture(const LightMapIndex& lmindex, uint32_t* dest, const BspSurface& surface, UZoneInfo* zoneActor, UModel* model)
+void RenderSubsystem::UpdateFogmapTexture(const LightmapAtlas::Entry* entry, const BspSurface& surface, UZoneInfo* zoneActor, UModel* model)
 {
 	FogmapBuilder builder;
 	builder.Setup(model, surface, zoneActor);
 
-	for (UActor* light : Light.Lights)
+	for (UActor* light : Light.FogLights)
 	{
-		if (light && light->VolumeRadius() != 0)
+		if (light->VolumeRadius() != 0)
 		{
 			builder.AddLight(light, engine->CameraLocation);
 		}
 	}
 
-#if 1 // Float high quality lightmaps
 	size_t size = (size_t)builder.Width() * builder.Height();
-	const vec4* src = builder.Pixels();
-	memcpy(dest, src, size * sizeof(vec4));
-#else // Low quality lightmaps like UE1 got them
-	size_t size = (size_t)builder.Width() * builder.Height();
-	const vec4* src = builder.Pixels();
-	for (size_t i = 0; i < size; i++)
-	{
-		const vec4& color = src[i];
+	if (Light.FogTexels.size() < size * 4)
+		Light.FogTexels.resize(size * 4);
 
-		uint32_t red = (uint32_t)clamp(src[i].r * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t green = (uint32_t)clamp(src[i].g * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t blue = (uint32_t)clamp(src[i].b * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t alpha = (uint32_t)clamp(src[i].a * 127.0f + 0.5f, 0.0f, 127.0f);
+	const float* src = &builder.Pixels()->x;
+	uint16_t* dest = Light.FogTexels.data();
+	for (size_t i = 0; i < size * 4; i++)
+		dest[i] = floatToHalf(src[i]);
+
+	Light.Fogmaps.Write(entry, dest);
+
+	FTextureInfo pageinfo = Light.Fogmaps.GetPageTextureInfo(entry);
+	if (!pageinfo.bRealtimeChanged)
+		Device->UpdateTextureRect(pageinfo, entry->X - 1, entry->Y - 1, entry->Width + 2, entry->Height + 2);
+}
+
+void RenderSubsystem::UpdateFogGeneration()
+{
+	Light.FogTexelsLeft = Light.FogTexelBudget;
+	Light.FogTexelsUpdated = 0;
 
-		dest[i] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+	bool changed = false;
+
+	UZoneInfo* cameraZone = engine->CameraActor ? engine->CameraActor->Region().Zone : nullptr;
+	vec3 delta = engine->CameraLocation - Light.FogCameraLocation;
+	if (cameraZone != Light.FogCameraZone || dot(delta, delta) > Light.FogCameraTolerance * Light.FogCameraTolerance)
+	{
+		Light.FogCameraZone = cameraZone;
+		Light.FogCameraLocation = engine->CameraLocation;
+		changed = true;
 	}
-#endif
+
+	for (size_t i = 0; i < Light.FogLights.size(); i++)
+	{
+		UActor* light = Light.FogLights[i];
+		FogLightState& prev = Light.FogLightStates[i];
+
+		FogLightState state;
+		state.Location = light->Location();
+		state.LightBrightness = light->LightBrightness();
+		state.LightHue = light->LightHue();
+		state.LightSaturation = light->LightSaturation();
+		state.VolumeBrightness = light->VolumeBrightness();
+		state.VolumeFog = light->VolumeFog();
+		state.VolumeRadius = light->VolumeRadius();
+
+		bool propertiesChanged =
+			state.LightBrightness != prev.LightBrightness || state.LightHue != prev.LightHue || state.LightSaturation != prev.LightSaturation ||
+			state.VolumeBrightness != prev.VolumeBrightness || state.VolumeFog != prev.VolumeFog || state.VolumeRadius != prev.VolumeRadius;
+		if (propertiesChanged || state.Location != prev.Location)
+		{
+			if (propertiesChanged)
+				light->FogInfo.brightness = -1.0f; // Let FogmapBuilder calculate the fog properties again
+			prev = state;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		Light.FogGeneration++;
 }
@@ -4,6 +4,11 @@
 #include "RenderDevice/RenderDevice.h"
 #include "Engine.h"
 #include "Math/hsb.h"
+#include "Lightmap/LightEffect.h"
+
+#ifndef NOSSE
+#include <emmintrin.h>
+#endif
 
 FTextureInfo RenderSubsystem::GetBrushLightmap(UActor* actor, const Poly& poly, UZoneInfo* zoneActor, UModel* model, const mat4& objectToWorld)
 {
@@ -15,9 +20,8 @@ FTextureInfo RenderSubsystem::GetBrushLightmap(UActor* actor, const Poly& poly,
 
 	uint64_t cacheID = (((uint64_t)model->LightMap[lightmapIndex].LMCacheID) << 32) | (((uint64_t)ambientID) << 8) | 1;
 
-	auto level = engine->Level;
-	auto& lmtexture = Light.lmtextures[cacheID];
-	if (!lmtexture)
+	LightmapAtlas::Entry* entry = Light.Lightmaps.Find(cacheID);
+	if (!entry)
 	{
 		// To do: do we also need to rotate XAxis, YAxis and ZAxis?
 		// To do: is objectToWorld correct here? It needs to be the location used at the original lightmap trace bake in the editor
@@ -27,25 +31,14 @@ FTextureInfo RenderSubsystem::GetBrushLightmap(UActor* actor, const Poly& poly,
 		mapCoords.YAxis = poly.TextureV;
 		mapCoords.ZAxis = poly.Normal;
 
-		Light.Builder.Setup(model, mapCoords, lightmapIndex, zoneActor);
-		Light.Builder.AddStaticLights(model, lightmapIndex);
+		LightmapLights lights = LightmapBuilder::GetLights(model, lightmapIndex, zoneActor);
+		Light.Builder.Setup(model, mapCoords, lightmapIndex, lights);
+		Light.Builder.AddStaticLights(model, lightmapIndex, lights);
 
-		lmtexture = CreateLightmapTexture();
+		entry = AddLightmap(cacheID, *CreateLightmapTexture(Light.Builder));
 	}
 
-	const LightMapIndex& lmindex = model->LightMap[lightmapIndex];
-
-	FTextureInfo texinfo;
-	texinfo.CacheID = cacheID;
-	texinfo.Format = lmtexture->Format;
-	texinfo.Mips = &lmtexture->Mip;
-	texinfo.NumMips = 1;
-	texinfo.USize = texinfo.Mips[0].Width;
-	texinfo.VSize = texinfo.Mips[0].Height;
-	texinfo.Pan = { lmindex.PanX, lmindex.PanY };
-	texinfo.UScale = lmindex.UScale;
-	texinfo.VScale = lmindex.VScale;
-	return texinfo;
+	return Light.Lightmaps.GetTextureInfo(entry, model->LightMap[lightmapIndex]);
 }
 
 FTextureInfo RenderSubsystem::GetSurfaceLightmap(BspSurface& surface, const FSurfaceFacet& facet, UZoneInfo* zoneActor, UModel* model)
@@ -57,140 +50,694 @@ FTextureInfo RenderSubsystem::GetSurfaceLightmap(BspSurface& surface, const FSur
 
 	uint64_t cacheID = (((uint64_t)model->LightMap[surface.LightMap].LMCacheID) << 32) | (((uint64_t)ambientID) << 8) | 1;
 
-	auto level = engine->Level;
-	auto& lmtexture = Light.lmtextures[cacheID];
-	if (!lmtexture)
+	const LightMapIndex& lmindex = model->LightMap[surface.LightMap];
+	LightmapAtlas::Entry* entry = Light.Lightmaps.Find(cacheID);
+	if (!entry)
 	{
+		// Draw with the ambient light until the worker thread is done baking it
+		if (Light.PendingBakes.find(cacheID) != Light.PendingBakes.end())
+			return GetAmbientLightmap(ambientID, zoneActor, lmindex);
+
 		Coords mapCoords;
 		mapCoords.Origin = model->Points[surface.pBase];
 		mapCoords.XAxis = model->Vectors[surface.vTextureU];
 		mapCoords.YAxis = model->Vectors[surface.vTextureV];
 		mapCoords.ZAxis = model->Vectors[surface.vNormal];
 
-		Light.Builder.Setup(model, mapCoords, surface.LightMap, zoneActor);
-		Light.Builder.AddStaticLights(model, surface.LightMap);
+		// Lightmaps evicted from the atlas are baked again in the background
+		if (Light.BakeQueue)
+		{
+			QueueLightmapBake(model, mapCoords, surface.LightMap, zoneActor, cacheID);
+			return GetAmbientLightmap(ambientID, zoneActor, lmindex);
+		}
+
+		LightmapLights lights = LightmapBuilder::GetLights(model, surface.LightMap, zoneActor);
+		Light.Builder.Setup(model, mapCoords, surface.LightMap, lights);
+		Light.Builder.AddStaticLights(model, surface.LightMap, lights);
 
-		lmtexture = CreateLightmapTexture();
+		entry = AddLightmap(cacheID, *CreateLightmapTexture(Light.Builder));
+		RememberLightmapSource(cacheID, model, mapCoords, surface.LightMap, zoneActor);
 	}
 
-	const LightMapIndex& lmindex = model->LightMap[surface.LightMap];
+	return Light.Lightmaps.GetTextureInfo(entry, lmindex);
+}
+
+LightmapAtlas::Entry* RenderSubsystem::AddLightmap(uint64_t cacheID, const LightmapTexture& lmtexture)
+{
+	LightmapAtlas::Entry* entry = Light.Lightmaps.Insert(cacheID, lmtexture.Mip.Width, lmtexture.Mip.Height);
+	Light.Lightmaps.Write(entry, lmtexture.Mip.Data.data());
+
+	FTextureInfo pageinfo = Light.Lightmaps.GetPageTextureInfo(entry);
+	if (!pageinfo.bRealtimeChanged)
+		Device->UpdateTextureRect(pageinfo, entry->X - 1, entry->Y - 1, entry->Width + 2, entry->Height + 2);
+
+	return entry;
+}
+
+FTextureInfo RenderSubsystem::GetAmbientLightmap(uint32_t ambientID, UZoneInfo* zoneActor, const LightMapIndex& lmindex)
+{
+	auto& lmtexture = Light.ambientTextures[ambientID];
+	if (!lmtexture)
+	{
+		vec3 ambientColor = hsbtorgb(zoneActor->AmbientHue(), zoneActor->AmbientSaturation(), zoneActor->AmbientBrightness());
+
+		UnrealMipmap lmmip;
+		lmmip.Width = 1;
+		lmmip.Height = 1;
+		lmmip.Data.resize(sizeof(uint32_t));
+		*(uint32_t*)lmmip.Data.data() = PackRGB9E5(ambientColor.r, ambientColor.g, ambientColor.b);
+
+		lmtexture = std::make_unique<LightmapTexture>();
+		lmtexture->Format = TextureFormat::RGB9E5;
+		lmtexture->Mip = std::move(lmmip);
+	}
 
 	FTextureInfo texinfo;
-	texinfo.CacheID = cacheID;
+	texinfo.CacheID = (((uint64_t)ambientID) << 8) | 3;
 	texinfo.Format = lmtexture->Format;
 	texinfo.Mips = &lmtexture->Mip;
 	texinfo.NumMips = 1;
-	texinfo.USize = texinfo.Mips[0].Width;
-	texinfo.VSize = texinfo.Mips[0].Height;
+	texinfo.USize = 1;
+	texinfo.VSize = 1;
 	texinfo.Pan = { lmindex.PanX, lmindex.PanY };
 	texinfo.UScale = lmindex.UScale;
 	texinfo.VScale = lmindex.VScale;
 	return texinfo;
 }
 
-std::unique_ptr<LightmapTexture> RenderSubsystem::CreateLightmapTexture()
+void RenderSubsystem::StartLightmapBakes()
 {
-#if 1 // Float high quality lightmaps
+	UModel* model = engine->Level->Model;
+	if (model->Nodes.empty() || model->LightMap.empty())
+		return;
 
-	UnrealMipmap lmmip;
-	lmmip.Width = Light.Builder.Width();
-	lmmip.Height = Light.Builder.Height();
-	lmmip.Data.resize((size_t)lmmip.Width * lmmip.Height * sizeof(vec4));
+	// Queue the surfaces in the same way DrawNodeSurface looks up their lightmaps
+	for (const BspNode& node : model->Nodes)
+	{
+		if (node.NumVertices <= 0 || node.Surf < 0)
+			continue;
 
-	vec4* dest = (vec4*)lmmip.Data.data();
-	const vec3* src = Light.Builder.Pixels();
-	int count = lmmip.Width * lmmip.Height;
+		const BspSurface& surface = model->Surfaces[node.Surf];
+		if (surface.LightMap < 0 || (surface.PolyFlags & PF_Unlit))
+			continue;
+
+		UZoneInfo* zoneActor = !model->Zones.empty() ? UObject::TryCast<UZoneInfo>(model->Zones[node.Zone1].ZoneActor) : nullptr;
+		if (!zoneActor)
+			zoneActor = engine->LevelInfo;
+
+		uint32_t ambientID = (((uint32_t)zoneActor->AmbientHue()) << 16) | (((uint32_t)zoneActor->AmbientSaturation()) << 8) | (uint32_t)zoneActor->AmbientBrightness();
+		uint64_t cacheID = (((uint64_t)model->LightMap[surface.LightMap].LMCacheID) << 32) | (((uint64_t)ambientID) << 8) | 1;
+		if (Light.PendingBakes.find(cacheID) != Light.PendingBakes.end())
+			continue;
+
+		Coords mapCoords;
+		mapCoords.Origin = model->Points[surface.pBase];
+		mapCoords.XAxis = model->Vectors[surface.vTextureU];
+		mapCoords.YAxis = model->Vectors[surface.vTextureV];
+		mapCoords.ZAxis = model->Vectors[surface.vNormal];
+
+		QueueLightmapBake(model, mapCoords, surface.LightMap, zoneActor, cacheID);
+	}
+}
+
+void RenderSubsystem::QueueLightmapBake(UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor, uint64_t cacheID)
+{
+	if (!Light.BakeQueue)
+	{
+		Light.BakeQueue = std::make_unique<JobQueue>();
+		Light.BakeBuilders.resize(Light.BakeQueue->GetThreadCount());
+	}
+
+	Light.PendingBakes.insert(cacheID);
+	RememberLightmapSource(cacheID, model, mapCoords, lightMap, zoneActor);
+
+	// Script can change the zone and the lights while the job runs, so it only gets a copy of their properties
+	LightmapLights lights = LightmapBuilder::GetLights(model, lightMap, zoneActor);
+	Light.BakeQueue->Add([=](int threadIndex)
+		{
+			LightmapBuilder& builder = Light.BakeBuilders[threadIndex];
+			builder.Setup(model, mapCoords, lightMap, lights);
+			builder.AddStaticLights(model, lightMap, lights);
+			std::unique_ptr<LightmapTexture> lmtexture = CreateLightmapTexture(builder);
+
+			std::unique_lock lock(Light.BakedMutex);
+			Light.Baked.push_back({ cacheID, std::move(lmtexture) });
+		});
+}
+
+void RenderSubsystem::CancelLightmapBakes()
+{
+	if (Light.BakeQueue)
+		Light.BakeQueue->Cancel();
+
+	Light.PendingBakes.clear();
+	Light.RelightAfterBake.clear();
+	Light.Baked.clear();
+}
+
+void RenderSubsystem::FinishLightmapBakes()
+{
+	if (Light.BakeQueue)
+		Light.BakeQueue->Wait();
+
+	CollectBakedLightmaps();
+}
+
+void RenderSubsystem::CollectBakedLightmaps()
+{
+	if (Light.PendingBakes.empty())
+		return;
+
+	Array<std::pair<uint64_t, std::unique_ptr<LightmapTexture>>> bakedList;
+	{
+		std::unique_lock lock(Light.BakedMutex);
+		std::swap(bakedList, Light.Baked);
+	}
+
+	for (auto& baked : bakedList)
+	{
+		AddLightmap(baked.first, *baked.second);
+		Light.PendingBakes.erase(baked.first);
+
+		// The bake used the light properties from when it was queued
+		if (Light.RelightAfterBake.erase(baked.first))
+		{
+			auto source = Light.RelightSources.find(baked.first);
+			if (source != Light.RelightSources.end())
+				RelightLightmap(baked.first, source->second);
+		}
+	}
+}
+
+static RelightLightState GetRelightLightState(UActor* light)
+{
+	RelightLightState state;
+	state.LightType = light->LightType();
+	state.LightBrightness = light->LightBrightness();
+	state.LightHue = light->LightHue();
+	state.LightSaturation = light->LightSaturation();
+	state.LightEffect = light->LightEffect();
+	state.LightRadius = light->LightRadius();
+	state.LightCone = light->LightCone();
+	state.Location = light->Location();
+	state.Rotation = light->Rotation();
+	return state;
+}
+
+void RenderSubsystem::BuildLightInfluence()
+{
+	Light.LightInfluence.clear();
+	Light.LightStates.clear();
+	Light.LightmapCacheIDs.clear();
+	Light.RelightSources.clear();
+	Light.RelightCacheBytes = 0;
+
+	UModel* model = engine->Level->Model;
+	for (int i = 0; i < (int)model->LightMap.size(); i++)
+	{
+		const LightMapIndex& lmindex = model->LightMap[i];
+		if (lmindex.LightActors < 0)
+			continue;
+
+		for (UActor** lightlist = &model->Lights[lmindex.LightActors]; *lightlist != nullptr; lightlist++)
+			Light.LightInfluence[*lightlist].push_back(i);
+	}
+
+	for (auto& it : Light.LightInfluence)
+		Light.LightStates[it.first] = GetRelightLightState(it.first);
+}
+
+void RenderSubsystem::RememberLightmapSource(uint64_t cacheID, UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor)
+{
+	if (!engine->Level || model != engine->Level->Model)
+		return;
+
+	RelightSource& source = Light.RelightSources[cacheID];
+	if (source.Model)
+		return;
+
+	source.Model = model;
+	source.MapCoords = mapCoords;
+	source.LightMap = lightMap;
+	source.ZoneActor = zoneActor;
+	Light.LightmapCacheIDs[lightMap].push_back(cacheID);
+}
+
+void RenderSubsystem::UpdateDynamicLightmaps()
+{
+	std::set<uint64_t> dirty;
+	for (auto& it : Light.LightInfluence)
+	{
+		UActor* light = it.first;
+		RelightLightState state = GetRelightLightState(light);
+		RelightLightState& prev = Light.LightStates[light];
+
+		bool illuminationChanged =
+			state.LightEffect != prev.LightEffect || state.LightRadius != prev.LightRadius || state.LightCone != prev.LightCone ||
+			state.Location != prev.Location || !(state.Rotation == prev.Rotation);
+		bool colorChanged =
+			state.LightType != prev.LightType || state.LightBrightness != prev.LightBrightness ||
+			state.LightHue != prev.LightHue || state.LightSaturation != prev.LightSaturation;
+		if (!illuminationChanged && !colorChanged)
+			continue;
+		prev = state;
+
+		for (int lightMap : it.second)
+		{
+			auto cacheIDs = Light.LightmapCacheIDs.find(lightMap);
+			if (cacheIDs == Light.LightmapCacheIDs.end())
+				continue;
+
+			for (uint64_t cacheID : cacheIDs->second)
+			{
+				if (illuminationChanged)
+				{
+					// Drop the cached illumination of this light only
+					RelightSource& source = Light.RelightSources[cacheID];
+					const LightMapIndex& lmindex = source.Model->LightMap[lightMap];
+					UActor** lightlist = &source.Model->Lights[lmindex.LightActors];
+					for (int i = 0; i < (int)source.Illumination.size() && lightlist[i] != nullptr; i++)
+					{
+						if (lightlist[i] == light)
+						{
+							Light.RelightCacheBytes -= source.Illumination[i].size() * sizeof(float);
+							source.Illumination[i].clear();
+						}
+					}
+				}
+				dirty.insert(cacheID);
+			}
+		}
+	}
+
+	if (dirty.empty())
+		return;
+
+	// Keep the illumination cache from growing without bounds
+	const size_t maxRelightCacheBytes = 64 * 1024 * 1024;
+	if (Light.RelightCacheBytes > maxRelightCacheBytes)
+	{
+		for (auto& it : Light.RelightSources)
+		{
+			it.second.Illumination.clear();
+			it.second.Illumination.shrink_to_fit();
+		}
+		Light.RelightCacheBytes = 0;
+	}
+
+	for (uint64_t cacheID : dirty)
+		RelightLightmap(cacheID, Light.RelightSources[cacheID]);
+}
+
+void RenderSubsystem::RelightLightmap(uint64_t cacheID, RelightSource& source)
+{
+	// Lightmaps not in the atlas are built from the current light properties the next time they are drawn
+	if (Light.PendingBakes.find(cacheID) != Light.PendingBakes.end())
+	{
+		Light.RelightAfterBake.insert(cacheID);
+		return;
+	}
+
+	LightmapAtlas::Entry* entry = Light.Lightmaps.Find(cacheID);
+	if (!entry)
+		return;
+
+	UModel* model = source.Model;
+	LightmapLights lights = LightmapBuilder::GetLights(model, source.LightMap, source.ZoneActor);
+	Light.Builder.Setup(model, source.MapCoords, source.LightMap, lights);
+
+	int count = (int)lights.Lights.size();
+	if ((int)source.Illumination.size() != count)
+		source.Illumination.resize(count);
+
+	size_t size = (size_t)Light.Builder.Width() * Light.Builder.Height();
 	for (int i = 0; i < count; i++)
 	{
-		dest[i] = vec4(src[i], 1.0f);
+		const LightmapLight& light = lights.Lights[i];
+		Array<float>& illumination = source.Illumination[i];
+		if (illumination.size() != size)
+		{
+			Light.RelightCacheBytes -= illumination.size() * sizeof(float);
+			illumination.resize(size);
+			Light.Builder.CalcLightIllumination(model, source.LightMap, i, light.Source, illumination.data());
+			Light.RelightCacheBytes += size * sizeof(float);
+		}
+
+		if (light.On)
+			Light.Builder.AddLightIllumination(illumination.data(), light.Color);
 	}
 
-	auto lmtexture = std::make_unique<LightmapTexture>();
-	lmtexture->Format = TextureFormat::RGBA32_F;
-	lmtexture->Mip = std::move(lmmip);
-	return lmtexture;
+	std::unique_ptr<LightmapTexture> lmtexture = CreateLightmapTexture(Light.Builder);
+	Light.Lightmaps.Write(entry, lmtexture->Mip.Data.data());
 
-#else // Low quality lightmaps like UE1 got them
+	FTextureInfo pageinfo = Light.Lightmaps.GetPageTextureInfo(entry);
+	if (!pageinfo.bRealtimeChanged)
+		Device->UpdateTextureRect(pageinfo, entry->X - 1, entry->Y - 1, entry->Width + 2, entry->Height + 2);
+}
 
+std::unique_ptr<LightmapTexture> RenderSubsystem::CreateLightmapTexture(const LightmapBuilder& builder)
+{
 	UnrealMipmap lmmip;
-	lmmip.Width = Light.Builder.Width();
-	lmmip.Height = Light.Builder.Height();
-	lmmip.Data.resize((size_t)lmmip.Width * lmmip.Height * 4);
+	lmmip.Width = builder.Width();
+	lmmip.Height = builder.Height();
+	lmmip.Data.resize((size_t)lmmip.Width * lmmip.Height * sizeof(uint32_t));
 
 	uint32_t* dest = (uint32_t*)lmmip.Data.data();
-	const vec3* src = Light.Builder.Pixels();
+	const float* srcR = builder.Red();
+	const float* srcG = builder.Green();
+	const float* srcB = builder.Blue();
 	int count = lmmip.Width * lmmip.Height;
 	for (int i = 0; i < count; i++)
 	{
-		uint32_t red = (uint32_t)clamp(src[i].r * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t green = (uint32_t)clamp(src[i].g * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t blue = (uint32_t)clamp(src[i].b * 127.0f + 0.5f, 0.0f, 127.0f);
-		uint32_t alpha = 127;
-
-		dest[i] = (alpha << 24) | (red << 16) | (green << 8) | blue;
+		dest[i] = PackRGB9E5(srcR[i], srcG[i], srcB[i]);
 	}
 
 	auto lmtexture = std::make_unique<LightmapTexture>();
-	lmtexture->Format = TextureFormat::BGRA8_LM;
+	lmtexture->Format = TextureFormat::RGB9E5;
 	lmtexture->Mip = std::move(lmmip);
 	return lmtexture;
-
-#endif
 }
 
 void RenderSubsystem::UpdateActorLightList(UActor* actor)
 {
 	vec3 location = actor->Location();
 
-	if (!actor->LightInfo.NeedsUpdate && actor->LightInfo.Location == location)
+	// Lights reaching any part of a mesh touch it, not only those reaching its origin
+	float actorRadius = 0.0f;
+	if (actor->DrawType() == DT_Mesh && actor->Mesh())
+	{
+		actor->UpdateMeshBounds();
+		actorRadius = actor->MeshBounds.Radius;
+	}
+
+	if (!actor->LightInfo.NeedsUpdate && actor->LightInfo.Location == location && actor->LightInfo.Radius == actorRadius)
 		return;
 
 	actor->LightInfo.NeedsUpdate = false;
 	actor->LightInfo.Location = location;
+	actor->LightInfo.Radius = actorRadius;
 	actor->LightInfo.LightList.clear();
 
 	if (actor->bUnlit())
+	{
+		actor->LightInfo.Traces.clear();
 		return;
+	}
 
-	for (UActor* light : Light.Lights)
+	// The previous traces are in light list order, allowing them to be merged with the lights in range
+	Array<ActorLightTrace>& traces = actor->LightInfo.Traces;
+	size_t oldCount = traces.size();
+	size_t oldIndex = 0;
+	float toleranceSquared = Light.TraceTolerance * Light.TraceTolerance;
+
+	for (int i = 0; i < (int)Light.Lights.size(); i++)
 	{
+		UActor* light = Light.Lights[i];
 		if (light && !light->bCorona() && !light->bSpecialLit())
 		{
-			float radius = light->WorldLightRadius();
+			float radius = light->WorldLightRadius() + actorRadius;
 			vec3 L = light->Location() - location;
 			if (light->LightEffect() == LE_Cylinder) // Cylinder lights have infinite Z axis range
 			{
 				L.z = 0.0f;
 			}
-			if (dot(L, L) < radius * radius && !engine->Level->TraceRayAnyHit(light->Location(), location, nullptr, false, true, true))
+			if (dot(L, L) >= radius * radius)
+				continue;
+
+			while (oldIndex < oldCount && traces[oldIndex].LightIndex < i)
+				oldIndex++;
+
+			ActorLightTrace trace;
+			if (oldIndex < oldCount && traces[oldIndex].LightIndex == i &&
+				dot(traces[oldIndex].Location - location, traces[oldIndex].Location - location) <= toleranceSquared &&
+				dot(traces[oldIndex].LightLocation - light->Location(), traces[oldIndex].LightLocation - light->Location()) <= toleranceSquared)
+			{
+				trace = traces[oldIndex];
+				Light.TracesSaved++;
+			}
+			else
 			{
-				actor->LightInfo.LightList.push_back(light);
+				trace.LightIndex = i;
+				trace.LightLocation = light->Location();
+				trace.Location = location;
+				trace.Visible = !engine->Level->TraceRayAnyHit(light->Location(), location, nullptr, false, true, true);
+				Light.TracesDone++;
 			}
+
+			// New traces are appended after the old ones and moved to the front once the merge is done
+			traces.push_back(trace);
+
+			if (trace.Visible)
+				actor->LightInfo.LightList.push_back(i);
+		}
+	}
+
+	traces.erase(traces.begin(), traces.begin() + oldCount);
+}
+
+const VertexLightSource& RenderSubsystem::GetVertexLightSource(int index)
+{
+	VertexLightSource& source = Light.VertexLights[index];
+	if (source.FrameCounter == FrameCounter)
+		return source;
+
+	UActor* light = Light.Lights[index];
+	float radius = light->WorldLightRadius();
+
+	source.FrameCounter = FrameCounter;
+	source.Location = light->Location();
+	source.Color = hsbtorgb(light->LightHue(), light->LightSaturation(), light->LightBrightness());
+	source.InvRadius = 1.0f / radius;
+	source.InvRadiusSquared = source.InvRadius * source.InvRadius;
+	source.RadiusSquared = radius * radius;
+	source.SpotDir = vec3(0.0f);
+	source.CosOuterAngle = 1.0f;
+
+	// To do: implement all the light effects
+	switch (light->LightEffect())
+	{
+	case LE_None:
+	case LE_TorchWaver:
+	case LE_FireWaver:
+	case LE_WateryShimmer:
+	case LE_Warp:
+	case LE_OmniBumpMap:
+	case LE_Interference:
+	case LE_SlowWave:
+	case LE_FastWave:
+	case LE_CloudCast:
+	case LE_Shock:
+	case LE_Disco:
+	case LE_Rotor:
+	case LE_Unused:
+		source.LightType = VertexLightSource::Point;
+		break;
+	case LE_NonIncidence:
+		source.LightType = VertexLightSource::NonIncidence;
+		break;
+	case LE_Cylinder:
+		source.LightType = VertexLightSource::Cylinder;
+		break;
+	case LE_Shell:
+		source.LightType = VertexLightSource::Shell;
+		break;
+	case LE_Spotlight:
+	case LE_StaticSpot:
+		{
+			vec3 xaxis, yaxis, zaxis;
+			Coords::Rotation(light->Rotation()).GetAxes(xaxis, yaxis, zaxis);
+			source.LightType = VertexLightSource::Spot;
+			source.SpotDir = -xaxis;
+			source.CosOuterAngle = 1.0f - light->LightCone() * (1.0f / 255.0f);
 		}
+		break;
+	case LE_Searchlight:
+	default:
+		source.LightType = VertexLightSource::None;
+		break;
 	}
+
+	return source;
 }
 
-vec3 RenderSubsystem::GetVertexLight(UActor* actor, const vec3& location, const vec3& normal, bool unlit)
+// Attenuation of a light at a vertex, using the light properties already evaluated for the frame
+static float VertexLightAttenuation(const VertexLightSource& light, const vec3& location, const vec3& N)
+{
+	vec3 L = light.Location - location;
+	switch (light.LightType)
+	{
+	case VertexLightSource::Point:
+		{
+			float distsqr = dot(L, L) * light.InvRadiusSquared;
+			if (distsqr >= 1.0f)
+				return 0.0f;
+			float angleAttenuation = std::abs(dot(L, N) * light.InvRadius);
+			return LightEffect::LightDistanceFalloff(distsqr) * angleAttenuation;
+		}
+	case VertexLightSource::NonIncidence:
+		return std::max(1.0f - std::sqrt(dot(L, L)) * light.InvRadius, 0.0f);
+	case VertexLightSource::Cylinder:
+		return std::max(1.0f - (L.x * L.x + L.y * L.y) * light.InvRadiusSquared, 0.0f);
+	case VertexLightSource::Shell:
+		{
+			float dist = std::sqrt(dot(L, L)) * light.InvRadius;
+			return (dist > 0.8f && dist < 1.0f) ? 1.0f - 10.0f * std::abs(dist - 0.9f) : 0.0f;
+		}
+	case VertexLightSource::Spot:
+		{
+			float distsqr = dot(L, L) * light.InvRadiusSquared;
+			if (distsqr >= 1.0f || light.CosOuterAngle >= 1.0f)
+				return 0.0f;
+			float angleAttenuation = std::abs(dot(L, N) * light.InvRadius);
+			float cosDir = dot(normalize(L), light.SpotDir);
+			float spotAttenuation = 1.0f - std::min((1.0f - cosDir) / (1.0f - light.CosOuterAngle), 1.0f);
+			spotAttenuation = spotAttenuation * spotAttenuation;
+			return LightEffect::LightDistanceFalloff(distsqr) * angleAttenuation * spotAttenuation;
+		}
+	default:
+		return 0.0f;
+	}
+}
+
+static void PointVertexLightScalar(int start, int count, const VertexLightSource& light, const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz, float* r, float* g, float* b)
+{
+	for (int i = start; i < count; i++)
+	{
+		vec3 L = light.Location - vec3(x[i], y[i], z[i]);
+		float distsqr = dot(L, L) * light.InvRadiusSquared;
+		if (distsqr < 1.0f)
+		{
+			float attenuation = LightEffect::LightDistanceFalloff(distsqr) * std::abs(dot(L, vec3(nx[i], ny[i], nz[i])) * light.InvRadius);
+			r[i] += light.Color.x * attenuation;
+			g[i] += light.Color.y * attenuation;
+			b[i] += light.Color.z * attenuation;
+		}
+	}
+}
+
+#ifndef NOSSE
+
+static void PointVertexLightSSE2(int count, const VertexLightSource& light, const float* x, const float* y, const float* z, const float* nx, const float* ny, const float* nz, float* r, float* g, float* b)
+{
+	__m128 lightX = _mm_set1_ps(light.Location.x);
+	__m128 lightY = _mm_set1_ps(light.Location.y);
+	__m128 lightZ = _mm_set1_ps(light.Location.z);
+	__m128 colorR = _mm_set1_ps(light.Color.x);
+	__m128 colorG = _mm_set1_ps(light.Color.y);
+	__m128 colorB = _mm_set1_ps(light.Color.z);
+	__m128 invRadius = _mm_set1_ps(light.InvRadius);
+	__m128 invRadiusSquared = _mm_set1_ps(light.InvRadiusSquared);
+	__m128 bias = _mm_set1_ps(1.0f / 4096.0f);
+	__m128 one = _mm_set1_ps(1.0f);
+	__m128 two = _mm_set1_ps(2.0f);
+	__m128 three = _mm_set1_ps(3.0f);
+	__m128 signMask = _mm_set1_ps(-0.0f);
+
+	int sseend = count / 4 * 4;
+	for (int i = 0; i < sseend; i += 4)
+	{
+		__m128 dx = _mm_sub_ps(lightX, _mm_loadu_ps(x + i));
+		__m128 dy = _mm_sub_ps(lightY, _mm_loadu_ps(y + i));
+		__m128 dz = _mm_sub_ps(lightZ, _mm_loadu_ps(z + i));
+		__m128 distsqr = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)), invRadiusSquared);
+		__m128 inside = _mm_cmplt_ps(distsqr, one);
+		if (_mm_movemask_ps(inside) == 0)
+			continue;
+
+		// LightDistanceFalloff
+		__m128 v = _mm_sqrt_ps(_mm_add_ps(distsqr, bias));
+		__m128 v2 = _mm_mul_ps(v, v);
+		__m128 v3 = _mm_mul_ps(v2, v);
+		__m128 distanceAttenuation = _mm_div_ps(_mm_sub_ps(_mm_add_ps(one, _mm_mul_ps(two, v3)), _mm_mul_ps(three, v2)), v);
+
+		__m128 ndotl = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(nx + i)), _mm_mul_ps(dy, _mm_loadu_ps(ny + i))), _mm_mul_ps(dz, _mm_loadu_ps(nz + i)));
+		__m128 angleAttenuation = _mm_mul_ps(_mm_andnot_ps(signMask, ndotl), invRadius);
+
+		__m128 attenuation = _mm_and_ps(inside, _mm_mul_ps(distanceAttenuation, angleAttenuation));
+		_mm_storeu_ps(r + i, _mm_add_ps(_mm_loadu_ps(r + i), _mm_mul_ps(colorR, attenuation)));
+		_mm_storeu_ps(g + i, _mm_add_ps(_mm_loadu_ps(g + i), _mm_mul_ps(colorG, attenuation)));
+		_mm_storeu_ps(b + i, _mm_add_ps(_mm_loadu_ps(b + i), _mm_mul_ps(colorB, attenuation)));
+	}
+	PointVertexLightScalar(sseend, count, light, x, y, z, nx, ny, nz, r, g, b);
+}
+
+#endif
+
+void RenderSubsystem::GetVertexLights(UActor* actor, const vec3* locations, const vec3* normals, vec3* lights, int count, bool unlit)
 {
 	if (unlit)
 	{
-		return vec3(clamp(actor->ScaleGlow() * 0.5f + actor->AmbientGlow() * (1.0f / 256.0f), 0.0f, 1.0f));
+		vec3 color = vec3(clamp(actor->ScaleGlow() * 0.5f + actor->AmbientGlow() * (1.0f / 256.0f), 0.0f, 1.0f));
+		for (int i = 0; i < count; i++)
+			lights[i] = color;
+		return;
 	}
-	else
+
+	UZoneInfo* zoneActor = UObject::TryCast<UZoneInfo>(engine->Level->Model->Zones[actor->Region().ZoneNumber].ZoneActor);
+	if (!zoneActor)
+		zoneActor = engine->LevelInfo;
+
+	vec3 ambient = hsbtorgb(zoneActor->AmbientHue(), zoneActor->AmbientSaturation(), zoneActor->AmbientBrightness());
+
+	// The lights are accumulated with the vertices split into separate x, y and z planes
+	Light.VertexX.resize(count);
+	Light.VertexY.resize(count);
+	Light.VertexZ.resize(count);
+	Light.NormalX.resize(count);
+	Light.NormalY.resize(count);
+	Light.NormalZ.resize(count);
+	Light.LightR.resize(count);
+	Light.LightG.resize(count);
+	Light.LightB.resize(count);
+	float* x = Light.VertexX.data();
+	float* y = Light.VertexY.data();
+	float* z = Light.VertexZ.data();
+	float* nx = Light.NormalX.data();
+	float* ny = Light.NormalY.data();
+	float* nz = Light.NormalZ.data();
+	float* r = Light.LightR.data();
+	float* g = Light.LightG.data();
+	float* b = Light.LightB.data();
+
+	for (int i = 0; i < count; i++)
 	{
-		UZoneInfo* zoneActor = UObject::TryCast<UZoneInfo>(engine->Level->Model->Zones[actor->Region().ZoneNumber].ZoneActor);
-		if (!zoneActor)
-			zoneActor = engine->LevelInfo;
+		x[i] = locations[i].x;
+		y[i] = locations[i].y;
+		z[i] = locations[i].z;
+		nx[i] = normals[i].x;
+		ny[i] = normals[i].y;
+		nz[i] = normals[i].z;
+		r[i] = ambient.x;
+		g[i] = ambient.y;
+		b[i] = ambient.z;
+	}
 
-		vec3 color = hsbtorgb(zoneActor->AmbientHue(), zoneActor->AmbientSaturation(), zoneActor->AmbientBrightness());
+	for (int index : actor->LightInfo.LightList)
+	{
+		if (index >= (int)Light.Lights.size())
+			continue;
 
-		for (UActor* light : actor->LightInfo.LightList)
+		const VertexLightSource& light = GetVertexLightSource(index);
+		if (light.LightType == VertexLightSource::Point)
 		{
-			float attenuation = LightEffect::VertexLight(light, location, normal);
-			vec3 lightcolor = hsbtorgb(light->LightHue(), light->LightSaturation(), light->LightBrightness());
-			color += lightcolor * attenuation;
+#ifndef NOSSE
+			PointVertexLightSSE2(count, light, x, y, z, nx, ny, nz, r, g, b);
+#else
+			PointVertexLightScalar(0, count, light, x, y, z, nx, ny, nz, r, g, b);
+#endif
+		}
+		else if (light.LightType != VertexLightSource::None)
+		{
+			for (int i = 0; i < count; i++)
+			{
+				float attenuation = VertexLightAttenuation(light, locations[i], normals[i]);
+				r[i] += light.Color.x * attenuation;
+				g[i] += light.Color.y * attenuation;
+				b[i] += light.Color.z * attenuation;
+			}
 		}
-
-		return color * 2.0f;
 	}
+
+	for (int i = 0; i < count; i++)
+		lights[i] = vec3(r[i], g[i], b[i]) * 2.0f;
 }
@@ -4,6 +4,70 @@
 #include "RenderDevice/RenderDevice.h"
 #include "Engine.h"
 
+#ifndef NOSSE
+#include <emmintrin.h>
+#endif
+
+static uint32_t GetMeshPolyFlags(UActor* actor)
+{
+	uint32_t polyFlags = 0;
+	switch (actor->Style())
+	{
+	case 2: polyFlags |= PF_Masked; break; // STY_Masked
+	case 3: polyFlags |= PF_Translucent; break; // STY_Translucent
+	case 4: polyFlags |= PF_Modulated; break; // STY_Modulated
+	}
+	if (actor->bNoSmooth()) polyFlags |= PF_NoSmooth;
+	if (actor->bSelected()) polyFlags |= PF_Selected;
+	if (actor->bMeshEnviroMap()) polyFlags |= PF_Environment;
+	if (actor->bMeshCurvy()) polyFlags |= PF_Flat;
+	if (actor->bUnlit() || actor->Region().ZoneNumber == 0) polyFlags |= PF_Unlit;
+	return polyFlags;
+}
+
+// Interpolates between two animation frames, optionally tweening towards a third, and transforms the result.
+// The transform is given as the four columns of a column major matrix.
+static void AnimateVertices(vec3* dest, const vec3* v0, const vec3* v1, const vec3* v2, int count, float t0, float t1, const vec4* transform)
+{
+	int i = 0;
+#ifndef NOSSE
+	__m128 col0 = _mm_loadu_ps(&transform[0].x);
+	__m128 col1 = _mm_loadu_ps(&transform[1].x);
+	__m128 col2 = _mm_loadu_ps(&transform[2].x);
+	__m128 col3 = _mm_loadu_ps(&transform[3].x);
+	__m128 mt0 = _mm_set1_ps(t0);
+	__m128 mt1 = _mm_set1_ps(t1);
+
+	// The last vertex is left to the scalar loop as a 16 byte load would read past the end of the array
+	for (; i + 1 < count; i++)
+	{
+		__m128 a = _mm_loadu_ps(&v0[i].x);
+		__m128 b = _mm_loadu_ps(&v1[i].x);
+		__m128 p = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), mt0));
+		if (v2)
+		{
+			__m128 c = _mm_loadu_ps(&v2[i].x);
+			p = _mm_add_ps(p, _mm_mul_ps(_mm_sub_ps(c, p), mt1));
+		}
+
+		__m128 x = _mm_shuffle_ps(p, p, _MM_SHUFFLE(0, 0, 0, 0));
+		__m128 y = _mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1));
+		__m128 z = _mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2));
+		__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, x), _mm_mul_ps(col1, y)), _mm_add_ps(_mm_mul_ps(col2, z), col3));
+
+		_mm_storel_pi((__m64*)&dest[i].x, r);
+		_mm_store_ss(&dest[i].z, _mm_movehl_ps(r, r));
+	}
+#endif
+	for (; i < count; i++)
+	{
+		vec3 p = mix(v0[i], v1[i], t0);
+		if (v2)
+			p = mix(p, v2[i], t1);
+		dest[i] = (transform[0] * p.x + transform[1] * p.y + transform[2] * p.z + transform[3]).xyz();
+	}
+}
+
 void RenderSubsystem::DrawMesh(FSceneNode* frame, UActor* actor, bool wireframe)
 {
 	UMesh* mesh = actor->Mesh();
@@ -26,57 +90,35 @@ void RenderSubsystem::DrawMesh(FSceneNode* frame, UActor* actor, bool wireframe)
 
 void RenderSubsystem::DrawMesh(FSceneNode* frame, UActor* actor, UMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld)
 {
-	MeshAnimSeq* seq = mesh->GetSequence(actor->AnimSequence());
-	float animFrame = actor->AnimFrame() * seq->NumFrames;
-
-	int vertexOffsets[3];
-	float t0, t1;
+	uint32_t polyflags = GetMeshPolyFlags(actor);
 
-	if (animFrame >= 0.0f)
-	{
-		int frame0 = (int)animFrame;
-		int frame1 = frame0 + 1;
-		frame0 = frame0 % seq->NumFrames;
-		frame1 = frame1 % seq->NumFrames;
-		t0 = animFrame - (float)frame0;
-		t1 = 0.0f;
-		vertexOffsets[0] = (seq->StartFrame + frame0) * mesh->FrameVerts;
-		vertexOffsets[1] = (seq->StartFrame + frame1) * mesh->FrameVerts;
-		vertexOffsets[2] = 0;
-	}
-	else // Tween from old animation
-	{
-		t0 = actor->TweenFromAnimFrame.T;
-		t1 = clamp(animFrame + 1.0f, 0.0f, 1.0f);
-		vertexOffsets[0] = actor->TweenFromAnimFrame.V0;
-		vertexOffsets[1] = actor->TweenFromAnimFrame.V1;
-		vertexOffsets[2] = seq->StartFrame * mesh->FrameVerts;
-	}
+	const AnimatedMeshVertices* anim = AnimateMeshVertices(actor, mesh, ObjectToWorld, ObjectNormalToWorld, !!(polyflags & PF_Unlit));
+	if (!anim)
+		return;
 
 	SetupMeshTextures(actor, mesh);
 
-	uint32_t polyflags = 0;
-	switch (actor->Style())
-	{
-	case 2: polyflags |= PF_Masked; break; // STY_Masked
-	case 3: polyflags |= PF_Translucent; break; // STY_Translucent
-	case 4: polyflags |= PF_Modulated; break; // STY_Modulated
-	}
-	if (actor->bNoSmooth()) polyflags |= PF_NoSmooth;
-	if (actor->bSelected()) polyflags |= PF_Selected;
-	if (actor->bMeshEnviroMap()) polyflags |= PF_Environment;
-	if (actor->bMeshCurvy()) polyflags |= PF_Flat;
-	if (actor->bNoSmooth()) polyflags |= PF_NoSmooth;
-	if (actor->bUnlit() || actor->Region().ZoneNumber == 0) polyflags |= PF_Unlit;
-
-	GouraudVertex vertices[3];
-	for (const MeshTri& tri : mesh->Tris)
+	const Array<vec3>& positions = anim->Positions;
+	const Array<vec3>& normals = anim->Normals;
+	const Array<vec3>& lights = anim->Lights;
+
+	size_t start = 0;
+	while (start < mesh->Tris.size())
 	{
-		if (tri.TextureIndex >= mesh->Textures.size())
+		// Draw consecutive triangles sharing texture and flags as one indexed triangle list
+		const MeshTri& first = mesh->Tris[start];
+		size_t end = start + 1;
+		while (end < mesh->Tris.size() && mesh->Tris[end].TextureIndex == first.TextureIndex && mesh->Tris[end].PolyFlags == first.PolyFlags)
+			end++;
+
+		size_t runStart = start;
+		start = end;
+
+		if (first.TextureIndex >= mesh->Textures.size())
 			continue;
 
-		uint32_t renderflags = tri.PolyFlags | polyflags;
-		UTexture* tex = (renderflags & PF_Environment) ? Mesh.envmap : Mesh.textures[tri.TextureIndex];
+		uint32_t renderflags = first.PolyFlags | polyflags;
+		UTexture* tex = (renderflags & PF_Environment) ? Mesh.envmap : Mesh.textures[first.TextureIndex];
 		if (!tex)
 			continue;
 
@@ -91,54 +133,69 @@ void RenderSubsystem::DrawMesh(FSceneNode* frame, UActor* actor, UMesh* mesh, co
 		if (tex->Palette())
 			texinfo.Palette = (FColor*)tex->Palette()->Colors.data();
 
+		UploadTextureChanges(texinfo, tex);
+
 		float uscale = (tex ? tex->Mipmaps.front().Width : 256) * (1.0f / 255.0f);
 		float vscale = (tex ? tex->Mipmaps.front().Height : 256) * (1.0f / 255.0f);
 
-		for (int i = 0; i < 3; i++)
-		{
-			vec3 vertex = mesh->Verts[tri.Indices[i]];
-			vertices[i].Point = (ObjectToWorld * vec4(vertex, 1.0f)).xyz();
-			vertices[i].UV = { tri.UV[i].x * uscale, tri.UV[i].y * vscale };
-		}
+		mat3 rotmat = mat3(frame->WorldToView * frame->ObjectToWorld);
 
-		if (renderflags & PF_Environment)
+		// Each triangle corner has its own UV, so the vertices are not shared between triangles
+		Mesh.Vertices.clear();
+		Mesh.Indices.clear();
+		for (size_t t = runStart; t < end; t++)
 		{
-			// To do: this needs to be the smoothed normal
-			vec3 n = normalize(cross(vertices[1].Point - vertices[0].Point, vertices[2].Point - vertices[0].Point));
-			mat3 rotmat = mat3(frame->WorldToView * frame->ObjectToWorld);
+			const MeshTri& tri = mesh->Tris[t];
 			for (int i = 0; i < 3; i++)
 			{
-				vec3 v = normalize(vertices[i].Point);
-				vec3 p = rotmat * reflect(v, n);
-				vertices[i].UV = { (p.x + 1.0f) * 128.0f * uscale, (p.y + 1.0f) * 128.0f * vscale };
-			}
-		}
+				size_t v = tri.Indices[i];
+				if (v >= positions.size())
+				{
+					// Out of bounds. Something is wrong with the mesh. Aborting render to prevent a crash.
+					return;
+				}
 
-		// To do: this needs to be the smoothed normal
-		vec3 n = normalize(cross(vertices[1].Point - vertices[0].Point, vertices[2].Point - vertices[0].Point));
+				GouraudVertex vertex;
+				vertex.Point = positions[v];
+				vertex.Light = lights[v];
+				vertex.Fog = vec4(0.0f);
+				if (renderflags & PF_Environment)
+				{
+					vec3 p = rotmat * reflect(normalize(vertex.Point), normals[v]);
+					vertex.UV = { (p.x + 1.0f) * 128.0f * uscale, (p.y + 1.0f) * 128.0f * vscale };
+				}
+				else
+				{
+					vertex.UV = { tri.UV[i].x * uscale, tri.UV[i].y * vscale };
+				}
 
-		if (renderflags & PF_Environment)
-		{
-			mat3 rotmat = mat3(frame->WorldToView * frame->ObjectToWorld);
-			for (int i = 0; i < 3; i++)
-			{
-				vec3 v = normalize(vertices[i].Point);
-				vec3 p = rotmat * reflect(v, n);
-				vertices[i].UV = { (p.x + 1.0f) * 128.0f * uscale, (p.y + 1.0f) * 128.0f * vscale };
+				Mesh.Indices.push_back((uint32_t)Mesh.Vertices.size());
+				Mesh.Vertices.push_back(vertex);
 			}
 		}
 
-		for (int i = 0; i < 3; i++)
-		{
-			vertices[i].Light = GetVertexLight(actor, vertices[i].Point, n, !!(polyflags & PF_Unlit));
-		}
-
-		Device->DrawGouraudPolygon(frame, texinfo, vertices, 3, renderflags);
+		Device->DrawGouraudTriangles(frame, texinfo, Mesh.Vertices.data(), (int)Mesh.Vertices.size(), Mesh.Indices.data(), (int)Mesh.Indices.size(), renderflags);
 	}
 }
 
 void RenderSubsystem::DrawLodMesh(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld)
 {
+	uint32_t polyFlags = GetMeshPolyFlags(actor);
+
+	const AnimatedMeshVertices* anim = AnimateMeshVertices(actor, mesh, ObjectToWorld, ObjectNormalToWorld, !!(polyFlags & PF_Unlit));
+	if (!anim)
+		return;
+
+	SetupLodMeshTextures(actor, mesh);
+	DrawLodMeshFace(frame, actor, mesh, mesh->Faces, *anim, mesh->SpecialVerts, polyFlags);
+	DrawLodMeshFace(frame, actor, mesh, mesh->SpecialFaces, *anim, 0, polyFlags);
+}
+
+const AnimatedMeshVertices* RenderSubsystem::AnimateMeshVertices(UActor* actor, UMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld, bool unlit)
+{
+	if (mesh->AnimSeqs.empty() || mesh->FrameVerts <= 0 || mesh->Normals.size() != mesh->Verts.size())
+		return nullptr;
+
 	MeshAnimSeq* seq = mesh->GetSequence(actor->AnimSequence());
 	float animFrame = actor->AnimFrame() * seq->NumFrames;
 
@@ -166,9 +223,81 @@ void RenderSubsystem::DrawLodMesh(FSceneNode* frame, UActor* actor, ULodMesh* me
 		vertexOffsets[2] = seq->StartFrame * mesh->FrameVerts;
 	}
 
-	SetupLodMeshTextures(actor, mesh);
-	DrawLodMeshFace(frame, actor, mesh, mesh->Faces, ObjectToWorld, ObjectNormalToWorld, mesh->SpecialVerts, vertexOffsets, t0, t1);
-	DrawLodMeshFace(frame, actor, mesh, mesh->SpecialFaces, ObjectToWorld, ObjectNormalToWorld, 0, vertexOffsets, t0, t1);
+	AnimatedMeshVertices& anim = Mesh.Animated[actor];
+	if (anim.FrameCounter == FrameCounter && anim.Mesh == mesh && anim.Unlit == unlit && anim.T0 == t0 && anim.T1 == t1 &&
+		anim.VertexOffsets[0] == vertexOffsets[0] && anim.VertexOffsets[1] == vertexOffsets[1] && anim.VertexOffsets[2] == vertexOffsets[2] &&
+		memcmp(anim.ObjectToWorld.matrix, ObjectToWorld.matrix, sizeof(ObjectToWorld.matrix)) == 0)
+	{
+		return &anim;
+	}
+
+	int frameCount = (t1 != 0.0f) ? 3 : 2;
+	for (int i = 0; i < frameCount; i++)
+	{
+		if (vertexOffsets[i] < 0 || (size_t)vertexOffsets[i] + mesh->FrameVerts > mesh->Verts.size())
+		{
+			// Out of bounds. Something is wrong with the mesh. Aborting render to prevent a crash.
+			anim.FrameCounter = -1;
+			return nullptr;
+		}
+	}
+
+	anim.FrameCounter = FrameCounter;
+	anim.Mesh = mesh;
+	anim.ObjectToWorld = ObjectToWorld;
+	anim.VertexOffsets[0] = vertexOffsets[0];
+	anim.VertexOffsets[1] = vertexOffsets[1];
+	anim.VertexOffsets[2] = vertexOffsets[2];
+	anim.T0 = t0;
+	anim.T1 = t1;
+	anim.Unlit = unlit;
+
+	int count = mesh->FrameVerts;
+	anim.Positions.resize(count);
+	anim.Normals.resize(count);
+	anim.Lights.resize(count);
+
+	const vec3* verts = mesh->Verts.data();
+	const vec3* meshNormals = mesh->Normals.data();
+
+	vec4 positionTransform[4] =
+	{
+		vec4(ObjectToWorld[0], ObjectToWorld[1], ObjectToWorld[2], ObjectToWorld[3]),
+		vec4(ObjectToWorld[4], ObjectToWorld[5], ObjectToWorld[6], ObjectToWorld[7]),
+		vec4(ObjectToWorld[8], ObjectToWorld[9], ObjectToWorld[10], ObjectToWorld[11]),
+		vec4(ObjectToWorld[12], ObjectToWorld[13], ObjectToWorld[14], ObjectToWorld[15])
+	};
+	vec4 normalTransform[4] =
+	{
+		vec4(ObjectNormalToWorld[0], ObjectNormalToWorld[1], ObjectNormalToWorld[2], 0.0f),
+		vec4(ObjectNormalToWorld[3], ObjectNormalToWorld[4], ObjectNormalToWorld[5], 0.0f),
+		vec4(ObjectNormalToWorld[6], ObjectNormalToWorld[7], ObjectNormalToWorld[8], 0.0f),
+		vec4(0.0f)
+	};
+
+	const vec3* v2 = (t1 != 0.0f) ? verts + vertexOffsets[2] : nullptr;
+	const vec3* n2 = (t1 != 0.0f) ? meshNormals + vertexOffsets[2] : nullptr;
+	AnimateVertices(anim.Positions.data(), verts + vertexOffsets[0], verts + vertexOffsets[1], v2, count, t0, t1, positionTransform);
+	AnimateVertices(anim.Normals.data(), meshNormals + vertexOffsets[0], meshNormals + vertexOffsets[1], n2, count, t0, t1, normalTransform);
+
+	for (int i = 0; i < count; i++)
+		anim.Normals[i] = normalize(anim.Normals[i]);
+
+	GetVertexLights(actor, anim.Positions.data(), anim.Normals.data(), anim.Lights.data(), count, unlit);
+
+	return &anim;
+}
+
+void RenderSubsystem::PruneAnimatedMeshes()
+{
+	// Forget actors that have not been drawn for a while
+	for (auto it = Mesh.Animated.begin(); it != Mesh.Animated.end();)
+	{
+		if (FrameCounter - it->second.FrameCounter > 256)
+			it = Mesh.Animated.erase(it);
+		else
+			++it;
+	}
 }
 
 void RenderSubsystem::SetupMeshTextures(UActor* actor, UMesh* mesh)
@@ -291,29 +420,34 @@ void RenderSubsystem::SetupLodMeshTextures(UActor* actor, ULodMesh* mesh)
 	}
 }
 
-void RenderSubsystem::DrawLodMeshFace(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const Array<MeshFace>& faces, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld, int baseVertexOffset, const int* vertexOffsets, float t0, float t1)
+void RenderSubsystem::DrawLodMeshFace(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const Array<MeshFace>& faces, const AnimatedMeshVertices& anim, int baseVertexOffset, uint32_t polyFlags)
 {
-	uint32_t polyFlags = 0;
-	switch (actor->Style())
+	if (Mesh.WedgeStamps.size() < mesh->Wedges.size())
 	{
-	case 2: polyFlags |= PF_Masked; break; // STY_Masked
-	case 3: polyFlags |= PF_Translucent; break; // STY_Translucent
-	case 4: polyFlags |= PF_Modulated; break; // STY_Modulated
+		Mesh.WedgeStamps.resize(mesh->Wedges.size(), 0);
+		Mesh.WedgeVertices.resize(mesh->Wedges.size(), 0);
 	}
-	if (actor->bNoSmooth()) polyFlags |= PF_NoSmooth;
-	if (actor->bSelected()) polyFlags |= PF_Selected;
-	if (actor->bMeshEnviroMap()) polyFlags |= PF_Environment;
-	if (actor->bMeshCurvy()) polyFlags |= PF_Flat;
-	if (actor->bNoSmooth()) polyFlags |= PF_NoSmooth;
-	if (actor->bUnlit() || actor->Region().ZoneNumber == 0) polyFlags |= PF_Unlit;
 
-	GouraudVertex vertices[3];
-	for (const MeshFace& face : faces)
+	const Array<vec3>& positions = anim.Positions;
+	const Array<vec3>& normals = anim.Normals;
+	const Array<vec3>& lights = anim.Lights;
+
+	size_t start = 0;
+	while (start < faces.size())
 	{
-		if (face.MaterialIndex >= mesh->Materials.size())
+		// Draw consecutive faces sharing a material as one indexed triangle list
+		uint16_t materialIndex = faces[start].MaterialIndex;
+		size_t end = start + 1;
+		while (end < faces.size() && faces[end].MaterialIndex == materialIndex)
+			end++;
+
+		size_t runStart = start;
+		start = end;
+
+		if (materialIndex >= mesh->Materials.size())
 			continue;
 
-		const MeshMaterial& material = mesh->Materials[face.MaterialIndex];
+		const MeshMaterial& material = mesh->Materials[materialIndex];
 
 		uint32_t renderflags = material.PolyFlags | polyFlags;
 		UTexture* tex = (renderflags & PF_Environment) ? Mesh.envmap : Mesh.textures[material.TextureIndex];
@@ -335,57 +469,63 @@ void RenderSubsystem::DrawLodMeshFace(FSceneNode* frame, UActor* actor, ULodMesh
 		if (texinfo.Texture->Palette())
 			texinfo.Palette = (FColor*)texinfo.Texture->Palette()->Colors.data();
 
+		UploadTextureChanges(texinfo, tex);
+
 		float uscale = (texinfo.Texture ? texinfo.Texture->Mipmaps.front().Width : 256) * (1.0f / 255.0f);
 		float vscale = (texinfo.Texture ? texinfo.Texture->Mipmaps.front().Height : 256) * (1.0f / 255.0f);
 
-		vec3 normals[3];
-		for (int i = 0; i < 3; i++)
-		{
-			const MeshWedge& wedge = mesh->Wedges[face.Indices[i]];
+		mat3 rotmat = mat3(frame->WorldToView * frame->ObjectToWorld);
 
-			if ((size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[0] >= mesh->Verts.size() ||
-				(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[1] >= mesh->Verts.size())
-			{
-				// Out of bounds. Something is wrong with the mesh. Aborting render to prevent a crash.
-				return;
-			}
-
-			const vec3& v0 = mesh->Verts[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[0]];
-			const vec3& v1 = mesh->Verts[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[1]];
-			const vec3& n0 = mesh->Normals[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[0]];
-			const vec3& n1 = mesh->Normals[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[1]];
-			vec3 vertex = mix(v0, v1, t0);
-			vec3 normal = mix(n0, n1, t0);
-			if (t1 != 0.0f)
-			{
-				const vec3& v2 = mesh->Verts[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[2]];
-				const vec3& n2 = mesh->Normals[(size_t)wedge.Vertex + baseVertexOffset + vertexOffsets[2]];
-				vertex = mix(vertex, v2, t1);
-				normal = mix(normal, n2, t1);
-			}
-
-			vertices[i].Point = (ObjectToWorld * vec4(vertex, 1.0f)).xyz();
-			vertices[i].UV = { wedge.U * uscale, wedge.V * vscale };
-			normals[i] = normalize(ObjectNormalToWorld * normal);
+		if (++Mesh.WedgeStamp == 0)
+		{
+			std::fill(Mesh.WedgeStamps.begin(), Mesh.WedgeStamps.end(), 0);
+			Mesh.WedgeStamp = 1;
 		}
 
-		if (renderflags & PF_Environment)
+		// Faces of the run sharing a wedge share the vertex
+		Mesh.Vertices.clear();
+		Mesh.Indices.clear();
+		for (size_t f = runStart; f < end; f++)
 		{
-			mat3 rotmat = mat3(frame->WorldToView * frame->ObjectToWorld);
+			const MeshFace& face = faces[f];
 			for (int i = 0; i < 3; i++)
 			{
-				vec3 v = normalize(vertices[i].Point);
-				vec3 p = rotmat * reflect(v, normals[i]);
-				vertices[i].UV = { (p.x + 1.0f) * 128.0f * uscale, (p.y + 1.0f) * 128.0f * vscale };
-			}
-		}
+				uint16_t wedgeIndex = face.Indices[i];
+				size_t v = wedgeIndex < mesh->Wedges.size() ? (size_t)mesh->Wedges[wedgeIndex].Vertex + baseVertexOffset : positions.size();
+				if (v >= positions.size())
+				{
+					// Out of bounds. Something is wrong with the mesh. Aborting render to prevent a crash.
+					return;
+				}
 
-		for (int i = 0; i < 3; i++)
-		{
-			vertices[i].Light = GetVertexLight(actor, vertices[i].Point, normals[i], !!(polyFlags & PF_Unlit));
+				if (Mesh.WedgeStamps[wedgeIndex] != Mesh.WedgeStamp)
+				{
+					const MeshWedge& wedge = mesh->Wedges[wedgeIndex];
+
+					GouraudVertex vertex;
+					vertex.Point = positions[v];
+					vertex.Light = lights[v];
+					vertex.Fog = vec4(0.0f);
+					if (renderflags & PF_Environment)
+					{
+						vec3 p = rotmat * reflect(normalize(vertex.Point), normals[v]);
+						vertex.UV = { (p.x + 1.0f) * 128.0f * uscale, (p.y + 1.0f) * 128.0f * vscale };
+					}
+					else
+					{
+						vertex.UV = { wedge.U * uscale, wedge.V * vscale };
+					}
+
+					Mesh.WedgeStamps[wedgeIndex] = Mesh.WedgeStamp;
+					Mesh.WedgeVertices[wedgeIndex] = (uint32_t)Mesh.Vertices.size();
+					Mesh.Vertices.push_back(vertex);
+				}
+
+				Mesh.Indices.push_back(Mesh.WedgeVertices[wedgeIndex]);
+			}
 		}
 
-		Device->DrawGouraudPolygon(frame, texinfo, vertices, 3, renderflags);
+		Device->DrawGouraudTriangles(frame, texinfo, Mesh.Vertices.data(), (int)Mesh.Vertices.size(), Mesh.Indices.data(), (int)Mesh.Indices.size(), renderflags);
 	}
 }
 
@@ -8,6 +8,8 @@
 
 void RenderSubsystem::DrawScene()
 {
+	PROFILE_ZONE("RenderSubsystem::DrawScene");
+
 	Scene.Clipper.numDrawSpans = 0;
 	Scene.Clipper.numSurfs = 0;
 	Scene.Clipper.numTris = 0;
@@ -40,6 +42,8 @@ void RenderSubsystem::DrawScene()
 
 	mat4 worldToView = Coords::ViewToRenderDev().ToMatrix() * Coords::Rotation(engine->CameraRotation).Inverse().ToMatrix() * Coords::Location(engine->CameraLocation).ToMatrix();
 	DrawFrame(engine->CameraLocation, worldToView);
+
+	ProfileTimer timer(&StageTimes.Translucent, "DrawCoronas");
 	DrawCoronas(&Scene.Frame);
 }
 
@@ -50,61 +54,278 @@ void RenderSubsystem::DrawFrame(const vec3& location, const mat4& worldToView)
 	Scene.ViewLocation = vec4(location, 1.0f);
 	Scene.ViewZone = FindZoneAt(location);
 	Scene.ViewZoneMask = Scene.ViewZone ? 1ULL << Scene.ViewZone : -1;
+	Scene.ViewVisibleZones = Scene.ZonePVS.GetVisibleZones(Scene.ViewZone);
 	Scene.ViewRotation = Coords::Rotation(engine->CameraRotation);
 	Scene.OpaqueNodes.clear();
 	Scene.TranslucentNodes.clear();
 	Scene.Actors.clear();
-	Scene.Coronas.clear(); // To do: don't do this - make them fade out instead if they don't get refreshed
+	Scene.Coronas.clear(); // Coronas no longer in the list fade out in DrawCoronas
+	Scene.Decals.clear();
 	Scene.FrameCounter++;
-	ProcessNode(&engine->Level->Model->Nodes[0]);
 
-	Device->SetSceneNode(&Scene.Frame);
-	for (const DrawNodeInfo& nodeInfo : Scene.OpaqueNodes)
-		DrawNodeSurface(nodeInfo);
-	DrawDecals(&Scene.Frame);
-	DrawActors();
+	{
+		ProfileTimer timer(&StageTimes.Traversal, "ProcessNode");
+		ProcessNode(&engine->Level->Model->Nodes[0]);
+	}
+
+	{
+		ProfileTimer timer(&StageTimes.Surfaces, "DrawSurfaceQueue");
+		Device->SetSceneNode(&Scene.Frame);
+		Scene.SurfaceQueue.clear();
+		Scene.SurfaceVertices.clear();
+		for (const DrawNodeInfo& nodeInfo : Scene.OpaqueNodes)
+			QueueNodeSurface(nodeInfo);
+		DrawSurfaceQueue();
+	}
+
+	{
+		ProfileTimer timer(&StageTimes.Actors, "DrawActors");
+		DrawDecals(&Scene.Frame);
+		DrawActors();
+	}
+
 	// Draw transparent surfaces last
+	ProfileTimer timer(&StageTimes.Translucent, "Translucent surfaces");
 	for (auto it = Scene.TranslucentNodes.rbegin(); it != Scene.TranslucentNodes.rend(); ++it)
 		DrawNodeSurface(*it);
 }
 
-void RenderSubsystem::DrawActors()
+// Actors blending with what is behind them must be drawn back to front after everything opaque
+static bool IsTranslucentActor(UActor* actor)
 {
-	// Sort the actors according to their distance to the camera
-	std::sort(Scene.Actors.begin(), Scene.Actors.end(), 
-		[&](UActor* actor1, UActor* actor2) { 
-			return length(Scene.ViewLocation - vec4(actor1->Location(), 1.0f)) > length(Scene.ViewLocation - vec4(actor2->Location(), 1.0f));
+	int style = actor->Style();
+	if (style == 3 || style == 4) // STY_Translucent, STY_Modulated
+		return true;
+
+	const uint32_t blendFlags = PF_Translucent | PF_Modulated;
+	EDrawType dt = (EDrawType)actor->DrawType();
+	if (dt == DT_Mesh)
+	{
+		if (auto lodmesh = UObject::TryCast<ULodMesh>(actor->Mesh()))
+		{
+			for (const MeshMaterial& material : lodmesh->Materials)
+			{
+				if (material.PolyFlags & blendFlags)
+					return true;
+			}
+			return false;
+		}
+		return (actor->Mesh()->OrFlags & blendFlags) != 0;
+	}
+	else if (dt == DT_Sprite || dt == DT_SpriteAnimOnce)
+	{
+		return (actor->Texture()->PolyFlags() & blendFlags) != 0;
+	}
+	else if (dt == DT_Brush)
+	{
+		for (const Poly& poly : actor->Brush()->Polys->Polys)
+		{
+			if (poly.PolyFlags & blendFlags)
+				return true;
 		}
-	);
+	}
+	return false;
+}
 
-	for (UActor* actor : Scene.Actors)
+void RenderSubsystem::DrawActors()
+{
+	// The sort key is the squared distance to the camera in the upper 32 bits and the index into Scene.Actors in the lower.
+	// The bits of a positive float sort the same way as its value, so the keys can be compared as integers.
+	Scene.OpaqueActorOrder.clear();
+	Scene.TranslucentActorOrder.clear();
+	vec3 viewLocation = Scene.ViewLocation.xyz();
+	for (size_t i = 0; i < Scene.Actors.size(); i++)
 	{
+		UActor* actor = Scene.Actors[i];
 		EDrawType dt = (EDrawType)actor->DrawType();
-		if (dt == DT_Mesh && actor->Mesh())
+		bool drawable =
+			(dt == DT_Mesh && actor->Mesh()) ||
+			((dt == DT_Sprite || dt == DT_SpriteAnimOnce) && actor->Texture()) ||
+			(dt == DT_Brush && actor->Brush());
+		if (!drawable)
+			continue;
+
+		vec3 d = actor->Location() - viewLocation;
+		float distSqr = dot(d, d);
+		uint32_t distBits;
+		memcpy(&distBits, &distSqr, sizeof(uint32_t));
+		uint64_t key = ((uint64_t)distBits << 32) | (uint64_t)i;
+
+		if (IsTranslucentActor(actor))
+			Scene.TranslucentActorOrder.push_back(key);
+		else
+			Scene.OpaqueActorOrder.push_back(key);
+	}
+
+	// Opaque actors front to back so the depth test rejects as much as possible of what is behind them
+	std::sort(Scene.OpaqueActorOrder.begin(), Scene.OpaqueActorOrder.end());
+	for (uint64_t key : Scene.OpaqueActorOrder)
+		DrawSceneActor(Scene.Actors[(uint32_t)key]);
+
+	std::sort(Scene.TranslucentActorOrder.begin(), Scene.TranslucentActorOrder.end(), std::greater<uint64_t>());
+	for (uint64_t key : Scene.TranslucentActorOrder)
+		DrawSceneActor(Scene.Actors[(uint32_t)key]);
+}
+
+void RenderSubsystem::DrawSceneActor(UActor* actor)
+{
+	EDrawType dt = (EDrawType)actor->DrawType();
+	if (dt == DT_Mesh)
+		DrawMesh(&Scene.Frame, actor);
+	else if (dt == DT_Sprite || dt == DT_SpriteAnimOnce)
+		DrawSprite(&Scene.Frame, actor);
+	else if (dt == DT_Brush)
+		DrawBrush(&Scene.Frame, actor);
+}
+
+static FSurfaceInfo GetSurfaceInfo(QueuedSurface& queued)
+{
+	FSurfaceInfo surfaceinfo;
+	surfaceinfo.PolyFlags = queued.PolyFlags;
+	surfaceinfo.Texture = queued.Texture.Texture ? &queued.Texture : nullptr;
+	surfaceinfo.MacroTexture = queued.MacroTexture.Texture ? &queued.MacroTexture : nullptr;
+	surfaceinfo.DetailTexture = queued.DetailTexture.Texture ? &queued.DetailTexture : nullptr;
+	surfaceinfo.LightMap = queued.LightMap.NumMips != 0 ? &queued.LightMap : nullptr;
+	surfaceinfo.FogMap = queued.FogMap.NumMips != 0 ? &queued.FogMap : nullptr;
+	return surfaceinfo;
+}
+
+void RenderSubsystem::DrawNodeSurface(const DrawNodeInfo& nodeInfo)
+{
+	UModel* model = engine->Level->Model;
+	BspNode* node = nodeInfo.Node;
+
+	int numverts = node->NumVertices;
+	vec3* points = GetTempVertexBuffer(numverts);
+
+	BspVert* v = &model->Vertices[node->VertPool];
+	for (int j = 0; j < numverts; j++)
+	{
+		points[j] = model->Points[v[j].Vertex];
+	}
+
+	QueuedSurface queued;
+	FSurfaceFacet facet;
+	facet.Vertices = points;
+	facet.VertexCount = numverts;
+	SetupSurfaceTextures(nodeInfo, facet, queued);
+	facet.MapCoords = queued.MapCoords;
+
+	FSurfaceInfo surfaceinfo = GetSurfaceInfo(queued);
+	Device->DrawComplexSurface(&Scene.Frame, surfaceinfo, facet);
+}
+
+void RenderSubsystem::QueueNodeSurface(const DrawNodeInfo& nodeInfo)
+{
+	UModel* model = engine->Level->Model;
+	BspNode* node = nodeInfo.Node;
+
+	size_t vertexStart = Scene.SurfaceVertices.size();
+	int numverts = node->NumVertices;
+	Scene.SurfaceVertices.resize(vertexStart + numverts);
+	vec3* points = Scene.SurfaceVertices.data() + vertexStart;
+
+	BspVert* v = &model->Vertices[node->VertPool];
+	for (int j = 0; j < numverts; j++)
+	{
+		points[j] = model->Points[v[j].Vertex];
+	}
+
+	// Nodes of the same surface usually follow each other. Reuse the texture setup of the previous node when possible.
+	if (!Scene.SurfaceQueue.empty())
+	{
+		const QueuedSurface& prev = Scene.SurfaceQueue.back();
+		if (prev.Surf == node->Surf && prev.Zone0 == node->Zone0 && prev.Zone1 == node->Zone1 && prev.PolyFlags == nodeInfo.PolyFlags)
 		{
-			DrawMesh(&Scene.Frame, actor);
+			QueuedSurface queued = prev;
+			queued.Texture.bRealtimeChanged = false;
+			queued.MacroTexture.bRealtimeChanged = false;
+			queued.DetailTexture.bRealtimeChanged = false;
+			queued.LightMap.bRealtimeChanged = false;
+			queued.FogMap.bRealtimeChanged = false;
+			queued.VertexStart = vertexStart;
+			queued.VertexCount = numverts;
+			Scene.SurfaceQueue.push_back(queued);
+			return;
 		}
-		else if ((dt == DT_Sprite || dt == DT_SpriteAnimOnce) && (actor->Texture()))
+	}
+
+	FSurfaceFacet facet;
+	facet.Vertices = points;
+	facet.VertexCount = numverts;
+
+	Scene.SurfaceQueue.push_back({});
+	QueuedSurface& queued = Scene.SurfaceQueue.back();
+	SetupSurfaceTextures(nodeInfo, facet, queued);
+	queued.VertexStart = vertexStart;
+	queued.VertexCount = numverts;
+}
+
+void RenderSubsystem::DrawSurfaceQueue()
+{
+	// Sort the surfaces so that surfaces sharing the same PolyFlags and textures are next to each other
+	size_t count = Scene.SurfaceQueue.size();
+	Scene.SurfaceOrder.resize(count);
+	for (size_t i = 0; i < count; i++)
+		Scene.SurfaceOrder[i] = (uint32_t)i;
+
+	const QueuedSurface* queue = Scene.SurfaceQueue.data();
+	std::stable_sort(Scene.SurfaceOrder.begin(), Scene.SurfaceOrder.end(), [=](uint32_t a, uint32_t b)
 		{
-			DrawSprite(&Scene.Frame, actor);
+			const QueuedSurface& sa = queue[a];
+			const QueuedSurface& sb = queue[b];
+			if (sa.PolyFlags != sb.PolyFlags) return sa.PolyFlags < sb.PolyFlags;
+			if (sa.Texture.CacheID != sb.Texture.CacheID) return sa.Texture.CacheID < sb.Texture.CacheID;
+			if (sa.LightMap.CacheID != sb.LightMap.CacheID) return sa.LightMap.CacheID < sb.LightMap.CacheID;
+			if (sa.MacroTexture.CacheID != sb.MacroTexture.CacheID) return sa.MacroTexture.CacheID < sb.MacroTexture.CacheID;
+			if (sa.DetailTexture.CacheID != sb.DetailTexture.CacheID) return sa.DetailTexture.CacheID < sb.DetailTexture.CacheID;
+			return sa.FogMap.CacheID < sb.FogMap.CacheID;
+		});
+
+	Scene.SurfaceInfos.resize(count);
+	Scene.SurfaceFacets.resize(count);
+	Scene.SurfaceBatches = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		QueuedSurface& queued = Scene.SurfaceQueue[Scene.SurfaceOrder[i]];
+		FSurfaceInfo& surfaceinfo = Scene.SurfaceInfos[i];
+		FSurfaceFacet& facet = Scene.SurfaceFacets[i];
+
+		surfaceinfo = GetSurfaceInfo(queued);
+		facet.MapCoords = queued.MapCoords;
+		facet.Vertices = Scene.SurfaceVertices.data() + queued.VertexStart;
+		facet.VertexCount = queued.VertexCount;
+
+		if (i == 0)
+		{
+			Scene.SurfaceBatches++;
 		}
-		else if (dt == DT_Brush && actor->Brush())
+		else
 		{
-			DrawBrush(&Scene.Frame, actor);
+			const QueuedSurface& prev = Scene.SurfaceQueue[Scene.SurfaceOrder[i - 1]];
+			if (prev.PolyFlags != queued.PolyFlags || prev.Texture.CacheID != queued.Texture.CacheID || prev.LightMap.CacheID != queued.LightMap.CacheID)
+				Scene.SurfaceBatches++;
 		}
 	}
+
+	Device->DrawComplexSurfaces(&Scene.Frame, Scene.SurfaceInfos.data(), Scene.SurfaceFacets.data(), (int)count);
 }
 
-void RenderSubsystem::DrawNodeSurface(const DrawNodeInfo& nodeInfo)
+void RenderSubsystem::SetupSurfaceTextures(const DrawNodeInfo& nodeInfo, const FSurfaceFacet& facet, QueuedSurface& queued)
 {
 	UModel* model = engine->Level->Model;
 	BspNode* node = nodeInfo.Node;
 	BspSurface& surface = model->Surfaces[node->Surf];
 	uint32_t PolyFlags = nodeInfo.PolyFlags;
 
-	const vec3& UVec = model->Vectors[surface.vTextureU];
-	const vec3& VVec = model->Vectors[surface.vTextureV];
-	const vec3& Base = model->Points[surface.pBase];
+	queued.Surf = node->Surf;
+	queued.Zone0 = node->Zone0;
+	queued.Zone1 = node->Zone1;
+	queued.PolyFlags = PolyFlags;
+
+	queued.MapCoords.Origin = model->Points[surface.pBase];
+	queued.MapCoords.XAxis = model->Vectors[surface.vTextureU];
+	queued.MapCoords.YAxis = model->Vectors[surface.vTextureV];
 
 	UpdateTexture(surface.Material);
 
@@ -119,66 +340,38 @@ void RenderSubsystem::DrawNodeSurface(const DrawNodeInfo& nodeInfo)
 	float ZoneUPanSpeed = zoneInfo ? zoneInfo->TexUPanSpeed() : engine->LevelInfo->TexUPanSpeed();
 	float ZoneVPanSpeed = zoneInfo ? zoneInfo->TexVPanSpeed() : engine->LevelInfo->TexVPanSpeed();
 
-	FTextureInfo texture;
 	if (surface.Material)
 	{
 		UTexture* tex = surface.Material->GetAnimTexture();
 		UpdateTexture(tex);
-		UpdateTextureInfo(texture, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
+		UpdateTextureInfo(queued.Texture, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
 	}
 
-	FTextureInfo detailtex;
 	if (surface.Material && surface.Material->DetailTexture())
 	{
 		UTexture* tex = surface.Material->DetailTexture()->GetAnimTexture();
 		UpdateTexture(tex);
-		UpdateTextureInfo(detailtex, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
+		UpdateTextureInfo(queued.DetailTexture, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
 	}
 
-	FTextureInfo macrotex;
 	if (surface.Material && surface.Material->MacroTexture())
 	{
 		UTexture* tex = surface.Material->MacroTexture()->GetAnimTexture();
 		UpdateTexture(tex);
-		UpdateTextureInfo(macrotex, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
-	}
-
-	int numverts = node->NumVertices;
-	vec3* points = GetTempVertexBuffer(numverts);
-
-	BspVert* v = &model->Vertices[node->VertPool];
-	for (int j = 0; j < numverts; j++)
-	{
-		points[j] = model->Points[v[j].Vertex];
+		UpdateTextureInfo(queued.MacroTexture, surface, tex, ZoneUPanSpeed, ZoneVPanSpeed);
 	}
 
-	FSurfaceFacet facet;
-	facet.MapCoords.Origin = Base;
-	facet.MapCoords.XAxis = UVec;
-	facet.MapCoords.YAxis = VVec;
-	facet.Vertices = points;
-	facet.VertexCount = numverts;
-
-	FTextureInfo lightmap;
-	FTextureInfo fogmap;
 	if ((PolyFlags & PF_Unlit) == 0)
 	{
+		FSurfaceFacet surfacefacet = facet;
+		surfacefacet.MapCoords = queued.MapCoords;
+
 		UZoneInfo* zoneActor = !model->Zones.empty() ? UObject::TryCast<UZoneInfo>(model->Zones[node->Zone1].ZoneActor) : nullptr;
 		if (!zoneActor)
 			zoneActor = engine->LevelInfo;
-		lightmap = GetSurfaceLightmap(surface, facet, zoneActor, model);
-		fogmap = GetSurfaceFogmap(surface, facet, engine->CameraActor->Region().Zone, model);
+		queued.LightMap = GetSurfaceLightmap(surface, surfacefacet, zoneActor, model);
+		queued.FogMap = GetSurfaceFogmap(surface, surfacefacet, engine->CameraActor->Region().Zone, model);
 	}
-
-	FSurfaceInfo surfaceinfo;
-	surfaceinfo.PolyFlags = PolyFlags;
-	surfaceinfo.Texture = surface.Material ? &texture : nullptr;
-	surfaceinfo.MacroTexture = surface.Material && surface.Material->MacroTexture() ? &macrotex : nullptr;
-	surfaceinfo.DetailTexture = surface.Material && surface.Material->DetailTexture() ? &detailtex : nullptr;
-	surfaceinfo.LightMap = lightmap.NumMips != 0 ? &lightmap : nullptr;
-	surfaceinfo.FogMap = fogmap.NumMips != 0 ? &fogmap : nullptr;
-
-	Device->DrawComplexSurface(&Scene.Frame, surfaceinfo, facet);
 }
 
 int RenderSubsystem::FindZoneAt(const vec3& location)
@@ -214,12 +407,23 @@ void RenderSubsystem::ProcessNode(BspNode* node)
 	if ((node->ZoneMask & Scene.ViewZoneMask) == 0)
 		return;
 
+	// Skip node if none of its zones are potentially visible from the view zone
+	if ((node->ZoneMask & Scene.ViewVisibleZones) == 0)
+		return;
+
 	// Skip node if its AABB is not visible
 	if (node->RenderBound != -1 && !Scene.Clipper.IsAABBVisible(engine->Level->Model->Bounds[node->RenderBound]))
 	{
 		return;
 	}
 
+	// Add the decals in the node that are inside the view frustum
+	for (LevelDecal* decal = node->DecalList; decal != nullptr; decal = decal->Next)
+	{
+		if (Scene.Clipper.IsAABBVisible(decal->Bounds))
+			Scene.Decals.push_back(decal);
+	}
+
 	// Add bsp node actors to the visible set
 	for (UActor* actor = node->ActorList; actor != nullptr; actor = actor->BspInfo.Next)
 	{
@@ -235,12 +439,8 @@ void RenderSubsystem::ProcessNode(BspNode* node)
 				EDrawType dt = (EDrawType)actor->DrawType();
 				if (dt == DT_Mesh && actor->Mesh())
 				{
-					// Note: this doesn't take the rotation into account!
-					BBox bbox = actor->Mesh()->BoundingBox;
-					vec3 Scale = actor->Mesh()->Scale * actor->DrawScale();
-					bbox.min = (bbox.min * Scale) + actor->Location();
-					bbox.max = (bbox.max * Scale) + actor->Location();
-					if (Scene.Clipper.IsAABBVisible(bbox))
+					actor->UpdateMeshBounds();
+					if (Scene.Clipper.IsAABBVisible(actor->MeshBounds.FrameBox))
 					{
 						Scene.Actors.push_back(actor);
 					}
@@ -33,9 +33,6 @@ void RenderSubsystem::DrawSprite(FSceneNode* frame, UActor* actor)
 	FTextureInfo texinfo;
 	texinfo.Texture = texture;
 	texinfo.CacheID = (uint64_t)(ptrdiff_t)texinfo.Texture;
-	texinfo.bRealtimeChanged = texture->TextureModified;
-	if (texture->TextureModified)
-		texture->TextureModified = false;
 	texinfo.Format = texinfo.Texture->ActualFormat;
 	texinfo.Mips = texinfo.Texture->Mipmaps.data();
 	texinfo.NumMips = (int)texinfo.Texture->Mipmaps.size();
@@ -44,6 +41,8 @@ void RenderSubsystem::DrawSprite(FSceneNode* frame, UActor* actor)
 	if (texinfo.Texture->Palette())
 		texinfo.Palette = (FColor*)texinfo.Texture->Palette()->Colors.data();
 
+	UploadTextureChanges(texinfo, texture);
+
 	float texwidth = (float)texture->Mipmaps.front().Width;
 	float texheight = (float)texture->Mipmaps.front().Height;
 
@@ -5,19 +5,66 @@
 #include "GameWindow.h"
 #include "UObject/USubsystem.h"
 #include "VM/ScriptCall.h"
+#include "Package/PackageManager.h"
 #include "Engine.h"
 
 RenderSubsystem::RenderSubsystem(RenderDevice* renderdevice) : Device(renderdevice)
 {
+	// Budget in megabytes for each of the lightmap and fogmap atlases
+	size_t lightmapBudget = std::max(std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "LightmapMemoryBudget", "64").c_str()), 1);
+	Light.Lightmaps.SetMemoryBudget(lightmapBudget * 1024 * 1024);
+	Light.Fogmaps.SetMemoryBudget(lightmapBudget * 1024 * 1024);
+
+	// Budget in megabytes for the textures the render device keeps resident
+	size_t textureBudget = std::max(std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "TextureMemoryBudget", "512").c_str()), 1);
+	Device->SetTextureMemoryBudget((uint64_t)textureBudget * 1024 * 1024);
+
+	// Max fogmap texels rebuilt each frame
+	Light.FogTexelBudget = std::max(std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "FogTexelBudget", "65536").c_str()), 1);
+
+	// Distance the camera can move before the fogmaps are rebuilt for the new view
+	Light.FogCameraTolerance = std::max((float)std::atof(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "FogCameraTolerance", "32").c_str()), 0.0f);
+
+	// Resolution of the coverage mask used for occlusion culling the BSP
+	int occlusionWidth = std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "OcclusionBufferWidth", "640").c_str());
+	int occlusionHeight = std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "OcclusionBufferHeight", "360").c_str());
+	Scene.Clipper.SetResolution(occlusionWidth, occlusionHeight);
+
+	// Distance an actor or a light can move before the visibility trace between them is done again
+	Light.TraceTolerance = std::max((float)std::atof(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "LightTraceTolerance", "8").c_str()), 0.0f);
+
+	// Max corona occlusion traces each frame. Coronas not traced in a frame keep fading towards their last result.
+	Corona.TraceBudget = std::max(std::atoi(engine->packages->GetIniValue("System", "Engine.SurrealRenderSettings", "CoronaTraceBudget", "16").c_str()), 1);
+}
+
+RenderSubsystem::~RenderSubsystem()
+{
+	CancelLightmapBakes();
 }
 
 void RenderSubsystem::DrawGame(float levelTimeElapsed)
 {
+	PROFILE_ZONE("RenderSubsystem::DrawGame");
+
 	FrameCounter++;
 	LevelTimeElapsed = levelTimeElapsed;
 	AutoUV += levelTimeElapsed * 64.0f;
 
-	Light.FogFrameCounter++;
+	Light.Lightmaps.SetFrame(FrameCounter);
+	Light.Fogmaps.SetFrame(FrameCounter);
+	{
+		ProfileTimer timer(&StageTimes.Lighting, "Lighting");
+		CollectBakedLightmaps();
+		UpdateDynamicLightmaps();
+		UpdateFogGeneration();
+	}
+	Light.TracesDone = 0;
+	Light.TracesSaved = 0;
+	if ((FrameCounter & 255) == 0)
+		PruneAnimatedMeshes();
+	if ((FrameCounter & 63) == 0)
+		PruneTextLayouts();
+	UpdateProceduralTextures();
 
 	vec3 flashScale = 0.5f;
 	vec3 flashFog = vec3(1.0f, 0.0f, 0.0f);
@@ -33,16 +80,24 @@ void RenderSubsystem::DrawGame(float levelTimeElapsed)
 	Device->Lock(vec4(flashScale, 1.0f), vec4(flashFog, 1.0f), vec4(0.0f));
 
 	ResetCanvas();
-	PreRender();
+	{
+		ProfileTimer timer(&StageTimes.Canvas, "PreRender");
+		PreRender();
+	}
 
 	if (engine->console->bNoDrawWorld() == false)
 	{
 		DrawScene();
+
+		ProfileTimer timer(&StageTimes.Canvas, "RenderOverlays");
 		RenderOverlays();
 		Device->EndFlash();
 	}
 
-	PostRender();
+	{
+		ProfileTimer timer(&StageTimes.Canvas, "PostRender");
+		PostRender();
+	}
 
 	Device->Unlock(true);
 }
@@ -57,15 +112,77 @@ void RenderSubsystem::UpdateTexture(UTexture* tex)
 {
 	if (tex && tex->FrameCounter != FrameCounter)
 	{
-		tex->Update(LevelTimeElapsed);
+		UFractalTexture* fractal = UObject::TryCast<UFractalTexture>(tex);
+		if (fractal)
+		{
+			// Textures that were not visible last frame catch up with the frames they missed.
+			// The time of the missed frames is estimated from the current frame.
+			if (fractal->SimulatedFrame != FrameCounter)
+			{
+				int frames = tex->FrameCounter >= 0 ? FrameCounter - tex->FrameCounter : UFractalTexture::MaxCatchUpSteps;
+				fractal->PrepareUpdate(LevelTimeElapsed * frames, frames);
+				fractal->Simulate();
+				fractal->SimulatedFrame = FrameCounter;
+			}
+			Procedural.Visible.push_back(fractal);
+		}
+		else
+		{
+			tex->Update(LevelTimeElapsed);
+		}
 		tex->FrameCounter = FrameCounter;
 	}
 }
 
+void RenderSubsystem::UpdateProceduralTextures()
+{
+	PROFILE_ZONE("UpdateProceduralTextures");
+
+	std::swap(Procedural.Simulating, Procedural.Visible);
+	Procedural.Visible.clear();
+	if (Procedural.Simulating.empty())
+		return;
+
+	if (!Procedural.SimulationQueue)
+		Procedural.SimulationQueue = std::make_unique<JobQueue>();
+
+	for (UFractalTexture* tex : Procedural.Simulating)
+	{
+		tex->PrepareUpdate(LevelTimeElapsed, 1);
+		tex->SimulatedFrame = FrameCounter;
+		if (tex->CanSimulateAsync())
+			Procedural.SimulationQueue->Add([=](int threadIndex) { tex->Simulate(); });
+	}
+	Procedural.SimulationQueue->Wait();
+
+	// Textures reading from another texture run afterwards on this thread, since their source may have been simulated too
+	for (UFractalTexture* tex : Procedural.Simulating)
+	{
+		if (!tex->CanSimulateAsync())
+			tex->Simulate();
+	}
+}
+
+void RenderSubsystem::UploadTextureChanges(FTextureInfo& info, UTexture* texture)
+{
+	info.bRealtimeChanged = false;
+	if (!texture->TextureModified)
+		return;
+
+	// Upload only the changed area if the device already has the texture. Otherwise all of it is uploaded when it is drawn.
+	const TextureDirtyRect& rect = texture->DirtyRect;
+	if (!rect.IsEmpty() && texture->Mipmaps.size() == 1 && (rect.X1 - rect.X0 < texture->Mipmaps.front().Width || rect.Y1 - rect.Y0 < texture->Mipmaps.front().Height))
+		Device->UpdateTextureRect(info, rect.X0, rect.Y0, rect.X1 - rect.X0, rect.Y1 - rect.Y0);
+	else
+		info.bRealtimeChanged = true;
+
+	texture->TextureModified = false;
+	texture->DirtyRect.Clear();
+}
+
 void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, BspSurface& surface, UTexture* texture, float ZoneUPanSpeed, float ZoneVPanSpeed)
 {
 	info.CacheID = (uint64_t)(ptrdiff_t)texture;
-	info.bRealtimeChanged = texture->TextureModified;
 	info.UScale = texture->DrawScale();
 	info.VScale = texture->DrawScale();
 	info.Pan.x = -(float)surface.PanU;
@@ -79,8 +196,7 @@ void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, BspSurface& surface,
 	if (texture->Palette())
 		info.Palette = (FColor*)texture->Palette()->Colors.data();
 
-	if (texture->TextureModified)
-		texture->TextureModified = false;
+	UploadTextureChanges(info, texture);
 
 	if (surface.PolyFlags & PF_AutoUPan) info.Pan.x -= AutoUV * ZoneUPanSpeed;
 	if (surface.PolyFlags & PF_AutoVPan) info.Pan.y -= AutoUV * ZoneVPanSpeed;
@@ -89,7 +205,6 @@ void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, BspSurface& surface,
 void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, const Poly& poly, UTexture* texture, float ZoneUPanSpeed, float ZoneVPanSpeed)
 {
 	info.CacheID = (uint64_t)(ptrdiff_t)texture;
-	info.bRealtimeChanged = texture->TextureModified;
 	info.UScale = texture->DrawScale();
 	info.VScale = texture->DrawScale();
 	info.Pan.x = -(float)poly.PanU;
@@ -103,8 +218,7 @@ void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, const Poly& poly, UT
 	if (texture->Palette())
 		info.Palette = (FColor*)texture->Palette()->Colors.data();
 
-	if (texture->TextureModified)
-		texture->TextureModified = false;
+	UploadTextureChanges(info, texture);
 
 	if (poly.PolyFlags & PF_AutoUPan) info.Pan.x -= AutoUV * ZoneUPanSpeed;
 	if (poly.PolyFlags & PF_AutoVPan) info.Pan.y -= AutoUV * ZoneVPanSpeed;
@@ -112,15 +226,61 @@ void RenderSubsystem::UpdateTextureInfo(FTextureInfo& info, const Poly& poly, UT
 
 void RenderSubsystem::OnMapLoaded()
 {
+	CancelLightmapBakes();
+
 	Device->Flush(true);
 
 	Light.Lights.clear();
-	Light.lmtextures.clear();
-	Light.fogtextures.clear();
+	Light.Lightmaps.Clear();
+	Light.Fogmaps.Clear();
+	Light.ambientTextures.clear();
+	Mesh.Animated.clear();
+	Procedural.Visible.clear();
+	Corona.States.clear();
+	Canvas.TextLayouts.clear();
 
 	std::set<UActor*> lightset;
 	for (UActor* light : engine->Level->Model->Lights)
 		lightset.insert(light);
 	for (UActor* light : lightset)
 		Light.Lights.push_back(light);
+
+	// The light lists of the actors are indices into Light.Lights
+	Light.VertexLights.clear();
+	Light.VertexLights.resize(Light.Lights.size());
+	for (UActor* actor : engine->Level->Actors)
+	{
+		if (actor)
+		{
+			actor->LightInfo.NeedsUpdate = true;
+			actor->LightInfo.LightList.clear();
+			actor->LightInfo.Traces.clear();
+		}
+	}
+
+	Light.FogLights.clear();
+	Light.FogLightStates.clear();
+	for (UActor* light : Light.Lights)
+	{
+		if (light && light->VolumeRadius() != 0)
+		{
+			Light.FogLights.push_back(light);
+			Light.FogLightStates.push_back({});
+		}
+	}
+	Light.FogCameraZone = nullptr;
+	Light.FogGeneration++;
+
+	if (!engine->packages->IsDedicatedServer())
+	{
+		Scene.ZonePVS.Setup(engine->LevelPackage, engine->Level->Model);
+		BuildLightInfluence();
+		StartLightmapBakes();
+	}
+}
+
+void RenderSubsystem::OnMapUnloaded()
+{
+	// The bake jobs reference the model of the map
+	CancelLightmapBakes();
 }
@@ -6,8 +6,15 @@
 #include "UObject/ULevel.h"
 #include "UObject/UClient.h"
 #include "RenderDevice/RenderDevice.h"
-#include "BspClipper.h"
+#include "OcclusionBuffer.h"
+#include "ZoneVisibility.h"
 #include "Lightmap/LightmapBuilder.h"
+#include "Lightmap/LightmapAtlas.h"
+#include "Utils/JobQueue.h"
+#include "Utils/Profiler.h"
+#include <mutex>
+#include <set>
+#include <unordered_map>
 
 class RenderDevice;
 
@@ -17,21 +24,153 @@ struct DrawNodeInfo
 	uint32_t PolyFlags;
 };
 
+// Opaque BSP surface waiting to be sorted and submitted to the render device
+struct QueuedSurface
+{
+	int Surf = -1;
+	int Zone0 = 0;
+	int Zone1 = 0;
+	uint32_t PolyFlags = 0;
+	FTextureInfo Texture;
+	FTextureInfo LightMap;
+	FTextureInfo MacroTexture;
+	FTextureInfo DetailTexture;
+	FTextureInfo FogMap;
+	Coords MapCoords;
+	size_t VertexStart = 0; // Index into the scene surface vertices
+	uint32_t VertexCount = 0;
+};
+
 struct LightmapTexture
 {
 	TextureFormat Format;
 	UnrealMipmap Mip;
 };
 
+// What a level lightmap was built from, so it can be relit when one of its lights changes
+struct RelightSource
+{
+	UModel* Model = nullptr;
+	Coords MapCoords;
+	int LightMap = -1;
+	UZoneInfo* ZoneActor = nullptr;
+	Array<Array<float>> Illumination; // Cached attenuation of each light in the light list of the lightmap
+};
+
+// Light properties affecting the lightmaps
+struct RelightLightState
+{
+	// Changes only need the lightmaps to be accumulated again
+	uint8_t LightType = 0;
+	uint8_t LightBrightness = 0;
+	uint8_t LightHue = 0;
+	uint8_t LightSaturation = 0;
+
+	// Changes require the illumination of the light to be calculated again
+	uint8_t LightEffect = 0;
+	uint8_t LightRadius = 0;
+	uint8_t LightCone = 0;
+	vec3 Location = vec3(0.0f);
+	Rotator Rotation;
+};
+
+// Light properties affecting the fogmaps
+struct FogLightState
+{
+	vec3 Location = vec3(0.0f);
+	uint8_t LightBrightness = 0;
+	uint8_t LightHue = 0;
+	uint8_t LightSaturation = 0;
+	uint8_t VolumeBrightness = 0;
+	uint8_t VolumeFog = 0;
+	uint8_t VolumeRadius = 0;
+};
+
+// Light properties used by the vertex lighting, evaluated once per frame for each light
+struct VertexLightSource
+{
+	enum Type : uint8_t
+	{
+		None, // The light effect does not light vertices
+		Point,
+		NonIncidence,
+		Cylinder,
+		Shell,
+		Spot
+	};
+
+	int FrameCounter = -1;
+	Type LightType = None;
+	vec3 Location = vec3(0.0f);
+	vec3 Color = vec3(0.0f);
+	float InvRadius = 0.0f;
+	float InvRadiusSquared = 0.0f;
+	float RadiusSquared = 0.0f;
+	vec3 SpotDir = vec3(0.0f);
+	float CosOuterAngle = 1.0f;
+};
+
+// World space vertices of an animated mesh for the current frame.
+// Each unique vertex is interpolated, transformed and lit once, then shared by every pass drawing the actor (sky, mirrors).
+struct AnimatedMeshVertices
+{
+	int FrameCounter = -1;
+	UMesh* Mesh = nullptr;
+	mat4 ObjectToWorld = mat4::identity();
+	int VertexOffsets[3] = {};
+	float T0 = 0.0f;
+	float T1 = 0.0f;
+	bool Unlit = false;
+	Array<vec3> Positions;
+	Array<vec3> Normals;
+	Array<vec3> Lights;
+};
+
+// Occlusion and fade state of the corona of a light
+struct CoronaState
+{
+	float Brightness = 0.0f;
+	bool Visible = false; // Result of the last occlusion trace
+	int TraceFrame = -1;
+	int SeenFrame = -1; // Last frame the light was in a visible BSP node and in front of the camera
+};
+
+// Glyphs of a string in a font, looked up once and reused by every frame drawing the same string
+struct TextLayoutGlyph
+{
+	UTexture* Texture = nullptr;
+	float StartU = 0.0f;
+	float StartV = 0.0f;
+	float USize = 0.0f;
+	float VSize = 0.0f;
+	bool Newline = false; // DrawText starts a new line here. DrawTextClipped draws the glyph like any other.
+	bool HotKey = false; // DrawTextClipped underlines the glyph. Only set when the layout was made with checkHotKey.
+};
+
+struct TextLayout
+{
+	UFont* Font = nullptr;
+	std::string Text;
+	bool CheckHotKey = false;
+	int FrameCounter = 0;
+	Array<TextLayoutGlyph> Glyphs;
+	ivec2 Size = { 0, 0 }; // Same as GetTextSize: the sum of all glyph widths and the tallest glyph
+};
+
 class RenderSubsystem
 {
 public:
 	RenderSubsystem(RenderDevice* renderdevice);
+	~RenderSubsystem();
 
 	void DrawEditorViewport();
 
 	void DrawGame(float levelTimeElapsed);
 	void OnMapLoaded();
+	void OnMapUnloaded();
+
+	// Waits for the lightmaps baking in the background and adds them to the atlas
+	void FinishLightmapBakes();
 
 	void DrawActor(UActor* actor, bool WireFrame, bool ClearZ);
 	void DrawClippedActor(UActor* actor, bool WireFrame, int X, int Y, int XB, int YB, bool ClearZ);
@@ -43,11 +182,24 @@ public:
 	ivec2 GetTextClippedSize(UFont* font, const std::string& text, float clipX);
 
 	void UpdateTexture(UTexture* tex);
+	void UploadTextureChanges(FTextureInfo& info, UTexture* texture);
 
 	bool ShowTimedemoStats = false;
 	bool ShowRenderStats = false;
+	bool ShowProfileStats = false;
 	bool ShowCollisionDebug = false;
 
+	// CPU time spent in each stage of the renderer, in seconds. Accumulated until reset by the caller.
+	struct
+	{
+		double Lighting = 0.0; // Collecting baked lightmaps, relighting and fogmap generations
+		double Traversal = 0.0; // BSP traversal and occlusion culling
+		double Surfaces = 0.0; // Lightmaps, fogmaps and submitting the opaque BSP surfaces
+		double Actors = 0.0; // Decals, meshes, sprites and brushes
+		double Translucent = 0.0; // Translucent BSP surfaces and coronas
+		double Canvas = 0.0; // Script rendering of the HUD and console
+	} StageTimes;
+
 private:
 	void DrawScene();
 	void DrawFrame(const vec3& location, const mat4& worldToView);
@@ -56,19 +208,36 @@ private:
 	void ProcessNode(BspNode* node);
 	void ProcessNodeSurface(BspNode* node);
 	void DrawNodeSurface(const DrawNodeInfo& nodeInfo);
+	void QueueNodeSurface(const DrawNodeInfo& nodeInfo);
+	void SetupSurfaceTextures(const DrawNodeInfo& nodeInfo, const FSurfaceFacet& facet, QueuedSurface& queued);
+	void DrawSurfaceQueue();
 	void DrawActors();
+	void DrawSceneActor(UActor* actor);
 	void SetupSceneFrame(const mat4& worldToView);
 
 	FTextureInfo GetBrushLightmap(UActor* actor, const Poly& poly, UZoneInfo* zoneActor, UModel* model, const mat4& objectToWorld);
 	FTextureInfo GetSurfaceLightmap(BspSurface& surface, const FSurfaceFacet& facet, UZoneInfo* zoneActor, UModel* model);
-	std::unique_ptr<LightmapTexture> CreateLightmapTexture();
+	FTextureInfo GetAmbientLightmap(uint32_t ambientID, UZoneInfo* zoneActor, const LightMapIndex& lmindex);
+	static std::unique_ptr<LightmapTexture> CreateLightmapTexture(const LightmapBuilder& builder);
+	LightmapAtlas::Entry* AddLightmap(uint64_t cacheID, const LightmapTexture& lmtexture);
+	void QueueLightmapBake(UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor, uint64_t cacheID);
+	void RememberLightmapSource(uint64_t cacheID, UModel* model, const Coords& mapCoords, int lightMap, UZoneInfo* zoneActor);
+	void BuildLightInfluence();
+	void UpdateDynamicLightmaps();
+	void RelightLightmap(uint64_t cacheID, RelightSource& source);
+	void StartLightmapBakes();
+	void CancelLightmapBakes();
+	void CollectBakedLightmaps();
 	void UpdateActorLightList(UActor* actor);
-	vec3 GetVertexLight(UActor* actor, const vec3& location, const vec3& normal, bool unlit);
+	void GetVertexLights(UActor* actor, const vec3* locations, const vec3* normals, vec3* lights, int count, bool unlit);
+	const VertexLightSource& GetVertexLightSource(int index);
 
 	FTextureInfo GetSurfaceFogmap(BspSurface& surface, const FSurfaceFacet& facet, UZoneInfo* zoneActor, UModel* model);
 	void UpdateTextureInfo(FTextureInfo& info, BspSurface& surface, UTexture* texture, float ZoneUPanSpeed, float ZoneVPanSpeed);
 	void UpdateTextureInfo(FTextureInfo& info, const Poly& poly, UTexture* texture, float ZoneUPanSpeed, float ZoneVPanSpeed);
-	void UpdateFogmapTexture(const LightMapIndex& lmindex, uint32_t* texels, const BspSurface& surface, UZoneInfo* zoneActor, UModel* model);
+	void UpdateFogmapTexture(const LightmapAtlas::Entry* entry, const BspSurface& surface, UZoneInfo* zoneActor, UModel* model);
+	void UpdateFogGeneration();
+	void UpdateProceduralTextures();
 
 	void ResetCanvas();
 	void PreRender();
@@ -77,20 +246,28 @@ private:
 	void DrawTimedemoStats();
 	void DrawCollisionDebug();
 	void DrawTile(FTextureInfo& texinfo, const Rectf& dest, const Rectf& src, const Rectf& clipBox, float Z, vec4 color, vec4 fog, uint32_t flags);
+	const TextLayout& GetTextLayout(UFont* font, const std::string& text, bool checkHotKey);
+	void PruneTextLayouts();
+	void AddTextTile(UTexture* texture, const Rectf& dest, const Rectf& src);
+	void DrawTextTiles(vec4 color, uint32_t flags);
 
 	void DrawMesh(FSceneNode* frame, UActor* actor, bool wireframe = false);
 	void DrawMesh(FSceneNode* frame, UActor* actor, UMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld);
 	void DrawLodMesh(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld);
-	void DrawLodMeshFace(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const Array<MeshFace>& faces, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld, int baseVertexOffset, const int* vertexOffsets, float t0, float t1);
+	void DrawLodMeshFace(FSceneNode* frame, UActor* actor, ULodMesh* mesh, const Array<MeshFace>& faces, const AnimatedMeshVertices& anim, int baseVertexOffset, uint32_t polyFlags);
 	void DrawSkeletalMesh(FSceneNode* frame, UActor* actor, USkeletalMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld);
 	void SetupMeshTextures(UActor* actor, UMesh* mesh);
 	void SetupLodMeshTextures(UActor* actor, ULodMesh* mesh);
+	const AnimatedMeshVertices* AnimateMeshVertices(UActor* actor, UMesh* mesh, const mat4& ObjectToWorld, const mat3& ObjectNormalToWorld, bool unlit);
+	void PruneAnimatedMeshes();
 
 	void DrawBrush(FSceneNode* frame, UActor* actor);
 	void DrawBrushPoly(FSceneNode* frame, UModel* model, const Poly& poly, int pass, UActor* actor);
 
 	void DrawSprite(FSceneNode* frame, UActor* actor);
 	void DrawCoronas(FSceneNode* frame);
+	void UpdateCoronaOcclusion(FSceneNode* frame);
+	void DrawCorona(FSceneNode* frame, UActor* light, float brightness);
 	void DrawDecals(FSceneNode* frame);
 
 	RenderDevice* Device = nullptr;
@@ -106,38 +283,130 @@ private:
 		int framesDrawn = 0;
 		uint64_t startFPSTime = 0;
 		FSceneNode Frame;
+
+		std::unordered_map<uint64_t, TextLayout> TextLayouts;
+
+		// Glyph tiles of the text being drawn, grouped by font page texture
+		struct TextTileBatch
+		{
+			UTexture* Texture = nullptr;
+			Array<TileRect> Tiles;
+		};
+		Array<TextTileBatch> TextBatches;
 	} Canvas;
 
 	struct
 	{
 		Array<UTexture*> textures;
 		UTexture* envmap = nullptr;
+
+		std::unordered_map<UActor*, AnimatedMeshVertices> Animated;
+
+		// Scratch buffers for the indexed triangles of a run of faces sharing a material
+		Array<GouraudVertex> Vertices;
+		Array<uint32_t> Indices;
+		Array<uint32_t> WedgeStamps; // Wedges with the current stamp already have a vertex in the run
+		Array<uint32_t> WedgeVertices;
+		uint32_t WedgeStamp = 0;
 	} Mesh;
 
 	struct
 	{
 		FSceneNode Frame;
-		BspClipper Clipper;
+		OcclusionBuffer Clipper;
 		vec4 ViewLocation;
 		Coords ViewRotation;
 		int ViewZone = 0;
 		uint64_t ViewZoneMask = 0;
+		uint64_t ViewVisibleZones = 0;
+		ZoneVisibility ZonePVS;
 		Array<DrawNodeInfo> OpaqueNodes;
 		Array<DrawNodeInfo> TranslucentNodes;
+		Array<QueuedSurface> SurfaceQueue;
+		Array<vec3> SurfaceVertices;
+		Array<uint32_t> SurfaceOrder;
+		Array<FSurfaceInfo> SurfaceInfos;
+		Array<FSurfaceFacet> SurfaceFacets;
+		int SurfaceBatches = 0;
 		Array<UActor*> Coronas;
+		Array<LevelDecal*> Decals;
 		Array<UActor*> Actors;
+		Array<uint64_t> OpaqueActorOrder;
+		Array<uint64_t> TranslucentActorOrder;
 		int FrameCounter = 0;
 	} Scene;
 
 	struct
 	{
-		std::map<uint64_t, std::unique_ptr<LightmapTexture>> lmtextures;
-		std::map<uint64_t, std::pair<int, std::unique_ptr<LightmapTexture>>> fogtextures;
+		LightmapAtlas Lightmaps{ TextureFormat::RGB9E5, 4, 1024, 4 };
+		LightmapAtlas Fogmaps{ TextureFormat::RGBA16_F, 8, 512, 5 };
+		Array<uint16_t> FogTexels;
 		Array<UActor*> Lights;
 		LightmapBuilder Builder;
-		int FogFrameCounter = 0;
+
+		// Fogmaps are rebuilt when the camera changes zone or moves more than FogCameraTolerance, or when a volumetric light changes.
+		// The rebuilds are spread over several frames by a per frame texel budget.
+		Array<UActor*> FogLights;
+		Array<FogLightState> FogLightStates;
+		int FogGeneration = 0;
+		UZoneInfo* FogCameraZone = nullptr;
+		vec3 FogCameraLocation = vec3(0.0f);
+		float FogCameraTolerance = 32.0f;
+		int FogTexelBudget = 65536;
+		int FogTexelsLeft = 0;
+		int FogTexelsUpdated = 0;
+
+		// Static lightmaps baked by worker threads after a map is loaded.
+		// Surfaces with a pending bake are drawn with an ambient only lightmap until the result is collected.
+		std::unique_ptr<JobQueue> BakeQueue;
+		Array<LightmapBuilder> BakeBuilders; // One for each bake thread
+		std::set<uint64_t> PendingBakes;
+		std::set<uint64_t> RelightAfterBake; // Pending bakes whose lights changed after the bake was queued
+		std::map<uint32_t, std::unique_ptr<LightmapTexture>> ambientTextures;
+		std::mutex BakedMutex;
+		Array<std::pair<uint64_t, std::unique_ptr<LightmapTexture>>> Baked; // Protected by BakedMutex
+
+		// Lightmaps touched by each light, as indices into UModel::LightMap
+		std::unordered_map<UActor*, Array<int>> LightInfluence;
+		std::unordered_map<UActor*, RelightLightState> LightStates;
+		std::unordered_map<int, Array<uint64_t>> LightmapCacheIDs; // Cache IDs created for each UModel::LightMap index
+		std::unordered_map<uint64_t, RelightSource> RelightSources;
+		size_t RelightCacheBytes = 0;
+
+		// Vertex lighting. The sources are refreshed the first time a light is used in a frame.
+		Array<VertexLightSource> VertexLights; // One for each entry in Lights
+		Array<float> VertexX, VertexY, VertexZ;
+		Array<float> NormalX, NormalY, NormalZ;
+		Array<float> LightR, LightG, LightB;
+
+		// Light visibility traces are reused while the actor and the light move less than the tolerance
+		float TraceTolerance = 8.0f;
+		int TracesDone = 0;
+		int TracesSaved = 0;
 	} Light;
 
+	struct
+	{
+		// Procedural textures drawn this frame. Only visible textures are simulated.
+		Array<UFractalTexture*> Visible;
+
+		// The textures drawn last frame are simulated in parallel at the start of the next one
+		Array<UFractalTexture*> Simulating;
+		std::unique_ptr<JobQueue> SimulationQueue;
+	} Procedural;
+
+	struct
+	{
+		// Coronas fade towards the result of the last occlusion trace of their light, and fade out once the light is no longer seen.
+		// At most TraceBudget lights are traced each frame, the ones with the oldest result first.
+		std::unordered_map<UActor*, CoronaState> States;
+		Array<std::pair<UActor*, CoronaState*>> TraceOrder;
+		int TraceBudget = 16;
+		float FadeRate = 4.0f; // Brightness change per second
+		int TracesDone = 0;
+		int Drawn = 0;
+	} Corona;
+
 	Array<vec3> VertexBuffer;
 
 	vec3* GetTempVertexBuffer(size_t count)
@@ -0,0 +1,255 @@
+#include "Precomp.h"
+#include "ZoneVisibility.h"
+#include "Package/Package.h"
+#include "UObject/ULevel.h"
+#include "UObject/UTexture.h"
+#include "Utils/File.h"
+#include <tuple>
+
+namespace
+{
+	const uint32_t ZoneVisibilitySignature = 0x20535650; // "PVS "
+	const uint32_t ZoneVisibilityFormatVersion = 1;
+
+	struct ZoneVisibilityHeader
+	{
+		uint32_t Signature;
+		uint32_t FormatVersion;
+		uint64_t SourceFileSize;
+		uint32_t NodeCount;
+		uint32_t SurfaceCount;
+	};
+
+	// Max portal chains examined for each zone before falling back to plain portal connectivity
+	const int FlowBudget = 100000;
+
+	const float PlaneEpsilon = 0.1f;
+}
+
+std::string ZoneVisibility::GetFilename(Package* package)
+{
+	return package->GetPackageFilename() + ".pvs";
+}
+
+void ZoneVisibility::Setup(Package* package, UModel* model)
+{
+	if (package && Load(package, model))
+		return;
+
+	Build(model);
+	if (!package)
+		return;
+
+	try
+	{
+		Save(package, model);
+	}
+	catch (const std::exception&)
+	{
+		// The cache file is optional. The map folder may be read only.
+	}
+}
+
+void ZoneVisibility::Clear()
+{
+	IsBuilt = false;
+	for (int i = 0; i < 64; i++)
+	{
+		VisibleZones[i] = 0;
+		ConnectedZones[i] = 0;
+		ZonePortals[i].clear();
+	}
+	Portals.clear();
+	Chain.clear();
+}
+
+void ZoneVisibility::Build(UModel* model)
+{
+	Clear();
+	FindPortals(model);
+	FindConnectedZones(model);
+
+	for (int zone = 1; zone < 64; zone++)
+	{
+		uint64_t visible = 1ULL << zone;
+		int budget = FlowBudget;
+		FlowThroughPortals(zone, visible, visible, budget);
+		if (budget <= 0)
+			visible |= ConnectedZones[zone];
+		VisibleZones[zone] = visible;
+	}
+
+	Portals.clear();
+	Chain.clear();
+	for (int i = 0; i < 64; i++)
+		ZonePortals[i].clear();
+
+	IsBuilt = true;
+}
+
+void ZoneVisibility::FindPortals(UModel* model)
+{
+	// Group the nodes of each portal by the zones it connects and its plane
+	std::map<std::tuple<int, int, int, int, int, int>, int> portalIndexes;
+
+	for (const BspNode& node : model->Nodes)
+	{
+		if (node.Surf < 0 || node.NumVertices < 3 || node.Zone0 == node.Zone1)
+			continue;
+		if (node.Zone0 <= 0 || node.Zone0 >= 64 || node.Zone1 <= 0 || node.Zone1 >= 64)
+			continue;
+
+		const BspSurface& surface = model->Surfaces[node.Surf];
+		uint32_t polyFlags = surface.PolyFlags;
+		if (surface.Material)
+			polyFlags |= surface.Material->PolyFlags();
+		if ((polyFlags & PF_Portal) == 0)
+			continue;
+
+		// Zone1 is in front of the node plane and Zone0 is behind it
+		vec4 plane = { node.PlaneX, node.PlaneY, node.PlaneZ, -node.PlaneW };
+		for (int side = 0; side < 2; side++)
+		{
+			int fromZone = side == 0 ? node.Zone1 : node.Zone0;
+			int toZone = side == 0 ? node.Zone0 : node.Zone1;
+			vec4 farPlane = side == 0 ? -plane : plane;
+
+			auto key = std::make_tuple(fromZone, toZone,
+				(int)std::round(plane.x * 1000.0f), (int)std::round(plane.y * 1000.0f), (int)std::round(plane.z * 1000.0f), (int)std::round(plane.w));
+
+			auto it = portalIndexes.find(key);
+			if (it == portalIndexes.end())
+			{
+				Portal portal;
+				portal.FromZone = fromZone;
+				portal.ToZone = toZone;
+				portal.FarPlane = farPlane;
+				it = portalIndexes.insert({ key, (int)Portals.size() }).first;
+				ZonePortals[fromZone].push_back((int)Portals.size());
+				Portals.push_back(std::move(portal));
+			}
+
+			Portal& portal = Portals[it->second];
+			const BspVert* v = &model->Vertices[node.VertPool];
+			for (int i = 0; i < node.NumVertices; i++)
+				portal.Points.push_back(model->Points[v[i].Vertex]);
+		}
+	}
+}
+
+void ZoneVisibility::FindConnectedZones(UModel* model)
+{
+	uint64_t neighbors[64] = {};
+	for (const Portal& portal : Portals)
+		neighbors[portal.FromZone] |= 1ULL << portal.ToZone;
+	for (int zone = 1; zone < 64 && zone < (int)model->Zones.size(); zone++)
+		neighbors[zone] |= model->Zones[zone].Connectivity & ~1ULL;
+
+	for (int zone = 1; zone < 64; zone++)
+	{
+		uint64_t connected = 1ULL << zone;
+		uint64_t previous = 0;
+		while (connected != previous)
+		{
+			previous = connected;
+			for (int i = 1; i < 64; i++)
+			{
+				if (connected & (1ULL << i))
+					connected |= neighbors[i];
+			}
+		}
+		ConnectedZones[zone] = connected;
+	}
+}
+
+void ZoneVisibility::FlowThroughPortals(int zone, uint64_t pathZones, uint64_t& visible, int& budget)
+{
+	for (int portalIndex : ZonePortals[zone])
+	{
+		if (budget <= 0)
+			return;
+
+		const Portal& portal = Portals[portalIndex];
+		uint64_t toZoneBit = 1ULL << portal.ToZone;
+		if (pathZones & toZoneBit)
+			continue;
+
+		// A line passing through every portal in the chain must stay beyond each portal once it has passed it
+		bool possible = true;
+		for (const Portal* prev : Chain)
+		{
+			if (!IsAnyPointInFront(portal.Points, prev->FarPlane) || !IsAnyPointBehind(prev->Points, portal.FarPlane))
+			{
+				possible = false;
+				break;
+			}
+		}
+		if (!possible)
+			continue;
+
+		visible |= toZoneBit;
+		budget--;
+
+		Chain.push_back(&portal);
+		FlowThroughPortals(portal.ToZone, pathZones | toZoneBit, visible, budget);
+		Chain.pop_back();
+	}
+}
+
+bool ZoneVisibility::IsAnyPointInFront(const Array<vec3>& points, const vec4& plane)
+{
+	for (const vec3& p : points)
+	{
+		if (dot(vec4(p, 1.0f), plane) > -PlaneEpsilon)
+			return true;
+	}
+	return false;
+}
+
+bool ZoneVisibility::IsAnyPointBehind(const Array<vec3>& points, const vec4& plane)
+{
+	for (const vec3& p : points)
+	{
+		if (dot(vec4(p, 1.0f), plane) < PlaneEpsilon)
+			return true;
+	}
+	return false;
+}
+
+void ZoneVisibility::Save(Package* package, UModel* model)
+{
+	ZoneVisibilityHeader header = {};
+	header.Signature = ZoneVisibilitySignature;
+	header.FormatVersion = ZoneVisibilityFormatVersion;
+	header.SourceFileSize = File::open_existing(package->GetPackageFilename())->size();
+	header.NodeCount = (uint32_t)model->Nodes.size();
+	header.SurfaceCount = (uint32_t)model->Surfaces.size();
+
+	auto file = File::create_always(GetFilename(package));
+	file->write(&header, sizeof(ZoneVisibilityHeader));
+	file->write(VisibleZones, sizeof(VisibleZones));
+}
+
+bool ZoneVisibility::Load(Package* package, UModel* model)
+{
+	Clear();
+
+	auto file = File::try_open_existing(GetFilename(package));
+	if (!file || (size_t)file->size() != sizeof(ZoneVisibilityHeader) + sizeof(VisibleZones))
+		return false;
+
+	ZoneVisibilityHeader header = {};
+	file->read(&header, sizeof(ZoneVisibilityHeader));
+	if (header.Signature != ZoneVisibilitySignature || header.FormatVersion != ZoneVisibilityFormatVersion)
+		return false;
+
+	if (header.NodeCount != (uint32_t)model->Nodes.size() || header.SurfaceCount != (uint32_t)model->Surfaces.size())
+		return false;
+
+	if (header.SourceFileSize != (uint64_t)File::open_existing(package->GetPackageFilename())->size())
+		return false;
+
+	file->read(VisibleZones, sizeof(VisibleZones));
+	IsBuilt = true;
+	return true;
+}
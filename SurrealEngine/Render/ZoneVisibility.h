@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Math/vec.h"
+
+class Package;
+class UModel;
+
+// Potentially visible set for the zones of a level.
+//
+// A zone is potentially visible from another zone if a straight line can pass through the chain of portals
+// connecting them. Each portal in the chain must lie at least partially beyond the planes of the portals before it.
+// The test is conservative: it never rejects a zone that can be seen, but it may accept zones that are hidden.
+class ZoneVisibility
+{
+public:
+	// Loads the cached visibility for the level, or builds it and writes the cache file
+	void Setup(Package* package, UModel* model);
+
+	void Build(UModel* model);
+	void Save(Package* package, UModel* model);
+	bool Load(Package* package, UModel* model);
+	void Clear();
+
+	// Returns a bit mask of the zones potentially visible from the zone
+	uint64_t GetVisibleZones(int zone) const { return (IsBuilt && zone > 0 && zone < 64) ? VisibleZones[zone] : ~0ULL; }
+
+	static std::string GetFilename(Package* package);
+
+private:
+	struct Portal
+	{
+		int FromZone = 0;
+		int ToZone = 0;
+		vec4 FarPlane = vec4(0.0f); // Points beyond the portal, as seen from FromZone, are in front of this plane
+		Array<vec3> Points;
+	};
+
+	void FindPortals(UModel* model);
+	void FindConnectedZones(UModel* model);
+	void FlowThroughPortals(int zone, uint64_t pathZones, uint64_t& visible, int& budget);
+	static bool IsAnyPointInFront(const Array<vec3>& points, const vec4& plane);
+	static bool IsAnyPointBehind(const Array<vec3>& points, const vec4& plane);
+
+	bool IsBuilt = false;
+	uint64_t VisibleZones[64] = {};
+	uint64_t ConnectedZones[64] = {};
+	Array<Portal> Portals;
+	Array<int> ZonePortals[64];
+	Array<const Portal*> Chain;
+};
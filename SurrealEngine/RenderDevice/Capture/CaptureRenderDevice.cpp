@@ -0,0 +1,364 @@
+#include "Precomp.h"
+#include "CaptureRenderDevice.h"
+#include "Utils/File.h"
+
+CaptureRenderDevice::CaptureRenderDevice(RenderDevice* forward) : Forward(forward)
+{
+	ClearTrace();
+}
+
+void CaptureRenderDevice::ClearTrace()
+{
+	Trace.clear();
+	Textures.clear();
+	Frames.clear();
+	Stats = {};
+
+	RenderTraceHeader header = {};
+	header.Signature = RenderTraceSignature;
+	header.FormatVersion = RenderTraceFormatVersion;
+	Write(header);
+}
+
+void CaptureRenderDevice::SaveTrace(const std::string& filename) const
+{
+	File::write_all_bytes(filename, Trace.data(), Trace.size());
+}
+
+void CaptureRenderDevice::WriteBytes(const void* data, size_t size)
+{
+	const uint8_t* bytes = static_cast<const uint8_t*>(data);
+	Trace.insert(Trace.end(), bytes, bytes + size);
+}
+
+uint32_t CaptureRenderDevice::DefineTexture(const FTextureInfo* info)
+{
+	if (!info)
+		return 0;
+
+	TextureDefinition& def = Textures[info->CacheID];
+	if (def.Index == 0 || def.Format != info->Format || def.USize != info->USize || def.VSize != info->VSize || def.NumMips != info->NumMips)
+	{
+		if (def.Index == 0)
+			def.Index = (uint32_t)Textures.size();
+		def.Format = info->Format;
+		def.USize = info->USize;
+		def.VSize = info->VSize;
+		def.NumMips = info->NumMips;
+
+		WriteCommand(RenderTraceCommand::DefineTexture);
+		Write(def.Index);
+		Write(info->CacheID);
+		Write((uint32_t)def.Format);
+		Write((int32_t)def.USize);
+		Write((int32_t)def.VSize);
+		Write((int32_t)def.NumMips);
+	}
+	return def.Index;
+}
+
+void CaptureRenderDevice::WriteTexture(const FTextureInfo* info, uint32_t index)
+{
+	Write(index);
+	if (index != 0)
+	{
+		RenderTraceTextureState state = {};
+		state.PanX = info->Pan.x;
+		state.PanY = info->Pan.y;
+		state.UScale = info->UScale;
+		state.VScale = info->VScale;
+		state.RealtimeChanged = info->bRealtimeChanged ? 1 : 0;
+		Write(state);
+	}
+}
+
+uint32_t CaptureRenderDevice::DefineFrame(const FSceneNode* frame)
+{
+	RenderTraceFrame data = {};
+	data.XB = frame->XB;
+	data.YB = frame->YB;
+	data.X = frame->X;
+	data.Y = frame->Y;
+	data.FX = frame->FX;
+	data.FY = frame->FY;
+	data.FX2 = frame->FX2;
+	data.FY2 = frame->FY2;
+	data.FovAngle = frame->FovAngle;
+	memcpy(data.ObjectToWorld, frame->ObjectToWorld.matrix, sizeof(data.ObjectToWorld));
+	memcpy(data.WorldToView, frame->WorldToView.matrix, sizeof(data.WorldToView));
+	memcpy(data.Projection, frame->Projection.matrix, sizeof(data.Projection));
+
+	// The renderer reuses the same scene nodes every frame. Only record them again when their contents change.
+	FrameDefinition& def = Frames[frame];
+	if (def.Index == 0 || memcmp(&def.Frame, &data, sizeof(RenderTraceFrame)) != 0)
+	{
+		if (def.Index == 0)
+			def.Index = (uint32_t)Frames.size();
+		def.Frame = data;
+
+		WriteCommand(RenderTraceCommand::SetFrame);
+		Write(def.Index);
+		Write(data);
+	}
+	return def.Index;
+}
+
+void CaptureRenderDevice::Flush(bool AllowPrecache)
+{
+	WriteCommand(RenderTraceCommand::Flush);
+	Write((uint8_t)(AllowPrecache ? 1 : 0));
+
+	if (Forward)
+		Forward->Flush(AllowPrecache);
+}
+
+bool CaptureRenderDevice::Exec(std::string Cmd, OutputDevice& Ar)
+{
+	return Forward ? Forward->Exec(Cmd, Ar) : false;
+}
+
+void CaptureRenderDevice::Lock(vec4 FlashScale, vec4 FlashFog, vec4 ScreenClear)
+{
+	WriteCommand(RenderTraceCommand::Lock);
+	Write(FlashScale);
+	Write(FlashFog);
+	Write(ScreenClear);
+
+	if (Forward)
+	{
+		Forward->Brightness = Brightness;
+		Forward->Lock(FlashScale, FlashFog, ScreenClear);
+	}
+}
+
+void CaptureRenderDevice::Unlock(bool Blit)
+{
+	WriteCommand(RenderTraceCommand::Unlock);
+	Write((uint8_t)(Blit ? 1 : 0));
+	Stats.Frames++;
+
+	if (Forward)
+		Forward->Unlock(Blit);
+}
+
+void CaptureRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet)
+{
+	uint32_t frame = DefineFrame(Frame);
+	uint32_t texture = DefineTexture(Surface.Texture);
+	uint32_t lightmap = DefineTexture(Surface.LightMap);
+	uint32_t macrotexture = DefineTexture(Surface.MacroTexture);
+	uint32_t detailtexture = DefineTexture(Surface.DetailTexture);
+	uint32_t fogmap = DefineTexture(Surface.FogMap);
+
+	WriteCommand(RenderTraceCommand::DrawComplexSurface);
+	Write(frame);
+	Write(Surface.PolyFlags);
+	WriteTexture(Surface.Texture, texture);
+	WriteTexture(Surface.LightMap, lightmap);
+	WriteTexture(Surface.MacroTexture, macrotexture);
+	WriteTexture(Surface.DetailTexture, detailtexture);
+	WriteTexture(Surface.FogMap, fogmap);
+	Write(Facet.MapCoords.Origin);
+	Write(Facet.MapCoords.XAxis);
+	Write(Facet.MapCoords.YAxis);
+	Write(Facet.MapCoords.ZAxis);
+	Write(Facet.VertexCount);
+	WriteBytes(Facet.Vertices, Facet.VertexCount * sizeof(vec3));
+	Stats.ComplexSurfaces++;
+
+	if (Forward)
+		Forward->DrawComplexSurface(Frame, Surface, Facet);
+}
+
+void CaptureRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags)
+{
+	uint32_t frame = DefineFrame(Frame);
+	uint32_t texture = DefineTexture(&Info);
+
+	WriteCommand(RenderTraceCommand::DrawGouraudPolygon);
+	Write(frame);
+	WriteTexture(&Info, texture);
+	Write(PolyFlags);
+	Write((uint32_t)NumPts);
+	WriteBytes(Pts, NumPts * sizeof(GouraudVertex));
+	Stats.GouraudPolygons++;
+
+	if (Forward)
+		Forward->DrawGouraudPolygon(Frame, Info, Pts, NumPts, PolyFlags);
+}
+
+void CaptureRenderDevice::DrawGouraudTriangles(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, const uint32_t* Indices, int NumIndices, uint32_t PolyFlags)
+{
+	uint32_t frame = DefineFrame(Frame);
+	uint32_t texture = DefineTexture(&Info);
+
+	WriteCommand(RenderTraceCommand::DrawGouraudTriangles);
+	Write(frame);
+	WriteTexture(&Info, texture);
+	Write(PolyFlags);
+	Write((uint32_t)NumPts);
+	WriteBytes(Pts, NumPts * sizeof(GouraudVertex));
+	Write((uint32_t)NumIndices);
+	WriteBytes(Indices, NumIndices * sizeof(uint32_t));
+	Stats.GouraudTriangles += NumIndices / 3;
+
+	if (Forward)
+		Forward->DrawGouraudTriangles(Frame, Info, Pts, NumPts, Indices, NumIndices, PolyFlags);
+}
+
+void CaptureRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags)
+{
+	uint32_t frame = DefineFrame(Frame);
+	uint32_t texture = DefineTexture(&Info);
+
+	WriteCommand(RenderTraceCommand::DrawTile);
+	Write(frame);
+	WriteTexture(&Info, texture);
+	float args[9] = { X, Y, XL, YL, U, V, UL, VL, Z };
+	Write(args);
+	Write(Color);
+	Write(Fog);
+	Write(PolyFlags);
+	Stats.Tiles++;
+
+	if (Forward)
+		Forward->DrawTile(Frame, Info, X, Y, XL, YL, U, V, UL, VL, Z, Color, Fog, PolyFlags);
+}
+
+void CaptureRenderDevice::DrawTiles(FSceneNode* Frame, FTextureInfo& Info, const TileRect* Tiles, int NumTiles, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags)
+{
+	// The trace stores the tiles one by one. They are still forwarded as a single batch.
+	RenderDevice* forward = Forward;
+	Forward = nullptr;
+	for (int i = 0; i < NumTiles; i++)
+	{
+		const TileRect& t = Tiles[i];
+		DrawTile(Frame, Info, t.X, t.Y, t.XL, t.YL, t.U, t.V, t.UL, t.VL, Z, Color, Fog, PolyFlags);
+	}
+	Forward = forward;
+
+	if (Forward)
+		Forward->DrawTiles(Frame, Info, Tiles, NumTiles, Z, Color, Fog, PolyFlags);
+}
+
+void CaptureRenderDevice::Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2)
+{
+	uint32_t frame = DefineFrame(Frame);
+
+	WriteCommand(RenderTraceCommand::Draw3DLine);
+	Write(frame);
+	Write(Color);
+	Write(P1);
+	Write(P2);
+	Stats.Lines++;
+
+	if (Forward)
+		Forward->Draw3DLine(Frame, Color, P1, P2);
+}
+
+void CaptureRenderDevice::Draw2DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2)
+{
+	uint32_t frame = DefineFrame(Frame);
+
+	WriteCommand(RenderTraceCommand::Draw2DLine);
+	Write(frame);
+	Write(Color);
+	Write(P1);
+	Write(P2);
+	Stats.Lines++;
+
+	if (Forward)
+		Forward->Draw2DLine(Frame, Color, P1, P2);
+}
+
+void CaptureRenderDevice::Draw2DPoint(FSceneNode* Frame, vec4 Color, float X1, float Y1, float X2, float Y2, float Z)
+{
+	uint32_t frame = DefineFrame(Frame);
+
+	WriteCommand(RenderTraceCommand::Draw2DPoint);
+	Write(frame);
+	Write(Color);
+	float args[5] = { X1, Y1, X2, Y2, Z };
+	Write(args);
+
+	if (Forward)
+		Forward->Draw2DPoint(Frame, Color, X1, Y1, X2, Y2, Z);
+}
+
+void CaptureRenderDevice::ClearZ(FSceneNode* Frame)
+{
+	uint32_t frame = DefineFrame(Frame);
+
+	WriteCommand(RenderTraceCommand::ClearZ);
+	Write(frame);
+
+	if (Forward)
+		Forward->ClearZ(Frame);
+}
+
+void CaptureRenderDevice::ReadPixels(FColor* Pixels)
+{
+	if (Forward)
+		Forward->ReadPixels(Pixels);
+}
+
+void CaptureRenderDevice::EndFlash()
+{
+	WriteCommand(RenderTraceCommand::EndFlash);
+
+	if (Forward)
+		Forward->EndFlash();
+}
+
+void CaptureRenderDevice::SetSceneNode(FSceneNode* Frame)
+{
+	uint32_t frame = DefineFrame(Frame);
+
+	WriteCommand(RenderTraceCommand::SetSceneNode);
+	Write(frame);
+
+	if (Forward)
+		Forward->SetSceneNode(Frame);
+}
+
+void CaptureRenderDevice::PrecacheTexture(FTextureInfo& Info, uint32_t PolyFlags)
+{
+	uint32_t texture = DefineTexture(&Info);
+
+	WriteCommand(RenderTraceCommand::PrecacheTexture);
+	WriteTexture(&Info, texture);
+	Write(PolyFlags);
+
+	if (Forward)
+		Forward->PrecacheTexture(Info, PolyFlags);
+}
+
+bool CaptureRenderDevice::SupportsTextureFormat(TextureFormat Format)
+{
+	return Forward ? Forward->SupportsTextureFormat(Format) : true;
+}
+
+void CaptureRenderDevice::UpdateTextureRect(FTextureInfo& Info, int U, int V, int UL, int VL)
+{
+	uint32_t texture = DefineTexture(&Info);
+
+	WriteCommand(RenderTraceCommand::UpdateTextureRect);
+	WriteTexture(&Info, texture);
+	int32_t args[4] = { U, V, UL, VL };
+	Write(args);
+
+	if (Forward)
+		Forward->UpdateTextureRect(Info, U, V, UL, VL);
+}
+
+void CaptureRenderDevice::SetTextureMemoryBudget(uint64_t bytes)
+{
+	if (Forward)
+		Forward->SetTextureMemoryBudget(bytes);
+}
+
+void CaptureRenderDevice::AddStats(Array<std::string>& lines)
+{
+	if (Forward)
+		Forward->AddStats(lines);
+}
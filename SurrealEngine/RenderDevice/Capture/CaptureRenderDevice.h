@@ -0,0 +1,86 @@
+#pragma once
+
+#include "RenderDevice/RenderDevice.h"
+#include "RenderTrace.h"
+#include <unordered_map>
+
+// Render device recording every call into a binary trace (see RenderTrace.h).
+// The calls are forwarded to another device if one is given, otherwise nothing is drawn.
+class CaptureRenderDevice : public RenderDevice
+{
+public:
+	CaptureRenderDevice(RenderDevice* forward = nullptr);
+
+	void Flush(bool AllowPrecache) override;
+	bool Exec(std::string Cmd, OutputDevice& Ar) override;
+	void Lock(vec4 FlashScale, vec4 FlashFog, vec4 ScreenClear) override;
+	void Unlock(bool Blit) override;
+	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) override;
+	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags) override;
+	void DrawGouraudTriangles(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, const uint32_t* Indices, int NumIndices, uint32_t PolyFlags) override;
+	void DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) override;
+	void DrawTiles(FSceneNode* Frame, FTextureInfo& Info, const TileRect* Tiles, int NumTiles, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) override;
+	void Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override;
+	void Draw2DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override;
+	void Draw2DPoint(FSceneNode* Frame, vec4 Color, float X1, float Y1, float X2, float Y2, float Z) override;
+	void ClearZ(FSceneNode* Frame) override;
+	void ReadPixels(FColor* Pixels) override;
+	void EndFlash() override;
+	void SetSceneNode(FSceneNode* Frame) override;
+	void PrecacheTexture(FTextureInfo& Info, uint32_t PolyFlags) override;
+	bool SupportsTextureFormat(TextureFormat Format) override;
+	void UpdateTextureRect(FTextureInfo& Info, int U, int V, int UL, int VL) override;
+	void SetTextureMemoryBudget(uint64_t bytes) override;
+	void AddStats(Array<std::string>& lines) override;
+
+	const Array<uint8_t>& GetTrace() const { return Trace; }
+	void SaveTrace(const std::string& filename) const;
+
+	// Starts a new trace. Textures and frames are defined again when they are next used.
+	void ClearTrace();
+
+	struct
+	{
+		int Frames = 0;
+		int ComplexSurfaces = 0;
+		int GouraudPolygons = 0;
+		int GouraudTriangles = 0;
+		int Tiles = 0;
+		int Lines = 0;
+	} Stats;
+
+private:
+	template<typename T>
+	void Write(const T& value)
+	{
+		const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+		Trace.insert(Trace.end(), bytes, bytes + sizeof(T));
+	}
+
+	void WriteBytes(const void* data, size_t size);
+	void WriteCommand(RenderTraceCommand command) { Write((uint8_t)command); }
+	void WriteTexture(const FTextureInfo* info, uint32_t index);
+
+	uint32_t DefineTexture(const FTextureInfo* info);
+	uint32_t DefineFrame(const FSceneNode* frame);
+
+	RenderDevice* Forward = nullptr;
+	Array<uint8_t> Trace;
+
+	struct TextureDefinition
+	{
+		uint32_t Index = 0;
+		TextureFormat Format = {};
+		int USize = 0;
+		int VSize = 0;
+		int NumMips = 0;
+	};
+	std::unordered_map<uint64_t, TextureDefinition> Textures;
+
+	struct FrameDefinition
+	{
+		uint32_t Index = 0;
+		RenderTraceFrame Frame = {};
+	};
+	std::unordered_map<const FSceneNode*, FrameDefinition> Frames;
+};
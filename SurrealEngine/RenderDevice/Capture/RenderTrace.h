@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+// Binary trace of the calls made to a render device. Written by CaptureRenderDevice and played back by RenderTraceReplayer.
+//
+// The trace is a RenderTraceHeader followed by a stream of commands. Each command is a RenderTraceCommand byte followed by its arguments.
+// Only the cache ID, format and size of a texture are recorded, not its pixels. A texture is described once by a DefineTexture command
+// and then referred to by its index, starting at 1. Zero means no texture. Scene nodes are handled the same way by SetFrame.
+// Integers and floats are stored in the byte order of the machine that recorded the trace.
+
+const uint32_t RenderTraceSignature = 0x52545253; // "SRTR"
+const uint32_t RenderTraceFormatVersion = 1;
+
+struct RenderTraceHeader
+{
+	uint32_t Signature;
+	uint32_t FormatVersion;
+};
+
+enum class RenderTraceCommand : uint8_t
+{
+	DefineTexture,        // uint32 index, uint64 cache ID, uint32 format, int32 USize, int32 VSize, int32 NumMips
+	SetFrame,             // uint32 index, RenderTraceFrame
+	Flush,                // uint8 allow precache
+	Lock,                 // vec4 flash scale, vec4 flash fog, vec4 screen clear
+	Unlock,               // uint8 blit
+	DrawComplexSurface,   // uint32 frame, uint32 poly flags, 5 texture refs, coords, uint32 vertex count, vec3 vertices
+	DrawGouraudPolygon,   // uint32 frame, texture ref, uint32 poly flags, uint32 vertex count, GouraudVertex vertices
+	DrawGouraudTriangles, // uint32 frame, texture ref, uint32 poly flags, uint32 vertex count, GouraudVertex vertices, uint32 index count, uint32 indices
+	DrawTile,             // uint32 frame, texture ref, float x, y, xl, yl, u, v, ul, vl, z, vec4 color, vec4 fog, uint32 poly flags
+	Draw3DLine,           // uint32 frame, vec4 color, vec3 p1, vec3 p2
+	Draw2DLine,           // uint32 frame, vec4 color, vec3 p1, vec3 p2
+	Draw2DPoint,          // uint32 frame, vec4 color, float x1, y1, x2, y2, z
+	ClearZ,               // uint32 frame
+	EndFlash,
+	SetSceneNode,         // uint32 frame
+	PrecacheTexture,      // texture ref, uint32 poly flags
+	UpdateTextureRect     // texture ref, int32 u, v, ul, vl
+};
+
+// A texture ref is the uint32 texture index, followed by RenderTraceTextureState when the index is not zero
+struct RenderTraceTextureState
+{
+	float PanX;
+	float PanY;
+	float UScale;
+	float VScale;
+	uint8_t RealtimeChanged;
+};
+
+struct RenderTraceFrame
+{
+	int32_t XB, YB;
+	int32_t X, Y;
+	float FX, FY;
+	float FX2, FY2;
+	float FovAngle;
+	float ObjectToWorld[16];
+	float WorldToView[16];
+	float Projection[16];
+};
@@ -0,0 +1,286 @@
+#include "Precomp.h"
+#include "RenderTraceReplayer.h"
+#include "Utils/File.h"
+
+void RenderTraceReplayer::Load(const std::string& filename)
+{
+	Load(File::read_all_bytes(filename));
+}
+
+void RenderTraceReplayer::Load(Array<uint8_t> trace)
+{
+	Trace = std::move(trace);
+	Pos = 0;
+
+	RenderTraceHeader header = Read<RenderTraceHeader>();
+	if (header.Signature != RenderTraceSignature)
+		Exception::Throw("Not a render trace");
+	if (header.FormatVersion != RenderTraceFormatVersion)
+		Exception::Throw("Unsupported render trace version " + std::to_string(header.FormatVersion));
+}
+
+void RenderTraceReplayer::ReadBytes(void* data, size_t size)
+{
+	if (Trace.size() - Pos < size)
+		Exception::Throw("Render trace is truncated");
+	memcpy(data, Trace.data() + Pos, size);
+	Pos += size;
+}
+
+void RenderTraceReplayer::DefineTexture()
+{
+	uint32_t index = Read<uint32_t>();
+	if (index == 0 || index > 0x100000)
+		Exception::Throw("Invalid texture index in render trace");
+
+	if (Textures.size() < index)
+		Textures.resize(index);
+
+	auto& texture = Textures[index - 1];
+	if (!texture)
+	{
+		texture = std::make_unique<Texture>();
+		texture->Mip.Width = 1;
+		texture->Mip.Height = 1;
+		texture->Mip.Data.resize(4, 255);
+	}
+
+	FTextureInfo& info = texture->Info;
+	info.CacheID = Read<uint64_t>();
+	Read<uint32_t>(); // The recorded format. The placeholder is always ARGB8.
+	info.Format = TextureFormat::ARGB8;
+	info.USize = Read<int32_t>();
+	info.VSize = Read<int32_t>();
+	Read<int32_t>(); // The recorded mip count. The placeholder has a single mip.
+	info.NumMips = 1;
+	info.Mips = &texture->Mip;
+}
+
+void RenderTraceReplayer::SetFrame()
+{
+	uint32_t index = Read<uint32_t>();
+	if (index == 0 || index > 0x10000)
+		Exception::Throw("Invalid frame index in render trace");
+
+	if (Frames.size() < index)
+		Frames.resize(index);
+
+	auto& frame = Frames[index - 1];
+	if (!frame)
+		frame = std::make_unique<FSceneNode>();
+
+	RenderTraceFrame data = Read<RenderTraceFrame>();
+	frame->XB = data.XB;
+	frame->YB = data.YB;
+	frame->X = data.X;
+	frame->Y = data.Y;
+	frame->FX = data.FX;
+	frame->FY = data.FY;
+	frame->FX2 = data.FX2;
+	frame->FY2 = data.FY2;
+	frame->FovAngle = data.FovAngle;
+	memcpy(frame->ObjectToWorld.matrix, data.ObjectToWorld, sizeof(data.ObjectToWorld));
+	memcpy(frame->WorldToView.matrix, data.WorldToView, sizeof(data.WorldToView));
+	memcpy(frame->Projection.matrix, data.Projection, sizeof(data.Projection));
+}
+
+FSceneNode* RenderTraceReplayer::ReadFrame()
+{
+	uint32_t index = Read<uint32_t>();
+	if (index == 0 || index > Frames.size() || !Frames[index - 1])
+		Exception::Throw("Render trace uses an undefined frame");
+	return Frames[index - 1].get();
+}
+
+FTextureInfo* RenderTraceReplayer::ReadTexture(FTextureInfo& info)
+{
+	uint32_t index = Read<uint32_t>();
+	if (index == 0)
+		return nullptr;
+	if (index > Textures.size() || !Textures[index - 1])
+		Exception::Throw("Render trace uses an undefined texture");
+
+	RenderTraceTextureState state = Read<RenderTraceTextureState>();
+	info = Textures[index - 1]->Info;
+	info.Pan = { state.PanX, state.PanY };
+	info.UScale = state.UScale;
+	info.VScale = state.VScale;
+	info.bRealtimeChanged = state.RealtimeChanged != 0;
+	return &info;
+}
+
+int RenderTraceReplayer::Replay(RenderDevice* device)
+{
+	Pos = sizeof(RenderTraceHeader);
+	Textures.clear();
+	Frames.clear();
+
+	int frames = 0;
+	FTextureInfo textures[5];
+	while (Pos < Trace.size())
+	{
+		RenderTraceCommand command = (RenderTraceCommand)Read<uint8_t>();
+		switch (command)
+		{
+		case RenderTraceCommand::DefineTexture:
+			DefineTexture();
+			break;
+
+		case RenderTraceCommand::SetFrame:
+			SetFrame();
+			break;
+
+		case RenderTraceCommand::Flush:
+			device->Flush(Read<uint8_t>() != 0);
+			break;
+
+		case RenderTraceCommand::Lock:
+		{
+			vec4 flashScale = Read<vec4>();
+			vec4 flashFog = Read<vec4>();
+			vec4 screenClear = Read<vec4>();
+			device->Lock(flashScale, flashFog, screenClear);
+			break;
+		}
+
+		case RenderTraceCommand::Unlock:
+			device->Unlock(Read<uint8_t>() != 0);
+			frames++;
+			break;
+
+		case RenderTraceCommand::DrawComplexSurface:
+		{
+			FSceneNode* frame = ReadFrame();
+			FSurfaceInfo surface;
+			surface.PolyFlags = Read<uint32_t>();
+			surface.Texture = ReadTexture(textures[0]);
+			surface.LightMap = ReadTexture(textures[1]);
+			surface.MacroTexture = ReadTexture(textures[2]);
+			surface.DetailTexture = ReadTexture(textures[3]);
+			surface.FogMap = ReadTexture(textures[4]);
+
+			FSurfaceFacet facet;
+			facet.MapCoords.Origin = Read<vec3>();
+			facet.MapCoords.XAxis = Read<vec3>();
+			facet.MapCoords.YAxis = Read<vec3>();
+			facet.MapCoords.ZAxis = Read<vec3>();
+			facet.VertexCount = Read<uint32_t>();
+			Vertices.resize(facet.VertexCount);
+			ReadBytes(Vertices.data(), facet.VertexCount * sizeof(vec3));
+			facet.Vertices = Vertices.data();
+
+			device->DrawComplexSurface(frame, surface, facet);
+			break;
+		}
+
+		case RenderTraceCommand::DrawGouraudPolygon:
+		{
+			FSceneNode* frame = ReadFrame();
+			FTextureInfo* texture = ReadTexture(textures[0]);
+			uint32_t polyFlags = Read<uint32_t>();
+			uint32_t count = Read<uint32_t>();
+			GouraudVertices.resize(count);
+			ReadBytes(GouraudVertices.data(), count * sizeof(GouraudVertex));
+			if (texture)
+				device->DrawGouraudPolygon(frame, *texture, GouraudVertices.data(), count, polyFlags);
+			break;
+		}
+
+		case RenderTraceCommand::DrawGouraudTriangles:
+		{
+			FSceneNode* frame = ReadFrame();
+			FTextureInfo* texture = ReadTexture(textures[0]);
+			uint32_t polyFlags = Read<uint32_t>();
+			uint32_t count = Read<uint32_t>();
+			GouraudVertices.resize(count);
+			ReadBytes(GouraudVertices.data(), count * sizeof(GouraudVertex));
+			uint32_t indexCount = Read<uint32_t>();
+			Indices.resize(indexCount);
+			ReadBytes(Indices.data(), indexCount * sizeof(uint32_t));
+			for (uint32_t index : Indices)
+			{
+				if (index >= count)
+					Exception::Throw("Render trace has an out of bounds vertex index");
+			}
+			if (texture)
+				device->DrawGouraudTriangles(frame, *texture, GouraudVertices.data(), count, Indices.data(), indexCount, polyFlags);
+			break;
+		}
+
+		case RenderTraceCommand::DrawTile:
+		{
+			FSceneNode* frame = ReadFrame();
+			FTextureInfo* texture = ReadTexture(textures[0]);
+			float args[9];
+			ReadBytes(args, sizeof(args));
+			vec4 color = Read<vec4>();
+			vec4 fog = Read<vec4>();
+			uint32_t polyFlags = Read<uint32_t>();
+			if (texture)
+				device->DrawTile(frame, *texture, args[0], args[1], args[2], args[3], args[4], args[5], args[6], args[7], args[8], color, fog, polyFlags);
+			break;
+		}
+
+		case RenderTraceCommand::Draw3DLine:
+		case RenderTraceCommand::Draw2DLine:
+		{
+			FSceneNode* frame = ReadFrame();
+			vec4 color = Read<vec4>();
+			vec3 p1 = Read<vec3>();
+			vec3 p2 = Read<vec3>();
+			if (command == RenderTraceCommand::Draw3DLine)
+				device->Draw3DLine(frame, color, p1, p2);
+			else
+				device->Draw2DLine(frame, color, p1, p2);
+			break;
+		}
+
+		case RenderTraceCommand::Draw2DPoint:
+		{
+			FSceneNode* frame = ReadFrame();
+			vec4 color = Read<vec4>();
+			float args[5];
+			ReadBytes(args, sizeof(args));
+			device->Draw2DPoint(frame, color, args[0], args[1], args[2], args[3], args[4]);
+			break;
+		}
+
+		case RenderTraceCommand::ClearZ:
+			device->ClearZ(ReadFrame());
+			break;
+
+		case RenderTraceCommand::EndFlash:
+			device->EndFlash();
+			break;
+
+		case RenderTraceCommand::SetSceneNode:
+			device->SetSceneNode(ReadFrame());
+			break;
+
+		case RenderTraceCommand::PrecacheTexture:
+		{
+			FTextureInfo* texture = ReadTexture(textures[0]);
+			uint32_t polyFlags = Read<uint32_t>();
+			if (texture)
+				device->PrecacheTexture(*texture, polyFlags);
+			break;
+		}
+
+		case RenderTraceCommand::UpdateTextureRect:
+		{
+			FTextureInfo* texture = ReadTexture(textures[0]);
+			int32_t args[4];
+			ReadBytes(args, sizeof(args));
+			// The placeholder is a single texel. Update all of it.
+			if (texture)
+				device->UpdateTextureRect(*texture, 0, 0, 1, 1);
+			break;
+		}
+
+		default:
+			Exception::Throw("Unknown command in render trace");
+		}
+	}
+
+	return frames;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "RenderDevice/RenderDevice.h"
+#include "RenderTrace.h"
+
+// Plays a trace recorded by CaptureRenderDevice back to another render device.
+// The pixels of the textures are not part of the trace. Each texture is replaced by a white placeholder using the same cache ID and size.
+class RenderTraceReplayer
+{
+public:
+	void Load(const std::string& filename);
+	void Load(Array<uint8_t> trace);
+
+	// Returns the number of frames (Unlock calls) played back
+	int Replay(RenderDevice* device);
+
+private:
+	template<typename T>
+	T Read()
+	{
+		T value;
+		ReadBytes(&value, sizeof(T));
+		return value;
+	}
+
+	void ReadBytes(void* data, size_t size);
+	FSceneNode* ReadFrame();
+	FTextureInfo* ReadTexture(FTextureInfo& info);
+
+	void DefineTexture();
+	void SetFrame();
+
+	struct Texture
+	{
+		FTextureInfo Info;
+		UnrealMipmap Mip;
+	};
+
+	Array<uint8_t> Trace;
+	size_t Pos = 0;
+
+	Array<std::unique_ptr<Texture>> Textures;
+	Array<std::unique_ptr<FSceneNode>> Frames;
+	Array<vec3> Vertices;
+	Array<GouraudVertex> GouraudVertices;
+	Array<uint32_t> Indices;
+};
@@ -5,11 +5,38 @@
 #include "UObject/ULevel.h"
 #include <zwidget/core/colorf.h>
 
+// Render device that draws nothing. Used by dedicated servers.
+class NullRenderDevice : public RenderDevice
+{
+public:
+	void Flush(bool AllowPrecache) override { }
+	void Lock(vec4 FlashScale, vec4 FlashFog, vec4 ScreenClear) override { }
+	void Unlock(bool Blit) override { }
+	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) override { }
+	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags) override { }
+	void DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) override { }
+	void Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override { }
+	void Draw2DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override { }
+	void Draw2DPoint(FSceneNode* Frame, vec4 Color, float X1, float Y1, float X2, float Y2, float Z) override { }
+	void ClearZ(FSceneNode* Frame) override { }
+	void ReadPixels(FColor* Pixels) override { }
+	void EndFlash() override { }
+	void SetSceneNode(FSceneNode* Frame) override { }
+	void PrecacheTexture(FTextureInfo& Info, uint32_t PolyFlags) override { }
+	bool SupportsTextureFormat(TextureFormat Format) override { return true; }
+	void UpdateTextureRect(FTextureInfo& Info, int U, int V, int UL, int VL) override { }
+};
+
 std::unique_ptr<RenderDevice> RenderDevice::Create(GameWindow* viewport, std::shared_ptr<VulkanSurface> surface)
 {
 	return std::make_unique<VulkanRenderDevice>(viewport, surface);
 }
 
+std::unique_ptr<RenderDevice> RenderDevice::CreateNull()
+{
+	return std::make_unique<NullRenderDevice>();
+}
+
 ////////////////////////////////////////////////////////////////////////////
 
 RenderDeviceCanvas::RenderDeviceCanvas(RenderDevice* device) : device(device)
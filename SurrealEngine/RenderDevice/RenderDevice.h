@@ -36,6 +36,12 @@ struct GouraudVertex
 	vec4 Fog;
 };
 
+struct TileRect
+{
+	float X, Y, XL, YL;
+	float U, V, UL, VL;
+};
+
 struct FSurfaceFacet
 {
 	Coords MapCoords;
@@ -92,6 +98,7 @@ class RenderDevice
 {
 public:
 	static std::unique_ptr<RenderDevice> Create(GameWindow* viewport, std::shared_ptr<VulkanSurface> surface);
+	static std::unique_ptr<RenderDevice> CreateNull();
 
 	virtual ~RenderDevice() = default;
 
@@ -100,8 +107,41 @@ public:
 	virtual void Lock(vec4 FlashScale, vec4 FlashFog, vec4 ScreenClear) = 0;
 	virtual void Unlock(bool Blit) = 0;
 	virtual void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) = 0;
+
+	// Draws a list of complex surfaces. The list should be sorted by PolyFlags and textures to allow the device to merge them into fewer draw calls.
+	virtual void DrawComplexSurfaces(FSceneNode* Frame, FSurfaceInfo* Surfaces, FSurfaceFacet* Facets, int NumSurfaces)
+	{
+		for (int i = 0; i < NumSurfaces; i++)
+			DrawComplexSurface(Frame, Surfaces[i], Facets[i]);
+	}
+
 	virtual void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags) = 0;
+
+	// Draws an indexed triangle list sharing one texture. Three indices for each triangle, indexing into Pts.
+	virtual void DrawGouraudTriangles(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, const uint32_t* Indices, int NumIndices, uint32_t PolyFlags)
+	{
+		GouraudVertex triangle[3];
+		for (int i = 0; i + 2 < NumIndices; i += 3)
+		{
+			triangle[0] = Pts[Indices[i]];
+			triangle[1] = Pts[Indices[i + 1]];
+			triangle[2] = Pts[Indices[i + 2]];
+			DrawGouraudPolygon(Frame, Info, triangle, 3, PolyFlags);
+		}
+	}
+
 	virtual void DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) = 0;
+
+	// Draws a list of tiles sharing one texture, color and PolyFlags
+	virtual void DrawTiles(FSceneNode* Frame, FTextureInfo& Info, const TileRect* Tiles, int NumTiles, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags)
+	{
+		for (int i = 0; i < NumTiles; i++)
+		{
+			const TileRect& t = Tiles[i];
+			DrawTile(Frame, Info, t.X, t.Y, t.XL, t.YL, t.U, t.V, t.UL, t.VL, Z, Color, Fog, PolyFlags);
+		}
+	}
+
 	virtual void Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) = 0;
 	virtual void Draw2DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) = 0;
 	virtual void Draw2DPoint(FSceneNode* Frame, vec4 Color, float X1, float Y1, float X2, float Y2, float Z) = 0;
@@ -113,6 +153,12 @@ public:
 	virtual bool SupportsTextureFormat(TextureFormat Format) = 0;
 	virtual void UpdateTextureRect(FTextureInfo& Info, int U, int V, int UL, int VL) = 0;
 
+	// Memory the device may keep textures resident in before it starts evicting the least recently used ones
+	virtual void SetTextureMemoryBudget(uint64_t bytes) { }
+
+	// Lines of device statistics for the render stats overlay
+	virtual void AddStats(Array<std::string>& lines) { }
+
 	bool ParseCommand(std::string* cmd, const std::string& keyword) { return false; }
 
 	GameWindow* Viewport = nullptr;
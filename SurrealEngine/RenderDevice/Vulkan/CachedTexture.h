@@ -10,4 +10,8 @@ public:
 
 	int BindlessIndex[4] = { -1, -1, -1, -1 };
 	int RealtimeChangeCount = 0;
+
+	uint64_t MemorySize = 0; // Bytes used by all mip levels of the image
+	int LastUsedFrame = -1;
+	bool Realtime = false; // Set once the content has been changed after the first upload
 };
@@ -5,6 +5,7 @@
 #include <zvulkan/vulkanbuilders.h>
 #include "CachedTexture.h"
 #include "UObject/ULevel.h"
+#include <unordered_set>
 
 DescriptorSetManager::DescriptorSetManager(VulkanRenderDevice* renderer) : renderer(renderer)
 {
@@ -29,7 +30,9 @@ VulkanDescriptorSet* DescriptorSetManager::GetTextureDescriptorSet(uint32_t Poly
 	{
 		if (SceneDescriptorPoolSetsLeft == 0)
 		{
+			// Sets are freed individually when the textures they use are evicted
 			SceneDescriptorPool.push_back(DescriptorPoolBuilder()
+				.Flags(VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT)
 				.AddPoolSize(VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1000 * 4)
 				.MaxSets(1000)
 				.DebugName("SceneDescriptorPool")
@@ -65,6 +68,38 @@ void DescriptorSetManager::ClearCache()
 
 	WriteBindless = WriteDescriptors();
 	NextBindlessIndex = 0;
+	FreeBindlessIndices.clear();
+}
+
+void DescriptorSetManager::RemoveTextures(const Array<CachedTexture*>& textures)
+{
+	std::unordered_set<CachedTexture*> removed(textures.begin(), textures.end());
+
+	for (auto it = TextureDescriptorSets.begin(); it != TextureDescriptorSets.end();)
+	{
+		const TexDescriptorKey& key = it->first;
+		if (removed.count(key.tex) || removed.count(key.lightmap) || removed.count(key.detailtex) || removed.count(key.macrotex))
+		{
+			// Sets freed from the pool currently allocated from can be allocated again
+			if (!SceneDescriptorPool.empty() && it->second->pool == SceneDescriptorPool.back().get())
+				SceneDescriptorPoolSetsLeft++;
+			it = TextureDescriptorSets.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+
+	for (CachedTexture* tex : textures)
+	{
+		for (int& index : tex->BindlessIndex)
+		{
+			if (index != -1)
+				FreeBindlessIndices.push_back(index);
+			index = -1;
+		}
+	}
 }
 
 int DescriptorSetManager::GetTextureArrayIndex(uint32_t PolyFlags, CachedTexture* tex, bool clamp)
@@ -80,7 +115,15 @@ int DescriptorSetManager::GetTextureArrayIndex(uint32_t PolyFlags, CachedTexture
 	if (index != -1)
 		return index;
 
-	index = NextBindlessIndex++;
+	if (!FreeBindlessIndices.empty())
+	{
+		index = FreeBindlessIndices.back();
+		FreeBindlessIndices.pop_back();
+	}
+	else
+	{
+		index = NextBindlessIndex++;
+	}
 
 	VulkanSampler* sampler = renderer->Samplers->Samplers[samplermode].get();
 	WriteBindless.AddCombinedImageSampler(SceneBindlessDescriptorSet.get(), 0, index, tex->imageView.get(), sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
@@ -54,6 +54,9 @@ public:
 	VulkanDescriptorSet* GetTextureDescriptorSet(uint32_t PolyFlags, CachedTexture* tex, CachedTexture* lightmap = nullptr, CachedTexture* macrotex = nullptr, CachedTexture* detailtex = nullptr, bool clamp = false);
 	void ClearCache();
 
+	// Forgets the descriptor sets and bindless slots of textures about to be destroyed
+	void RemoveTextures(const Array<CachedTexture*>& textures);
+
 	int GetTextureArrayIndex(uint32_t PolyFlags, CachedTexture* tex, bool clamp = false);
 	VulkanDescriptorSet* GetBindlessDescriptorSet() { return SceneBindlessDescriptorSet.get(); }
 	void UpdateBindlessDescriptorSet();
@@ -78,6 +81,7 @@ private:
 	std::unique_ptr<VulkanDescriptorSet> SceneBindlessDescriptorSet;
 	WriteDescriptors WriteBindless;
 	int NextBindlessIndex = 0;
+	Array<int> FreeBindlessIndices;
 
 	Array<std::unique_ptr<VulkanDescriptorPool>> SceneDescriptorPool;
 	int SceneDescriptorPoolSetsLeft = 0;
@@ -5,6 +5,7 @@
 #include "CachedTexture.h"
 #include <zvulkan/vulkanbuilders.h>
 #include "UObject/UTexture.h"
+#include <algorithm>
 
 TextureManager::TextureManager(VulkanRenderDevice* renderer) : renderer(renderer)
 {
@@ -18,11 +19,16 @@ TextureManager::~TextureManager()
 
 void TextureManager::UpdateTextureRect(FTextureInfo* info, int x, int y, int w, int h)
 {
-	std::unique_ptr<CachedTexture>& tex = TextureCache[0][info->CacheID];
-	if (tex)
+	// Update both the unmasked and masked copy if they exist
+	for (int masked = 0; masked < 2; masked++)
 	{
-		renderer->Uploads->UploadTextureRect(tex.get(), *info, x, y, w, h);
-		info->bRealtimeChanged = 0;
+		auto it = TextureCache[masked].find(info->CacheID);
+		if (it != TextureCache[masked].end() && it->second)
+		{
+			renderer->Uploads->UploadTextureRect(it->second.get(), *info, x, y, w, h, masked != 0);
+			MarkRealtime(it->second.get());
+			info->bRealtimeChanged = 0;
+		}
 	}
 }
 
@@ -36,6 +42,7 @@ CachedTexture* TextureManager::GetTexture(FTextureInfo* info, bool masked)
 	{
 		tex.reset(new CachedTexture());
 		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		ResidentBytes += tex->MemorySize;
 	}
 	else if (info->bRealtimeChanged /*&& (!info->Texture || info->Texture->RealtimeChangeCount != tex->RealtimeChangeCount)*/)
 	{
@@ -43,16 +50,81 @@ CachedTexture* TextureManager::GetTexture(FTextureInfo* info, bool masked)
 			info->Texture->RealtimeChangeCount = tex->RealtimeChangeCount;*/
 		info->bRealtimeChanged = 0;
 		renderer->Uploads->UploadTexture(tex.get(), *info, masked);
+		MarkRealtime(tex.get());
 	}
+	tex->LastUsedFrame = CurrentFrame;
 	return tex.get();
 }
 
+void TextureManager::MarkRealtime(CachedTexture* tex)
+{
+	if (!tex->Realtime)
+	{
+		tex->Realtime = true;
+		RealtimeBytes += tex->MemorySize;
+	}
+}
+
+void TextureManager::EndFrame()
+{
+	if (ResidentBytes > MemoryBudget)
+	{
+		struct Candidate
+		{
+			int Cache;
+			uint64_t CacheID;
+			CachedTexture* Texture;
+		};
+
+		// Textures used in this frame are never evicted, even if that leaves the cache over budget
+		Array<Candidate> candidates;
+		for (int masked = 0; masked < 2; masked++)
+		{
+			for (auto& it : TextureCache[masked])
+			{
+				if (it.second && it.second->LastUsedFrame != CurrentFrame)
+					candidates.push_back({ masked, it.first, it.second.get() });
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b)
+		{
+			if (a.Texture->Realtime != b.Texture->Realtime)
+				return a.Texture->Realtime;
+			return a.Texture->LastUsedFrame < b.Texture->LastUsedFrame;
+		});
+
+		Array<CachedTexture*> evicted;
+		for (const Candidate& candidate : candidates)
+		{
+			if (ResidentBytes <= MemoryBudget)
+				break;
+			ResidentBytes -= candidate.Texture->MemorySize;
+			if (candidate.Texture->Realtime)
+				RealtimeBytes -= candidate.Texture->MemorySize;
+			evicted.push_back(candidate.Texture);
+		}
+
+		if (!evicted.empty())
+		{
+			renderer->DescriptorSets->RemoveTextures(evicted);
+			for (size_t i = 0; i < evicted.size(); i++)
+				TextureCache[candidates[i].Cache].erase(candidates[i].CacheID);
+			renderer->Stats.Evictions += (int)evicted.size();
+		}
+	}
+
+	CurrentFrame++;
+}
+
 void TextureManager::ClearCache()
 {
 	for (auto& cache : TextureCache)
 	{
 		cache.clear();
 	}
+	ResidentBytes = 0;
+	RealtimeBytes = 0;
 }
 
 void TextureManager::CreateNullTexture()
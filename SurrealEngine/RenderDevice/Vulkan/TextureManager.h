@@ -8,6 +8,11 @@ struct FTextureInfo;
 class VulkanRenderDevice;
 class CachedTexture;
 
+// Keeps the textures used for drawing resident on the GPU.
+//
+// When the textures in the cache use more memory than the budget, the least recently used ones are
+// evicted at the end of a frame. Realtime textures not drawn in the frame go first since their GPU copy
+// is out of date anyway and needs a full upload when they are drawn again.
 class TextureManager
 {
 public:
@@ -17,8 +22,17 @@ public:
 	void UpdateTextureRect(FTextureInfo* info, int x, int y, int w, int h);
 	CachedTexture* GetTexture(FTextureInfo* info, bool masked);
 
+	// Evicts textures until the cache fits the budget again and starts the next frame.
+	// Must only be called once the GPU is done with the frame.
+	void EndFrame();
+
 	void ClearCache();
 
+	void SetMemoryBudget(uint64_t bytes) { MemoryBudget = bytes; }
+	uint64_t GetMemoryBudget() const { return MemoryBudget; }
+	uint64_t GetResidentBytes() const { return ResidentBytes; }
+	uint64_t GetRealtimeBytes() const { return RealtimeBytes; }
+
 	std::unique_ptr<VulkanImage> NullTexture;
 	std::unique_ptr<VulkanImageView> NullTextureView;
 
@@ -32,7 +46,13 @@ public:
 private:
 	void CreateNullTexture();
 	void CreateDitherTexture();
+	void MarkRealtime(CachedTexture* tex);
 
 	VulkanRenderDevice* renderer = nullptr;
 	std::unordered_map<uint64_t, std::unique_ptr<CachedTexture>> TextureCache[2];
+
+	uint64_t MemoryBudget = 512 * 1024 * 1024;
+	uint64_t ResidentBytes = 0;
+	uint64_t RealtimeBytes = 0;
+	int CurrentFrame = 0;
 };
@@ -2,6 +2,12 @@
 #include "Precomp.h"
 #include "TextureUploader.h"
 #include "UObject/UTexture.h"
+#include "Utils/CpuFeatures.h"
+#include "Utils/JobQueue.h"
+
+#ifndef NOSSE
+#include <emmintrin.h>
+#endif
 
 TextureUploader* TextureUploader::GetUploader(TextureFormat format)
 {
@@ -147,7 +153,7 @@ TextureUploader* TextureUploader::GetUploader(TextureFormat format)
 		Uploaders[TextureFormat::RGB10A2].reset(new TextureUploader_RGB10A2());
 		Uploaders[TextureFormat::RGB10A2_UI].reset(new TextureUploader_RGB10A2_UI());
 		Uploaders[TextureFormat::RGB10A2_LM].reset(new TextureUploader_RGB10A2_LM());
-		//Uploaders[TextureFormat::RGB9E5].reset(new TextureUploader_RGB9E5());
+		Uploaders[TextureFormat::RGB9E5].reset(new TextureUploader_Simple(VK_FORMAT_E5B9G9R9_UFLOAT_PACK32, 4));
 		//Uploaders[TextureFormat::P8_RGB9E5].reset(new TextureUploader_P8_RGB9E5());
 		//Uploaders[TextureFormat::R1].reset(new TextureUploader_R1());
 		//Uploaders[TextureFormat::RGB10A2_S].reset(new TextureUploader_RGB10A2_S());
@@ -174,6 +180,30 @@ TextureUploader* TextureUploader::GetUploader(TextureFormat format)
 
 /////////////////////////////////////////////////////////////////////////////
 
+void TextureUploader::ConvertRows(int w, int h, const std::function<void(int y0, int y1)>& convertRows)
+{
+	// Big textures are split into blocks of rows converted by worker threads
+	const int64_t minPixelsPerJob = 128 * 1024;
+	int jobs = (int)std::min((int64_t)w * h / minPixelsPerJob, (int64_t)h);
+	if (jobs <= 1)
+	{
+		convertRows(0, h);
+		return;
+	}
+
+	static JobQueue queue;
+	jobs = std::min(jobs, queue.GetThreadCount());
+	for (int i = 0; i < jobs; i++)
+	{
+		int y0 = h * i / jobs;
+		int y1 = h * (i + 1) / jobs;
+		queue.Add([&convertRows, y0, y1](int threadIndex) { convertRows(y0, y1); });
+	}
+	queue.Wait();
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
 int TextureUploader_P8::GetUploadSize(int x, int y, int w, int h)
 {
 	return w * h * 4;
@@ -181,37 +211,69 @@ int TextureUploader_P8::GetUploadSize(int x, int y, int w, int h)
 
 void TextureUploader_P8::UploadRect(void* d, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
 {
-	int pitch = mip->Width;
-	uint8_t* src = mip->Data.data() + x + y * pitch;
-	FColor* Ptr = (FColor*)d;
+	// A 256 color palette is too big for byte shuffles, so the expansion stays a table lookup.
+	// Masking is done by the table, which keeps the inner loop free of branches.
+	// UPalette::Load pads every palette to 256 colors, so the copy never reads past its end.
+	uint32_t colors[256];
+	memcpy(colors, palette, sizeof(colors));
 	if (masked)
+		colors[0] = 0;
+
+	int pitch = mip->Width;
+	const uint8_t* src = mip->Data.data() + x + y * pitch;
+	uint32_t* dst = (uint32_t*)d;
+	ConvertRows(w, h, [&](int y0, int y1)
 	{
-		FColor translucent(0, 0, 0, 0);
-		for (int i = 0; i < h; i++)
+		for (int i = y0; i < y1; i++)
 		{
-			for (int j = 0; j < w; j++)
+			const uint8_t* line = src + i * pitch;
+			uint32_t* Ptr = dst + (size_t)i * w;
+			int j = 0;
+			for (; j + 4 <= w; j += 4)
 			{
-				int idx = src[j];
-				*Ptr++ = (idx != 0) ? palette[idx] : translucent;
+				uint32_t indexes;
+				memcpy(&indexes, line + j, 4);
+				Ptr[j] = colors[indexes & 0xff];
+				Ptr[j + 1] = colors[(indexes >> 8) & 0xff];
+				Ptr[j + 2] = colors[(indexes >> 16) & 0xff];
+				Ptr[j + 3] = colors[indexes >> 24];
 			}
-			src += pitch;
+			for (; j < w; j++)
+				Ptr[j] = colors[line[j]];
 		}
+	});
+}
+
+/////////////////////////////////////////////////////////////////////////////
+
+static void ConvertBGRA8_LMScalar(FColor* Ptr, const FColor* src, int x, int w)
+{
+	for (; x < w; x++)
+	{
+		FColor Src = src[x];
+		Ptr[x].R = Src.B << 1;
+		Ptr[x].G = Src.G << 1;
+		Ptr[x].B = Src.R << 1;
+		Ptr[x].A = Src.A << 1;
 	}
-	else
+}
+
+#ifndef NOSSE
+
+static int ConvertBGRA8_LMSSE2(FColor* Ptr, const FColor* src, int x, int w)
+{
+	__m128i greenAlpha = _mm_set1_epi32(0xff00ff00);
+	__m128i lowByte = _mm_set1_epi32(0xff);
+	for (; x + 4 <= w; x += 4)
 	{
-		for (int i = 0; i < h; i++)
-		{
-			for (int j = 0; j < w; j++)
-			{
-				int idx = src[j];
-				*Ptr++ = palette[idx];
-			}
-			src += pitch;
-		}
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i swapped = _mm_or_si128(_mm_and_si128(c, greenAlpha), _mm_or_si128(_mm_and_si128(_mm_srli_epi32(c, 16), lowByte), _mm_slli_epi32(_mm_and_si128(c, lowByte), 16)));
+		_mm_storeu_si128((__m128i*)(Ptr + x), _mm_add_epi8(swapped, swapped));
 	}
+	return x;
 }
 
-/////////////////////////////////////////////////////////////////////////////
+#endif
 
 int TextureUploader_BGRA8_LM::GetUploadSize(int x, int y, int w, int h)
 {
@@ -221,57 +283,145 @@ int TextureUploader_BGRA8_LM::GetUploadSize(int x, int y, int w, int h)
 void TextureUploader_BGRA8_LM::UploadRect(void* dst, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
 {
 	int pitch = mip->Width;
-	FColor* src = ((FColor*)mip->Data.data()) + x + y * pitch;
-	auto Ptr = (FColor*)dst;
-	for (int i = 0; i < h; i++)
+	const FColor* src = ((const FColor*)mip->Data.data()) + x + y * pitch;
+	ConvertRows(w, h, [&](int y0, int y1)
 	{
-		for (int j = 0; j < w; j++)
+		for (int i = y0; i < y1; i++)
 		{
-			FColor Src = src[j];
-			Ptr->R = Src.B << 1;
-			Ptr->G = Src.G << 1;
-			Ptr->B = Src.R << 1;
-			Ptr->A = Src.A << 1;
-			Ptr++;
+			const FColor* line = src + i * pitch;
+			FColor* Ptr = (FColor*)dst + (size_t)i * w;
+			int j = 0;
+#ifndef NOSSE
+			if (GetSimdLevel() != SimdLevel::Scalar)
+				j = ConvertBGRA8_LMSSE2(Ptr, line, j, w);
+#endif
+			ConvertBGRA8_LMScalar(Ptr, line, j, w);
 		}
-		src += pitch;
-	}
+	});
 }
 
 /////////////////////////////////////////////////////////////////////////////
 
-int TextureUploader_RGB10A2::GetUploadSize(int x, int y, int w, int h)
+// The RGB10A2 formats are expanded to four 16-bit channels. How the channels are scaled depends on the format.
+enum class RGB10A2Scale
 {
-	return w * h * 8;
-}
+	Unorm, // Full 10-bit and 2-bit range to 0-65535
+	Uint, // Unscaled
+	Lightmap // Overbright 8-bit range to 0-65535
+};
 
-void TextureUploader_RGB10A2::UploadRect(void* dst, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
+template<RGB10A2Scale scale>
+static void ConvertRGB10A2Scalar(uint16_t* Ptr, const uint32_t* src, int x, int w)
 {
-	int pitch = mip->Width;
-	uint32_t* src = ((uint32_t*)mip->Data.data()) + x + y * pitch;
-	uint16_t* Ptr = (uint16_t*)dst;
-	for (int i = 0; i < h; i++)
+	Ptr += x * 4;
+	for (; x < w; x++)
 	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
+		uint32_t c = src[x];
+		uint32_t r = (c >> 22) & 0x3ff;
+		uint32_t g = (c >> 12) & 0x3ff;
+		uint32_t b = (c >> 2) & 0x3ff;
+		uint32_t a = c & 0x3;
 
+		if (scale == RGB10A2Scale::Unorm)
+		{
 			r = r * 0xffff / 0x3ff;
 			g = g * 0xffff / 0x3ff;
 			b = b * 0xffff / 0x3ff;
 			a = a * 0xffff / 0x3;
+		}
+		else if (scale == RGB10A2Scale::Lightmap)
+		{
+			r = (r << 1) * 0xffff / 0xff;
+			g = (g << 1) * 0xffff / 0xff;
+			b = (b << 1) * 0xffff / 0xff;
+			a = (a << 1) * 0xffff / 0x3;
+		}
+
+		*(Ptr++) = r;
+		*(Ptr++) = g;
+		*(Ptr++) = b;
+		*(Ptr++) = a;
+	}
+}
 
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
+#ifndef NOSSE
+
+// v * 0xffff / 0x3ff for 10-bit values. Equals 64 * v + 21 * v / 341, with the division done as a multiply and shift.
+static __m128i ExpandUnorm10SSE2(__m128i v)
+{
+	__m128i quotient = _mm_srli_epi16(_mm_mulhi_epu16(_mm_mullo_epi16(v, _mm_set1_epi16(21)), _mm_set1_epi16(24601)), 7);
+	return _mm_add_epi16(_mm_slli_epi16(v, 6), quotient);
+}
+
+template<RGB10A2Scale scale>
+static int ConvertRGB10A2SSE2(uint16_t* Ptr, const uint32_t* src, int x, int w)
+{
+	__m128i mask10 = _mm_set1_epi32(0x3ff);
+	__m128i mask2 = _mm_set1_epi32(0x3);
+	__m128i lowHalf = _mm_set_epi32(0, 0, -1, -1);
+	for (; x + 4 <= w; x += 4)
+	{
+		__m128i c = _mm_loadu_si128((const __m128i*)(src + x));
+		__m128i r = _mm_and_si128(_mm_srli_epi32(c, 22), mask10);
+		__m128i g = _mm_and_si128(_mm_srli_epi32(c, 12), mask10);
+		__m128i b = _mm_and_si128(_mm_srli_epi32(c, 2), mask10);
+		__m128i a = _mm_and_si128(c, mask2);
+
+		// Four pixels of two channels in each register
+		__m128i rg = _mm_packs_epi32(r, g);
+		__m128i ba = _mm_packs_epi32(b, a);
+
+		if (scale == RGB10A2Scale::Unorm)
+		{
+			rg = ExpandUnorm10SSE2(rg);
+			ba = _mm_or_si128(_mm_and_si128(ExpandUnorm10SSE2(ba), lowHalf), _mm_andnot_si128(lowHalf, _mm_mullo_epi16(ba, _mm_set1_epi16(0x5555))));
 		}
-		src += pitch;
+		else if (scale == RGB10A2Scale::Lightmap)
+		{
+			// (v << 1) * 0xffff / 0xff is v * 514 and (a << 1) * 0xffff / 3 is a * 0xaaaa, truncated to 16 bits like the scalar version
+			rg = _mm_mullo_epi16(rg, _mm_set1_epi16(514));
+			ba = _mm_mullo_epi16(ba, _mm_set_epi16((short)0xaaaa, (short)0xaaaa, (short)0xaaaa, (short)0xaaaa, 514, 514, 514, 514));
+		}
+
+		__m128i rgPairs = _mm_unpacklo_epi16(rg, _mm_srli_si128(rg, 8));
+		__m128i baPairs = _mm_unpacklo_epi16(ba, _mm_srli_si128(ba, 8));
+		_mm_storeu_si128((__m128i*)(Ptr + x * 4), _mm_unpacklo_epi32(rgPairs, baPairs));
+		_mm_storeu_si128((__m128i*)(Ptr + x * 4 + 8), _mm_unpackhi_epi32(rgPairs, baPairs));
 	}
+	return x;
+}
+
+#endif
+
+template<RGB10A2Scale scale>
+static void UploadRGB10A2(void* dst, UnrealMipmap* mip, int x, int y, int w, int h)
+{
+	int pitch = mip->Width;
+	const uint32_t* src = ((const uint32_t*)mip->Data.data()) + x + y * pitch;
+	TextureUploader::ConvertRows(w, h, [&](int y0, int y1)
+	{
+		for (int i = y0; i < y1; i++)
+		{
+			const uint32_t* line = src + i * pitch;
+			uint16_t* Ptr = (uint16_t*)dst + (size_t)i * w * 4;
+			int j = 0;
+#ifndef NOSSE
+			if (GetSimdLevel() != SimdLevel::Scalar)
+				j = ConvertRGB10A2SSE2<scale>(Ptr, line, j, w);
+#endif
+			ConvertRGB10A2Scalar<scale>(Ptr, line, j, w);
+		}
+	});
+}
+
+int TextureUploader_RGB10A2::GetUploadSize(int x, int y, int w, int h)
+{
+	return w * h * 8;
+}
+
+void TextureUploader_RGB10A2::UploadRect(void* dst, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
+{
+	UploadRGB10A2<RGB10A2Scale::Unorm>(dst, mip, x, y, w, h);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -283,26 +433,7 @@ int TextureUploader_RGB10A2_UI::GetUploadSize(int x, int y, int w, int h)
 
 void TextureUploader_RGB10A2_UI::UploadRect(void* dst, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
 {
-	int pitch = mip->Width;
-	uint32_t* src = ((uint32_t*)mip->Data.data()) + x + y * pitch;
-	uint16_t* Ptr = (uint16_t*)dst;
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
-
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
-		}
-		src += pitch;
-	}
+	UploadRGB10A2<RGB10A2Scale::Uint>(dst, mip, x, y, w, h);
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -314,31 +445,7 @@ int TextureUploader_RGB10A2_LM::GetUploadSize(int x, int y, int w, int h)
 
 void TextureUploader_RGB10A2_LM::UploadRect(void* dst, UnrealMipmap* mip, int x, int y, int w, int h, FColor* palette, bool masked)
 {
-	int pitch = mip->Width;
-	uint32_t* src = ((uint32_t*)mip->Data.data()) + x + y * pitch;
-	uint16_t* Ptr = (uint16_t*)dst;
-	for (int i = 0; i < h; i++)
-	{
-		for (int j = 0; j < w; j++)
-		{
-			uint32_t c = *Ptr;
-			uint32_t r = (c >> 22) & 0x3ff;
-			uint32_t g = (c >> 12) & 0x3ff;
-			uint32_t b = (c >> 2) & 0x3ff;
-			uint32_t a = c & 0x3;
-
-			r = (r << 1) * 0xffff / 0xff;
-			g = (g << 1) * 0xffff / 0xff;
-			b = (b << 1) * 0xffff / 0xff;
-			a = (a << 1) * 0xffff / 0x3;
-
-			*(Ptr++) = r;
-			*(Ptr++) = g;
-			*(Ptr++) = b;
-			*(Ptr++) = a;
-		}
-		src += pitch;
-	}
+	UploadRGB10A2<RGB10A2Scale::Lightmap>(dst, mip, x, y, w, h);
 }
 
 /////////////////////////////////////////////////////////////////////////////
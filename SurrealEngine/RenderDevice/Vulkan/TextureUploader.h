@@ -2,6 +2,7 @@
 
 #include <zvulkan/vulkanobjects.h>
 #include "RenderDevice/RenderDevice.h"
+#include <functional>
 
 struct FTextureInfo;
 class UnrealMipmap;
@@ -20,6 +21,9 @@ public:
 
 	static TextureUploader* GetUploader(TextureFormat format);
 
+	// Calls convertRows with ranges of the h rows to convert. Large rects are split across worker threads.
+	static void ConvertRows(int w, int h, const std::function<void(int y0, int y1)>& convertRows);
+
 private:
 	VkFormat Format;
 };
@@ -5,6 +5,7 @@
 #include "CachedTexture.h"
 #include <zvulkan/vulkanbuilders.h>
 #include "UObject/UTexture.h"
+#include <algorithm>
 
 UploadManager::UploadManager(VulkanRenderDevice* renderer) : renderer(renderer)
 {
@@ -21,6 +22,9 @@ bool UploadManager::SupportsTextureFormat(TextureFormat Format) const
 
 void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info, bool masked)
 {
+	if (Info.Texture)
+		Info.Texture->LoadMipData();
+
 	int width = Info.USize;
 	int height = Info.VSize;
 	int mipcount = Info.NumMips;
@@ -52,6 +56,14 @@ void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info,
 			.Image(tex->image.get(), format)
 			.DebugName("CachedTexture.ImageView")
 			.Create(renderer->Device.get());
+
+		tex->MemorySize = 0;
+		for (int level = 0; level < mipcount; level++)
+		{
+			int mipwidth = std::max(width >> level, 1);
+			int mipheight = std::max(height >> level, 1);
+			tex->MemorySize += uploader ? uploader->GetUploadSize(0, 0, mipwidth, mipheight) : mipwidth * mipheight * 4;
+		}
 	}
 
 	if (uploader)
@@ -60,8 +72,11 @@ void UploadManager::UploadTexture(CachedTexture* tex, const FTextureInfo& Info,
 		UploadWhite(tex->image->image);
 }
 
-void UploadManager::UploadTextureRect(CachedTexture* tex, const FTextureInfo& Info, int x, int y, int w, int h)
+void UploadManager::UploadTextureRect(CachedTexture* tex, const FTextureInfo& Info, int x, int y, int w, int h, bool masked)
 {
+	if (Info.Texture)
+		Info.Texture->LoadMipData();
+
 	TextureUploader* uploader = TextureUploader::GetUploader(Info.Format);
 	if (!uploader || Info.NumMips < 1 || x < 0 || y < 0 || w <= 0 || h <= 0 || x + w > Info.Mips[0].Width || y + h > Info.Mips[0].Height || Info.Mips[0].Data.empty())
 		return;
@@ -73,7 +88,8 @@ void UploadManager::UploadTextureRect(CachedTexture* tex, const FTextureInfo& In
 
 	uint8_t* data = renderer->Buffers->UploadData;
 	uint8_t* Ptr = data + UploadBufferPos;
-	uploader->UploadRect(Ptr, &Info.Mips[0], x, y, w, h, Info.Palette, false);
+	uploader->UploadRect(Ptr, &Info.Mips[0], x, y, w, h, Info.Palette, masked);
+	renderer->Stats.UploadBytes += pixelsSize;
 
 	VkBufferImageCopy region = {};
 	region.bufferOffset = (VkDeviceSize)(Ptr - data);
@@ -134,6 +150,7 @@ void UploadManager::UploadData(VkImage image, const FTextureInfo& Info, bool mas
 		}
 	}
 
+	renderer->Stats.UploadBytes += pixelsSize;
 	Uploads.push_back(upload);
 }
 
@@ -158,6 +175,7 @@ void UploadManager::UploadWhite(VkImage image)
 	Uploads.push_back(upload);
 	ImageCopies.push_back(region);
 	UploadBufferPos += 16; // 16-byte aligned
+	renderer->Stats.UploadBytes += 16;
 }
 
 void UploadManager::WaitIfUploadBufferIsFull(int bytes)
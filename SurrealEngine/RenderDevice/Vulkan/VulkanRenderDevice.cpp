@@ -370,22 +370,21 @@ void VulkanRenderDevice::Unlock(bool Blit)
 	}
 #endif
 
-	if (Blit)
-	{
-		Stats.DrawCalls = 0;
-		Stats.ComplexSurfaces = 0;
-		Stats.GouraudPolygons = 0;
-		Stats.Tiles = 0;
-		Stats.Uploads = 0;
-		Stats.RectUploads = 0;
-	}
-
 	DrawBatch(Commands->GetDrawCommands());
 	RenderPasses->EndScene(Commands->GetDrawCommands());
 
 	BlitSceneToPostprocess();
 	SubmitAndWait(Blit, Viewport->GetPixelWidth(), Viewport->GetPixelHeight());
 
+	if (Blit)
+	{
+		// SubmitAndWait waited for the GPU, so nothing uses the textures anymore
+		Textures->EndFrame();
+
+		LastFrameStats = Stats;
+		Stats = {};
+	}
+
 	IsLocked = false;
 }
 
@@ -399,6 +398,21 @@ void VulkanRenderDevice::UpdateTextureRect(FTextureInfo& Info, int U, int V, int
 	Textures->UpdateTextureRect(&Info, U, V, UL, VL);
 }
 
+void VulkanRenderDevice::SetTextureMemoryBudget(uint64_t bytes)
+{
+	Textures->SetMemoryBudget(bytes);
+}
+
+void VulkanRenderDevice::AddStats(Array<std::string>& lines)
+{
+	uint64_t mb = 1024 * 1024;
+	lines.push_back(std::to_string(Textures->GetTexturesInCache()) + " textures resident (" + std::to_string(Textures->GetResidentBytes() / mb) + " of " + std::to_string(Textures->GetMemoryBudget() / mb) + " MB)");
+	lines.push_back(std::to_string(Textures->GetRealtimeBytes() / mb) + " MB realtime textures");
+	lines.push_back(std::to_string(LastFrameStats.UploadBytes / 1024) + " KB uploaded in " + std::to_string(LastFrameStats.Uploads) + " uploads (" + std::to_string(LastFrameStats.RectUploads) + " rects)");
+	lines.push_back(std::to_string(LastFrameStats.Evictions) + " textures evicted");
+	lines.push_back(std::to_string(LastFrameStats.DrawCalls) + " draw calls");
+}
+
 void VulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
 {
 	uint32_t icount = SceneIndexPos - Batch.SceneIndexStart;
@@ -417,71 +431,118 @@ void VulkanRenderDevice::DrawBatch(VulkanCommandBuffer* cmdbuffer)
 
 void VulkanRenderDevice::DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet)
 {
-	CachedTexture* tex = Textures->GetTexture(Surface.Texture, !!(Surface.PolyFlags & PF_Masked));
-	CachedTexture* lightmap = Textures->GetTexture(Surface.LightMap, false);
-	CachedTexture* macrotex = Textures->GetTexture(Surface.MacroTexture, false);
-	CachedTexture* detailtex = Textures->GetTexture(Surface.DetailTexture, false);
-	CachedTexture* fogmap = Textures->GetTexture(Surface.FogMap, false);
-
-	if (Surface.DetailTexture && Surface.FogMap) detailtex = nullptr;
-
-	float UDot = dot(Facet.MapCoords.XAxis, Facet.MapCoords.Origin);
-	float VDot = dot(Facet.MapCoords.YAxis, Facet.MapCoords.Origin);
+	ComplexSurfaceTextures textures = BindComplexSurfaceTextures(Surface);
+	DrawComplexSurfaceFacet(Surface, textures, Facet);
+}
 
-	float UPan = tex ? UDot + Surface.Texture->Pan.x : 0.0f;
-	float VPan = tex ? VDot + Surface.Texture->Pan.y : 0.0f;
-	float UMult = tex ? GetUMult(*Surface.Texture) : 0.0f;
-	float VMult = tex ? GetVMult(*Surface.Texture) : 0.0f;
-	float LMUPan = lightmap ? UDot + Surface.LightMap->Pan.x - 0.5f * Surface.LightMap->UScale : 0.0f;
-	float LMVPan = lightmap ? VDot + Surface.LightMap->Pan.y - 0.5f * Surface.LightMap->VScale : 0.0f;
-	float LMUMult = lightmap ? GetUMult(*Surface.LightMap) : 0.0f;
-	float LMVMult = lightmap ? GetVMult(*Surface.LightMap) : 0.0f;
-	float MacroUPan = macrotex ? UDot + Surface.MacroTexture->Pan.x : 0.0f;
-	float MacroVPan = macrotex ? VDot + Surface.MacroTexture->Pan.y : 0.0f;
-	float MacroUMult = macrotex ? GetUMult(*Surface.MacroTexture) : 0.0f;
-	float MacroVMult = macrotex ? GetVMult(*Surface.MacroTexture) : 0.0f;
-	float DetailUPan = detailtex ? UDot + Surface.DetailTexture->Pan.x : 0.0f;
-	float DetailVPan = detailtex ? VDot + Surface.DetailTexture->Pan.y : 0.0f;
-	float DetailUMult = detailtex ? GetUMult(*Surface.DetailTexture) : 0.0f;
-	float DetailVMult = detailtex ? GetVMult(*Surface.DetailTexture) : 0.0f;
-
-	uint32_t flags = 0;
-	if (lightmap) flags |= 1;
-	if (macrotex) flags |= 2;
-	if (detailtex && !fogmap) flags |= 4;
-	if (fogmap) flags |= 8;
-
-	if (fogmap) // if Surface.FogMap exists, use instead of detail texture
+void VulkanRenderDevice::DrawComplexSurfaces(FSceneNode* Frame, FSurfaceInfo* Surfaces, FSurfaceFacet* Facets, int NumSurfaces)
+{
+	// Surfaces are expected to be sorted by their PolyFlags and textures.
+	// The texture lookups and descriptor set selection are then done once for each run of identical surfaces
+	// and the vertices of the run are all appended to the same draw call.
+	ComplexSurfaceTextures textures;
+	for (int i = 0; i < NumSurfaces; i++)
 	{
-		detailtex = fogmap;
-		DetailUPan = UDot + Surface.FogMap->Pan.x - 0.5f * Surface.FogMap->UScale;
-		DetailVPan = VDot + Surface.FogMap->Pan.y - 0.5f * Surface.FogMap->VScale;
-		DetailUMult = GetUMult(*Surface.FogMap);
-		DetailVMult = GetVMult(*Surface.FogMap);
+		if (i == 0 || !UsesSameTextures(Surfaces[i - 1], Surfaces[i]))
+			textures = BindComplexSurfaceTextures(Surfaces[i]);
+		DrawComplexSurfaceFacet(Surfaces[i], textures, Facets[i]);
 	}
+}
+
+static bool UsesSameTexture(const FTextureInfo* a, const FTextureInfo* b)
+{
+	if (!a || !b)
+		return a == b;
+	return a->CacheID == b->CacheID && !b->bRealtimeChanged;
+}
+
+bool VulkanRenderDevice::UsesSameTextures(const FSurfaceInfo& a, const FSurfaceInfo& b)
+{
+	return a.PolyFlags == b.PolyFlags &&
+		UsesSameTexture(a.Texture, b.Texture) &&
+		UsesSameTexture(a.LightMap, b.LightMap) &&
+		UsesSameTexture(a.MacroTexture, b.MacroTexture) &&
+		UsesSameTexture(a.DetailTexture, b.DetailTexture) &&
+		UsesSameTexture(a.FogMap, b.FogMap);
+}
+
+VulkanRenderDevice::ComplexSurfaceTextures VulkanRenderDevice::BindComplexSurfaceTextures(FSurfaceInfo& Surface)
+{
+	ComplexSurfaceTextures textures;
+	textures.tex = Textures->GetTexture(Surface.Texture, !!(Surface.PolyFlags & PF_Masked));
+	textures.lightmap = Textures->GetTexture(Surface.LightMap, false);
+	textures.macrotex = Textures->GetTexture(Surface.MacroTexture, false);
+	textures.detailtex = Textures->GetTexture(Surface.DetailTexture, false);
+	textures.fogmap = Textures->GetTexture(Surface.FogMap, false);
+
+	if (Surface.DetailTexture && Surface.FogMap) textures.detailtex = nullptr;
+
+	textures.flags = 0;
+	if (textures.lightmap) textures.flags |= 1;
+	if (textures.macrotex) textures.flags |= 2;
+	if (textures.detailtex && !textures.fogmap) textures.flags |= 4;
+	if (textures.fogmap) textures.flags |= 8;
+
+	// if Surface.FogMap exists, use instead of detail texture
+	CachedTexture* detailtex = textures.fogmap ? textures.fogmap : textures.detailtex;
 
 	SetPipeline(RenderPasses->getPipeline(Surface.PolyFlags, UsesBindless));
 
-	ivec4 textureBinds;
 	if (UsesBindless)
 	{
-		textureBinds.x = DescriptorSets->GetTextureArrayIndex(Surface.PolyFlags, tex);
-		textureBinds.y = DescriptorSets->GetTextureArrayIndex(0, macrotex);
-		textureBinds.z = DescriptorSets->GetTextureArrayIndex(0, detailtex);
-		textureBinds.w = DescriptorSets->GetTextureArrayIndex(0, lightmap);
+		textures.binds.x = DescriptorSets->GetTextureArrayIndex(Surface.PolyFlags, textures.tex);
+		textures.binds.y = DescriptorSets->GetTextureArrayIndex(0, textures.macrotex);
+		textures.binds.z = DescriptorSets->GetTextureArrayIndex(0, detailtex);
+		textures.binds.w = DescriptorSets->GetTextureArrayIndex(0, textures.lightmap);
 
 		SetDescriptorSet(DescriptorSets->GetBindlessDescriptorSet(), true);
 	}
 	else
 	{
-		textureBinds.x = 0;
-		textureBinds.y = 0;
-		textureBinds.z = 0;
-		textureBinds.w = 0;
+		textures.binds.x = 0;
+		textures.binds.y = 0;
+		textures.binds.z = 0;
+		textures.binds.w = 0;
 
-		SetDescriptorSet(DescriptorSets->GetTextureDescriptorSet(Surface.PolyFlags, tex, lightmap, macrotex, detailtex), false);
+		SetDescriptorSet(DescriptorSets->GetTextureDescriptorSet(Surface.PolyFlags, textures.tex, textures.lightmap, textures.macrotex, detailtex), false);
 	}
 
+	return textures;
+}
+
+void VulkanRenderDevice::DrawComplexSurfaceFacet(const FSurfaceInfo& Surface, const ComplexSurfaceTextures& textures, const FSurfaceFacet& Facet)
+{
+	float UDot = dot(Facet.MapCoords.XAxis, Facet.MapCoords.Origin);
+	float VDot = dot(Facet.MapCoords.YAxis, Facet.MapCoords.Origin);
+
+	float UPan = textures.tex ? UDot + Surface.Texture->Pan.x : 0.0f;
+	float VPan = textures.tex ? VDot + Surface.Texture->Pan.y : 0.0f;
+	float UMult = textures.tex ? GetUMult(*Surface.Texture) : 0.0f;
+	float VMult = textures.tex ? GetVMult(*Surface.Texture) : 0.0f;
+	float LMUPan = textures.lightmap ? UDot + Surface.LightMap->Pan.x - 0.5f * Surface.LightMap->UScale : 0.0f;
+	float LMVPan = textures.lightmap ? VDot + Surface.LightMap->Pan.y - 0.5f * Surface.LightMap->VScale : 0.0f;
+	float LMUMult = textures.lightmap ? GetUMult(*Surface.LightMap) : 0.0f;
+	float LMVMult = textures.lightmap ? GetVMult(*Surface.LightMap) : 0.0f;
+	float MacroUPan = textures.macrotex ? UDot + Surface.MacroTexture->Pan.x : 0.0f;
+	float MacroVPan = textures.macrotex ? VDot + Surface.MacroTexture->Pan.y : 0.0f;
+	float MacroUMult = textures.macrotex ? GetUMult(*Surface.MacroTexture) : 0.0f;
+	float MacroVMult = textures.macrotex ? GetVMult(*Surface.MacroTexture) : 0.0f;
+	float DetailUPan = textures.detailtex ? UDot + Surface.DetailTexture->Pan.x : 0.0f;
+	float DetailVPan = textures.detailtex ? VDot + Surface.DetailTexture->Pan.y : 0.0f;
+	float DetailUMult = textures.detailtex ? GetUMult(*Surface.DetailTexture) : 0.0f;
+	float DetailVMult = textures.detailtex ? GetVMult(*Surface.DetailTexture) : 0.0f;
+
+	if (textures.fogmap) // if Surface.FogMap exists, use instead of detail texture
+	{
+		DetailUPan = UDot + Surface.FogMap->Pan.x - 0.5f * Surface.FogMap->UScale;
+		DetailVPan = VDot + Surface.FogMap->Pan.y - 0.5f * Surface.FogMap->VScale;
+		DetailUMult = GetUMult(*Surface.FogMap);
+		DetailVMult = GetVMult(*Surface.FogMap);
+	}
+
+	uint32_t flags = textures.flags;
+	ivec4 textureBinds = textures.binds;
+
 	uint32_t vpos = SceneVertexPos;
 	uint32_t ipos = SceneIndexPos;
 
@@ -540,6 +601,48 @@ void VulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Inf
 {
 	if (NumPts < 3) return; // This can apparently happen!!
 
+	WriteGouraudVertices(Info, Pts, NumPts, PolyFlags);
+
+	uint32_t vstart = SceneVertexPos;
+	uint32_t vcount = NumPts;
+	uint32_t istart = SceneIndexPos;
+	uint32_t icount = (vcount - 2) * 3;
+
+	uint32_t* iptr = Buffers->SceneIndexes + istart;
+	for (uint32_t i = vstart + 2; i < vstart + vcount; i++)
+	{
+		*(iptr++) = vstart;
+		*(iptr++) = i - 1;
+		*(iptr++) = i;
+	}
+
+	SceneVertexPos += vcount;
+	SceneIndexPos += icount;
+
+	Stats.GouraudPolygons++;
+}
+
+void VulkanRenderDevice::DrawGouraudTriangles(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, const uint32_t* Indices, int NumIndices, uint32_t PolyFlags)
+{
+	if (NumPts < 3 || NumIndices < 3) return;
+
+	WriteGouraudVertices(Info, Pts, NumPts, PolyFlags);
+
+	uint32_t vstart = SceneVertexPos;
+	uint32_t icount = NumIndices - NumIndices % 3;
+
+	uint32_t* iptr = Buffers->SceneIndexes + SceneIndexPos;
+	for (uint32_t i = 0; i < icount; i++)
+		*(iptr++) = vstart + Indices[i];
+
+	SceneVertexPos += NumPts;
+	SceneIndexPos += icount;
+
+	Stats.GouraudPolygons += icount / 3;
+}
+
+void VulkanRenderDevice::WriteGouraudVertices(FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags)
+{
 	SetPipeline(RenderPasses->getPipeline(PolyFlags, UsesBindless));
 
 	CachedTexture* tex = Textures->GetTexture(&Info, !!(PolyFlags & PF_Masked));
@@ -617,28 +720,19 @@ void VulkanRenderDevice::DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Inf
 			vertex++;
 		}
 	}
-
-	uint32_t vstart = SceneVertexPos;
-	uint32_t vcount = NumPts;
-	uint32_t istart = SceneIndexPos;
-	uint32_t icount = (vcount - 2) * 3;
-
-	uint32_t* iptr = Buffers->SceneIndexes + istart;
-	for (uint32_t i = vstart + 2; i < vstart + vcount; i++)
-	{
-		*(iptr++) = vstart;
-		*(iptr++) = i - 1;
-		*(iptr++) = i;
-	}
-
-	SceneVertexPos += vcount;
-	SceneIndexPos += icount;
-
-	Stats.GouraudPolygons++;
 }
 
 void VulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags)
 {
+	TileRect tile = { X, Y, XL, YL, U, V, UL, VL };
+	DrawTiles(Frame, Info, &tile, 1, Z, Color, Fog, PolyFlags);
+}
+
+void VulkanRenderDevice::DrawTiles(FSceneNode* Frame, FTextureInfo& Info, const TileRect* Tiles, int NumTiles, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags)
+{
+	if (NumTiles <= 0)
+		return;
+
 	if ((PolyFlags & (PF_Modulated)) == PF_Modulated && Info.Format == TextureFormat::P8)
 		PolyFlags = PF_Modulated;
 
@@ -696,28 +790,31 @@ void VulkanRenderDevice::DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X
 	}
 	a = 1.0f;
 
-	v[0] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y - Frame->FY2),      Z), vec2(U * UMult,        V * VMult),        vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-	v[1] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y - Frame->FY2),      Z), vec2((U + UL) * UMult, V * VMult),        vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-	v[2] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2((U + UL) * UMult, (V + VL) * VMult), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
-	v[3] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2(U * UMult,        (V + VL) * VMult), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+	uint32_t* iptr = Buffers->SceneIndexes + SceneIndexPos;
+	for (int i = 0; i < NumTiles; i++)
+	{
+		float X = Tiles[i].X, Y = Tiles[i].Y, XL = Tiles[i].XL, YL = Tiles[i].YL;
+		float U = Tiles[i].U, V = Tiles[i].V, UL = Tiles[i].UL, VL = Tiles[i].VL;
 
-	uint32_t vstart = SceneVertexPos;
-	uint32_t vcount = 4;
-	uint32_t istart = SceneIndexPos;
-	uint32_t icount = (vcount - 2) * 3;
+		v[0] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y - Frame->FY2),      Z), vec2(U * UMult,        V * VMult),        vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+		v[1] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y - Frame->FY2),      Z), vec2((U + UL) * UMult, V * VMult),        vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+		v[2] = { 0, vec3(RFX2 * Z * (X + XL - Frame->FX2), RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2((U + UL) * UMult, (V + VL) * VMult), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+		v[3] = { 0, vec3(RFX2 * Z * (X - Frame->FX2),      RFY2 * Z * (Y + YL - Frame->FY2), Z), vec2(U * UMult,        (V + VL) * VMult), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec2(0.0f, 0.0f), vec4(r, g, b, a), textureBinds };
+		v += 4;
 
-	uint32_t* iptr = Buffers->SceneIndexes + istart;
-	for (uint32_t i = vstart + 2; i < vstart + vcount; i++)
-	{
+		uint32_t vstart = SceneVertexPos + i * 4;
 		*(iptr++) = vstart;
-		*(iptr++) = i - 1;
-		*(iptr++) = i;
+		*(iptr++) = vstart + 1;
+		*(iptr++) = vstart + 2;
+		*(iptr++) = vstart;
+		*(iptr++) = vstart + 2;
+		*(iptr++) = vstart + 3;
 	}
 
-	SceneVertexPos += vcount;
-	SceneIndexPos += icount;
+	SceneVertexPos += NumTiles * 4;
+	SceneIndexPos += NumTiles * 6;
 
-	Stats.Tiles++;
+	Stats.Tiles += NumTiles;
 }
 
 void VulkanRenderDevice::Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2)
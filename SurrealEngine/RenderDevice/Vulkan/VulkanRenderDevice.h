@@ -28,8 +28,11 @@ public:
 	void Lock(vec4 FlashScale, vec4 FlashFog, vec4 ScreenClear) override;
 	void Unlock(bool Blit) override;
 	void DrawComplexSurface(FSceneNode* Frame, FSurfaceInfo& Surface, FSurfaceFacet& Facet) override;
+	void DrawComplexSurfaces(FSceneNode* Frame, FSurfaceInfo* Surfaces, FSurfaceFacet* Facets, int NumSurfaces) override;
 	void DrawGouraudPolygon(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags) override;
+	void DrawGouraudTriangles(FSceneNode* Frame, FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, const uint32_t* Indices, int NumIndices, uint32_t PolyFlags) override;
 	void DrawTile(FSceneNode* Frame, FTextureInfo& Info, float X, float Y, float XL, float YL, float U, float V, float UL, float VL, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) override;
+	void DrawTiles(FSceneNode* Frame, FTextureInfo& Info, const TileRect* Tiles, int NumTiles, float Z, vec4 Color, vec4 Fog, uint32_t PolyFlags) override;
 	void Draw3DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override;
 	void Draw2DLine(FSceneNode* Frame, vec4 Color, vec3 P1, vec3 P2) override;
 	void Draw2DPoint(FSceneNode* Frame, vec4 Color, float X1, float Y1, float X2, float Y2, float Z) override;
@@ -40,6 +43,8 @@ public:
 	void PrecacheTexture(FTextureInfo& Info, uint32_t PolyFlags) override;
 	bool SupportsTextureFormat(TextureFormat Format) override;
 	void UpdateTextureRect(FTextureInfo& Info, int U, int V, int UL, int VL) override;
+	void SetTextureMemoryBudget(uint64_t bytes) override;
+	void AddStats(Array<std::string>& lines) override;
 
 	std::shared_ptr<VulkanDevice> Device;
 
@@ -65,7 +70,7 @@ public:
 
 	void DrawPresentTexture(int x, int y, int width, int height);
 
-	struct
+	struct FrameStats
 	{
 		int ComplexSurfaces = 0;
 		int GouraudPolygons = 0;
@@ -73,7 +78,11 @@ public:
 		int DrawCalls = 0;
 		int Uploads = 0;
 		int RectUploads = 0;
-	} Stats;
+		uint64_t UploadBytes = 0;
+		int Evictions = 0;
+	};
+	FrameStats Stats;
+	FrameStats LastFrameStats;
 
 private:
 	void Dispose();
@@ -97,6 +106,22 @@ private:
 	void SetPipeline(VulkanPipeline* pipeline);
 	void SetDescriptorSet(VulkanDescriptorSet* descriptorSet, bool bindless);
 	void DrawBatch(VulkanCommandBuffer* cmdbuffer);
+
+	struct ComplexSurfaceTextures
+	{
+		CachedTexture* tex = nullptr;
+		CachedTexture* lightmap = nullptr;
+		CachedTexture* macrotex = nullptr;
+		CachedTexture* detailtex = nullptr;
+		CachedTexture* fogmap = nullptr;
+		uint32_t flags = 0;
+		ivec4 binds = ivec4(0);
+	};
+
+	static bool UsesSameTextures(const FSurfaceInfo& a, const FSurfaceInfo& b);
+	ComplexSurfaceTextures BindComplexSurfaceTextures(FSurfaceInfo& Surface);
+	void DrawComplexSurfaceFacet(const FSurfaceInfo& Surface, const ComplexSurfaceTextures& textures, const FSurfaceFacet& Facet);
+	void WriteGouraudVertices(FTextureInfo& Info, const GouraudVertex* Pts, int NumPts, uint32_t PolyFlags);
 	void SubmitAndWait(bool present, int presentWidth, int presentHeight);
 
 	struct
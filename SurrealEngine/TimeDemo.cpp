@@ -0,0 +1,324 @@
+
+#include "Precomp.h"
+#include "TimeDemo.h"
+#include "Engine.h"
+#include "Utils/File.h"
+#include <algorithm>
+
+static const uint32_t TimeDemoSignature = 0x4d454453; // "SDEM"
+static const uint32_t TimeDemoFormatVersion = 1;
+
+std::unique_ptr<TimeDemo> TimeDemo::Record(const std::string& filename, uint32_t seed)
+{
+	auto demo = std::make_unique<TimeDemo>();
+	demo->Filename = filename;
+	demo->Seed = seed;
+	std::srand(seed);
+	return demo;
+}
+
+std::unique_ptr<TimeDemo> TimeDemo::Play(const std::string& filename, const std::string& statsFilename)
+{
+	auto demo = std::make_unique<TimeDemo>();
+	demo->Filename = filename;
+	demo->StatsFilename = statsFilename;
+	demo->Playing = true;
+	demo->Load();
+	std::srand(demo->Seed);
+	return demo;
+}
+
+bool TimeDemo::BeginFrame(float& realTimeElapsed)
+{
+	if (Playing)
+	{
+		if (FrameIndex >= Frames.size())
+			return false;
+		realTimeElapsed = Frames[FrameIndex].Elapsed;
+	}
+	else
+	{
+		Frame frame;
+		frame.Elapsed = realTimeElapsed;
+		Frames.push_back(std::move(frame));
+	}
+
+	Phases = {};
+	FrameStart = std::chrono::steady_clock::now();
+	return true;
+}
+
+void TimeDemo::EndFrame()
+{
+	FrameTimes.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - FrameStart).count());
+	FramePhases.push_back(Phases);
+	if (Playing)
+		FrameIndex++;
+}
+
+void TimeDemo::RecordInputEvent(EInputKey key, EInputType type, int delta)
+{
+	if (Playing || Frames.empty())
+		return;
+
+	Event e;
+	e.Type = EventType::Input;
+	e.Key = key;
+	e.InputType = type;
+	e.Delta = delta;
+	Frames.back().Events.push_back(std::move(e));
+}
+
+void TimeDemo::RecordKey(const std::string& chars)
+{
+	if (Playing || Frames.empty())
+		return;
+
+	Event e;
+	e.Type = EventType::Key;
+	e.Chars = chars;
+	Frames.back().Events.push_back(std::move(e));
+}
+
+void TimeDemo::DispatchInput()
+{
+	if (!Playing || FrameIndex >= Frames.size())
+		return;
+
+	Dispatching = true;
+	for (const Event& e : Frames[FrameIndex].Events)
+	{
+		if (e.Type == EventType::Input)
+			engine->InputEvent(e.Key, e.InputType, e.Delta);
+		else
+			engine->Key(e.Chars);
+	}
+	Dispatching = false;
+}
+
+void TimeDemo::Finish()
+{
+	if (Playing)
+		WriteStats();
+	else
+		Save();
+}
+
+void TimeDemo::Save()
+{
+	Array<uint8_t> data;
+	auto write = [&](const void* value, size_t size)
+	{
+		const uint8_t* bytes = static_cast<const uint8_t*>(value);
+		data.insert(data.end(), bytes, bytes + size);
+	};
+	auto writeString = [&](const std::string& value)
+	{
+		uint32_t size = (uint32_t)value.size();
+		write(&size, sizeof(uint32_t));
+		write(value.data(), value.size());
+	};
+
+	write(&TimeDemoSignature, sizeof(uint32_t));
+	write(&TimeDemoFormatVersion, sizeof(uint32_t));
+	write(&Seed, sizeof(uint32_t));
+	writeString(URL);
+
+	uint32_t frameCount = (uint32_t)Frames.size();
+	write(&frameCount, sizeof(uint32_t));
+	for (const Frame& frame : Frames)
+	{
+		uint32_t eventCount = (uint32_t)frame.Events.size();
+		write(&frame.Elapsed, sizeof(float));
+		write(&eventCount, sizeof(uint32_t));
+		for (const Event& e : frame.Events)
+		{
+			uint8_t type = (uint8_t)e.Type;
+			write(&type, sizeof(uint8_t));
+			if (e.Type == EventType::Input)
+			{
+				uint8_t key = (uint8_t)e.Key;
+				uint8_t inputType = (uint8_t)e.InputType;
+				int32_t delta = e.Delta;
+				write(&key, sizeof(uint8_t));
+				write(&inputType, sizeof(uint8_t));
+				write(&delta, sizeof(int32_t));
+			}
+			else
+			{
+				writeString(e.Chars);
+			}
+		}
+	}
+
+	File::write_all_bytes(Filename, data.data(), data.size());
+	LogMessage("Saved time demo " + Filename + " (" + std::to_string(Frames.size()) + " frames)");
+}
+
+void TimeDemo::Load()
+{
+	Array<uint8_t> data = File::read_all_bytes(Filename);
+	size_t pos = 0;
+	auto read = [&](void* value, size_t size)
+	{
+		if (data.size() - pos < size)
+			Exception::Throw("Time demo " + Filename + " is truncated");
+		memcpy(value, data.data() + pos, size);
+		pos += size;
+	};
+	auto readUInt32 = [&]()
+	{
+		uint32_t value;
+		read(&value, sizeof(uint32_t));
+		return value;
+	};
+	auto readString = [&]()
+	{
+		uint32_t size = readUInt32();
+		if (data.size() - pos < size)
+			Exception::Throw("Time demo " + Filename + " is truncated");
+		std::string value((const char*)data.data() + pos, size);
+		pos += size;
+		return value;
+	};
+
+	if (readUInt32() != TimeDemoSignature)
+		Exception::Throw(Filename + " is not a time demo");
+	if (readUInt32() != TimeDemoFormatVersion)
+		Exception::Throw("Unsupported time demo version in " + Filename);
+
+	Seed = readUInt32();
+	URL = readString();
+
+	uint32_t frameCount = readUInt32();
+	Frames.clear();
+	Frames.reserve(frameCount);
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		Frame frame;
+		read(&frame.Elapsed, sizeof(float));
+		uint32_t eventCount = readUInt32();
+		for (uint32_t j = 0; j < eventCount; j++)
+		{
+			Event e;
+			uint8_t type;
+			read(&type, sizeof(uint8_t));
+			e.Type = (EventType)type;
+			if (e.Type == EventType::Input)
+			{
+				uint8_t key, inputType;
+				int32_t delta;
+				read(&key, sizeof(uint8_t));
+				read(&inputType, sizeof(uint8_t));
+				read(&delta, sizeof(int32_t));
+				e.Key = (EInputKey)key;
+				e.InputType = (EInputType)inputType;
+				e.Delta = delta;
+			}
+			else if (e.Type == EventType::Key)
+			{
+				e.Chars = readString();
+			}
+			else
+			{
+				Exception::Throw("Unknown event in time demo " + Filename);
+			}
+			frame.Events.push_back(std::move(e));
+		}
+		Frames.push_back(std::move(frame));
+	}
+}
+
+std::shared_ptr<File> TimeDemo::ConsoleResults;
+
+void TimeDemo::WriteConsoleResult(const std::string& line)
+{
+	if (!ConsoleResults)
+		ConsoleResults = File::create_always(FilePath::combine(FilePath::combine(engine->LaunchInfo.gameRootFolder, "System"), "TimeDemo.log"));
+
+	std::string text = line + "\n";
+	ConsoleResults->write(text.data(), text.size());
+}
+
+void TimeDemo::CloseConsoleResults()
+{
+	ConsoleResults.reset();
+}
+
+static std::string JsonString(const std::string& value)
+{
+	std::string result = "\"";
+	for (char c : value)
+	{
+		if (c == '"' || c == '\\')
+			result.push_back('\\');
+		result.push_back(c);
+	}
+	result.push_back('"');
+	return result;
+}
+
+void TimeDemo::WriteStats()
+{
+	if (FrameTimes.empty())
+		return;
+
+	auto stats = [&](const std::string& name, Array<double> values) -> std::string
+	{
+		std::sort(values.begin(), values.end());
+		double total = 0.0;
+		for (double value : values)
+			total += value;
+		auto percentile = [&](double p) { return values[std::min((size_t)(p * (values.size() - 1) + 0.5), values.size() - 1)] * 1000.0; };
+
+		return "\t\t\"" + name + "\": { " +
+			"\"min\": " + std::to_string(values.front() * 1000.0) + ", " +
+			"\"avg\": " + std::to_string(total * 1000.0 / values.size()) + ", " +
+			"\"p50\": " + std::to_string(percentile(0.50)) + ", " +
+			"\"p95\": " + std::to_string(percentile(0.95)) + ", " +
+			"\"p99\": " + std::to_string(percentile(0.99)) + ", " +
+			"\"max\": " + std::to_string(values.back() * 1000.0) + " }";
+	};
+
+	auto phase = [&](double TimeDemoPhases::*member)
+	{
+		Array<double> values;
+		values.reserve(FramePhases.size());
+		for (const TimeDemoPhases& phases : FramePhases)
+			values.push_back(phases.*member);
+		return values;
+	};
+
+	double totalTime = 0.0;
+	for (double value : FrameTimes)
+		totalTime += value;
+
+	std::string json;
+	json += "{\n";
+	json += "\t\"demo\": " + JsonString(Filename) + ",\n";
+	json += "\t\"url\": " + JsonString(URL) + ",\n";
+	json += "\t\"seed\": " + std::to_string(Seed) + ",\n";
+	json += "\t\"frames\": " + std::to_string(FrameTimes.size()) + ",\n";
+	json += "\t\"seconds\": " + std::to_string(totalTime) + ",\n";
+	json += "\t\"fps\": " + std::to_string(FrameTimes.size() / totalTime) + ",\n";
+	json += "\t\"ms\": {\n";
+	json += stats("frame", FrameTimes) + ",\n";
+	json += stats("tick", phase(&TimeDemoPhases::Tick)) + ",\n";
+	json += stats("script", phase(&TimeDemoPhases::Script)) + ",\n";
+	json += stats("physics", phase(&TimeDemoPhases::Physics)) + ",\n";
+	json += stats("render", phase(&TimeDemoPhases::Render)) + ",\n";
+	json += stats("audio", phase(&TimeDemoPhases::Audio)) + "\n";
+	json += "\t}\n";
+	json += "}\n";
+
+	LogMessage("Time demo " + Filename + ": " + std::to_string(FrameTimes.size()) + " frames in " + std::to_string(totalTime) + " seconds (" + std::to_string(FrameTimes.size() / totalTime) + " FPS)");
+	if (!StatsFilename.empty())
+	{
+		File::write_all_text(StatsFilename, json);
+		LogMessage("Saved time demo stats to " + StatsFilename);
+	}
+	else
+	{
+		LogMessage(json);
+	}
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include "GameWindow.h"
+#include <chrono>
+
+class File;
+
+// Time spent in each part of an engine frame, in seconds, added up by ProfileTimer.
+// Tick is all game logic for the frame. Script is the time spent running script code, and Physics the time in actor physics
+// not counting the script events it calls. Both are measured with exclusive timers.
+struct TimeDemoPhases
+{
+	double Tick = 0.0;
+	double Script = 0.0;
+	double Physics = 0.0;
+	double Render = 0.0;
+	double Audio = 0.0;
+};
+
+// Records the input and frame times of the engine loop into a demo file, or plays a demo back.
+// Playback replaces the live input and clock with the recorded ones and reseeds std::rand with the seed of the recording,
+// so the same demo runs the same game logic on every build. The frame times measured during playback are reported as JSON.
+class TimeDemo
+{
+public:
+	static std::unique_ptr<TimeDemo> Record(const std::string& filename, uint32_t seed);
+	static std::unique_ptr<TimeDemo> Play(const std::string& filename, const std::string& statsFilename);
+
+	bool IsPlaying() const { return Playing; }
+	const std::string& GetURL() const { return URL; }
+	void SetURL(const std::string& url) { URL = url; }
+
+	// Called at the start of every engine frame. Replaces the elapsed time with the recorded one when playing.
+	// Returns false when there are no more frames to play.
+	bool BeginFrame(float& realTimeElapsed);
+	void EndFrame();
+
+	// Live input is blocked during playback. The recorded input is sent by DispatchInput instead.
+	bool AcceptInput() const { return !Playing || Dispatching; }
+	void RecordInputEvent(EInputKey key, EInputType type, int delta);
+	void RecordKey(const std::string& chars);
+	void DispatchInput();
+
+	// Saves the recording, or writes the stats of the playback
+	void Finish();
+
+	int GetFrameIndex() const { return (int)FrameIndex; }
+	int GetFrameCount() const { return (int)Frames.size(); }
+
+	// Lines of the timedemo results of the console (Console.SaveTimeDemo). The first line of a set of results starts a new
+	// TimeDemo.log in the System folder, and the file is closed when the frame ends.
+	static void WriteConsoleResult(const std::string& line);
+	static void CloseConsoleResults();
+
+	TimeDemoPhases Phases;
+
+private:
+	enum class EventType : uint8_t
+	{
+		Input,
+		Key
+	};
+
+	struct Event
+	{
+		EventType Type = EventType::Input;
+		EInputKey Key = IK_None;
+		EInputType InputType = IST_None;
+		int Delta = 0;
+		std::string Chars;
+	};
+
+	struct Frame
+	{
+		float Elapsed = 0.0f;
+		Array<Event> Events;
+	};
+
+	void Load();
+	void Save();
+	void WriteStats();
+
+	std::string Filename;
+	std::string StatsFilename;
+	std::string URL;
+	uint32_t Seed = 0;
+	bool Playing = false;
+	bool Dispatching = false;
+
+	Array<Frame> Frames;
+	size_t FrameIndex = 0;
+
+	std::chrono::steady_clock::time_point FrameStart;
+	Array<double> FrameTimes;
+	Array<TimeDemoPhases> FramePhases;
+
+	static std::shared_ptr<File> ConsoleResults;
+};
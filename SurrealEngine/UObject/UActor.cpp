@@ -8,6 +8,8 @@
 #include "VM/Frame.h"
 #include "Package/PackageManager.h"
 #include "Engine.h"
+#include "TimeDemo.h"
+#include "Utils/Profiler.h"
 #include "Collision/TraceAABBModel.h"
 #include "Collision/TraceRayModel.h"
 #include "Collision/OverlapCylinderLevel.h"
@@ -352,25 +354,34 @@ void UActor::Tick(float elapsed)
 {
 	TickAnimation(elapsed);
 
-	if (Role() >= ROLE_SimulatedProxy && IsEventEnabled(EventName::Tick))
-	{
-		CallEvent(this, EventName::Tick, { ExpressionValue::FloatValue(elapsed) });
-	}
+	TimeDemoPhases* phases = engine->timedemo ? &engine->timedemo->Phases : nullptr;
 
-	if (StateFrame && StateFrame->LatentState == LatentRunState::Sleep)
 	{
-		SleepTimeLeft = std::max(SleepTimeLeft - elapsed, 0.0f);
-		if (SleepTimeLeft == 0.0f)
-			StateFrame->LatentState = LatentRunState::Continue;
+		ProfileTimer scriptTimer(phases ? &phases->Script : nullptr, nullptr, true);
+
+		if (Role() >= ROLE_SimulatedProxy && IsEventEnabled(EventName::Tick))
+		{
+			CallEvent(this, EventName::Tick, { ExpressionValue::FloatValue(elapsed) });
+		}
+
+		if (StateFrame && StateFrame->LatentState == LatentRunState::Sleep)
+		{
+			SleepTimeLeft = std::max(SleepTimeLeft - elapsed, 0.0f);
+			if (SleepTimeLeft == 0.0f)
+				StateFrame->LatentState = LatentRunState::Continue;
+		}
+
+		if (Role() >= ROLE_SimulatedProxy && StateFrame && StateFrame->LatentState == LatentRunState::Continue)
+		{
+			StateFrame->Tick();
+		}
 	}
 
-	if (Role() >= ROLE_SimulatedProxy && StateFrame && StateFrame->LatentState == LatentRunState::Continue)
 	{
-		StateFrame->Tick();
+		ProfileTimer physicsTimer(phases ? &phases->Physics : nullptr, nullptr, true);
+		TickPhysics(elapsed);
 	}
 
-	TickPhysics(elapsed);
-
 	if (TimerRate() > 0.0f) // Role() == ROLE_Authority && RemoteRole() == ROLE_AutonomousProxy
 	{
 		TimerCounter() += elapsed;
@@ -386,6 +397,8 @@ void UActor::Tick(float elapsed)
 
 void UActor::TickPhysics(float elapsed)
 {
+	PROFILE_ZONE("UActor::TickPhysics");
+
 	for (float timeLeft = elapsed; timeLeft > 0.0f && !bDeleteMe(); timeLeft -= 0.02f)
 	{
 		float physTimeElapsed = std::min(timeLeft, 0.02f);
@@ -1820,12 +1833,123 @@ bool UActor::PlayerCanSeeMe()
 	return false;
 }
 
+static BBox TransformBox(const mat4& transform, const BBox& box)
+{
+	const float* m = transform.matrix;
+	vec3 center = (transform * vec4(box.center(), 1.0f)).xyz();
+	vec3 extents = box.extents();
+	vec3 worldExtents(
+		std::abs(m[0]) * extents.x + std::abs(m[4]) * extents.y + std::abs(m[8]) * extents.z,
+		std::abs(m[1]) * extents.x + std::abs(m[5]) * extents.y + std::abs(m[9]) * extents.z,
+		std::abs(m[2]) * extents.x + std::abs(m[6]) * extents.y + std::abs(m[10]) * extents.z);
+	return BBox(center - worldExtents, center + worldExtents);
+}
+
+void UActor::UpdateMeshBounds()
+{
+	UMesh* mesh = Mesh();
+	if (!mesh)
+	{
+		MeshBounds.Mesh = nullptr;
+		return;
+	}
+
+	// Same frames as the renderer interpolates between
+	int frames[3] = { -1, -1, -1 };
+	if (!mesh->AnimSeqs.empty() && mesh->FrameVerts > 0)
+	{
+		MeshAnimSeq* seq = mesh->GetSequence(AnimSequence());
+		float animFrame = AnimFrame() * seq->NumFrames;
+		if (animFrame < 0.0f)
+		{
+			frames[0] = TweenFromAnimFrame.V0 / mesh->FrameVerts;
+			frames[1] = TweenFromAnimFrame.V1 / mesh->FrameVerts;
+			frames[2] = seq->StartFrame;
+		}
+		else if (seq->NumFrames > 0)
+		{
+			int frame0 = (int)animFrame;
+			frames[0] = seq->StartFrame + frame0 % seq->NumFrames;
+			frames[1] = seq->StartFrame + (frame0 + 1) % seq->NumFrames;
+		}
+	}
+
+	bool scaled = MeshBounds.Mesh != mesh || MeshBounds.DrawScale != DrawScale() || MeshBounds.PrePivot != PrePivot();
+	bool moved = scaled || MeshBounds.Location != Location() || MeshBounds.Rotation != Rotation();
+	bool animated = moved || MeshBounds.Frames[0] != frames[0] || MeshBounds.Frames[1] != frames[1] || MeshBounds.Frames[2] != frames[2];
+	if (!animated)
+		return;
+
+	MeshBounds.Mesh = mesh;
+	MeshBounds.Location = Location();
+	MeshBounds.Rotation = Rotation();
+	MeshBounds.PrePivot = PrePivot();
+	MeshBounds.DrawScale = DrawScale();
+	MeshBounds.Frames[0] = frames[0];
+	MeshBounds.Frames[1] = frames[1];
+	MeshBounds.Frames[2] = frames[2];
+
+	mat4 meshToObject = mat4::scale(DrawScale()) * mesh->meshToObject;
+	mat4 meshToWorld = mat4::translate(Location() + PrePivot()) * Coords::Rotation(Rotation()).ToMatrix() * meshToObject;
+
+	if (scaled)
+	{
+		const BBox& box = mesh->BoundingBox;
+		float radius = 0.0f;
+		for (int i = 0; i < 8; i++)
+		{
+			vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+			radius = std::max(radius, length((meshToObject * vec4(corner, 1.0f)).xyz()));
+		}
+		MeshBounds.Radius = length(PrePivot()) + radius;
+	}
+
+	if (moved)
+	{
+		MeshBounds.MeshBox = TransformBox(meshToWorld, mesh->BoundingBox);
+	}
+
+	// Frames without bounds (skeletal meshes, broken packages) fall back to the bounds of the whole mesh
+	BBox frameBox;
+	bool frameBoxValid = frames[0] >= 0;
+	for (int i = 0; i < 3 && frameBoxValid; i++)
+	{
+		int frame = frames[i];
+		if (frame < 0)
+			continue;
+
+		if (frame >= (int)mesh->BoundingBoxes.size() || !mesh->BoundingBoxes[frame].IsValid)
+		{
+			frameBoxValid = false;
+		}
+		else if (i == 0)
+		{
+			frameBox = mesh->BoundingBoxes[frame];
+		}
+		else
+		{
+			const BBox& box = mesh->BoundingBoxes[frame];
+			frameBox.min = vec3(std::min(frameBox.min.x, box.min.x), std::min(frameBox.min.y, box.min.y), std::min(frameBox.min.z, box.min.z));
+			frameBox.max = vec3(std::max(frameBox.max.x, box.max.x), std::max(frameBox.max.y, box.max.y), std::max(frameBox.max.z, box.max.z));
+		}
+	}
+	MeshBounds.FrameBox = frameBoxValid ? TransformBox(meshToWorld, frameBox) : MeshBounds.MeshBox;
+}
+
 void UActor::UpdateBspInfo()
 {
 	vec3 extents;
 	if (LightBrightness() == 0)
 	{
 		extents = { VisibilityRadius(), VisibilityRadius(), VisibilityHeight() };
+
+		// Meshes use their rotation independent radius so that turning or animating doesn't relink them
+		if (DrawType() == DT_Mesh && Mesh())
+		{
+			UpdateMeshBounds();
+			float radius = MeshBounds.Radius;
+			extents = { std::max(extents.x, radius), std::max(extents.y, radius), std::max(extents.z, radius) };
+		}
 	}
 	else
 	{
@@ -2510,23 +2634,14 @@ UObject* UDecal::AttachDecal(float traceDistance, const vec3& decalDir)
 	leveldecal->UVs[1] = vec2(usize, 0.0f);
 	leveldecal->UVs[2] = vec2(usize, vsize);
 	leveldecal->UVs[3] = vec2(0.0f, vsize);
-	XLevel()->Decals.push_back(std::move(leveldecal));
+	XLevel()->AddDecal(std::move(leveldecal));
 
 	return Level();
 }
 
 void UDecal::DetachDecal()
 {
-	auto& decals = XLevel()->Decals;
-	auto it = decals.begin();
-	while (it != decals.end())
-	{
-		auto& leveldecal = *it;
-		if (leveldecal->Decal == this)
-			it = decals.erase(it);
-		else
-			++it;
-	}
+	XLevel()->RemoveDecals(this);
 }
 
 /////////////////////////////////////////////////////////////////////////////
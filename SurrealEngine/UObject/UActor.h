@@ -2,6 +2,7 @@
 
 #include "UObject.h"
 #include "UnrealURL.h"
+#include "Math/bbox.h"
 
 class UTexture;
 class UMesh;
@@ -32,6 +33,15 @@ class CollisionHit;
 class BspNode;
 struct MeshAnimSeq;
 
+// Result of the visibility trace between an actor and a light
+struct ActorLightTrace
+{
+	int LightIndex; // Index into the light list of the renderer
+	vec3 LightLocation;
+	vec3 Location;
+	bool Visible;
+};
+
 struct PointRegion
 {
 	UZoneInfo* Zone;
@@ -235,7 +245,9 @@ public:
 	{
 		bool NeedsUpdate = true;
 		vec3 Location = vec3(0.0f);
-		Array<UActor*> LightList;
+		float Radius = 0.0f;
+		Array<int> LightList; // Indices into the light list of the renderer
+		Array<ActorLightTrace> Traces; // Lights in range, in light list order
 	} LightInfo;
 
 	// Fog between actor and camera
@@ -257,6 +269,22 @@ public:
 		UActor* Next = nullptr;
 	} BspInfo;
 
+	// World space bounds of the mesh. Only recalculated when the actor moves, rotates, scales or animates
+	struct
+	{
+		UMesh* Mesh = nullptr;
+		vec3 Location = vec3(0.0f);
+		Rotator Rotation;
+		vec3 PrePivot = vec3(0.0f);
+		float DrawScale = 0.0f;
+		int Frames[3] = { -1, -1, -1 };
+		BBox MeshBox; // All animation frames
+		BBox FrameBox; // Animation frames of the current pose
+		float Radius = 0.0f; // Distance from the actor location to the furthest point of the mesh in any rotation
+	} MeshBounds;
+
+	void UpdateMeshBounds();
+
 	// Tweening animation state
 	struct
 	{
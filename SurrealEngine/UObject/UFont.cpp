@@ -18,14 +18,7 @@ void UFont::Load(ObjectStream* stream)
 		for (FontPage& page : pages)
 		{
 			page.Texture = stream->ReadObject<UTexture>();
-			page.Characters.resize(stream->ReadIndex());
-			for (FontCharacter& character : page.Characters)
-			{
-				character.StartU = stream->ReadInt32();
-				character.StartV = stream->ReadInt32();
-				character.USize = stream->ReadInt32();
-				character.VSize = stream->ReadInt32();
-			}
+			stream->ReadArray(page.Characters, stream->ReadIndex());
 		}
 
 		charactersPerPage = stream->ReadUInt32();
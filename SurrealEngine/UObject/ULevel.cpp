@@ -5,9 +5,11 @@
 #include "UTexture.h"
 #include "UClass.h"
 #include "VM/ScriptCall.h"
+#include "Package/CookedMap.h"
 #include "Collision/TraceRayLevel.h"
 #include "Collision/TraceRayModel.h"
 #include "Collision/TraceCylinderLevel.h"
+#include "Utils/Profiler.h"
 
 BBox BspNode::GetCollisionBox(UModel* model) const
 {
@@ -116,6 +118,8 @@ void ULevel::TickActor(float elapsed, UActor* actor)
 
 void ULevel::Tick(float elapsed)
 {
+	PROFILE_ZONE("ULevel::Tick");
+
 	for (size_t i = 0; i < Actors.size(); i++)
 	{
 		TickActor(elapsed, Actors[i]);
@@ -183,12 +187,76 @@ bool ULevel::TraceRayAnyHit(vec3 from, vec3 to, UActor* tracingActor, bool trace
 	return trace.TraceAnyHit(this, from, to, tracingActor, traceActors, traceWorld, visibilityOnly);
 }
 
+void ULevel::AddDecal(std::unique_ptr<LevelDecal> decal)
+{
+	decal->Bounds = BBox(decal->Positions[0], decal->Positions[0]);
+	for (const vec3& pos : decal->Positions)
+	{
+		BBox& bounds = decal->Bounds;
+		bounds.min = vec3(std::min(bounds.min.x, pos.x), std::min(bounds.min.y, pos.y), std::min(bounds.min.z, pos.z));
+		bounds.max = vec3(std::max(bounds.max.x, pos.x), std::max(bounds.max.y, pos.y), std::max(bounds.max.z, pos.z));
+	}
+
+	// Link the decal into the same node an actor with these bounds would be in
+	vec3 center = decal->Bounds.center();
+	vec3 extents = decal->Bounds.extents();
+	BspNode* node = !Model->Nodes.empty() ? &Model->Nodes[0] : nullptr;
+	while (node)
+	{
+		int side = UActor::NodeAABBOverlap(center, extents, node);
+		if (side == 0 || (side < 0 && node->Front < 0) || (side > 0 && node->Back < 0))
+		{
+			decal->Node = node;
+			decal->Next = node->DecalList;
+			if (node->DecalList)
+				node->DecalList->Prev = decal.get();
+			node->DecalList = decal.get();
+			break;
+		}
+		node = &Model->Nodes[side < 0 ? node->Front : node->Back];
+	}
+
+	Decals.push_back(std::move(decal));
+}
+
+void ULevel::RemoveDecals(UDecal* decal)
+{
+	auto it = Decals.begin();
+	while (it != Decals.end())
+	{
+		LevelDecal* leveldecal = it->get();
+		if (leveldecal->Decal == decal)
+		{
+			if (leveldecal->Next)
+				leveldecal->Next->Prev = leveldecal->Prev;
+			if (leveldecal->Prev)
+				leveldecal->Prev->Next = leveldecal->Next;
+			if (leveldecal->Node && leveldecal->Node->DecalList == leveldecal)
+				leveldecal->Node->DecalList = leveldecal->Next;
+			it = Decals.erase(it);
+		}
+		else
+		{
+			++it;
+		}
+	}
+}
+
 /////////////////////////////////////////////////////////////////////////////
 
 void UModel::Load(ObjectStream* stream)
 {
 	UPrimitive::Load(stream);
 
+	static uint32_t NextLMCacheID = 0; // For easier unique CacheIDs for lightmap textures
+
+	if (CookedMap::Load(stream, this))
+	{
+		for (LightMapIndex& entry : LightMap)
+			entry.LMCacheID = NextLMCacheID++;
+		return;
+	}
+
 	if (stream->GetVersion() <= 61)
 	{
 		UVectors* vectors = stream->ReadObject<UVectors>();
@@ -216,26 +284,13 @@ void UModel::Load(ObjectStream* stream)
 	else
 	{
 		int count = stream->ReadIndex();
-		for (int i = 0; i < count; i++)
-		{
-			vec3 v;
-			v.x = stream->ReadFloat();
-			v.y = stream->ReadFloat();
-			v.z = stream->ReadFloat();
-			Vectors.push_back(v);
-		}
+		stream->ReadArray(Vectors, count);
 
 		count = stream->ReadIndex();
-		for (int i = 0; i < count; i++)
-		{
-			vec3 v;
-			v.x = stream->ReadFloat();
-			v.y = stream->ReadFloat();
-			v.z = stream->ReadFloat();
-			Points.push_back(v);
-		}
+		stream->ReadArray(Points, count);
 
 		count = stream->ReadIndex();
+		Nodes.reserve(count);
 		for (int i = 0; i < count; i++)
 		{
 			BspNode node;
@@ -261,6 +316,7 @@ void UModel::Load(ObjectStream* stream)
 		}
 
 		count = stream->ReadIndex();
+		Surfaces.reserve(count);
 		for (int i = 0; i < count; i++)
 		{
 			BspSurface surface;
@@ -279,6 +335,7 @@ void UModel::Load(ObjectStream* stream)
 		}
 
 		count = stream->ReadIndex();
+		Vertices.reserve(count);
 		for (int i = 0; i < count; i++)
 		{
 			BspVert vert;
@@ -304,9 +361,8 @@ void UModel::Load(ObjectStream* stream)
 
 	Polys = stream->ReadObject<UPolys>();
 
-	static uint32_t NextLMCacheID = 0; // For easier unique CacheIDs for lightmap textures
-
 	int count = stream->ReadIndex();
+	LightMap.reserve(count);
 	for (int i = 0; i < count; i++)
 	{
 		LightMapIndex entry;
@@ -327,26 +383,22 @@ void UModel::Load(ObjectStream* stream)
 	stream->ReadBytes(LightBits.data(), (uint32_t)LightBits.size());
 
 	count = stream->ReadIndex();
+	const uint8_t* boundsData = stream->ReadBlock(count, 25);
+	Bounds.resize(count);
 	for (int i = 0; i < count; i++)
 	{
-		BBox boundingBox;
-		boundingBox.min.x = stream->ReadFloat();
-		boundingBox.min.y = stream->ReadFloat();
-		boundingBox.min.z = stream->ReadFloat();
-		boundingBox.max.x = stream->ReadFloat();
-		boundingBox.max.y = stream->ReadFloat();
-		boundingBox.max.z = stream->ReadFloat();
-		boundingBox.IsValid = stream->ReadInt8() != 0;
-		Bounds.push_back(boundingBox);
+		const uint8_t* src = boundsData + i * 25;
+		BBox& boundingBox = Bounds[i];
+		memcpy(&boundingBox.min, src, sizeof(vec3));
+		memcpy(&boundingBox.max, src + 12, sizeof(vec3));
+		boundingBox.IsValid = src[24] != 0;
 	}
 
 	count = stream->ReadIndex();
-	for (int i = 0; i < count; i++)
-	{
-		LeafHulls.push_back(stream->ReadInt32());
-	}
+	stream->ReadArray(LeafHulls, count);
 
 	count = stream->ReadIndex();
+	Leaves.reserve(count);
 	for (int i = 0; i < count; i++)
 	{
 		ConvexVolumeLeaf leaf;
@@ -440,14 +492,7 @@ void UPolys::Load(ObjectStream* stream)
 		poly.TextureV.x = stream->ReadFloat();
 		poly.TextureV.y = stream->ReadFloat();
 		poly.TextureV.z = stream->ReadFloat();
-		for (int i = 0; i < numVertices; i++)
-		{
-			vec3 v;
-			v.x = stream->ReadFloat();
-			v.y = stream->ReadFloat();
-			v.z = stream->ReadFloat();
-			poly.Vertices.push_back(v);
-		}
+		stream->ReadArray(poly.Vertices, numVertices);
 		poly.PolyFlags = stream->ReadUInt32();
 		poly.Actor = stream->ReadObject<UBrush>();
 		poly.Texture = stream->ReadObject<UTexture>();
@@ -534,14 +579,7 @@ void UVectors::Load(ObjectStream* stream)
 	UObject::Load(stream);
 	int count = stream->ReadInt32();
 	int maxcount = stream->ReadInt32();
-	for (int i = 0; i < count; i++)
-	{
-		vec3 v;
-		v.x = stream->ReadFloat();
-		v.y = stream->ReadFloat();
-		v.z = stream->ReadFloat();
-		Vectors.push_back(v);
-	}
+	stream->ReadArray(Vectors, count);
 }
 
 /////////////////////////////////////////////////////////////////////////////
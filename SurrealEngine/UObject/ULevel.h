@@ -13,6 +13,7 @@ class UDecal;
 class UZoneInfo;
 class UPolys;
 struct PointRegion;
+struct LevelDecal;
 
 enum EBspNodeFlags
 {
@@ -48,6 +49,7 @@ public:
 	BBox GetCollisionBox(UModel* model) const;
 
 	UActor* ActorList = nullptr;
+	LevelDecal* DecalList = nullptr;
 };
 
 class BspSurface
@@ -245,6 +247,12 @@ struct LevelDecal
 	UDecal* Decal = nullptr;
 	vec3 Positions[4];
 	vec2 UVs[4];
+
+	// Location in the BSP tree. The decal is only drawn when its node is visible.
+	BBox Bounds;
+	BspNode* Node = nullptr;
+	LevelDecal* Prev = nullptr;
+	LevelDecal* Next = nullptr;
 };
 
 class ULevel : public ULevelBase
@@ -260,6 +268,9 @@ public:
 
 	bool TraceRayAnyHit(vec3 from, vec3 to, UActor* tracingActor, bool traceActors, bool traceWorld, bool visibilityOnly);
 
+	void AddDecal(std::unique_ptr<LevelDecal> decal);
+	void RemoveDecals(UDecal* decal);
+
 	Array<LevelReachSpec> ReachSpecs;
 	UModel* Model = nullptr;
 
@@ -25,6 +25,17 @@ void UPrimitive::Load(ObjectStream* stream)
 
 /////////////////////////////////////////////////////////////////////////////
 
+// These are read straight from the package with ObjectStream::ReadArray
+static_assert(sizeof(MeshTri) == 20, "MeshTri must match the package layout");
+static_assert(sizeof(MeshVertConnect) == 8, "MeshVertConnect must match the package layout");
+static_assert(sizeof(MeshFace) == 8, "MeshFace must match the package layout");
+static_assert(sizeof(MeshWedge) == 4, "MeshWedge must match the package layout");
+static_assert(sizeof(MeshMaterial) == 8, "MeshMaterial must match the package layout");
+static_assert(sizeof(ExtMeshWedge) == 12, "ExtMeshWedge must match the package layout");
+static_assert(sizeof(BoneWeightIndex) == 8, "BoneWeightIndex must match the package layout");
+static_assert(sizeof(BoneWeight) == 4, "BoneWeight must match the package layout");
+static_assert(sizeof(vec3) == 12 && sizeof(quaternion) == 16, "Vectors must match the package layout");
+
 void UMesh::Load(ObjectStream* stream)
 {
 	UPrimitive::Load(stream);
@@ -40,24 +51,28 @@ void UMesh::Load(ObjectStream* stream)
 	//			which type of mesh this is?
 	if (stream->GetPackage()->GetPackageManager()->IsDeusEx())
 	{
+		struct DeusExVertex
+		{
+			int16_t x, y, z, padding;
+		};
+		const uint8_t* src = stream->ReadBlock(NumVerts, sizeof(DeusExVertex));
+		Verts.resize(NumVerts);
 		for (int i = 0; i < NumVerts; i++)
 		{
-			struct DeusExVertex
-			{
-				int16_t x, y, z, padding;
-			} packedvertex;
-			stream->ReadBytes(&packedvertex, sizeof(DeusExVertex));
-			vec3 vertex = { (float)packedvertex.x, (float)packedvertex.y, (float)packedvertex.z };
-			Verts.push_back(vertex);
+			DeusExVertex packedvertex;
+			memcpy(&packedvertex, src + i * sizeof(DeusExVertex), sizeof(DeusExVertex));
+			Verts[i] = { (float)packedvertex.x, (float)packedvertex.y, (float)packedvertex.z };
 		}
 	}
 	else
 	{
+		const uint8_t* src = stream->ReadBlock(NumVerts, sizeof(int32_t));
+		Verts.resize(NumVerts);
 		for (int i = 0; i < NumVerts; i++)
 		{
-			int32_t packedvertex = stream->ReadInt32();
-			vec3 vertex = { (float)((packedvertex << 21) >> 21), (float)((packedvertex << 10) >> 21), (float)(packedvertex >> 22) };
-			Verts.push_back(vertex);
+			int32_t packedvertex;
+			memcpy(&packedvertex, src + i * sizeof(int32_t), sizeof(int32_t));
+			Verts[i] = { (float)((packedvertex << 21) >> 21), (float)((packedvertex << 10) >> 21), (float)(packedvertex >> 22) };
 		}
 	}
 	if (stream->GetVersion() > 61 && stream->Tell() != VertsSkipOffset)
@@ -66,22 +81,7 @@ void UMesh::Load(ObjectStream* stream)
 	uint32_t TrisSkipOffset = 0;
 	if (stream->GetVersion() > 61) TrisSkipOffset = stream->ReadUInt32();
 	int NumTris = stream->ReadIndex();
-	for (int i = 0; i < NumTris; i++)
-	{
-		MeshTri tri;
-		tri.Indices[0] = stream->ReadUInt16();
-		tri.Indices[1] = stream->ReadUInt16();
-		tri.Indices[2] = stream->ReadUInt16();
-		tri.UV[0].x = stream->ReadUInt8();
-		tri.UV[0].y = stream->ReadUInt8();
-		tri.UV[1].x = stream->ReadUInt8();
-		tri.UV[1].y = stream->ReadUInt8();
-		tri.UV[2].x = stream->ReadUInt8();
-		tri.UV[2].y = stream->ReadUInt8();
-		tri.PolyFlags = stream->ReadUInt32();
-		tri.TextureIndex = stream->ReadInt32();
-		Tris.push_back(tri);
-	}
+	stream->ReadArray(Tris, NumTris);
 	if (stream->GetVersion() > 61 && stream->Tell() != TrisSkipOffset)
 		Exception::Throw("Unexpected lazy array size");
 
@@ -109,13 +109,7 @@ void UMesh::Load(ObjectStream* stream)
 	uint32_t ConnectsSkipOffset = 0;
 	if (stream->GetVersion() > 61) ConnectsSkipOffset = stream->ReadUInt32();
 	int NumConnects = stream->ReadIndex();
-	for (int i = 0; i < NumConnects; i++)
-	{
-		MeshVertConnect connect;
-		connect.NumVertTriangles = stream->ReadInt32();
-		connect.TriangleListOffset = stream->ReadUInt32();
-		Connects.push_back(connect);
-	}
+	stream->ReadArray(Connects, NumConnects);
 	if (stream->GetVersion() > 61 && stream->Tell() != ConnectsSkipOffset)
 		Exception::Throw("Unexpected lazy array size");
 
@@ -136,10 +130,7 @@ void UMesh::Load(ObjectStream* stream)
 	uint32_t VertLinksSkipOffset = 0;
 	if (stream->GetVersion() > 61) VertLinksSkipOffset = stream->ReadUInt32();
 	int NumVertLinks = stream->ReadIndex();
-	for (int i = 0; i < NumVertLinks; i++)
-	{
-		VertLinks.push_back(stream->ReadInt32());
-	}
+	stream->ReadArray(VertLinks, NumVertLinks);
 	if (stream->GetVersion() > 61 && stream->Tell() != VertLinksSkipOffset)
 		Exception::Throw("Unexpected lazy array size");
 
@@ -148,27 +139,32 @@ void UMesh::Load(ObjectStream* stream)
 		Textures.push_back(stream->ReadObject<UTexture>());
 
 	int NumBoundingBoxes = stream->ReadIndex();
+	const uint8_t* boundsData = stream->ReadBlock(NumBoundingBoxes, 25);
+	BoundingBoxes.resize(NumBoundingBoxes);
 	for (int i = 0; i < NumBoundingBoxes; i++)
 	{
-		BBox bbox;
-		bbox.min.x = stream->ReadFloat();
-		bbox.min.y = stream->ReadFloat();
-		bbox.min.z = stream->ReadFloat();
-		bbox.max.x = stream->ReadFloat();
-		bbox.max.y = stream->ReadFloat();
-		bbox.max.z = stream->ReadFloat();
-		bbox.IsValid = stream->ReadUInt8() == 1;
-		BoundingBoxes.push_back(bbox);
+		const uint8_t* src = boundsData + i * 25;
+		BBox& bbox = BoundingBoxes[i];
+		memcpy(&bbox.min, src, sizeof(vec3));
+		memcpy(&bbox.max, src + 12, sizeof(vec3));
+		bbox.IsValid = src[24] == 1;
 	}
 
 	int NumBoundingSpheres = stream->ReadIndex();
-	for (int i = 0; i < NumBoundingSpheres; i++)
+	if (stream->GetVersion() > 61)
 	{
-		float x = stream->ReadFloat();
-		float y = stream->ReadFloat();
-		float z = stream->ReadFloat();
-		float w = (stream->GetVersion() > 61) ? stream->ReadFloat() : 0.0f;
-		BoundingSpheres.push_back({ x, y, z, w });
+		stream->ReadArray(BoundingSpheres, NumBoundingSpheres);
+	}
+	else
+	{
+		const uint8_t* spheresData = stream->ReadBlock(NumBoundingSpheres, sizeof(vec3));
+		BoundingSpheres.resize(NumBoundingSpheres);
+		for (int i = 0; i < NumBoundingSpheres; i++)
+		{
+			vec3 center;
+			memcpy(&center, spheresData + i * sizeof(vec3), sizeof(vec3));
+			BoundingSpheres[i] = vec4(center, 0.0f);
+		}
 	}
 
 	FrameVerts = stream->ReadInt32();
@@ -199,17 +195,41 @@ void UMesh::Load(ObjectStream* stream)
 	else if (stream->GetVersion() >= 66)
 	{
 		int NumTextureLOD = stream->ReadIndex();
-		for (int i = 0; i < NumTextureLOD; i++)
-		{
-			TextureLOD.push_back(stream->ReadFloat());
-		}
+		stream->ReadArray(TextureLOD, NumTextureLOD);
 	}
 
 	meshToObject = Coords::Rotation(RotOrigin).ToMatrix() * mat4::scale(Scale) * mat4::translate(-Origin);
 
 	// Build smoothed normals
-	// 
-	// To do: build normals from mesh faces (maybe using the Connects array?)
+	Normals.clear();
+	if (!Tris.empty())
+	{
+		Normals.resize(Verts.size(), vec3(0.0f));
+		for (int frame = 0; frame < AnimFrames; frame++)
+		{
+			size_t frameOffset = (size_t)frame * FrameVerts;
+			for (const MeshTri& tri : Tris)
+			{
+				size_t v0 = tri.Indices[0] + frameOffset;
+				size_t v1 = tri.Indices[1] + frameOffset;
+				size_t v2 = tri.Indices[2] + frameOffset;
+				if (v0 >= Verts.size() || v1 >= Verts.size() || v2 >= Verts.size())
+					continue;
+				vec3 n = cross(Verts[v1] - Verts[v0], Verts[v2] - Verts[v0]);
+				float len = length(n);
+				if (len > 0.0f)
+					n = n * (1.0f / len);
+				Normals[v0] += n;
+				Normals[v1] += n;
+				Normals[v2] += n;
+			}
+		}
+		for (vec3& n : Normals)
+		{
+			float len = length(n);
+			n = len > 0.0f ? n * (1.0f / len) : vec3(0.0f, 0.0f, 1.0f);
+		}
+	}
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -219,57 +239,25 @@ void ULodMesh::Load(ObjectStream* stream)
 	UMesh::Load(stream);
 
 	int NumCollapsePointThus = stream->ReadIndex();
-	for (int i = 0; i < NumCollapsePointThus; i++)
-		CollapsePointThus.push_back(stream->ReadUInt16());
+	stream->ReadArray(CollapsePointThus, NumCollapsePointThus);
 
 	int NumFaceLevel = stream->ReadIndex();
-	for (int i = 0; i < NumFaceLevel; i++)
-		FaceLevel.push_back(stream->ReadUInt16());
+	stream->ReadArray(FaceLevel, NumFaceLevel);
 
 	int NumFaces = stream->ReadIndex();
-	for (int i = 0; i < NumFaces; i++)
-	{
-		MeshFace face;
-		face.Indices[0] = stream->ReadUInt16();
-		face.Indices[1] = stream->ReadUInt16();
-		face.Indices[2] = stream->ReadUInt16();
-		face.MaterialIndex = stream->ReadUInt16();
-		Faces.push_back(face);
-	}
+	stream->ReadArray(Faces, NumFaces);
 
 	int NumCollapseWedgeThus = stream->ReadIndex();
-	for (int i = 0; i < NumCollapseWedgeThus; i++)
-		CollapseWedgeThus.push_back(stream->ReadUInt16());
+	stream->ReadArray(CollapseWedgeThus, NumCollapseWedgeThus);
 
 	int NumWedges = stream->ReadIndex();
-	for (int i = 0; i < NumWedges; i++)
-	{
-		MeshWedge wedge;
-		wedge.Vertex = stream->ReadUInt16();
-		wedge.U = stream->ReadUInt8();
-		wedge.V = stream->ReadUInt8();
-		Wedges.push_back(wedge);
-	}
+	stream->ReadArray(Wedges, NumWedges);
 
 	int NumMaterials = stream->ReadIndex();
-	for (int i = 0; i < NumMaterials; i++)
-	{
-		MeshMaterial material;
-		material.PolyFlags = stream->ReadUInt32();
-		material.TextureIndex = stream->ReadInt32();
-		Materials.push_back(material);
-	}
+	stream->ReadArray(Materials, NumMaterials);
 
 	int NumSpecialFaces = stream->ReadIndex();
-	for (int i = 0; i < NumSpecialFaces; i++)
-	{
-		MeshFace face;
-		face.Indices[0] = stream->ReadUInt16();
-		face.Indices[1] = stream->ReadUInt16();
-		face.Indices[2] = stream->ReadUInt16();
-		face.MaterialIndex = stream->ReadUInt16();
-		SpecialFaces.push_back(face);
-	}
+	stream->ReadArray(SpecialFaces, NumSpecialFaces);
 
 	ModelVerts = stream->ReadUInt32();
 	SpecialVerts = stream->ReadUInt32();
@@ -281,10 +269,7 @@ void ULodMesh::Load(ObjectStream* stream)
 	LODZDisplace = stream->ReadFloat();
 
 	int NumReMapAnimVerts = stream->ReadIndex();
-	for (int i = 0; i < NumReMapAnimVerts; i++)
-	{
-		ReMapAnimVerts.push_back(stream->ReadUInt16());
-	}
+	stream->ReadArray(ReMapAnimVerts, NumReMapAnimVerts);
 
 	OldFrameVerts = stream->ReadUInt32();
 
@@ -327,25 +312,10 @@ void USkeletalMesh::Load(ObjectStream* stream)
 	ULodMesh::Load(stream);
 
 	int NumExtWedges = stream->ReadIndex();
-	for (int i = 0; i < NumExtWedges; i++)
-	{
-		ExtMeshWedge wedge;
-		wedge.Vertex = stream->ReadUInt16();
-		wedge.Flags = stream->ReadUInt16();
-		wedge.U = stream->ReadFloat();
-		wedge.V = stream->ReadFloat();
-		ExtWedges.push_back(wedge);
-	}
+	stream->ReadArray(ExtWedges, NumExtWedges);
 
 	int NumPoints = stream->ReadIndex();
-	for (int i = 0; i < NumPoints; i++)
-	{
-		vec3 p;
-		p.x = stream->ReadFloat();
-		p.y = stream->ReadFloat();
-		p.z = stream->ReadFloat();
-		Points.push_back(p);
-	}
+	stream->ReadArray(Points, NumPoints);
 
 	int NumRefSkeletonBones = stream->ReadIndex();
 	for (int i = 0; i < NumRefSkeletonBones; i++)
@@ -370,34 +340,13 @@ void USkeletalMesh::Load(ObjectStream* stream)
 	}
 
 	int NumBoneWeightIndices = stream->ReadIndex();
-	for (int i = 0; i < NumBoneWeightIndices; i++)
-	{
-		BoneWeightIndex index;
-		index.WeightIndex = stream->ReadUInt16();
-		index.Number = stream->ReadUInt16();
-		index.DetailA = stream->ReadUInt16();
-		index.DetailB = stream->ReadUInt16();
-		BoneWeightIndices.push_back(index);
-	}
+	stream->ReadArray(BoneWeightIndices, NumBoneWeightIndices);
 
 	int NumBoneWeights = stream->ReadIndex();
-	for (int i = 0; i < NumBoneWeights; i++)
-	{
-		BoneWeight weight;
-		weight.PointIndex = stream->ReadUInt16();
-		weight.BoneWeight = stream->ReadUInt16();
-		BoneWeights.push_back(weight);
-	}
+	stream->ReadArray(BoneWeights, NumBoneWeights);
 
 	int NumLocalPoints = stream->ReadIndex();
-	for (int i = 0; i < NumLocalPoints; i++)
-	{
-		vec3 p;
-		p.x = stream->ReadFloat();
-		p.y = stream->ReadFloat();
-		p.z = stream->ReadFloat();
-		LocalPoints.push_back(p);
-	}
+	stream->ReadArray(LocalPoints, NumLocalPoints);
 
 	SkeletalDepth = stream->ReadUInt32();
 	DefaultAnimation = stream->ReadObject<UAnimation>();
@@ -445,8 +394,7 @@ void UAnimation::Load(ObjectStream* stream)
 		move.Flags = stream->ReadUInt32();
 
 		int NumBoneIndices = stream->ReadIndex();
-		for (int j = 0; j < NumBoneIndices; j++)
-			move.BoneIndices.push_back(stream->ReadUInt32());
+		stream->ReadArray(move.BoneIndices, NumBoneIndices);
 
 		int NumAnimTracks = stream->ReadIndex();
 		for (int j = 0; j < NumAnimTracks; j++)
@@ -455,29 +403,13 @@ void UAnimation::Load(ObjectStream* stream)
 			track.Flags = stream->ReadUInt32();
 
 			int NumKeyQuat = stream->ReadIndex();
-			for (int k = 0; k < NumKeyQuat; k++)
-			{
-				quaternion q;
-				q.x = stream->ReadFloat();
-				q.y = stream->ReadFloat();
-				q.z = stream->ReadFloat();
-				q.w = stream->ReadFloat();
-				track.KeyQuat.push_back(q);
-			}
+			stream->ReadArray(track.KeyQuat, NumKeyQuat);
 
 			int NumKeyPos = stream->ReadIndex();
-			for (int k = 0; k < NumKeyPos; k++)
-			{
-				vec3 pos;
-				pos.x = stream->ReadFloat();
-				pos.y = stream->ReadFloat();
-				pos.z = stream->ReadFloat();
-				track.KeyPos.push_back(pos);
-			}
+			stream->ReadArray(track.KeyPos, NumKeyPos);
 
 			int NumKeyTime = stream->ReadIndex();
-			for (int k = 0; k < NumKeyTime; k++)
-				track.KeyTime.push_back(stream->ReadFloat());
+			stream->ReadArray(track.KeyTime, NumKeyTime);
 
 			move.AnimTracks.push_back(track);
 		}
@@ -486,29 +418,13 @@ void UAnimation::Load(ObjectStream* stream)
 		rootTrack.Flags = stream->ReadUInt32();
 
 		int NumKeyQuat = stream->ReadIndex();
-		for (int k = 0; k < NumKeyQuat; k++)
-		{
-			quaternion q;
-			q.x = stream->ReadFloat();
-			q.y = stream->ReadFloat();
-			q.z = stream->ReadFloat();
-			q.w = stream->ReadFloat();
-			rootTrack.KeyQuat.push_back(q);
-		}
+		stream->ReadArray(rootTrack.KeyQuat, NumKeyQuat);
 
 		int NumKeyPos = stream->ReadIndex();
-		for (int k = 0; k < NumKeyPos; k++)
-		{
-			vec3 pos;
-			pos.x = stream->ReadFloat();
-			pos.y = stream->ReadFloat();
-			pos.z = stream->ReadFloat();
-			rootTrack.KeyPos.push_back(pos);
-		}
+		stream->ReadArray(rootTrack.KeyPos, NumKeyPos);
 
 		int NumKeyTime = stream->ReadIndex();
-		for (int k = 0; k < NumKeyTime; k++)
-			rootTrack.KeyTime.push_back(stream->ReadFloat());
+		stream->ReadArray(rootTrack.KeyTime, NumKeyTime);
 
 		Moves.push_back(move);
 	}
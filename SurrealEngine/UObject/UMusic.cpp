@@ -1,6 +1,7 @@
 
 #include "Precomp.h"
 #include "UMusic.h"
+#include "Package/PackageManager.h"
 
 void UMusic::Load(ObjectStream* stream)
 {
@@ -10,6 +11,14 @@ void UMusic::Load(ObjectStream* stream)
 	if (stream->GetVersion() > 61)
 		stream->ReadUInt32(); // lazy array skip offset
 	uint32_t size = stream->ReadIndex();
+
+	// Music is never played by a dedicated server
+	if (stream->GetPackage()->GetPackageManager()->IsDedicatedServer())
+	{
+		stream->Skip(size);
+		return;
+	}
+
 	Data.resize(size);
 	stream->ReadBytes(Data.data(), size);
 }
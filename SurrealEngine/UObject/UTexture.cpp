@@ -1,6 +1,22 @@
 
 #include "Precomp.h"
 #include "UTexture.h"
+#include "Package/PackageManager.h"
+#include "Package/PackageStream.h"
+#include "Utils/CpuFeatures.h"
+
+#ifndef NOSSE
+#include <emmintrin.h>
+#endif
+
+std::list<UTexture*> UTexture::ResidentTextures;
+size_t UTexture::ResidentMipBytes = 0;
+size_t UTexture::MipMemoryBudget = 256 * 1024 * 1024;
+
+UTexture::~UTexture()
+{
+	UnloadMipData();
+}
 
 void UTexture::Load(ObjectStream* stream)
 {
@@ -17,8 +33,7 @@ void UTexture::Load(ObjectStream* stream)
 		if (stream->GetVersion() >= 63)
 			widthoffset = stream->ReadInt32();
 		int bytes = stream->ReadIndex();
-		mipmap.Data.resize(bytes);
-		stream->ReadBytes(mipmap.Data.data(), bytes);
+		ReadMipmap(stream, mipmap, bytes);
 		mipmap.Width = stream->ReadUInt32();
 		mipmap.Height = stream->ReadUInt32();
 		uint8_t UBits = stream->ReadUInt8();
@@ -37,14 +52,102 @@ void UTexture::Load(ObjectStream* stream)
 			if (stream->GetVersion() >= 68)
 				widthoffset = stream->ReadInt32();
 			int bytes = stream->ReadIndex();
-			mipmap.Data.resize(bytes);
-			stream->ReadBytes(mipmap.Data.data(), bytes);
+			ReadMipmap(stream, mipmap, bytes);
 			mipmap.Width = stream->ReadUInt32();
 			mipmap.Height = stream->ReadUInt32();
 			uint8_t UBits = stream->ReadUInt8();
 			uint8_t VBits = stream->ReadUInt8();
 		}
 	}
+
+	size_t bytes = 0;
+	for (UnrealMipmap& mipmap : Mipmaps)
+		bytes += mipmap.Data.size();
+	if (bytes > 0)
+		AddResidentMipData(bytes);
+}
+
+void UTexture::ReadMipmap(ObjectStream* stream, UnrealMipmap& mipmap, int bytes)
+{
+	// The object stream already holds the whole export, so keep the pixels instead of reading them from the file again in LoadMipData
+	mipmap.DataOffset = stream->Tell();
+	mipmap.DataSize = bytes;
+	mipmap.Data.resize(bytes);
+	if (bytes > 0)
+		stream->ReadBytes(mipmap.Data.data(), bytes);
+}
+
+void UTexture::LoadMipData()
+{
+	if (MipDataResident)
+	{
+		ResidentTextures.splice(ResidentTextures.begin(), ResidentTextures, ResidentIterator);
+		return;
+	}
+
+	std::shared_ptr<PackageStream> file;
+	size_t bytes = 0;
+	for (UnrealMipmap& mipmap : Mipmaps)
+	{
+		if (mipmap.DataOffset < 0 || mipmap.DataSize == 0 || !mipmap.Data.empty())
+			continue;
+
+		if (!file)
+			file = package->GetPackageManager()->GetStream(package);
+
+		mipmap.Data.resize(mipmap.DataSize);
+		file->Seek((uint32_t)mipmap.DataOffset);
+		file->ReadBytes(mipmap.Data.data(), mipmap.DataSize);
+		bytes += mipmap.DataSize;
+	}
+
+	if (bytes > 0)
+		AddResidentMipData(bytes);
+}
+
+void UTexture::AddResidentMipData(size_t bytes)
+{
+	MipDataResident = true;
+	ResidentTextures.push_front(this);
+	ResidentIterator = ResidentTextures.begin();
+	ResidentMipBytes += bytes;
+
+	EvictMipData();
+}
+
+void UTexture::UnloadMipData()
+{
+	if (!MipDataResident)
+		return;
+
+	for (UnrealMipmap& mipmap : Mipmaps)
+	{
+		if (mipmap.DataOffset < 0 || mipmap.Data.empty())
+			continue;
+
+		ResidentMipBytes -= mipmap.Data.size();
+		mipmap.Data.clear();
+		mipmap.Data.shrink_to_fit();
+	}
+
+	ResidentTextures.erase(ResidentIterator);
+	MipDataResident = false;
+}
+
+void UTexture::SetMipMemoryBudget(size_t bytes)
+{
+	MipMemoryBudget = bytes;
+	if (!ResidentTextures.empty())
+		ResidentTextures.front()->EvictMipData();
+}
+
+void UTexture::EvictMipData()
+{
+	// The renderer keeps its own copy of uploaded textures, so the least recently used pixel data can simply be dropped and read again if needed
+	while (ResidentMipBytes > MipMemoryBudget && ResidentTextures.back() != this)
+	{
+		ResidentTextures.back()->UnloadMipData();
+	}
 }
 
 void UTexture::Update(float elapsed)
@@ -82,6 +185,9 @@ void UFractalTexture::Load(ObjectStream* stream)
 {
 	UTexture::Load(stream);
 
+	// The pixels are generated, so drop the mip data kept from the package before replacing the mipmaps
+	UnloadMipData();
+
 	ActualFormat = TextureFormat::P8;
 	Mipmaps.resize(1);
 
@@ -91,9 +197,103 @@ void UFractalTexture::Load(ObjectStream* stream)
 	UnrealMipmap& mipmap = Mipmaps.front();
 	mipmap.Width = width;
 	mipmap.Height = height;
+	mipmap.DataOffset = -1;
+	mipmap.DataSize = 0;
 	mipmap.Data.resize((size_t)mipmap.Width * mipmap.Height);
 	uint8_t* pixels = (uint8_t*)mipmap.Data.data();
 	memset(pixels, 0, (size_t)width * height);
+
+	RandomState = ((uint32_t)std::rand() << 1) | 1;
+}
+
+void UFractalTexture::Update(float elapsed)
+{
+	PrepareUpdate(elapsed, 1);
+	Simulate();
+}
+
+void UFractalTexture::PrepareUpdate(float elapsed, int frames)
+{
+	int steps = 0;
+	if (MaxFrameRate() > 0.0f)
+	{
+		float stepTime = 1.0f / MaxFrameRate();
+		Accumulator() += elapsed;
+		steps = (int)(Accumulator() / stepTime);
+		if (steps > MaxCatchUpSteps)
+		{
+			// Drop the rest of the time the texture was not visible
+			steps = MaxCatchUpSteps;
+			Accumulator() = 0.0f;
+		}
+		else
+		{
+			Accumulator() -= steps * stepTime;
+		}
+	}
+	else
+	{
+		// One step per frame
+		steps = std::min(std::max(frames, 1), MaxCatchUpSteps);
+	}
+
+	PendingSteps = std::min(PendingSteps + steps, MaxCatchUpSteps);
+}
+
+void UFractalTexture::Simulate()
+{
+	if (PendingSteps == 0 || Mipmaps.empty())
+		return;
+
+	for (int i = 0; i < PendingSteps; i++)
+		UpdateFrame();
+	PendingSteps = 0;
+
+	const uint8_t* pixels = DrawSimulation();
+	if (pixels)
+		CommitPixels(pixels);
+}
+
+void UFractalTexture::CommitPixels(const uint8_t* src)
+{
+	UnrealMipmap& mipmap = Mipmaps.front();
+	int width = mipmap.Width;
+	int height = mipmap.Height;
+	uint8_t* pixels = (uint8_t*)mipmap.Data.data();
+
+	// Only copy the texels that changed and remember where they are, so the renderer can upload just that area
+	TextureDirtyRect rect;
+	rect.X0 = width;
+	rect.Y0 = height;
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* srcline = src + y * width;
+		uint8_t* destline = pixels + y * width;
+		if (memcmp(srcline, destline, width) == 0)
+			continue;
+
+		int x0 = 0;
+		int x1 = width;
+		while (srcline[x0] == destline[x0])
+			x0++;
+		while (srcline[x1 - 1] == destline[x1 - 1])
+			x1--;
+		memcpy(destline + x0, srcline + x0, x1 - x0);
+
+		rect.X0 = std::min(rect.X0, x0);
+		rect.X1 = std::max(rect.X1, x1);
+		rect.Y0 = std::min(rect.Y0, y);
+		rect.Y1 = y + 1;
+	}
+
+	if (rect.IsEmpty())
+		return;
+
+	if (!TextureModified)
+		DirtyRect = rect;
+	else if (!DirtyRect.IsEmpty())
+		DirtyRect.Add(rect);
+	TextureModified = true;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -118,247 +318,270 @@ void UFireTexture::Load(ObjectStream* stream)
 	}
 }
 
-void UFireTexture::UpdateFrame()
+static void FireLineScalar(uint8_t* destLine, const uint8_t* srcLine, const uint8_t* nextLine, int x, int end, int width, const uint8_t* fadeTable)
 {
-	if (!TextureModified)
+	for (; x < end; x++)
 	{
-		UnrealMipmap& mipmap = Mipmaps.front();
+		int left = srcLine[x != 0 ? x - 1 : width - 1];
+		int center = srcLine[x];
+		int right = srcLine[x != width - 1 ? x + 1 : 0];
+		int bottom = nextLine[x];
+		destLine[x] = fadeTable[left + center + right + bottom];
+	}
+}
+
+#ifndef NOSSE
+
+// Computes the fade table entries directly. With heatLoss = 1 - (255 - renderHeat) / 16, the table entry of a sum
+// round(clamp((sum + 0.5) / 4 + heatLoss, 0, 255)) equals clamp((4 * sum + renderHeat - 229) >> 4, 0, 255).
+static int FireLineSSE2(uint8_t* destLine, const uint8_t* srcLine, const uint8_t* nextLine, int x, int end, int renderHeat)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i bias = _mm_set1_epi16((short)(renderHeat - 229));
+	for (; x + 16 <= end; x += 16)
+	{
+		__m128i left = _mm_loadu_si128((const __m128i*)(srcLine + x - 1));
+		__m128i center = _mm_loadu_si128((const __m128i*)(srcLine + x));
+		__m128i right = _mm_loadu_si128((const __m128i*)(srcLine + x + 1));
+		__m128i bottom = _mm_loadu_si128((const __m128i*)(nextLine + x));
+
+		__m128i sumlo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(left, zero), _mm_unpacklo_epi8(center, zero)), _mm_add_epi16(_mm_unpacklo_epi8(right, zero), _mm_unpacklo_epi8(bottom, zero)));
+		__m128i sumhi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(left, zero), _mm_unpackhi_epi8(center, zero)), _mm_add_epi16(_mm_unpackhi_epi8(right, zero), _mm_unpackhi_epi8(bottom, zero)));
+		sumlo = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(sumlo, 2), bias), 4);
+		sumhi = _mm_srai_epi16(_mm_add_epi16(_mm_slli_epi16(sumhi, 2), bias), 4);
 
-		int width = mipmap.Width;
-		int height = mipmap.Height;
-		uint8_t* pixels = (uint8_t*)mipmap.Data.data();
+		_mm_storeu_si128((__m128i*)(destLine + x), _mm_packus_epi16(sumlo, sumhi));
+	}
+	return x;
+}
+
+#endif
+
+void UFireTexture::UpdateFrame()
+{
+	UnrealMipmap& mipmap = Mipmaps.front();
+
+	int width = mipmap.Width;
+	int height = mipmap.Height;
+	HeatMap.resize(width * height);
+	uint8_t* pixels = HeatMap.data();
 
-		for (size_t i = 0; i < Sparks.size(); i++)
+	for (size_t i = 0; i < Sparks.size(); i++)
+	{
+		Spark& spark = Sparks[i];
+		bool canEmit = Sparks.size() + Particles.size() < (size_t)SparksLimit();
+		switch (spark.Type)
 		{
-			Spark& spark = Sparks[i];
-			bool canEmit = Sparks.size() + Particles.size() < (size_t)SparksLimit();
-			switch (spark.Type)
-			{
-			case ESpark::Burn:
-			{
-				int x = spark.X;
-				int y = spark.Y;
-				pixels[x + y * width] = RandomByteValue();
-				break;
-			}
-			case ESpark::Wheel:
+		case ESpark::Burn:
+		{
+			int x = spark.X;
+			int y = spark.Y;
+			pixels[x + y * width] = RandomByteValue();
+			break;
+		}
+		case ESpark::Wheel:
+		{
+			if (canEmit)
 			{
-				if (canEmit)
-				{
-					SparkParticle particle;
-					particle.Type = SparkParticleType::Twirl;
-					particle.Twirl.X = spark.X + 0.5f;
-					particle.Twirl.Y = spark.Y + 0.5f;
-					particle.Twirl.Heat = spark.Heat;
-					particle.Twirl.Angle = radians(spark.Wheel.Angle * (360.0f / 256));
-					particle.Twirl.RotSpeed = radians(spark.Wheel.TwirlRotSpeed * (16.0f / 256) * (360.0f / 256));
-					particle.Twirl.Age = spark.Wheel.TwirlAge;
-					Particles.push_back(particle);
-				}
-				spark.Wheel.Angle += spark.Wheel.RotSpeed;
-				break;
+				SparkParticle particle;
+				particle.Type = SparkParticleType::Twirl;
+				particle.Twirl.X = spark.X + 0.5f;
+				particle.Twirl.Y = spark.Y + 0.5f;
+				particle.Twirl.Heat = spark.Heat;
+				particle.Twirl.Angle = radians(spark.Wheel.Angle * (360.0f / 256));
+				particle.Twirl.RotSpeed = radians(spark.Wheel.TwirlRotSpeed * (16.0f / 256) * (360.0f / 256));
+				particle.Twirl.Age = spark.Wheel.TwirlAge;
+				Particles.push_back(particle);
 			}
-			case ESpark::Emit:
+			spark.Wheel.Angle += spark.Wheel.RotSpeed;
+			break;
+		}
+		case ESpark::Emit:
+		{
+			if (canEmit && RandomByteValue() < 64)
 			{
-				if (canEmit && RandomByteValue() < 64)
-				{
-					SparkParticle particle;
-					particle.Type = SparkParticleType::Drift;
-					particle.Drift.X = spark.X + 0.5f;
-					particle.Drift.Y = spark.Y + 0.5f;
-					particle.Drift.Heat = spark.Heat;
-					particle.Drift.HeatDecay = spark.Emit.HeatDecay;
-					particle.Drift.SpeedX = ((int8_t)spark.Emit.SpeedX) * (1.0f / 128.0f);
-					particle.Drift.SpeedY = ((int8_t)spark.Emit.SpeedY) * (1.0f / 128.0f);
-					Particles.push_back(particle);
-				}
-				break;
+				SparkParticle particle;
+				particle.Type = SparkParticleType::Drift;
+				particle.Drift.X = spark.X + 0.5f;
+				particle.Drift.Y = spark.Y + 0.5f;
+				particle.Drift.Heat = spark.Heat;
+				particle.Drift.HeatDecay = spark.Emit.HeatDecay;
+				particle.Drift.SpeedX = ((int8_t)spark.Emit.SpeedX) * (1.0f / 128.0f);
+				particle.Drift.SpeedY = ((int8_t)spark.Emit.SpeedY) * (1.0f / 128.0f);
+				Particles.push_back(particle);
 			}
-			case ESpark::OzHasSpoken:
+			break;
+		}
+		case ESpark::OzHasSpoken:
+		{
+			if (canEmit && RandomByteValue() < 128)
 			{
-				if (canEmit && RandomByteValue() < 128)
-				{
-					SparkParticle particle;
-					particle.Type = SparkParticleType::Drift;
-					particle.Drift.X = spark.X + 0.5f;
-					particle.Drift.Y = spark.Y + 0.5f;
-					particle.Drift.Heat = spark.Heat;
-					particle.Drift.HeatDecay = 5;
-					particle.Drift.SpeedX = ((int)RandomByteValue() - 128) * (0.5f / 128.0f);
-					particle.Drift.SpeedY = -0.5f;
-					Particles.push_back(particle);
-				}
-				break;
+				SparkParticle particle;
+				particle.Type = SparkParticleType::Drift;
+				particle.Drift.X = spark.X + 0.5f;
+				particle.Drift.Y = spark.Y + 0.5f;
+				particle.Drift.Heat = spark.Heat;
+				particle.Drift.HeatDecay = 5;
+				particle.Drift.SpeedX = ((int)RandomByteValue() - 128) * (0.5f / 128.0f);
+				particle.Drift.SpeedY = -0.5f;
+				Particles.push_back(particle);
 			}
-			case ESpark::Blaze:
+			break;
+		}
+		case ESpark::Blaze:
+		{
+			if (canEmit && RandomByteValue() < 128)
 			{
-				if (canEmit && RandomByteValue() < 128)
-				{
-					SparkParticle particle;
-					particle.Type = SparkParticleType::Drift;
-					particle.Drift.X = spark.X + 0.5f;
-					particle.Drift.Y = spark.Y + 0.5f;
-					particle.Drift.Heat = spark.Heat;
-					particle.Drift.HeatDecay = spark.Blaze.HeatDecay;
-					particle.Drift.SpeedX = ((int)RandomByteValue() - 128) * (1.0f / 128.0f);
-					particle.Drift.SpeedY = ((int)RandomByteValue() - 128) * (1.0f / 128.0f);
-					Particles.push_back(particle);
-				}
-				break;
+				SparkParticle particle;
+				particle.Type = SparkParticleType::Drift;
+				particle.Drift.X = spark.X + 0.5f;
+				particle.Drift.Y = spark.Y + 0.5f;
+				particle.Drift.Heat = spark.Heat;
+				particle.Drift.HeatDecay = spark.Blaze.HeatDecay;
+				particle.Drift.SpeedX = ((int)RandomByteValue() - 128) * (1.0f / 128.0f);
+				particle.Drift.SpeedY = ((int)RandomByteValue() - 128) * (1.0f / 128.0f);
+				Particles.push_back(particle);
 			}
-			case ESpark::SphereLightning:
+			break;
+		}
+		case ESpark::SphereLightning:
+		{
+			if (RandomByteValue() >= spark.SphereLightning.Frequency)
 			{
-				if (RandomByteValue() >= spark.SphereLightning.Frequency)
+				// Worst lightning line implementation ever, but it will do, maybe!
+				float angle = radians(RandomByteValue() * (360.0f / 256));
+				float radius = spark.SphereLightning.Radius * 0.50f;
+				float x0 = spark.X + 0.5f;
+				float y0 = spark.Y + 0.5f;
+				float dx = std::cos(angle);
+				float dy = std::sin(angle);
+				int color0 = spark.Heat;
+				int color1 = spark.Heat / 4;
+				for (float i = 0; i < radius; i += 0.5f)
 				{
-					// Worst lightning line implementation ever, but it will do, maybe!
-					float angle = radians(RandomByteValue() * (360.0f / 256));
-					float radius = spark.SphereLightning.Radius * 0.50f;
-					float x0 = spark.X + 0.5f;
-					float y0 = spark.Y + 0.5f;
-					float dx = std::cos(angle);
-					float dy = std::sin(angle);
-					int color0 = spark.Heat;
-					int color1 = spark.Heat / 4;
-					for (float i = 0; i < radius; i += 0.5f)
-					{
-						float t = i / radius;
-						int c = (int)(color0 + (color1 - color0) * t + 0.5f);
-						int x = (int)(x0 + dx * i);
-						int y = (int)(y0 + dy * i);
-						if (x < 0) x += width;
-						else if (x >= width) x -= width;
-						if (y < 0) y += height;
-						else if (y >= height) y -= height;
-						pixels[x + y * width] = c;
-
-						x0 += (float)(rand() * 2.0 / RAND_MAX - 1.0);
-						y0 += (float)(rand() * 2.0 / RAND_MAX - 1.0);
-					}
+					float t = i / radius;
+					int c = (int)(color0 + (color1 - color0) * t + 0.5f);
+					int x = (int)(x0 + dx * i);
+					int y = (int)(y0 + dy * i);
+					if (x < 0) x += width;
+					else if (x >= width) x -= width;
+					if (y < 0) y += height;
+					else if (y >= height) y -= height;
+					pixels[x + y * width] = c;
+
+					x0 += RandomByteValue() * (2.0f / 255.0f) - 1.0f;
+					y0 += RandomByteValue() * (2.0f / 255.0f) - 1.0f;
 				}
-				break;
-			}
 			}
+			break;
+		}
 		}
+	}
 
-		for (size_t i = 0; i < Particles.size(); i++)
+	for (size_t i = 0; i < Particles.size(); i++)
+	{
+		SparkParticle& particle = Particles[i];
+		switch (particle.Type)
 		{
-			SparkParticle& particle = Particles[i];
-			switch (particle.Type)
-			{
-			case SparkParticleType::Twirl:
+		case SparkParticleType::Twirl:
+		{
+			if (particle.Twirl.Age > 0)
 			{
-				if (particle.Twirl.Age > 0)
-				{
-					int x = (int)particle.Twirl.X;
-					int y = (int)particle.Twirl.Y;
-					if (x < 0) x += width; else if (x >= width) x -= width;
-					if (y < 0) y += height; else if (y >= height) y -= height;
-					pixels[x + y * width] = particle.Twirl.Heat;
-
-					float angle = particle.Twirl.Angle;
-					float dx = std::sin(angle);
-					float dy = std::cos(angle);
-
-					particle.Twirl.X += dx * 0.5f;
-					particle.Twirl.Y += dy * 0.5f;
-					particle.Twirl.Angle += particle.Twirl.RotSpeed;
-					particle.Twirl.Age--;
-				}
-				else
-				{
-					particle = Particles.back();
-					Particles.pop_back();
-				}
-				break;
+				int x = (int)particle.Twirl.X;
+				int y = (int)particle.Twirl.Y;
+				if (x < 0) x += width; else if (x >= width) x -= width;
+				if (y < 0) y += height; else if (y >= height) y -= height;
+				pixels[x + y * width] = particle.Twirl.Heat;
+
+				float angle = particle.Twirl.Angle;
+				float dx = std::sin(angle);
+				float dy = std::cos(angle);
+
+				particle.Twirl.X += dx * 0.5f;
+				particle.Twirl.Y += dy * 0.5f;
+				particle.Twirl.Angle += particle.Twirl.RotSpeed;
+				particle.Twirl.Age--;
 			}
-			case SparkParticleType::Drift:
+			else
 			{
-				particle.Drift.Heat -= particle.Drift.HeatDecay;
-				if (particle.Drift.Heat > 0)
-				{
-					int x = (int)particle.Drift.X;
-					int y = (int)particle.Drift.Y;
-					if (x < 0) x += width; else if (x >= width) x -= width;
-					if (y < 0) y += height; else if (y >= height) y -= height;
-					pixels[x + y * width] = particle.Drift.Heat;
-
-					particle.Drift.X += particle.Drift.SpeedX;
-					particle.Drift.Y += particle.Drift.SpeedY;
-				}
-				else
-				{
-					particle = Particles.back();
-					Particles.pop_back();
-				}
-				break;
-			}
+				particle = Particles.back();
+				Particles.pop_back();
 			}
+			break;
 		}
-
-		if (CurrentRenderHeat != RenderHeat())
+		case SparkParticleType::Drift:
 		{
-			CurrentRenderHeat = RenderHeat();
-			float heatLoss = 1.0f - (255 - CurrentRenderHeat) / 16.0f;
-			for (int i = 0; i < 4 * 256; i++)
+			particle.Drift.Heat -= particle.Drift.HeatDecay;
+			if (particle.Drift.Heat > 0)
+			{
+				int x = (int)particle.Drift.X;
+				int y = (int)particle.Drift.Y;
+				if (x < 0) x += width; else if (x >= width) x -= width;
+				if (y < 0) y += height; else if (y >= height) y -= height;
+				pixels[x + y * width] = particle.Drift.Heat;
+
+				particle.Drift.X += particle.Drift.SpeedX;
+				particle.Drift.Y += particle.Drift.SpeedY;
+			}
+			else
 			{
-				FadeTable[i] = (uint8_t)std::round(clamp((i + 0.5f) * 0.25f + heatLoss, 0.0f, 255.0f));
+				particle = Particles.back();
+				Particles.pop_back();
 			}
+			break;
 		}
+		}
+	}
 
-		WorkBuffer.resize(width * height);
-		uint8_t* buffer = WorkBuffer.data();
-		int riseAmount = bRising() ? 1 : 0;
-		for (int y = 0; y < height; y++)
+	if (CurrentRenderHeat != RenderHeat())
+	{
+		CurrentRenderHeat = RenderHeat();
+		float heatLoss = 1.0f - (255 - CurrentRenderHeat) / 16.0f;
+		for (int i = 0; i < 4 * 256; i++)
 		{
-			uint8_t* destLine = buffer + y * width;
-			uint8_t* srcLine = pixels + ((y + riseAmount) % height) * width;
-			uint8_t* nextLine = pixels + ((y + riseAmount + 1) % height) * width;
-			for (int x = 0; x < width; x++)
-			{
-				int left = srcLine[x != 0 ? x - 1 : width - 1];
-				int center = srcLine[x];
-				int right = srcLine[x != width - 1 ? x + 1 : 0];
-				int bottom = nextLine[x];
-				destLine[x] = FadeTable[left + center + right + bottom];
-			}
+			FadeTable[i] = (uint8_t)std::round(clamp((i + 0.5f) * 0.25f + heatLoss, 0.0f, 255.0f));
 		}
-		memcpy(pixels, buffer, width * height);
+	}
 
-		TextureModified = true;
+	WorkBuffer.resize(width * height);
+	uint8_t* buffer = WorkBuffer.data();
+	int riseAmount = bRising() ? 1 : 0;
+	for (int y = 0; y < height; y++)
+	{
+		uint8_t* destLine = buffer + y * width;
+		uint8_t* srcLine = pixels + ((y + riseAmount) % height) * width;
+		uint8_t* nextLine = pixels + ((y + riseAmount + 1) % height) * width;
+
+		// The first and last texel wrap around to the other side of the line
+		int x = 0;
+		FireLineScalar(destLine, srcLine, nextLine, x, 1, width, FadeTable);
+		x = 1;
+#ifndef NOSSE
+		if (GetSimdLevel() != SimdLevel::Scalar)
+			x = FireLineSSE2(destLine, srcLine, nextLine, x, width - 1, CurrentRenderHeat);
+#endif
+		FireLineScalar(destLine, srcLine, nextLine, x, width, width, FadeTable);
 	}
+	std::swap(HeatMap, WorkBuffer);
 }
 
 /////////////////////////////////////////////////////////////////////////////
 
-void UIceTexture::UpdateFrame()
+const uint8_t* UIceTexture::DrawSimulation()
 {
-	if (!TextureModified)
-	{
-		UnrealMipmap& mipmap = Mipmaps.front();
-
-		int width = mipmap.Width;
-		int height = mipmap.Height;
-		uint8_t* pixels = (uint8_t*)mipmap.Data.data();
-		int count = width * height;
-
-		UTexture* tex = SourceTexture();
-		if (tex && !tex->Mipmaps.empty() && tex->Mipmaps.front().Width == mipmap.Width && tex->Mipmaps.front().Height == mipmap.Height)
-		{
-			const uint8_t* srcpixels = (const uint8_t*)tex->Mipmaps.front().Data.data();
-			for (int i = 0; i < count; i++)
-			{
-				pixels[i] = srcpixels[i];
-			}
-		}
-		else
-		{
-			for (int i = 0; i < count; i++)
-			{
-				pixels[i] = 200;
-			}
-		}
+	UnrealMipmap& mipmap = Mipmaps.front();
 
-		TextureModified = true;
+	UTexture* tex = SourceTexture();
+	if (tex && !tex->Mipmaps.empty() && tex->Mipmaps.front().Width == mipmap.Width && tex->Mipmaps.front().Height == mipmap.Height)
+	{
+		tex->LoadMipData();
+		return (const uint8_t*)tex->Mipmaps.front().Data.data();
+	}
+	else
+	{
+		WorkBuffer.resize((size_t)mipmap.Width * mipmap.Height);
+		memset(WorkBuffer.data(), 200, WorkBuffer.size());
+		return WorkBuffer.data();
 	}
 }
 
@@ -366,63 +589,214 @@ void UIceTexture::UpdateFrame()
 
 void UWaterTexture::UpdateFrame()
 {
-	if (!TextureModified)
+	UpdateWater();
+}
+
+#ifndef NOSSE
+
+static int DrawWaterLineSSE2(uint8_t* destline, const float* xgradient, const float* ygradient, int x, int end)
+{
+	__m128 yy = _mm_set1_ps(0.2f * 0.2f);
+	__m128 ny = _mm_set1_ps(0.2f);
+	__m128 signmask = _mm_set1_ps(-0.0f);
+	__m128 scale = _mm_set1_ps(255.0f);
+	__m128 offset = _mm_set1_ps(128.0f);
+	__m128 zero = _mm_setzero_ps();
+	for (; x + 4 <= end; x += 4)
 	{
-		UpdateWater();
+		__m128 xg = _mm_loadu_ps(xgradient + x);
+		__m128 yg = _mm_loadu_ps(ygradient + x);
+		__m128 len = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(xg, xg), yy), _mm_mul_ps(yg, yg)));
+		__m128 normaly = _mm_andnot_ps(signmask, _mm_div_ps(ny, len));
+		__m128 value = _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(normaly, scale), offset), zero), scale);
+		__m128i ivalue = _mm_cvttps_epi32(value);
+		ivalue = _mm_packs_epi32(ivalue, ivalue);
+		ivalue = _mm_packus_epi16(ivalue, ivalue);
+		int packed = _mm_cvtsi128_si32(ivalue);
+		memcpy(destline + x, &packed, 4);
+	}
+	return x;
+}
 
-		// Show the current water in the texture:
-		// To do: this probably shouldn't just show the depth, but rather the slope
+#endif
 
-		UnrealMipmap& mipmap = Mipmaps.front();
+const uint8_t* UWaterTexture::DrawSimulation()
+{
+	// Show the current water in the texture:
+	// To do: this probably shouldn't just show the depth, but rather the slope
 
-		int width = mipmap.Width;
-		int height = mipmap.Height;
-		uint8_t* pixels = (uint8_t*)mipmap.Data.data();
+	UnrealMipmap& mipmap = Mipmaps.front();
 
-		for (int y = 0; y < height; y++)
+	int width = mipmap.Width;
+	int height = mipmap.Height;
+	WorkBuffer.resize(width * height);
+	uint8_t* pixels = WorkBuffer.data();
+
+	const WaterField& water = WaterDepth[CurrentWaterDepth];
+	for (int y = 0; y < height; y++)
+	{
+		const float* xgradient = &water.XGradient[y * width];
+		const float* ygradient = &water.YGradient[y * width];
+		uint8_t* destline = pixels + y * width;
+		int x = 0;
+#ifndef NOSSE
+		if (GetSimdLevel() != SimdLevel::Scalar)
+			x = DrawWaterLineSSE2(destline, xgradient, ygradient, x, width);
+#endif
+		for (; x < width; x++)
 		{
-			const WaterPixel* waterline = &WaterDepth[CurrentWaterDepth][y * width];
-			uint8_t* destline = pixels + y * width;
-			for (int x = 0; x < width; x++)
-			{
-				// float u = 0.2f * waterline[x].XGradient;
-				// float v = 0.2f * waterline[x].YGradient;
-				vec3 normal = normalize(vec3(-waterline[x].XGradient, 0.2f, -waterline[x].YGradient));
-				destline[x] = (uint8_t)clamp(std::abs(normal.y) * 255.0f + 128.0f, 0.0f, 255.0f);
-			}
+			vec3 normal = normalize(vec3(-xgradient[x], 0.2f, -ygradient[x]));
+			destline[x] = (uint8_t)clamp(std::abs(normal.y) * 255.0f + 128.0f, 0.0f, 255.0f);
+		}
+	}
+	return pixels;
+}
+
+// Pressure of a PhaseSpot drop for each of its 256 phases
+static const float* GetPhaseSpotTable()
+{
+	struct PhaseSpotTable
+	{
+		PhaseSpotTable()
+		{
+			for (int i = 0; i < 256; i++)
+				Values[i] = std::sin(i * (3.14f / 128));
 		}
+		float Values[256];
+	};
+	static PhaseSpotTable table;
+	return table.Values;
+}
 
-		TextureModified = true;
+static void UpdateWaterLineScalar(WaterField& dest, const WaterField& src, int y, int x, int end, int width, int height)
+{
+	const float* srcline = &src.Pressure[y * width];
+	const float* srclineup = &src.Pressure[(y - 1 >= 0 ? y - 1 : height - 1) * width];
+	const float* srclinedown = &src.Pressure[(y + 1 < height ? y + 1 : 0) * width];
+	const float* velocityline = &src.Velocity[y * width];
+	for (; x < end; x++)
+	{
+		int xleft = x - 1 >= 0 ? x - 1 : width - 1;
+		int xright = x + 1 < width ? x + 1 : 0;
+
+		float velocity = velocityline[x];
+		float pressure = srcline[x];
+		float pressureLeft = srcline[xleft];
+		float pressureRight = srcline[xright];
+		float pressureUp = srclineup[x];
+		float pressureDown = srclinedown[x];
+
+		const float delta = 1.0f; // Use a smaller number for a smaller timestep
+
+		// Apply horizontal wave function
+		velocity += delta * (-2.0f * pressure + pressureRight + pressureLeft) * 0.25f;
+
+		// Apply vertical wave function
+		velocity += delta * (-2.0f * pressure + pressureUp + pressureDown) * 0.25f;
+
+		// Change pressure by pressure velocity
+		pressure += delta * velocity;
+
+		// "Spring" motion. This makes the waves look more like water waves and less like sound waves.
+		velocity -= 0.005f * delta * pressure;
+
+		// Velocity damping so things eventually calm down
+		velocity *= 1.0f - 0.002f * delta;
+
+		// Pressure damping to prevent it from building up forever.
+		pressure *= 0.999f;
+
+		int i = y * width + x;
+		dest.Pressure[i] = pressure;
+		dest.Velocity[i] = velocity;
+		dest.XGradient[i] = (pressureRight - pressureLeft) * 0.5f;
+		dest.YGradient[i] = (pressureDown - pressureUp) * 0.5f;
 	}
 }
 
+#ifndef NOSSE
+
+// Same as UpdateWaterLineScalar for four pixels at a time. The operations are done in the same order, so the results are identical.
+static int UpdateWaterLineSSE2(WaterField& dest, const WaterField& src, int y, int x, int end, int width, int height)
+{
+	const float* srcline = &src.Pressure[y * width];
+	const float* srclineup = &src.Pressure[(y - 1 >= 0 ? y - 1 : height - 1) * width];
+	const float* srclinedown = &src.Pressure[(y + 1 < height ? y + 1 : 0) * width];
+	const float* velocityline = &src.Velocity[y * width];
+	float* pressureDest = &dest.Pressure[y * width];
+	float* velocityDest = &dest.Velocity[y * width];
+	float* xgradientDest = &dest.XGradient[y * width];
+	float* ygradientDest = &dest.YGradient[y * width];
+
+	const float delta = 1.0f;
+	__m128 minusTwo = _mm_set1_ps(-2.0f);
+	__m128 mdelta = _mm_set1_ps(delta);
+	__m128 quarter = _mm_set1_ps(0.25f);
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 spring = _mm_set1_ps(0.005f * delta);
+	__m128 velocityDamping = _mm_set1_ps(1.0f - 0.002f * delta);
+	__m128 pressureDamping = _mm_set1_ps(0.999f);
+	for (; x + 4 <= end; x += 4)
+	{
+		__m128 velocity = _mm_loadu_ps(velocityline + x);
+		__m128 pressure = _mm_loadu_ps(srcline + x);
+		__m128 pressureLeft = _mm_loadu_ps(srcline + x - 1);
+		__m128 pressureRight = _mm_loadu_ps(srcline + x + 1);
+		__m128 pressureUp = _mm_loadu_ps(srclineup + x);
+		__m128 pressureDown = _mm_loadu_ps(srclinedown + x);
+
+		__m128 horizontal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(minusTwo, pressure), pressureRight), pressureLeft);
+		velocity = _mm_add_ps(velocity, _mm_mul_ps(_mm_mul_ps(mdelta, horizontal), quarter));
+
+		__m128 vertical = _mm_add_ps(_mm_add_ps(_mm_mul_ps(minusTwo, pressure), pressureUp), pressureDown);
+		velocity = _mm_add_ps(velocity, _mm_mul_ps(_mm_mul_ps(mdelta, vertical), quarter));
+
+		pressure = _mm_add_ps(pressure, _mm_mul_ps(mdelta, velocity));
+		velocity = _mm_sub_ps(velocity, _mm_mul_ps(spring, pressure));
+		velocity = _mm_mul_ps(velocity, velocityDamping);
+		pressure = _mm_mul_ps(pressure, pressureDamping);
+
+		_mm_storeu_ps(pressureDest + x, pressure);
+		_mm_storeu_ps(velocityDest + x, velocity);
+		_mm_storeu_ps(xgradientDest + x, _mm_mul_ps(_mm_sub_ps(pressureRight, pressureLeft), half));
+		_mm_storeu_ps(ygradientDest + x, _mm_mul_ps(_mm_sub_ps(pressureDown, pressureUp), half));
+	}
+	return x;
+}
+
+#endif
+
 void UWaterTexture::UpdateWater()
 {
 	UnrealMipmap& mipmap = Mipmaps.front();
 
 	int width = mipmap.Width;
 	int height = mipmap.Height;
-	uint8_t* pixels = (uint8_t*)mipmap.Data.data();
 
-	WaterDepth[0].resize(width * height);
-	WaterDepth[1].resize(width * height);
+	WaterDepth[0].Resize(width * height);
+	WaterDepth[1].Resize(width * height);
 
 	ADrop* drops = Drops();
 	for (int i = 0, count = NumDrops(); i < count; i++)
 	{
 		ADrop& drop = drops[i];
-		WaterPixel& water = WaterDepth[CurrentWaterDepth][drop.X * 2 + drop.Y * 2 * width];
+		int dropX = drop.X * 2;
+		int dropY = drop.Y * 2;
+		if (dropX >= width || dropY >= height)
+			continue;
+
+		float& pressure = WaterDepth[CurrentWaterDepth].Pressure[dropX + dropY * width];
 		switch (drop.Type)
 		{
 		case ADropType::FixedDepth:
 		{
-			water.Pressure = ((int)drop.Depth - 128) * (1.0f / 255);
+			pressure = ((int)drop.Depth - 128) * (1.0f / 255);
 			break;
 		}
 		case ADropType::PhaseSpot:
 		{
 			drop.Depth += drop.ByteD;
-			water.Pressure = std::sin(drop.Depth * (3.14f / 128)); // To do: use a table since there are only 256 possible values passed into std::sin here
+			pressure = GetPhaseSpotTable()[drop.Depth];
 			break;
 		}
 		case ADropType::ShallowSpot:
@@ -507,47 +881,15 @@ void UWaterTexture::UpdateWater()
 
 	for (int y = 0; y < height; y++)
 	{
-		const WaterPixel* srcline = &WaterDepth[cur][y * width];
-		const WaterPixel* srclineup = &WaterDepth[cur][(y - 1 >= 0 ? y - 1 : height - 1) * width];
-		const WaterPixel* srclinedown = &WaterDepth[cur][(y + 1 < height ? y + 1 : 0) * width];
-		WaterPixel* destline = &WaterDepth[next][y * width];
-		for (int x = 0; x < width; x++)
-		{
-			int xleft = x - 1 >= 0 ? x - 1 : width - 1;
-			int xright = x + 1 < width ? x + 1 : 0;
-
-			float velocity = srcline[x].Velocity;
-			float pressure = srcline[x].Pressure;
-			float pressureLeft = srcline[xleft].Pressure;
-			float pressureRight = srcline[xright].Pressure;
-			float pressureUp = srclineup[x].Pressure;
-			float pressureDown = srclinedown[x].Pressure;
-
-			const float delta = 1.0f; // Use a smaller number for a smaller timestep
-
-			// Apply horizontal wave function
-			velocity += delta * (-2.0f * pressure + pressureRight + pressureLeft) * 0.25f;
-
-			// Apply vertical wave function
-			velocity += delta * (-2.0f * pressure + pressureUp + pressureDown) * 0.25f;
-
-			// Change pressure by pressure velocity
-			pressure += delta * velocity;
-
-			// "Spring" motion. This makes the waves look more like water waves and less like sound waves.
-			velocity -= 0.005f * delta * pressure;
-
-			// Velocity damping so things eventually calm down
-			velocity *= 1.0f - 0.002f * delta;
-
-			// Pressure damping to prevent it from building up forever.
-			pressure *= 0.999f;
-
-			destline[x].Pressure = pressure;
-			destline[x].Velocity = velocity;
-			destline[x].XGradient = (pressureRight - pressureLeft) * 0.5f;
-			destline[x].YGradient = (pressureDown - pressureUp) * 0.5f;
-		}
+		// The first and last pixel wrap around to the other side of the line
+		int x = 0;
+		UpdateWaterLineScalar(WaterDepth[next], WaterDepth[cur], y, x, 1, width, height);
+		x = 1;
+#ifndef NOSSE
+		if (GetSimdLevel() != SimdLevel::Scalar)
+			x = UpdateWaterLineSSE2(WaterDepth[next], WaterDepth[cur], y, x, width - 1, width, height);
+#endif
+		UpdateWaterLineScalar(WaterDepth[next], WaterDepth[cur], y, x, width, width, height);
 	}
 }
 
@@ -561,39 +903,35 @@ void UWaveTexture::UpdateFrame()
 
 /////////////////////////////////////////////////////////////////////////////
 
-void UWetTexture::UpdateFrame()
+const uint8_t* UWetTexture::DrawSimulation()
 {
-	if (!TextureModified)
-	{
-		UpdateWater();
+	UnrealMipmap& mipmap = Mipmaps.front();
 
-		UnrealMipmap& mipmap = Mipmaps.front();
+	UTexture* tex = SourceTexture();
+	if (!tex || tex->Mipmaps.empty() || tex->Mipmaps.front().Width != mipmap.Width || tex->Mipmaps.front().Height != mipmap.Height)
+		return nullptr;
 
-		UTexture* tex = SourceTexture();
-		if (tex && !tex->Mipmaps.empty() && tex->Mipmaps.front().Width == mipmap.Width && tex->Mipmaps.front().Height == mipmap.Height)
+	int width = mipmap.Width;
+	int height = mipmap.Height;
+	WorkBuffer.resize(width * height);
+	uint8_t* pixels = WorkBuffer.data();
+	tex->LoadMipData();
+	const uint8_t* srcpixels = (const uint8_t*)tex->Mipmaps.front().Data.data();
+	for (int y = 0; y < height; y++)
+	{
+		const float* xgradient = &WaterDepth[CurrentWaterDepth].XGradient[y * width];
+		const uint8_t* srcline = srcpixels + y * width;
+		uint8_t* destline = pixels + y * width;
+		for (int x = 0; x < width; x++)
 		{
-			int width = mipmap.Width;
-			int height = mipmap.Height;
-			uint8_t* pixels = (uint8_t*)mipmap.Data.data();
-			const uint8_t* srcpixels = (const uint8_t*)tex->Mipmaps.front().Data.data();
-			for (int y = 0; y < height; y++)
-			{
-				const WaterPixel* waterline = &WaterDepth[CurrentWaterDepth][y * width];
-				const uint8_t* srcline = srcpixels + y * width;
-				uint8_t* destline = pixels + y * width;
-				for (int x = 0; x < width; x++)
-				{
-					// Use water as displacement
+			// Use water as displacement
 
-					int water = (int)(0.5f * waterline[x].XGradient * width);
-					int srcx = clamp(x + water, 0, width - 1);
-					destline[x] = srcline[srcx];
-				}
-			}
+			int water = (int)(0.5f * xgradient[x] * width);
+			int srcx = clamp(x + water, 0, width - 1);
+			destline[x] = srcline[srcx];
 		}
-
-		TextureModified = true;
 	}
+	return pixels;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -602,12 +940,15 @@ void UPalette::Load(ObjectStream* stream)
 {
 	UObject::Load(stream);
 	int count = stream->ReadIndex();
-	Colors.resize(count);
-	stream->ReadBytes(Colors.data(), count * 4);
+	stream->ReadArray(Colors, count);
 
 	if (stream->GetVersion() < 66)
 	{
 		for (uint32_t& c : Colors)
 			c |= 0xff000000;
 	}
+
+	// The renderer looks colors up with 8-bit indices through a raw pointer, so it must always hold 256 colors
+	if (Colors.size() < 256)
+		Colors.resize(256, 0);
 }
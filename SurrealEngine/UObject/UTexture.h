@@ -1,6 +1,7 @@
 #pragma once
 
 #include "UObject.h"
+#include <list>
 
 class UPalette;
 class USound;
@@ -12,6 +13,10 @@ public:
 	int Width;
 	int Height;
 	Array<uint8_t> Data;
+
+	// Location of the pixel data in the package file. Data is filled when the texture is loaded and read back from here if it was evicted.
+	int64_t DataOffset = -1;
+	uint32_t DataSize = 0;
 };
 
 enum class TextureFormat : uint32_t
@@ -167,12 +172,40 @@ public:
 	int& VSize() { return Value<int>(PropOffsets_Bitmap.VSize); }
 };
 
+// Area of the first mipmap changed by a procedural texture update
+struct TextureDirtyRect
+{
+	int X0 = 0, Y0 = 0, X1 = 0, Y1 = 0;
+
+	bool IsEmpty() const { return X0 >= X1 || Y0 >= Y1; }
+	void Clear() { X0 = Y0 = X1 = Y1 = 0; }
+
+	void Add(const TextureDirtyRect& rect)
+	{
+		X0 = std::min(X0, rect.X0);
+		Y0 = std::min(Y0, rect.Y0);
+		X1 = std::max(X1, rect.X1);
+		Y1 = std::max(Y1, rect.Y1);
+	}
+};
+
 class UTexture : public UBitmap
 {
 public:
 	using UBitmap::UBitmap;
+	~UTexture();
 	void Load(ObjectStream* stream) override;
 
+	// Reads the pixel data of all mipmaps that are not resident. Must be called before accessing UnrealMipmap::Data.
+	void LoadMipData();
+
+	// Frees the pixel data of mipmaps that can be read back from the package file.
+	void UnloadMipData();
+
+	static size_t GetResidentMipBytes() { return ResidentMipBytes; }
+	static size_t GetMipMemoryBudget() { return MipMemoryBudget; }
+	static void SetMipMemoryBudget(size_t bytes);
+
 	UTexture* GetAnimTexture() { return AnimCurrent() ? AnimCurrent() : this; }
 
 	int GetAnimTextureCount()
@@ -193,6 +226,7 @@ public:
 	TextureFormat ActualFormat = TextureFormat::P8;
 	Array<UnrealMipmap> Mipmaps;
 	bool TextureModified = false;
+	TextureDirtyRect DirtyRect; // Changed area while TextureModified is set. The whole texture changed if it is empty.
 	int RealtimeChangeCount = 0;
 
 	int FrameCounter = -1;
@@ -301,6 +335,18 @@ public:
 	BitfieldBool bX5() { return BoolValue(PropOffsets_Texture.bX5); }
 	BitfieldBool bX6() { return BoolValue(PropOffsets_Texture.bX6); }
 	BitfieldBool bX7() { return BoolValue(PropOffsets_Texture.bX7); }
+
+private:
+	void ReadMipmap(ObjectStream* stream, UnrealMipmap& mipmap, int bytes);
+	void AddResidentMipData(size_t bytes);
+	void EvictMipData();
+
+	bool MipDataResident = false;
+	std::list<UTexture*>::iterator ResidentIterator;
+
+	static std::list<UTexture*> ResidentTextures; // Most recently used first
+	static size_t ResidentMipBytes;
+	static size_t MipMemoryBudget;
 };
 
 class UFractalTexture : public UTexture
@@ -309,6 +355,22 @@ public:
 	using UTexture::UTexture;
 	void Load(ObjectStream* stream) override;
 
+	// Runs the simulation steps due for the elapsed time
+	void Update(float elapsed) override;
+	void UpdateFrame() override { }
+
+	// Update split in two for the renderer. PrepareUpdate counts the steps due on the main thread and Simulate runs them.
+	// Frames is the number of frames since the texture was last updated. Missed frames are caught up with at most MaxCatchUpSteps steps.
+	void PrepareUpdate(float elapsed, int frames);
+	void Simulate();
+
+	// Simulate only touches the texture itself, so it can run on a worker thread
+	virtual bool CanSimulateAsync() const { return true; }
+
+	static const int MaxCatchUpSteps = 16;
+
+	int SimulatedFrame = -1; // Renderer frame the texture was last simulated for
+
 	uint8_t& AuxPhase() { return Value<uint8_t>(PropOffsets_FractalTexture.AuxPhase); }
 	uint8_t& DrawPhase() { return Value<uint8_t>(PropOffsets_FractalTexture.DrawPhase); }
 	int& GlobalPhase() { return Value<int>(PropOffsets_FractalTexture.GlobalPhase); }
@@ -316,6 +378,26 @@ public:
 	int& SoundOutput() { return Value<int>(PropOffsets_FractalTexture.SoundOutput); }
 	int& UMask() { return Value<int>(PropOffsets_FractalTexture.UMask); }
 	int& VMask() { return Value<int>(PropOffsets_FractalTexture.VMask); }
+
+protected:
+	// Returns the texels of the current simulation state. Simulate copies the changed ones into the first mipmap.
+	virtual const uint8_t* DrawSimulation() { return nullptr; }
+
+	// Each texture has its own random sequence, so simulations running on different threads do not share state
+	int RandomByteValue()
+	{
+		RandomState ^= RandomState << 13;
+		RandomState ^= RandomState >> 17;
+		RandomState ^= RandomState << 5;
+		return (int)(RandomState >> 24);
+	}
+
+	uint32_t RandomState = 1;
+
+private:
+	void CommitPixels(const uint8_t* src);
+
+	int PendingSteps = 0;
 };
 
 enum class ESpark : uint8_t
@@ -424,9 +506,11 @@ public:
 	uint8_t& StarStatus() { return Value<uint8_t>(PropOffsets_FireTexture.StarStatus); }
 	BitfieldBool bRising() { return BoolValue(PropOffsets_FireTexture.bRising); }
 
-private:
-	int RandomByteValue() { return (int)(rand() * 256LL / (RAND_MAX + 1LL)); }
+protected:
+	const uint8_t* DrawSimulation() override { return HeatMap.data(); }
 
+private:
+	Array<uint8_t> HeatMap;
 	Array<uint8_t> WorkBuffer;
 	uint8_t FadeTable[4 * 256];
 	int CurrentRenderHeat = -1;
@@ -439,7 +523,7 @@ class UIceTexture : public UFractalTexture
 public:
 	using UFractalTexture::UFractalTexture;
 
-	void UpdateFrame() override;
+	bool CanSimulateAsync() const override { return false; }
 
 	uint8_t& Amplitude() { return Value<uint8_t>(PropOffsets_IceTexture.Amplitude); }
 	int& ForceRefresh() { return Value<int>(PropOffsets_IceTexture.ForceRefresh); }
@@ -462,6 +546,12 @@ public:
 	float& VDisplace() { return Value<float>(PropOffsets_IceTexture.VDisplace); }
 	float& VPosition() { return Value<float>(PropOffsets_IceTexture.VPosition); }
 	uint8_t& VertPanSpeed() { return Value<uint8_t>(PropOffsets_IceTexture.VertPanSpeed); }
+
+protected:
+	const uint8_t* DrawSimulation() override;
+
+private:
+	Array<uint8_t> WorkBuffer;
 };
 
 enum class ADropType : uint8_t
@@ -497,12 +587,21 @@ struct ADrop
 	uint8_t ByteA,ByteB, ByteC, ByteD;
 };
 
-struct WaterPixel
+// Simulation state of a water texture, with one array per field so that rows can be processed four pixels at a time
+struct WaterField
 {
-	float Pressure = 0.0f;
-	float Velocity = 0.0f;
-	float XGradient = 0.0f;
-	float YGradient = 0.0f;
+	Array<float> Pressure;
+	Array<float> Velocity;
+	Array<float> XGradient;
+	Array<float> YGradient;
+
+	void Resize(size_t size)
+	{
+		Pressure.resize(size);
+		Velocity.resize(size);
+		XGradient.resize(size);
+		YGradient.resize(size);
+	}
 };
 
 class UWaterTexture : public UFractalTexture
@@ -532,10 +631,12 @@ public:
 	uint8_t& WaveAmp() { return Value<uint8_t>(PropOffsets_WaterTexture.WaveAmp); }
 
 protected:
+	const uint8_t* DrawSimulation() override;
 	void UpdateWater();
 
-	Array<WaterPixel> WaterDepth[2];
+	WaterField WaterDepth[2];
 	int CurrentWaterDepth = 0;
+	Array<uint8_t> WorkBuffer;
 };
 
 class UWaveTexture : public UWaterTexture
@@ -556,11 +657,14 @@ class UWetTexture : public UWaterTexture
 public:
 	using UWaterTexture::UWaterTexture;
 
-	void UpdateFrame() override;
+	bool CanSimulateAsync() const override { return false; }
 
 	int& LocalSourceBitmap() { return Value<int>(PropOffsets_WetTexture.LocalSourceBitmap); }
 	UTexture*& OldSourceTex() { return Value<UTexture*>(PropOffsets_WetTexture.OldSourceTex); }
 	UTexture*& SourceTexture() { return Value<UTexture*>(PropOffsets_WetTexture.SourceTexture); }
+
+protected:
+	const uint8_t* DrawSimulation() override;
 };
 
 class UScriptedTexture : public UTexture
@@ -0,0 +1,64 @@
+#include "Precomp.h"
+#include "CpuFeatures.h"
+
+#if !defined(NOSSE) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+static SimdLevel DetectSimdLevel()
+{
+#if defined(NOSSE)
+	return SimdLevel::Scalar;
+#elif defined(_MSC_VER)
+	int info[4] = {};
+	__cpuid(info, 0);
+	if (info[0] >= 7)
+	{
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		if (osxsave && avx && (_xgetbv(0) & 6) == 6)
+		{
+			__cpuidex(info, 7, 0);
+			if (info[1] & (1 << 5))
+				return SimdLevel::AVX2;
+		}
+	}
+	return SimdLevel::SSE2;
+#else
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return SimdLevel::AVX2;
+	return SimdLevel::SSE2;
+#endif
+}
+
+static SimdLevel MaxSimdLevel = DetectSimdLevel();
+static SimdLevel CurrentSimdLevel = MaxSimdLevel;
+
+SimdLevel GetSimdLevel()
+{
+	return CurrentSimdLevel;
+}
+
+void SetSimdLevel(SimdLevel level)
+{
+	CurrentSimdLevel = std::min(level, MaxSimdLevel);
+}
+
+SimdLevel GetMaxSimdLevel()
+{
+	return MaxSimdLevel;
+}
+
+const char* GetSimdLevelName(SimdLevel level)
+{
+	switch (level)
+	{
+	case SimdLevel::Scalar: return "scalar";
+	case SimdLevel::SSE2: return "SSE2";
+	case SimdLevel::AVX2: return "AVX2";
+	}
+	return "unknown";
+}
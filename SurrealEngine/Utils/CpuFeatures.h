@@ -0,0 +1,26 @@
+#pragma once
+
+// Instruction sets the SIMD kernels can be compiled for
+enum class SimdLevel
+{
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+// Highest instruction set supported by both the build and the CPU, unless lowered by SetSimdLevel
+SimdLevel GetSimdLevel();
+
+// Selects the kernels to use (for benchmarking). The level is clamped to what the CPU supports.
+void SetSimdLevel(SimdLevel level);
+
+SimdLevel GetMaxSimdLevel();
+const char* GetSimdLevelName(SimdLevel level);
+
+// Marks a function as using AVX2 instructions without requiring the whole build to target AVX2.
+// Only call such functions when GetSimdLevel() returns SimdLevel::AVX2.
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define SIMD_TARGET_AVX2
+#endif
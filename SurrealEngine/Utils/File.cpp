@@ -66,6 +66,23 @@ public:
 		}
 	}
 
+	void read_at(void *data, size_t size, uint64_t offset) override
+	{
+		size_t pos = 0;
+		while (pos < size)
+		{
+			size_t readsize = std::min(size - pos, (size_t)0xffffffff);
+			OVERLAPPED overlapped = {};
+			overlapped.Offset = (DWORD)(offset + pos);
+			overlapped.OffsetHigh = (DWORD)((offset + pos) >> 32);
+			DWORD bytesRead = 0;
+			BOOL result = ReadFile(handle, (uint8_t*)data + pos, (DWORD)readsize, &bytesRead, &overlapped);
+			if (result == FALSE || bytesRead != readsize)
+				Exception::Throw("ReadFile failed");
+			pos += readsize;
+		}
+	}
+
 	int64_t size() override
 	{
 		LARGE_INTEGER fileSize;
@@ -127,13 +144,19 @@ public:
 	{
 	}
 
+	~FileImpl()
+	{
+		fclose(handle);
+	}
+
 	int64_t size() override
 	{
-		auto pos = ftell(handle);
-		fseek(handle, 0, SEEK_END);
-		auto s = ftell(handle);
-		fseek(handle, pos, SEEK_SET);
-		return s;
+		// fstat leaves the file position alone, so it is safe while other threads use read_at
+		fflush(handle);
+		struct stat info;
+		if (fstat(fileno(handle), &info) != 0)
+			Exception::Throw("fstat failed");
+		return info.st_size;
 	}
 
 	void read(void *data, size_t size) override
@@ -143,6 +166,19 @@ public:
 			Exception::Throw("fread failed");
 	}
 
+	void read_at(void *data, size_t size, uint64_t offset) override
+	{
+		int fd = fileno(handle);
+		size_t pos = 0;
+		while (pos < size)
+		{
+			ssize_t result = pread(fd, (uint8_t*)data + pos, size - pos, (off_t)(offset + pos));
+			if (result <= 0)
+				Exception::Throw("pread failed");
+			pos += result;
+		}
+	}
+
 	void write(const void *data, size_t size) override
 	{
 		size_t result = fwrite(data, size, 1, handle);
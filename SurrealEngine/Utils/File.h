@@ -46,6 +46,7 @@ public:
 	virtual ~File() = default;
 	virtual int64_t size() = 0;
 	virtual void read(void *data, size_t size) = 0;
+	virtual void read_at(void *data, size_t size, uint64_t offset) = 0; // Reads without using or changing the file position. Safe to call from multiple threads.
 	virtual void write(const void *data, size_t size) = 0;
 	virtual void seek(int64_t offset, SeekPoint origin = SeekPoint::begin) = 0;
 	virtual uint64_t tell() = 0;
@@ -0,0 +1,71 @@
+#include "Precomp.h"
+#include "JobQueue.h"
+#include "Profiler.h"
+
+JobQueue::JobQueue(int threadCount)
+{
+	if (threadCount <= 0)
+		threadCount = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+
+	for (int i = 0; i < threadCount; i++)
+		threads.push_back(std::thread([=]() { WorkerMain(i); }));
+}
+
+JobQueue::~JobQueue()
+{
+	std::unique_lock lock(mutex);
+	jobs.clear();
+	stopFlag = true;
+	lock.unlock();
+	jobAdded.notify_all();
+
+	for (std::thread& thread : threads)
+		thread.join();
+}
+
+void JobQueue::Add(std::function<void(int threadIndex)> job)
+{
+	std::unique_lock lock(mutex);
+	jobs.push_back(std::move(job));
+	lock.unlock();
+	jobAdded.notify_one();
+}
+
+void JobQueue::Cancel()
+{
+	std::unique_lock lock(mutex);
+	jobs.clear();
+	jobsDone.wait(lock, [&]() { return runningJobs == 0; });
+}
+
+void JobQueue::Wait()
+{
+	std::unique_lock lock(mutex);
+	jobsDone.wait(lock, [&]() { return jobs.empty() && runningJobs == 0; });
+}
+
+void JobQueue::WorkerMain(int threadIndex)
+{
+	std::unique_lock lock(mutex);
+	while (true)
+	{
+		jobAdded.wait(lock, [&]() { return stopFlag || !jobs.empty(); });
+		if (stopFlag)
+			break;
+
+		std::function<void(int threadIndex)> job = std::move(jobs.front());
+		jobs.pop_front();
+		runningJobs++;
+		lock.unlock();
+
+		{
+			PROFILE_ZONE("JobQueue job");
+			job(threadIndex);
+		}
+
+		lock.lock();
+		runningJobs--;
+		if (jobs.empty() && runningJobs == 0)
+			jobsDone.notify_all();
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+
+// Fixed pool of worker threads running queued jobs in the order they were added.
+// A job receives the index of the worker thread running it so it can use per thread scratch data.
+// Jobs must not throw.
+class JobQueue
+{
+public:
+	// A thread count of zero picks one thread less than the number of hardware threads (minimum one)
+	JobQueue(int threadCount = 0);
+	~JobQueue();
+
+	int GetThreadCount() const { return (int)threads.size(); }
+
+	void Add(std::function<void(int threadIndex)> job);
+
+	// Removes all jobs not yet started and waits for the running ones to finish
+	void Cancel();
+
+	// Waits until the queue is empty and no job is running
+	void Wait();
+
+private:
+	void WorkerMain(int threadIndex);
+
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable jobAdded;
+	std::condition_variable jobsDone;
+	std::deque<std::function<void(int threadIndex)>> jobs;
+	int runningJobs = 0;
+	bool stopFlag = false;
+
+	JobQueue(const JobQueue&) = delete;
+	JobQueue& operator=(const JobQueue&) = delete;
+};
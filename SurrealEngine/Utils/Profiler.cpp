@@ -0,0 +1,173 @@
+#include "Precomp.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <memory>
+
+namespace
+{
+	struct ProfileEvent
+	{
+		const char* Name;
+		uint64_t Start;
+		uint64_t End;
+	};
+
+	struct ProfileThread
+	{
+		enum { RingSize = 1 << 16 };
+
+		// Entries closest to being overwritten are skipped when reading from another thread
+		enum { ReadMargin = 1024 };
+
+		int ThreadID = 0;
+		std::unique_ptr<ProfileEvent[]> Events = std::make_unique<ProfileEvent[]>(RingSize);
+		std::atomic<uint64_t> Count = 0;
+
+		uint64_t GetFirstReadable(uint64_t count) const
+		{
+			return count > RingSize - ReadMargin ? count - (RingSize - ReadMargin) : 0;
+		}
+	};
+
+	struct ProfileState
+	{
+		std::mutex Mutex;
+		Array<std::unique_ptr<ProfileThread>> Threads; // Kept after a thread exits so its zones can still be dumped
+		ProfileThread* MainThread = nullptr;
+
+		enum { FrameRingSize = 1024 };
+		uint64_t FrameStarts[FrameRingSize] = {};
+		uint64_t FrameCount = 0;
+	};
+
+	ProfileState& GetState()
+	{
+		static ProfileState state;
+		return state;
+	}
+
+	ProfileThread* GetCurrentThread()
+	{
+		thread_local ProfileThread* current = nullptr;
+		if (!current)
+		{
+			ProfileState& state = GetState();
+			std::unique_lock lock(state.Mutex);
+			auto thread = std::make_unique<ProfileThread>();
+			thread->ThreadID = (int)state.Threads.size() + 1;
+			current = thread.get();
+			state.Threads.push_back(std::move(thread));
+		}
+		return current;
+	}
+}
+
+std::atomic<bool> Profiler::Enabled = false;
+
+uint64_t Profiler::GetTimestamp()
+{
+	using namespace std::chrono;
+	return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::AddZone(const char* name, uint64_t start, uint64_t end)
+{
+	ProfileThread* thread = GetCurrentThread();
+	uint64_t count = thread->Count.load(std::memory_order_relaxed);
+	thread->Events[count % ProfileThread::RingSize] = { name, start, end };
+	thread->Count.store(count + 1, std::memory_order_release);
+}
+
+void Profiler::BeginFrame()
+{
+	ProfileState& state = GetState();
+	ProfileThread* thread = GetCurrentThread();
+	std::unique_lock lock(state.Mutex);
+	state.MainThread = thread;
+	state.FrameStarts[state.FrameCount % ProfileState::FrameRingSize] = GetTimestamp();
+	state.FrameCount++;
+}
+
+Array<ProfileZoneStats> Profiler::GetLastFrameZones()
+{
+	ProfileState& state = GetState();
+	std::unique_lock lock(state.Mutex);
+	if (!state.MainThread || state.FrameCount < 2)
+		return {};
+
+	uint64_t frameStart = state.FrameStarts[(state.FrameCount - 2) % ProfileState::FrameRingSize];
+	uint64_t frameEnd = state.FrameStarts[(state.FrameCount - 1) % ProfileState::FrameRingSize];
+
+	// Zones are added when they end, so walk backwards from the newest until the zones end before the frame
+	Array<ProfileZoneStats> zones;
+	ProfileThread* thread = state.MainThread;
+	uint64_t count = thread->Count.load(std::memory_order_acquire);
+	for (uint64_t i = count; i > thread->GetFirstReadable(count); i--)
+	{
+		const ProfileEvent& e = thread->Events[(i - 1) % ProfileThread::RingSize];
+		if (e.End < frameStart)
+			break;
+		if (e.Start < frameStart || e.End > frameEnd)
+			continue;
+
+		auto it = std::find_if(zones.begin(), zones.end(), [&](const ProfileZoneStats& zone) { return zone.Name == e.Name; });
+		if (it == zones.end())
+		{
+			zones.push_back({ e.Name, 0.0, 0 });
+			it = zones.end() - 1;
+		}
+		it->Milliseconds += (e.End - e.Start) / 1'000'000.0;
+		it->Count++;
+	}
+
+	std::sort(zones.begin(), zones.end(), [](const ProfileZoneStats& a, const ProfileZoneStats& b) { return a.Milliseconds > b.Milliseconds; });
+	return zones;
+}
+
+std::string Profiler::GetChromeTrace(int frames)
+{
+	ProfileState& state = GetState();
+	std::unique_lock lock(state.Mutex);
+
+	uint64_t traceStart = 0;
+	if (state.FrameCount > 0)
+	{
+		uint64_t count = std::min((uint64_t)std::max(frames, 1), std::min(state.FrameCount, (uint64_t)ProfileState::FrameRingSize));
+		traceStart = state.FrameStarts[(state.FrameCount - count) % ProfileState::FrameRingSize];
+	}
+
+	std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	auto addEvent = [&](const std::string& e)
+	{
+		if (!first)
+			json += ",\n";
+		json += e;
+		first = false;
+	};
+
+	for (const auto& thread : state.Threads)
+	{
+		std::string tid = std::to_string(thread->ThreadID);
+		std::string threadName = thread.get() == state.MainThread ? "Main" : "Thread " + tid;
+		addEvent("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + tid + ",\"args\":{\"name\":\"" + threadName + "\"}}");
+
+		uint64_t count = thread->Count.load(std::memory_order_acquire);
+		for (uint64_t i = thread->GetFirstReadable(count); i < count; i++)
+		{
+			const ProfileEvent& e = thread->Events[i % ProfileThread::RingSize];
+			if (e.Start < traceStart)
+				continue;
+
+			// Timestamps are in microseconds relative to the start of the trace
+			addEvent("{\"name\":\"" + std::string(e.Name) + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" + tid +
+				",\"ts\":" + std::to_string((e.Start - traceStart) / 1000.0) +
+				",\"dur\":" + std::to_string((e.End - e.Start) / 1000.0) + "}");
+		}
+	}
+
+	json += "\n]}\n";
+	return json;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Scoped CPU zones showing where the time of a frame goes.
+// PROFILE_ZONE only compiles to something when SURREAL_PROFILER is defined, and zones are only recorded while the profiler is enabled.
+// ProfileTimer is the same scope timer, also adding its time to totals such as the render stage times and the time demo phases.
+// Every thread records its zones into its own ring buffer, so recording never takes a lock and only the most recent zones are kept.
+
+struct ProfileZoneStats
+{
+	const char* Name = nullptr;
+	double Milliseconds = 0.0;
+	int Count = 0;
+};
+
+class Profiler
+{
+public:
+	static bool IsEnabled() { return Enabled.load(std::memory_order_relaxed); }
+	static void SetEnabled(bool value) { Enabled.store(value, std::memory_order_relaxed); }
+
+	// Marks the start of a new frame. Called by the engine loop, which makes the calling thread the main thread.
+	static void BeginFrame();
+
+	// Inclusive time of each zone recorded by the main thread during the last complete frame
+	static Array<ProfileZoneStats> GetLastFrameZones();
+
+	// Zones of all threads during the last frames, as Chrome trace_event JSON (for chrome://tracing or Perfetto)
+	static std::string GetChromeTrace(int frames);
+
+	static uint64_t GetTimestamp();
+	static void AddZone(const char* name, uint64_t start, uint64_t end);
+
+private:
+	static std::atomic<bool> Enabled;
+};
+
+// Adds the time from construction to destruction to a total in seconds and records it as a profiler zone.
+// Pass a null total to only record the zone, or a null name to only add to the total.
+// An exclusive timer pauses the exclusive timer it was started in, so nested exclusive time is only added to the innermost total.
+class ProfileTimer
+{
+public:
+	ProfileTimer(double* total, const char* name, bool exclusive = false) : Total(total), Name(RecordsZone(name) ? name : nullptr), Exclusive(total && exclusive)
+	{
+		if (!Total && !Name)
+			return;
+
+		Start = Profiler::GetTimestamp();
+		Last = Start;
+		if (Exclusive)
+		{
+			Outer = Current;
+			if (Outer)
+				Outer->AddElapsed(Start);
+			Current = this;
+		}
+	}
+
+	~ProfileTimer()
+	{
+		if (Start == 0)
+			return;
+
+		uint64_t end = Profiler::GetTimestamp();
+		if (Total)
+			AddElapsed(end);
+
+		if (Exclusive)
+		{
+			Current = Outer;
+			if (Outer)
+				Outer->Last = end;
+		}
+
+		if (Name)
+			Profiler::AddZone(Name, Start, end);
+	}
+
+private:
+	static bool RecordsZone(const char* name)
+	{
+#ifdef SURREAL_PROFILER
+		return name && Profiler::IsEnabled();
+#else
+		return false;
+#endif
+	}
+
+	void AddElapsed(uint64_t end)
+	{
+		*Total += (end - Last) / 1'000'000'000.0;
+		Last = end;
+	}
+
+	double* Total;
+	const char* Name;
+	bool Exclusive;
+	uint64_t Start = 0;
+	uint64_t Last = 0;
+	ProfileTimer* Outer = nullptr;
+
+	static inline thread_local ProfileTimer* Current = nullptr;
+
+	ProfileTimer(const ProfileTimer&) = delete;
+	ProfileTimer& operator=(const ProfileTimer&) = delete;
+};
+
+#ifdef SURREAL_PROFILER
+
+#define PROFILE_ZONE_VARIABLE2(line) profileZone##line
+#define PROFILE_ZONE_VARIABLE(line) PROFILE_ZONE_VARIABLE2(line)
+#define PROFILE_ZONE(name) ProfileTimer PROFILE_ZONE_VARIABLE(__LINE__)(nullptr, name)
+
+#else
+
+#define PROFILE_ZONE(name)
+
+#endif
@@ -2,6 +2,9 @@
 #include "Precomp.h"
 #include "ScriptCall.h"
 #include "Frame.h"
+#include "Engine.h"
+#include "TimeDemo.h"
+#include "Utils/Profiler.h"
 #include <unordered_map>
 
 NameString ToNameString(EventName name)
@@ -67,7 +70,10 @@ ExpressionValue CallEvent(UObject* Context, EventName eventname, Array<Expressio
 
 	UFunction* func = FindEventFunction(Context, ToNameString(eventname));
 	if (func)
+	{
+		ProfileTimer scriptTimer(engine && engine->timedemo ? &engine->timedemo->Phases.Script : nullptr, nullptr, true);
 		return Frame::Call(func, Context, std::move(args));
+	}
 	else
 		return ExpressionValue::NothingValue();
 }
@@ -79,7 +85,10 @@ ExpressionValue CallEvent(UObject* Context, const NameString& name, Array<Expres
 
 	UFunction* func = FindEventFunction(Context, name);
 	if (func)
+	{
+		ProfileTimer scriptTimer(engine && engine->timedemo ? &engine->timedemo->Phases.Script : nullptr, nullptr, true);
 		return Frame::Call(func, Context, std::move(args));
+	}
 	else
 		return ExpressionValue::NothingValue();
 }